@@ -0,0 +1,690 @@
+//
+// LICENSE:
+//
+// Copyright (c) 2016 -- 2021 Fabio Pellacini
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <yocto/ext/json.hpp>
+#include <yocto/yocto_bvh.h>
+#include <yocto/yocto_cli.h>
+#include <yocto/yocto_geometry.h>
+#include <yocto/yocto_image.h>
+#include <yocto/yocto_math.h>
+#include <yocto/yocto_parallel.h>
+#include <yocto/yocto_scene.h>
+#include <yocto/yocto_sceneio.h>
+#include <yocto/yocto_shape.h>
+#include <yocto/yocto_trace.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+using namespace yocto;
+
+// json type used for results
+using bench_json = nlohmann::ordered_json;
+
+// A benchmark result. Time are lower-is-better, throughputs higher-is-better.
+struct bench_result {
+  string name   = "";
+  double value  = 0;
+  string unit   = "";
+  bool   higher = false;
+};
+
+// Benchmark results
+struct bench_results {
+  string               scene   = "";
+  int                  threads = 0;
+  vector<bench_result> results = {};
+};
+
+// Each timing sample repeats a function until this time has elapsed, so that
+// short kernels are not dominated by timer resolution and noise
+const auto bench_min_sample = 0.01;
+const auto bench_max_calls  = 1000;
+
+// Time a function, returning the best time per call over repeats in seconds.
+// Advances the progress bar at each repeat.
+template <typename Func>
+static double bench_time(int repeats, Func&& func) {
+  auto best = (double)flt_max;
+  for (auto repeat = 0; repeat < max(repeats, 1); repeat++) {
+    auto calls = 0;
+    auto timer = simple_timer{};
+    while (calls == 0 || (elapsed_seconds(timer) < bench_min_sample &&
+                             calls < bench_max_calls)) {
+      func();
+      calls += 1;
+    }
+    best = min(best, elapsed_seconds(timer) / calls);
+    print_progress_next();
+  }
+  return best;
+}
+// Same as above, calling `setup` before each repeat without timing it.
+// Functions are called once per repeat, since setup usually dominates.
+template <typename Func, typename Setup>
+static double bench_time(int repeats, Func&& func, Setup&& setup) {
+  auto best = (double)flt_max;
+  for (auto repeat = 0; repeat < max(repeats, 1); repeat++) {
+    setup();
+    auto timer = simple_timer{};
+    func();
+    best = min(best, elapsed_seconds(timer));
+    print_progress_next();
+  }
+  return best;
+}
+
+// Add results
+static void add_time(
+    bench_results& results, const string& name, double seconds) {
+  results.results.push_back({name, seconds, "s", false});
+}
+static void add_throughput(bench_results& results, const string& name,
+    double value, const string& unit) {
+  results.results.push_back({name, value, unit, true});
+}
+
+// Results to json
+static bench_json results_to_json(const bench_results& results) {
+  auto js       = bench_json::object();
+  js["scene"]   = results.scene;
+  js["threads"] = results.threads;
+  auto& jsres   = js["results"];
+  jsres         = bench_json::object();
+  for (auto& result : results.results) {
+    auto& jsr  = jsres[result.name];
+    jsr        = bench_json::object();
+    jsr["value"]  = result.value;
+    jsr["unit"]   = result.unit;
+    jsr["better"] = result.higher ? "higher" : "lower";
+  }
+  return js;
+}
+
+// Json to results
+static bool json_to_results(
+    const bench_json& js, bench_results& results, string& error) {
+  try {
+    results         = {};
+    results.scene   = js.value("scene", ""s);
+    results.threads = js.value("threads", 0);
+    for (auto& [name, jsr] : js.at("results").items()) {
+      auto& result  = results.results.emplace_back();
+      result.name   = name;
+      result.value  = jsr.at("value").get<double>();
+      result.unit   = jsr.value("unit", ""s);
+      result.higher = jsr.value("better", "lower"s) == "higher";
+    }
+    return true;
+  } catch (std::exception& except) {
+    error = "bad benchmark file: "s + except.what();
+    return false;
+  }
+}
+
+// Load and save results
+static bool load_results(
+    const string& filename, bench_results& results, string& error) {
+  auto text = ""s;
+  if (!load_text(filename, text, error)) return false;
+  auto js = bench_json::parse(text, nullptr, false);
+  if (js.is_discarded()) {
+    error = filename + ": parse error";
+    return false;
+  }
+  if (!json_to_results(js, results, error)) {
+    error = filename + ": " + error;
+    return false;
+  }
+  return true;
+}
+static bool save_results(
+    const string& filename, const bench_results& results, string& error) {
+  return save_text(filename, results_to_json(results).dump(2) + "\n", error);
+}
+
+// Timings below this are too noisy to be compared
+const auto bench_min_time = 1e-5;
+
+// Compare results against a baseline, printing a report. Returns the number
+// of regressions, i.e. metrics that are worse than the baseline by more
+// than the relative tolerance.
+static int compare_results(const bench_results& results,
+    const bench_results& baseline, float tolerance) {
+  auto regressions = 0;
+  print_info("benchmark comparison ------------");
+  for (auto& result : results.results) {
+    auto base = std::find_if(baseline.results.begin(), baseline.results.end(),
+        [&result](auto& base) { return base.name == result.name; });
+    if (base == baseline.results.end()) {
+      print_info(result.name + ": no baseline");
+      continue;
+    }
+    if (base->value <= 0 || result.value <= 0) continue;
+    if (!result.higher && max(result.value, base->value) < bench_min_time) {
+      continue;
+    }
+    auto ratio   = result.higher ? base->value / result.value
+                                 : result.value / base->value;
+    auto failed  = ratio > 1 + tolerance;
+    auto percent = (int)round(std::abs(ratio - 1) * 100);
+    print_info(result.name + ": " + std::to_string(result.value) + " vs " +
+               std::to_string(base->value) + " " + result.unit + " (" +
+               std::to_string(percent) +
+               (ratio > 1 ? "% slower)" : "% faster)") +
+               (failed ? " REGRESSION" : ""));
+    if (failed) regressions += 1;
+  }
+  return regressions;
+}
+
+// Arguments in [0,1)^2 for math functions, from a low-discrepancy sequence
+static vector<vec2f> make_math_args(int count) {
+  auto args = vector<vec2f>(count);
+  for (auto idx : range(count)) {
+    args[idx] = {(float)std::fmod(idx * 0.6180339887498949 + 0.5, 1.0),
+        (float)std::fmod(idx * 0.4142135623730950 + 0.5, 1.0)};
+  }
+  return args;
+}
+
+// run params
+struct run_params {
+  string scene      = "scene.json";
+  string output     = "";
+  string baseline   = "";
+  float  tolerance  = 0.25f;
+  int    resolution = 256;
+  int    samples    = 8;
+  int    repeats    = 3;
+  int    shapesteps = 256;
+  int    threads    = 0;
+  bool   noparallel = false;
+  bool   record     = false;
+};
+
+// Cli
+void add_command(const cli_command& cli, const string& name,
+    run_params& params, const string& usage) {
+  auto cmd = add_command(cli, name, usage);
+  add_argument(cmd, "scene", params.scene, "Scene filename.");
+  add_option(cmd, "output", params.output, "Output results (json).");
+  add_option(cmd, "baseline", params.baseline,
+      "Baseline results (json).");
+  add_option(cmd, "tolerance", params.tolerance,
+      "Relative tolerance for regressions.", {0, 100});
+  add_option(
+      cmd, "resolution", params.resolution, "Image resolution.", {1, 4096});
+  add_option(cmd, "samples", params.samples, "Number of samples.", {1, 4096});
+  add_option(cmd, "repeats", params.repeats, "Timing repeats.", {1, 100});
+  add_option(cmd, "shapesteps", params.shapesteps,
+      "Tesselation of the procedural shape.", {4, 4096});
+  add_option(cmd, "threads", params.threads,
+      "Number of threads (0 for all cores).", {0, 1024});
+  add_option(cmd, "noparallel", params.noparallel, "Disable threading.");
+  add_option(cmd, "record", params.record, "Record the baseline.");
+}
+
+// run benchmarks
+int run_run(const run_params& params) {
+  auto results    = bench_results{};
+  results.scene   = path_filename(params.scene);
+  set_parallel_threads(params.threads);
+  results.threads = params.noparallel ? 1 : get_parallel_threads();
+
+  // scene loading
+  auto scene   = scene_model{};
+  auto ioerror = ""s;
+  print_progress_begin("load scene", params.repeats);
+  add_time(results, "load_scene", bench_time(params.repeats, [&]() {
+    scene = {};
+    if (!load_scene(params.scene, scene, ioerror, params.noparallel))
+      print_fatal(ioerror);
+  }));
+
+  // tesselation
+  if (!scene.subdivs.empty()) {
+    print_progress_begin("tesselate subdivs");
+    tesselate_subdivs(scene);
+    print_progress_end();
+  }
+
+  // bvh
+  auto bvh = bvh_scene{};
+  for (auto highquality : {false, true}) {
+    auto name = highquality ? "bvh_build_highquality"s : "bvh_build"s;
+    print_progress_begin(name, params.repeats);
+    add_time(results, name, bench_time(params.repeats, [&]() {
+      bvh = make_bvh(scene, highquality, false, params.noparallel);
+    }));
+  }
+
+  // lights
+  auto lights = trace_lights{};
+  print_progress_begin("lights_build", params.repeats);
+  add_time(results, "lights_build", bench_time(params.repeats, [&]() {
+    auto lparams       = trace_params{};
+    lparams.noparallel = params.noparallel;
+    lights             = make_lights(scene, lparams);
+  }));
+  auto tscene = make_trace_scene(scene);
+
+  // rendering
+  auto render = color_image{};
+  for (auto sampler_id : range((int)trace_sampler_names.size())) {
+    auto tparams       = trace_params{};
+    tparams.sampler    = (trace_sampler_type)sampler_id;
+    tparams.resolution = params.resolution;
+    tparams.samples    = params.samples;
+    tparams.seed       = trace_default_seed;
+    tparams.noparallel = params.noparallel;
+    auto name          = "render_" + trace_sampler_names[sampler_id];
+    auto state         = trace_state{};
+    print_progress_begin(name, params.repeats);
+    auto seconds = bench_time(params.repeats, [&]() {
+      state = make_state(scene, tparams);
+      for (auto sample = 0; sample < tparams.samples; sample++) {
+        trace_samples(state, scene, tscene, bvh, lights, tparams);
+      }
+    });
+    auto pixels = (double)state.width * state.height * tparams.samples;
+    add_throughput(results, name, pixels / seconds / 1e6, "Msamples/s");
+    if (!state.stats.empty()) {
+      auto stats = get_stats(state);
+      auto rays  = stats.camera_rays + stats.bounce_rays + stats.shadow_rays +
+                  stats.light_rays;
+      add_throughput(
+          results, name + "_rays", (double)rays / seconds / 1e6, "Mrays/s");
+    }
+    if (tparams.sampler == trace_sampler_type::path) render = get_render(state);
+  }
+
+  // interactive session: time to the first preview after a restart, and
+  // time to cancel rendering while sampling
+  auto session        = trace_session{};
+  auto sparams        = trace_params{};
+  sparams.resolution  = params.resolution;
+  sparams.samples     = 4096;
+  sparams.noparallel  = params.noparallel;
+  init_session(session, scene, sparams);
+  auto session_render = color_image{};
+  print_progress_begin("session", params.repeats * 2);
+  add_time(results, "session_restart", bench_time(params.repeats, [&]() {
+    start_session(session, scene, sparams);
+    while (!update_render(session_render, session)) {
+      std::this_thread::yield();
+    }
+  }));
+  add_time(results, "session_cancel", bench_time(params.repeats, [&]() {
+    stop_session(session);
+  }, [&]() {
+    start_session(session, scene, sparams);
+    while (session.samples < 2) std::this_thread::yield();
+  }));
+  stop_session(session);
+
+  // image io
+  auto tmpdir = std::filesystem::temp_directory_path().u8string();
+  for (auto ext : {".png"s, ".exr"s}) {
+    auto filename = path_join(
+        tmpdir, "ybench-" + std::to_string(std::hash<string>{}(
+                                params.scene)) + ext);
+    auto mpixels  = (double)render.width * render.height / 1e6;
+    auto image    = color_image{};
+    print_progress_begin("image io " + ext, params.repeats * 2);
+    auto save_seconds = bench_time(params.repeats, [&]() {
+      if (!save_image(filename, render, ioerror)) print_fatal(ioerror);
+    });
+    auto load_seconds = bench_time(params.repeats, [&]() {
+      if (!load_image(filename, image, ioerror)) print_fatal(ioerror);
+    });
+    std::filesystem::remove(std::filesystem::u8path(filename));
+    add_throughput(
+        results, "image_save" + ext, mpixels / save_seconds, "Mpixels/s");
+    add_throughput(
+        results, "image_load" + ext, mpixels / load_seconds, "Mpixels/s");
+  }
+
+  // color grading, directly and with a baked lookup table, over enough
+  // passes of the render to be timed reliably
+  auto gparams       = colorgrade_params{};
+  gparams.exposure   = 0.5f;
+  gparams.filmic     = true;
+  gparams.contrast   = 0.6f;
+  gparams.saturation = 0.6f;
+  gparams.midtones   = 0.45f;
+  auto graded        = make_image(render.width, render.height, false);
+  auto lut_graded    = make_image(render.width, render.height, false);
+  auto passes        = max(1, (1 << 20) / max((int)render.pixels.size(), 1));
+  auto mgrades       = (double)render.pixels.size() * passes / 1e6;
+  auto lut           = colorgrade_lut{};
+  print_progress_begin("colorgrade", params.repeats * 3);
+  auto direct_seconds = bench_time(params.repeats, [&]() {
+    for (auto pass = 0; pass < passes; pass++)
+      colorgrade_image_mt(graded, render, gparams);
+  });
+  add_time(results, "colorgrade_bake", bench_time(params.repeats, [&]() {
+    lut = make_colorgrade_lut(gparams, render.linear);
+  }));
+  auto lut_seconds = bench_time(params.repeats, [&]() {
+    for (auto pass = 0; pass < passes; pass++)
+      colorgrade_image_mt(lut_graded, render, lut);
+  });
+  auto lut_error = 0.0f;
+  for (auto idx : range(render.pixels.size())) {
+    lut_error = max(lut_error, max(abs(xyz(graded.pixels[idx]) -
+                                       xyz(lut_graded.pixels[idx]))));
+  }
+  add_throughput(
+      results, "colorgrade", mgrades / direct_seconds, "Mpixels/s");
+  add_throughput(
+      results, "colorgrade_lut", mgrades / lut_seconds, "Mpixels/s");
+  results.results.push_back(
+      {"colorgrade_lut_error", lut_error * 255, "codes", false});
+
+  // resizing, upsampling the render by 4 and back, and mip chains
+  auto resized = color_image{}, downsized = color_image{};
+  auto mips    = vector<color_image>{};
+  print_progress_begin("resize", params.repeats * 3);
+  auto upsize_seconds = bench_time(params.repeats, [&]() {
+    resized = resize_image(render, render.width * 4, render.height * 4);
+  });
+  auto downsize_seconds = bench_time(params.repeats, [&]() {
+    downsized = resize_image(resized, render.width, render.height);
+  });
+  auto mips_seconds = bench_time(params.repeats, [&]() {
+    mips = make_image_mips(resized);
+  });
+  auto mresized = (double)resized.width * resized.height / 1e6;
+  add_throughput(
+      results, "image_upsize", mresized / upsize_seconds, "Mpixels/s");
+  add_throughput(
+      results, "image_downsize", mresized / downsize_seconds, "Mpixels/s");
+  add_throughput(results, "image_mips", mresized / mips_seconds, "Mpixels/s");
+
+  // procedural textures, at the resolution used by the scene presets
+  auto fbmmap = color_image{}, sunsky = color_image{};
+  print_progress_begin("procedural images", params.repeats * 2);
+  auto fbm_seconds = bench_time(params.repeats, [&]() {
+    fbmmap = make_fbmmap(1024, 1024);
+  });
+  auto sunsky_seconds = bench_time(params.repeats, [&]() {
+    sunsky = make_sunsky(1024, 512, pif / 4, 3, true);
+  });
+  add_throughput(
+      results, "image_fbmmap", 1024 * 1024 / 1e6 / fbm_seconds, "Mpixels/s");
+  add_throughput(results, "image_sunsky", 1024 * 512 / 1e6 / sunsky_seconds,
+      "Mpixels/s");
+
+  // shape processing
+  auto shape = make_sphere(params.shapesteps);
+  print_progress_begin("shape kernels", params.repeats * 6);
+  add_time(results, "shape_triangles", bench_time(params.repeats, [&]() {
+    auto triangles = quads_to_triangles(shape.quads);
+  }));
+  add_time(results, "shape_normals", bench_time(params.repeats, [&]() {
+    auto normals = compute_normals(shape);
+  }));
+  add_time(results, "shape_subdivide", bench_time(params.repeats, [&]() {
+    auto subdivided = subdivide_shape(shape, 1, true);
+  }));
+  add_time(results, "shape_samplecdf", bench_time(params.repeats, [&]() {
+    auto cdf = sample_shape_cdf(shape);
+  }));
+  add_time(results, "shape_bvh", bench_time(params.repeats, [&]() {
+    auto shape_bvh = make_bvh(shape, true);
+  }));
+  auto unwelded = vector<vec3f>{};
+  for (auto& quad : shape.quads) {
+    for (auto vertex : {quad.x, quad.y, quad.z, quad.w})
+      unwelded.push_back(shape.positions[vertex]);
+  }
+  add_time(results, "shape_weld", bench_time(params.repeats, [&]() {
+    auto welded = weld_vertices(unwelded, 1e-4f);
+  }));
+
+  // parallel algorithms, timed with and without threads, checking that
+  // results do not depend on threading; sorts order indices by key, and are
+  // also timed against std::sort with a key comparison
+  auto algo_count  = (size_t)1 << 22;
+  auto algo_values = vector<float>(algo_count);
+  auto algo_keys   = vector<uint32_t>(algo_count);
+  for (auto idx : range(algo_count)) {
+    algo_keys[idx]   = (uint32_t)idx * 2654435761u;
+    algo_values[idx] = (algo_keys[idx] >> 8) / (float)(1 << 24);
+  }
+  auto bench_algo = [&](const string& name, auto&& func) {
+    auto result           = decltype(func(false)){};
+    auto serial           = decltype(func(false)){};
+    auto parallel_seconds = bench_time(params.repeats, [&]() {
+      result = func(false);
+    });
+    auto serial_seconds = bench_time(params.repeats, [&]() {
+      serial = func(true);
+    });
+    add_throughput(results, "parallel_" + name,
+        algo_count / 1e6 / parallel_seconds, "Melements/s");
+    add_throughput(results, "parallel_" + name + "_serial",
+        algo_count / 1e6 / serial_seconds, "Melements/s");
+    if (result != serial)
+      print_fatal("parallel_" + name + " depends on threading");
+    return result;
+  };
+  print_progress_begin("parallel algorithms", params.repeats * 9);
+  bench_algo("reduce", [&](bool noparallel) {
+    return parallel_reduce(
+        algo_count, 0.0f, [&](size_t idx) { return algo_values[idx]; },
+        [](float a, float b) { return a + b; }, noparallel);
+  });
+  bench_algo("scan", [&](bool noparallel) {
+    auto scanned = algo_values;
+    parallel_inclusive_scan(
+        scanned, [](float a, float b) { return a + b; }, noparallel);
+    return scanned;
+  });
+  auto algo_ids = vector<int>(algo_count);
+  for (auto idx : range((int)algo_count)) algo_ids[idx] = idx;
+  auto sorted = bench_algo("sort", [&](bool noparallel) {
+    auto ids = algo_ids;
+    parallel_sort(ids, [&](int idx) { return algo_keys[idx]; }, noparallel);
+    return ids;
+  });
+  auto std_sorted  = algo_ids;
+  auto std_seconds = bench_time(params.repeats, [&]() {
+    std_sorted = algo_ids;
+    std::sort(std_sorted.begin(), std_sorted.end(),
+        [&](int a, int b) { return algo_keys[a] < algo_keys[b]; });
+  });
+  add_throughput(results, "parallel_sort_std", algo_count / 1e6 / std_seconds,
+      "Melements/s");
+  if (sorted != std_sorted) print_fatal("parallel_sort not sorted");
+  bench_algo("partition", [&](bool noparallel) {
+    auto partitioned = algo_keys;
+    parallel_partition(
+        partitioned, 0, algo_count,
+        [](uint32_t key) { return (key & 1) != 0; }, noparallel);
+    return partitioned;
+  });
+
+  // fast approximate math, timed against the standard library; arguments
+  // in [0,1)^2 come from a low-discrepancy sequence, shuffled like random
+  // samples, and are mapped to the ranges used in rendering
+  auto math_count = 1 << 20;
+  auto math_args  = make_math_args(math_count);
+  auto math_std   = vector<float>(math_count);
+  auto math_fast  = vector<float>(math_count);
+  auto bench_math = [&](const string& name, auto&& approx_func,
+                        auto&& std_func) {
+    auto fast_seconds = bench_time(params.repeats, [&]() {
+      for (auto idx : range(math_count))
+        math_fast[idx] = approx_func(math_args[idx]);
+    });
+    auto std_seconds = bench_time(params.repeats, [&]() {
+      for (auto idx : range(math_count))
+        math_std[idx] = std_func(math_args[idx]);
+    });
+    add_throughput(results, "math_" + name,
+        math_count / 1e6 / fast_seconds, "Mcalls/s");
+    add_throughput(results, "math_" + name + "_libm",
+        math_count / 1e6 / std_seconds, "Mcalls/s");
+  };
+  print_progress_begin("math kernels", params.repeats * 14);
+  bench_math(
+      "sincos",
+      [](const vec2f& uv) {
+        auto [s, c] = approx_sincos((uv.x * 2 - 1) * 8 * pif);
+        return s + c;
+      },
+      [](const vec2f& uv) {
+        auto a = (uv.x * 2 - 1) * 8 * pif;
+        return std::sin(a) + std::cos(a);
+      });
+  bench_math(
+      "atan", [](const vec2f& uv) { return approx_atan((uv.x * 2 - 1) * 16); },
+      [](const vec2f& uv) { return std::atan((uv.x * 2 - 1) * 16); });
+  bench_math(
+      "atan2",
+      [](const vec2f& uv) { return approx_atan2(uv.y * 2 - 1, uv.x * 2 - 1); },
+      [](const vec2f& uv) { return std::atan2(uv.y * 2 - 1, uv.x * 2 - 1); });
+  bench_math(
+      "acos", [](const vec2f& uv) { return approx_acos(uv.x * 2 - 1); },
+      [](const vec2f& uv) { return std::acos(uv.x * 2 - 1); });
+  bench_math(
+      "exp", [](const vec2f& uv) { return approx_exp(-uv.x * 16); },
+      [](const vec2f& uv) { return std::exp(-uv.x * 16); });
+  bench_math(
+      "log", [](const vec2f& uv) { return approx_log(uv.x * 16); },
+      [](const vec2f& uv) { return std::log(uv.x * 16); });
+  bench_math(
+      "pow",
+      [](const vec2f& uv) { return approx_pow(uv.x + 0.0625f, uv.y * 8); },
+      [](const vec2f& uv) { return std::pow(uv.x + 0.0625f, uv.y * 8); });
+
+  // print results
+  print_info("benchmark results ------------");
+  for (auto& result : results.results) {
+    print_info(result.name + ": " + std::to_string(result.value) + " " +
+               result.unit);
+  }
+
+  // save results
+  if (!params.output.empty()) {
+    if (!save_results(params.output, results, ioerror)) print_fatal(ioerror);
+  }
+
+  // record or compare baseline
+  if (!params.baseline.empty() && params.record) {
+    auto baseline_path = std::filesystem::u8path(params.baseline);
+    if (baseline_path.has_parent_path())
+      std::filesystem::create_directories(baseline_path.parent_path());
+    if (!save_results(params.baseline, results, ioerror)) print_fatal(ioerror);
+    print_info("recorded baseline " + params.baseline);
+  } else if (!params.baseline.empty()) {
+    auto baseline = bench_results{};
+    if (!load_results(params.baseline, baseline, ioerror)) print_fatal(ioerror);
+    if (results.threads != baseline.threads) {
+      print_info("warning: thread counts differ");
+    }
+    if (compare_results(results, baseline, params.tolerance) != 0)
+      return print_fatal("performance regressions found");
+  } else if (params.record) {
+    return print_fatal("missing baseline filename");
+  }
+
+  // done
+  return 0;
+}
+
+// compare params
+struct compare_params {
+  string results   = "results.json";
+  string baseline  = "baseline.json";
+  float  tolerance = 0.25f;
+};
+
+// Cli
+void add_command(const cli_command& cli, const string& name,
+    compare_params& params, const string& usage) {
+  auto cmd = add_command(cli, name, usage);
+  add_argument(cmd, "results", params.results, "Results (json).");
+  add_argument(cmd, "baseline", params.baseline, "Baseline results (json).");
+  add_option(cmd, "tolerance", params.tolerance,
+      "Relative tolerance for regressions.", {0, 100});
+}
+
+// compare benchmarks
+int run_compare(const compare_params& params) {
+  auto results  = bench_results{};
+  auto baseline = bench_results{};
+  auto ioerror  = ""s;
+  if (!load_results(params.results, results, ioerror)) print_fatal(ioerror);
+  if (!load_results(params.baseline, baseline, ioerror)) print_fatal(ioerror);
+  if (results.threads != baseline.threads) {
+    print_info("warning: thread counts differ");
+  }
+  if (compare_results(results, baseline, params.tolerance) != 0)
+    return print_fatal("performance regressions found");
+  return 0;
+}
+
+struct app_params {
+  string         command = "run";
+  run_params     run     = {};
+  compare_params compare = {};
+};
+
+// Cli
+cli_state make_commands(
+    const string& name, app_params& params, const string& usage) {
+  auto cli = make_cli(name, usage);
+  set_command_var(cli, params.command);
+  add_command(cli, "run", params.run, "Run benchmarks.");
+  add_command(cli, "compare", params.compare, "Compare benchmark results.");
+  return cli;
+}
+
+// Parse cli
+void parse_cli(app_params& params, int argc, const char** argv) {
+  auto cli = make_commands("ybench", params, "Benchmark Yocto/GL.");
+  parse_cli(cli, argc, argv);
+}
+
+int main(int argc, const char* argv[]) {
+  // command line parameters
+  auto params = app_params{};
+  parse_cli(params, argc, argv);
+
+  // dispatch commands
+  if (params.command == "run") {
+    return run_run(params.run);
+  } else if (params.command == "compare") {
+    return run_compare(params.compare);
+  } else {
+    return print_fatal("unknown command " + params.command);
+  }
+}
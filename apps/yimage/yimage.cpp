@@ -39,12 +39,13 @@ using namespace yocto;
 
 // convert params
 struct convert_params {
-  string image    = "image.png";
-  string output   = "out.png";
-  float  exposure = 0;
-  bool   filmic   = false;
-  int    width    = 0;
-  int    height   = 0;
+  string             image    = "image.png";
+  string             output   = "out.png";
+  float              exposure = 0;
+  bool               filmic   = false;
+  int                width    = 0;
+  int                height   = 0;
+  resize_filter_type filter   = resize_filter_type::automatic;
 };
 
 // Cli
@@ -58,6 +59,8 @@ void add_command(const cli_command& cli, const string& name,
   add_option(cmd, "filmic", params.filmic, "Tonemap filmic.");
   add_option(cmd, "width", params.width, "Resize width.", {1, int_max});
   add_option(cmd, "height", params.height, "Resize height.", {1, int_max});
+  add_option(
+      cmd, "filter", params.filter, "Resize filter.", resize_filter_names);
 }
 
 // convert images
@@ -69,7 +72,7 @@ int run_convert(const convert_params& params) {
 
   // resize if needed
   if (params.width != 0 || params.height != 0) {
-    image = resize_image(image, params.width, params.height);
+    image = resize_image(image, params.width, params.height, params.filter);
   }
 
   // tonemap if needed
@@ -26,8 +26,10 @@
 // POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <yocto/ext/json.hpp>
 #include <yocto/yocto_cli.h>
 #include <yocto/yocto_math.h>
+#include <yocto/yocto_parallel.h>
 #include <yocto/yocto_scene.h>
 #include <yocto/yocto_sceneio.h>
 #include <yocto/yocto_shape.h>
@@ -145,7 +147,13 @@ struct render_params : trace_params {
   string camname   = "";
   bool   addsky    = false;
   string envname   = "";
-  bool   savebatch = false;
+  bool   savebatch  = false;
+  bool   sidecar    = false;
+  string checkpoint = "";
+  float  checkpointtime = 600;
+  bool   resume     = false;
+  int    shards     = 1;
+  int    shard      = 0;
 };
 
 // Cli
@@ -158,6 +166,14 @@ void add_command(const cli_command& cli, const string& name,
   add_option(cmd, "addsky", params.addsky, "Add sky.");
   add_option(cmd, "envname", params.envname, "Add environment map.");
   add_option(cmd, "savebatch", params.savebatch, "Save batch.");
+  add_option(cmd, "sidecar", params.sidecar, "Save render info as json.");
+  add_option(cmd, "checkpoint", params.checkpoint, "Checkpoint filename.");
+  add_option(cmd, "checkpointtime", params.checkpointtime,
+      "Seconds between checkpoints.", {1, flt_max});
+  add_option(cmd, "resume", params.resume, "Resume from checkpoint.");
+  add_option(cmd, "shards", params.shards,
+      "Split samples over processes, merged with yscene merge.", {1, 4096});
+  add_option(cmd, "shard", params.shard, "Samples shard to render.");
   add_option(
       cmd, "resolution", params.resolution, "Image resolution.", {1, 4096});
   add_option(
@@ -166,6 +182,19 @@ void add_command(const cli_command& cli, const string& name,
       trace_falsecolor_names);
   add_option(cmd, "samples", params.samples, "Number of samples.", {1, 4096});
   add_option(cmd, "bounces", params.bounces, "Number of bounces.", {1, 128});
+  add_option(cmd, "adaptive", params.adaptive,
+      "Adaptive sampling target error (0 disables).", {0, 1});
+  add_option(cmd, "adaptivemin", params.adaptivemin,
+      "Uniform samples before adaptive sampling.", {1, 4096});
+  add_option(cmd, "timebudget", params.timebudget,
+      "Rendering time budget in seconds, ignoring samples (0 disables).",
+      {0, flt_max});
+  add_option(cmd, "counterrng", params.counterrng,
+      "Use counter-based random numbers.");
+  add_option(cmd, "sequence", params.sequence, "Random sequence type.",
+      trace_sequence_names);
+  add_option(cmd, "accumulation", params.accumulation,
+      "Sample accumulation type.", trace_accumulation_names);
   add_option(cmd, "denoise", params.denoise, "Enable denoiser.");
   add_option(cmd, "batch", params.batch, "Sample batch.");
   add_option(cmd, "clamp", params.clamp, "Clamp params.", {10, flt_max});
@@ -175,6 +204,8 @@ void add_command(const cli_command& cli, const string& name,
   add_option(cmd, "embreebvh", params.embreebvh, "Use Embree as BVH.");
   add_option(
       cmd, "highqualitybvh", params.highqualitybvh, "Use high quality BVH.");
+  add_option(cmd, "spatialbvh", params.spatialbvh,
+      "Spatial split BVH duplication budget (0 disables).", {0, 4});
   add_option(cmd, "exposure", params.exposure, "Exposure value.");
   add_option(cmd, "filmic", params.filmic, "Filmic tone mapping.");
   add_option(cmd, "noparallel", params.noparallel, "Disable threading.");
@@ -185,6 +216,15 @@ int run_render(const render_params& params_) {
   // copy params
   auto params = params_;
 
+  // timing of each stage, saved in the sidecar
+  auto timings = vector<pair<string, double>>{};
+  auto timer   = simple_timer{};
+  auto timed   = [&timings, &timer](const string& stage) {
+    stop_timer(timer);
+    timings.push_back({stage, elapsed_seconds(timer)});
+    timer = simple_timer{};
+  };
+
   // scene loading
   auto scene   = scene_model{};
   auto ioerror = string{};
@@ -203,22 +243,43 @@ int run_render(const render_params& params_) {
   // camera
   params.camera = find_camera(scene, params.camname);
 
+  // resuming reads the state from the checkpoint file
+  if (params.resume && params.checkpoint.empty())
+    return print_fatal("resume requires a checkpoint file");
+
+  // shards render a disjoint part of the samples with independent rngs
+  if (params.shards > 1) {
+    if (params.shard < 0 || params.shard >= params.shards)
+      return print_fatal("shard should be in [0, shards)");
+    if (params.checkpoint.empty())
+      return print_fatal("shards are saved to the checkpoint file");
+    if (params.samples < params.shards)
+      return print_fatal("shards should have at least one sample each");
+    params.samples = params.samples / params.shards +
+                     (params.shard < params.samples % params.shards ? 1 : 0);
+    params.seed += params.shard;
+  }
+
   // tesselation
   if (!scene.subdivs.empty()) {
     print_progress_begin("tesselate subdivs");
     tesselate_subdivs(scene);
     print_progress_end();
   }
+  timed("load");
 
   // build bvh
   print_progress_begin("build bvh");
   auto bvh = make_bvh(scene, params);
   print_progress_end();
+  timed("bvh");
 
   // init renderer
   print_progress_begin("build lights");
   auto lights = make_lights(scene, params);
+  auto tscene = make_trace_scene(scene);
   print_progress_end();
+  timed("lights");
 
   // fix renderer type if no lights
   if (lights.lights.empty() && is_sampler_lit(params)) {
@@ -229,20 +290,103 @@ int run_render(const render_params& params_) {
   // state
   print_progress_begin("init state");
   auto state = make_state(scene, params);
+  if (params.resume) {
+    auto resumed = trace_state{};
+    if (!load_state(params.checkpoint, resumed, ioerror))
+      return print_fatal(ioerror);
+    auto mismatch = ""s;
+    if (!check_state(resumed, state, mismatch))
+      return print_fatal(params.checkpoint +
+                         ": incompatible checkpoint for the render options, " +
+                         mismatch);
+    state = std::move(resumed);
+  }
   print_progress_end();
+  timed("state");
+
+  // checkpoints are saved asynchronously from a copy of the state
+  auto checkpoint_state  = trace_state{};
+  auto checkpoint_error  = ""s;
+  auto checkpoint_saved  = true;
+  auto checkpoint_future = future<void>{};
+  auto checkpoint_timer  = simple_timer{};
+  auto wait_checkpoint   = [&]() {
+    if (!is_valid(checkpoint_future)) return;
+    checkpoint_future.get();
+    if (!checkpoint_saved) print_fatal(checkpoint_error);
+  };
+  auto save_checkpoint = [&]() {
+    wait_checkpoint();
+    checkpoint_state  = state;
+    checkpoint_future = run_async([&]() {
+      checkpoint_saved = save_state(
+          params.checkpoint, checkpoint_state, checkpoint_error);
+    });
+    checkpoint_timer = simple_timer{};
+  };
 
   // render
-  print_progress_begin("render image", params.samples);
-  for (auto sample = 0; sample < params.samples; sample++) {
-    trace_samples(state, scene, bvh, lights, params);
+  auto render_timer  = simple_timer{};
+  auto start_samples = state.samples;
+  // with a time budget, samples are unbounded and progress is reported in
+  // seconds of the budget
+  auto progress_total = params.timebudget > 0 ? (int)ceil(params.timebudget)
+                                              : params.samples;
+  print_progress_begin("render image", progress_total);
+  while (!is_converged(state, params)) {
+    trace_samples(state, scene, tscene, bvh, lights, params);
     if (params.savebatch && state.samples % params.batch == 0) {
       auto image = params.denoise ? get_denoised(state) : get_render(state);
-      auto ext = "-s" + std::to_string(sample) + path_extension(params.output);
+      auto ext   = "-s" + std::to_string(state.samples - 1) +
+                 path_extension(params.output);
       auto outfilename = replace_extension(params.output, ext);
       auto ioerror     = ""s;
       if (!save_image(outfilename, image, ioerror)) print_fatal(ioerror);
     }
-    print_progress_next();
+    auto elapsed   = elapsed_seconds(render_timer);
+    auto passes    = state.samples - start_samples;
+    auto rate      = passes / elapsed;
+    auto remaining = params.timebudget > 0
+                         ? max(params.timebudget - elapsed, 0.0)
+                         : (params.samples - state.samples) / rate;
+    auto progress  = params.timebudget > 0 ? (int)elapsed : state.samples;
+    if (!params.checkpoint.empty() &&
+        elapsed_seconds(checkpoint_timer) > params.checkpointtime)
+      save_checkpoint();
+    print_progress("render image " + std::to_string((int)round(rate)) +
+                       " spp/s eta " +
+                       format_duration((int64_t)(remaining * 1e9)),
+        min(progress, progress_total), progress_total);
+    if (is_out_of_budget(params, passes, elapsed)) break;
+  }
+  print_progress_end();
+  timed("render");
+
+  // save final checkpoint
+  if (!params.checkpoint.empty()) {
+    save_checkpoint();
+    wait_checkpoint();
+  }
+
+  // print stats
+  if (!state.stats.empty()) {
+    auto stats = get_stats(state);
+    auto rays  = stats.camera_rays + stats.bounce_rays + stats.shadow_rays +
+                stats.light_rays;
+    print_info("render stats ------------");
+    print_info("camera rays:  " + std::to_string(stats.camera_rays));
+    print_info("bounce rays:  " + std::to_string(stats.bounce_rays));
+    print_info("shadow rays:  " + std::to_string(stats.shadow_rays));
+    print_info("light rays:   " + std::to_string(stats.light_rays));
+    print_info("bounces:      " + std::to_string(stats.bounces));
+    print_info("nodes:        " + std::to_string(stats.nodes));
+    print_info("primitives:   " + std::to_string(stats.primitives));
+    print_info("instances:    " + std::to_string(stats.instances));
+    if (rays != 0) {
+      print_info("nodes/ray:    " + std::to_string((double)stats.nodes / rays));
+      print_info(
+          "prims/ray:    " + std::to_string((double)stats.primitives / rays));
+    }
   }
 
   // save image
@@ -250,6 +394,75 @@ int run_render(const render_params& params_) {
   auto image = params.denoise ? get_denoised(state) : get_render(state);
   if (!save_image(params.output, image, ioerror)) return print_fatal(ioerror);
   print_progress_end();
+  timed("save");
+
+  // save sidecar
+  if (params.sidecar) {
+    auto samples = (double)state.samples;
+    if (!state.counts.empty()) {
+      samples = 0;
+      for (auto count : state.counts) samples += count;
+      samples /= state.counts.size();
+    }
+    auto js          = nlohmann::ordered_json::object();
+    js["scene"]      = params.scene;
+    js["width"]      = state.width;
+    js["height"]     = state.height;
+    js["samples"]    = samples;
+    js["passes"]     = state.samples;
+    js["timebudget"] = params.timebudget;
+    for (auto& [stage, seconds] : timings) js["timings"][stage] = seconds;
+    auto sidecar = params.output + ".json";
+    if (!save_text(sidecar, js.dump(2) + "\n", ioerror))
+      return print_fatal(ioerror);
+  }
+
+  // done
+  return 0;
+}
+
+// merge params
+struct merge_params {
+  vector<string> states  = {"state.ytrace"};
+  string         output  = "out.png";
+  bool           denoise = false;
+};
+
+// Cli
+void add_command(const cli_command& cli, const string& name,
+    merge_params& params, const string& usage) {
+  auto cmd = add_command(cli, name, usage);
+  add_option(cmd, "output", params.output, "Output filename.");
+  add_option(cmd, "denoise", params.denoise, "Enable denoiser.");
+  add_argument(cmd, "states", params.states, "Rendering states.");
+}
+
+// merge partial renders
+int run_merge(const merge_params& params) {
+  // merge states
+  auto merged  = trace_state{};
+  auto ioerror = ""s;
+  print_progress_begin("merge states", (int)params.states.size());
+  for (auto& filename : params.states) {
+    auto state = trace_state{};
+    if (!load_state(filename, state, ioerror)) return print_fatal(ioerror);
+    if (&filename == &params.states.front()) {
+      merged = std::move(state);
+    } else if (auto mismatch = ""s; !check_state(state, merged, mismatch)) {
+      return print_fatal(filename + ": incompatible state, " + mismatch);
+    } else {
+      merge_state(merged, state);
+    }
+    print_progress_next();
+  }
+
+  // save image
+  if (params.denoise && merged.albedo.empty())
+    return print_fatal("states have no denoising buffers");
+  print_progress_begin("save image");
+  auto image = params.denoise ? get_denoised(merged) : get_render(merged);
+  if (!save_image(params.output, image, ioerror)) return print_fatal(ioerror);
+  print_progress_end();
 
   // done
   return 0;
@@ -291,6 +504,8 @@ void add_command(const cli_command& cli, const string& name,
   add_option(cmd, "embreebvh", params.embreebvh, "Use Embree as BVH.");
   add_option(
       cmd, "highqualitybvh", params.highqualitybvh, "Use high quality BVH.");
+  add_option(cmd, "spatialbvh", params.spatialbvh,
+      "Spatial split BVH duplication budget (0 disables).", {0, 4});
   add_option(cmd, "exposure", params.exposure, "Exposure value.");
   add_option(cmd, "filmic", params.filmic, "Filmic tone mapping.");
   add_option(cmd, "noparallel", params.noparallel, "Disable threading.");
@@ -402,6 +617,7 @@ struct app_params {
   convert_params convert = {};
   info_params    info    = {};
   render_params  render  = {};
+  merge_params   merge   = {};
   view_params    view    = {};
   glview_params  glview  = {};
 };
@@ -414,6 +630,7 @@ cli_state make_commands(
   add_command(cli, "convert", params.convert, "Convert scenes.");
   add_command(cli, "info", params.info, "Print scenes info.");
   add_command(cli, "render", params.render, "Render scenes.");
+  add_command(cli, "merge", params.merge, "Merge partial renders.");
   add_command(cli, "view", params.view, "View scenes.");
   add_command(cli, "glview", params.glview, "View scenes with OpenGL.");
   return cli;
@@ -437,6 +654,8 @@ int main(int argc, const char* argv[]) {
     return run_info(params.info);
   } else if (params.command == "render") {
     return run_render(params.render);
+  } else if (params.command == "merge") {
+    return run_merge(params.merge);
   } else if (params.command == "view") {
     return run_view(params.view);
   } else if (params.command == "glview") {
@@ -0,0 +1,1553 @@
+//
+// LICENSE:
+//
+// Copyright (c) 2016 -- 2021 Fabio Pellacini
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <yocto/yocto_bvh.h>
+#include <yocto/yocto_cli.h>
+#include <yocto/yocto_geometry.h>
+#include <yocto/yocto_image.h>
+#include <yocto/yocto_math.h>
+#include <yocto/yocto_noise.h>
+#include <yocto/yocto_parallel.h>
+#include <yocto/yocto_scene.h>
+#include <yocto/yocto_shape.h>
+#include <yocto/yocto_trace.h>
+#include <yocto/yocto_wide.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <thread>
+using namespace yocto;
+
+// Test state. Checks record failures instead of stopping at the first one.
+struct test_state {
+  int checks   = 0;
+  int failures = 0;
+};
+
+// Check a condition, reporting it if it fails
+static void check(test_state& state, bool value, const string& message) {
+  state.checks += 1;
+  if (value) return;
+  state.failures += 1;
+  print_info("failed: " + message);
+}
+
+// Triangle overlaps, including coplanar triangles
+static void test_overlap_triangles(test_state& state) {
+  auto p0 = vec3f{0, 0, 0}, p1 = vec3f{1, 0, 0}, p2 = vec3f{0, 1, 0};
+  check(state,
+      !overlap_triangles(
+          p0, p1, p2, {0.6f, 0.6f, 0}, {1.6f, 0.6f, 0}, {0.6f, 1.6f, 0}),
+      "disjoint coplanar triangles do not overlap");
+  check(state,
+      !overlap_triangles(p0, p1, p2, {2, 0, 0}, {3, 0, 0}, {2, 1, 0}),
+      "distant coplanar triangles do not overlap");
+  check(state,
+      overlap_triangles(
+          p0, p1, p2, {0.2f, 0.2f, 0}, {1.2f, 0.2f, 0}, {0.2f, 1.2f, 0}),
+      "overlapping coplanar triangles overlap");
+  check(state,
+      overlap_triangles(p0, p1, p2, {0.2f, 0.2f, 0}, {0.4f, 0.2f, 0},
+          {0.2f, 0.4f, 0}),
+      "contained coplanar triangles overlap");
+  check(state,
+      !overlap_triangles(p0, p1, p2, {0, 0, 1}, {1, 0, 1}, {0, 1, 1}),
+      "parallel triangles do not overlap");
+  check(state,
+      overlap_triangles(p0, p1, p2, {0.2f, 0.2f, -1}, {0.2f, 0.2f, 1},
+          {0.8f, 0.8f, 0}),
+      "crossing triangles overlap");
+  check(state,
+      !overlap_triangles(p0, p1, p2, {2, 2, -1}, {2, 2, 1}, {3, 3, 0}),
+      "non-coplanar distant triangles do not overlap");
+}
+
+// A time budget keeps sampling past the sample count until it runs out
+static void test_trace_timebudget(test_state& state) {
+  auto scene = scene_model{};
+  make_cornellbox(scene);
+  auto params       = trace_params{};
+  params.resolution = 32;
+  params.samples    = 4;
+  params.timebudget = 0.5f;
+  auto bvh          = make_bvh(scene, params);
+  auto lights       = make_lights(scene, params);
+  auto tscene       = make_trace_scene(scene);
+  auto tstate       = make_state(scene, params);
+  auto timer        = simple_timer{};
+  while (!is_converged(tstate, params)) {
+    trace_samples(tstate, scene, tscene, bvh, lights, params);
+    if (is_out_of_budget(params, tstate.samples, elapsed_seconds(timer)))
+      break;
+  }
+  check(state, tstate.samples > params.samples,
+      "time budget samples past the sample count");
+  check(state, elapsed_seconds(timer) < params.timebudget * 2,
+      "time budget stops rendering");
+}
+
+// The Cornell box test scene
+static scene_model make_cornellbox_scene() {
+  auto scene = scene_model{};
+  make_cornellbox(scene);
+  return scene;
+}
+
+// A flat test scene, with a matte rectangle lit by a constant environment
+static scene_model make_flat_scene() {
+  auto scene = make_shape_scene(make_rect({1, 1}, {4, 4}));
+  scene.materials[0].type  = scene_material_type::matte;
+  scene.materials[0].color = {0.5f, 0.5f, 0.5f};
+  scene.environment_names.emplace_back("constant");
+  scene.environments.push_back({identity3x4f, {1, 1, 1}, invalidid});
+  return scene;
+}
+
+// Mean luminance of an image
+static double mean_luminance(const color_image& image) {
+  auto sum = 0.0;
+  for (auto& pixel : image.pixels) sum += luminance(xyz(pixel));
+  return sum / image.pixels.size();
+}
+
+// Adaptive renders of flat scenes converge before the sample count, and
+// match uniform renders on average
+static void test_trace_adaptive(test_state& state) {
+  auto scene         = make_flat_scene();
+  auto params        = trace_params{};
+  params.resolution  = 32;
+  params.samples     = 256;
+  params.adaptive    = 0.05f;
+  params.adaptivemin = 16;
+  auto bvh           = make_bvh(scene, params);
+  auto lights        = make_lights(scene, params);
+  auto tscene        = make_trace_scene(scene);
+  auto adaptive      = make_state(scene, params);
+  auto passes        = 0;
+  while (adaptive.samples < params.samples && passes < 10000) {
+    trace_samples(adaptive, scene, tscene, bvh, lights, params);
+    passes += 1;
+  }
+  auto total = (size_t)0;
+  for (auto count : adaptive.counts) total += count;
+  auto pixels = (size_t)adaptive.width * adaptive.height;
+  check(state, is_converged(adaptive, params), "adaptive render converges");
+  check(state, adaptive.samples >= params.samples,
+      "converged adaptive render reaches the sample count");
+  check(state, total < pixels * params.samples / 2,
+      "adaptive render stops early on flat scenes");
+
+  auto uparams     = params;
+  uparams.adaptive = 0;
+  auto uniform     = make_state(scene, uparams);
+  for (auto sample = 0; sample < uparams.samples; sample++)
+    trace_samples(uniform, scene, tscene, bvh, lights, uparams);
+  auto adaptive_mean = mean_luminance(get_render(adaptive));
+  auto uniform_mean  = mean_luminance(get_render(uniform));
+  check(state, std::abs(adaptive_mean - uniform_mean) < 0.01 * uniform_mean,
+      "adaptive render matches the uniform one on average");
+}
+
+// Merging states rendered in shards, with the samples split as in yscene and
+// different seeds, matches a single render with the same total samples
+static void test_trace_merge(test_state& state) {
+  auto scene        = make_flat_scene();
+  auto params       = trace_params{};
+  params.resolution = 32;
+  params.samples    = 64;
+  auto bvh          = make_bvh(scene, params);
+  auto lights       = make_lights(scene, params);
+  auto tscene       = make_trace_scene(scene);
+  auto single       = make_state(scene, params);
+  for (auto sample = 0; sample < params.samples; sample++)
+    trace_samples(single, scene, tscene, bvh, lights, params);
+
+  auto shards = 3;
+  auto merged = trace_state{};
+  for (auto shard = 0; shard < shards; shard++) {
+    auto sparams    = params;
+    sparams.samples = params.samples / shards +
+                      (shard < params.samples % shards ? 1 : 0);
+    sparams.seed += shard;
+    auto sstate = make_state(scene, sparams);
+    for (auto sample = 0; sample < sparams.samples; sample++)
+      trace_samples(sstate, scene, tscene, bvh, lights, sparams);
+    if (shard == 0) {
+      merged = std::move(sstate);
+    } else {
+      merge_state(merged, sstate);
+    }
+  }
+  check(state, merged.samples == params.samples,
+      "merged shards have the total samples");
+  auto single_mean = mean_luminance(get_render(single));
+  auto merged_mean = mean_luminance(get_render(merged));
+  check(state, std::abs(merged_mean - single_mean) < 0.01 * single_mean,
+      "merged shards match a single render on average");
+
+  // states with different buffers are not merged
+  auto dparams    = params;
+  dparams.denoise = true;
+  auto denoised   = make_state(scene, dparams);
+  auto error      = string{};
+  check(state, !check_state(merged, denoised, error),
+      "states with different buffers do not match");
+  check(state, error == "albedo does not match", "mismatched buffer name");
+  auto thrown = false;
+  try {
+    merge_state(merged, denoised);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  check(state, thrown, "states with different buffers are not merged");
+
+  // states without samples render black
+  auto empty  = get_render(make_state(scene, params));
+  auto black  = std::all_of(empty.pixels.begin(), empty.pixels.end(),
+      [](const vec4f& pixel) { return pixel == vec4f{0, 0, 0, 0}; });
+  check(state, black, "states without samples render black");
+}
+
+// Check that two vectors have the same bytes
+template <typename T>
+static bool same_bytes(const vector<T>& a, const vector<T>& b) {
+  return a.size() == b.size() &&
+         (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+// Check that two states have the same bytes in all accumulation buffers
+static bool same_state(const trace_state& a, const trace_state& b) {
+  return a.width == b.width && a.height == b.height &&
+         a.samples == b.samples && same_bytes(a.image, b.image) &&
+         same_bytes(a.residuals, b.residuals) &&
+         same_bytes(a.imageh, b.imageh) && same_bytes(a.albedo, b.albedo) &&
+         same_bytes(a.normal, b.normal) && same_bytes(a.moments, b.moments) &&
+         same_bytes(a.counts, b.counts);
+}
+
+// Renders resumed from a checkpoint are bit-identical to uninterrupted
+// ones, while truncated and inconsistent checkpoints are rejected
+static void test_trace_checkpoint(test_state& state) {
+  auto scene    = make_cornellbox_scene();
+  auto filename = (std::filesystem::temp_directory_path() /
+                   "ytest_checkpoint.ytrace")
+                      .string();
+  auto variants = vector<pair<string, trace_params>>{};
+  for (auto accumulation : {trace_accumulation_type::single,
+           trace_accumulation_type::compensated,
+           trace_accumulation_type::half}) {
+    auto params         = trace_params{};
+    params.resolution   = 32;
+    params.samples      = 8;
+    params.accumulation = accumulation;
+    variants.push_back(
+        {trace_accumulation_names[(int)accumulation], params});
+  }
+  variants.push_back({"adaptive", variants.front().second});
+  variants.back().second.adaptive    = 0.1f;
+  variants.back().second.adaptivemin = 2;
+  variants.push_back({"denoise", variants.front().second});
+  variants.back().second.denoise = true;
+  for (auto& [name, params] : variants) {
+    auto bvh      = make_bvh(scene, params);
+    auto lights   = make_lights(scene, params);
+    auto tscene   = make_trace_scene(scene);
+    auto straight = make_state(scene, params);
+    for (auto sample = 0; sample < params.samples; sample++)
+      trace_samples(straight, scene, tscene, bvh, lights, params);
+    auto partial = make_state(scene, params);
+    for (auto sample = 0; sample < 3; sample++)
+      trace_samples(partial, scene, tscene, bvh, lights, params);
+    auto resumed = trace_state{};
+    auto error   = string{};
+    auto loaded  = save_state(filename, partial, error) &&
+                  load_state(filename, resumed, error);
+    check(state, loaded, name + " checkpoint saves and loads");
+    for (auto sample = 3; sample < params.samples; sample++)
+      trace_samples(resumed, scene, tscene, bvh, lights, params);
+    check(state, same_state(resumed, straight),
+        name + " resumed render is bit-identical");
+  }
+
+  // truncated files and inconsistent buffer masks are rejected
+  auto params     = variants.front().second;
+  auto checkpoint = make_state(scene, params);
+  auto error      = string{};
+  auto loaded     = trace_state{};
+  save_state(filename, checkpoint, error);
+  auto size = std::filesystem::file_size(filename);
+  std::filesystem::resize_file(filename, size - 1);
+  check(state, !load_state(filename, loaded, error),
+      "truncated checkpoints are rejected");
+  save_state(filename, checkpoint, error);
+  auto patched = false;
+  if (auto fs = fopen(filename.c_str(), "r+b"); fs) {
+    // the buffer mask follows the magic, size and samples
+    auto buffers = 0u;
+    patched      = fseek(fs, 20, SEEK_SET) == 0 &&
+              fread(&buffers, sizeof(buffers), 1, fs) == 1 &&
+              fseek(fs, 20, SEEK_SET) == 0;
+    buffers |= 1u << 3;
+    patched = patched && fwrite(&buffers, sizeof(buffers), 1, fs) == 1;
+    fclose(fs);
+  }
+  check(state, patched && !load_state(filename, loaded, error),
+      "checkpoints with mismatched buffers are rejected");
+  std::filesystem::remove(filename);
+}
+
+// Renders with counter-based rngs do not depend on the order pixels are
+// visited or on the number of threads
+static void test_trace_counterrng(test_state& state) {
+  auto scene = make_cornellbox_scene();
+  for (auto sequence :
+      {trace_sequence_type::random, trace_sequence_type::sobol}) {
+    auto params       = trace_params{};
+    params.resolution = 24;
+    params.samples    = 4;
+    params.counterrng = true;
+    params.sequence   = sequence;
+    params.noparallel = true;
+    auto name         = trace_sequence_names[(int)sequence];
+    auto bvh          = make_bvh(scene, params);
+    auto lights       = make_lights(scene, params);
+    auto tscene       = make_trace_scene(scene);
+    auto serial       = make_state(scene, params);
+    for (auto sample = 0; sample < params.samples; sample++)
+      trace_samples(serial, scene, tscene, bvh, lights, params);
+
+    // pixels visited in a different random order at each pass
+    auto shuffled = make_state(scene, params);
+    auto pixels   = vector<vec2i>{};
+    for (auto j = 0; j < shuffled.height; j++) {
+      for (auto i = 0; i < shuffled.width; i++) pixels.push_back({i, j});
+    }
+    auto rng = make_rng(5);
+    for (auto sample = 0; sample < params.samples; sample++) {
+      shuffle(pixels, rng);
+      for (auto& [i, j] : pixels)
+        trace_sample(shuffled, scene, tscene, bvh, lights, i, j, params);
+      shuffled.samples += 1;
+    }
+    check(state, same_state(serial, shuffled),
+        name + ": renders do not depend on the pixel order");
+
+    // different thread counts, then back to the default
+    for (auto threads : {1, 3, 8}) {
+      set_parallel_threads(threads);
+      auto pparams       = params;
+      pparams.noparallel = false;
+      auto parallel      = make_state(scene, pparams);
+      for (auto sample = 0; sample < params.samples; sample++)
+        trace_samples(parallel, scene, tscene, bvh, lights, pparams);
+      check(state, same_state(serial, parallel),
+          name + ": renders do not depend on the number of threads, " +
+              std::to_string(threads) + " threads");
+    }
+    set_parallel_threads(0);
+  }
+}
+
+// Half and compensated accumulation match float accumulation against a
+// double precision reference, and buffers are allocated only when enabled
+static void test_trace_accumulation(test_state& state) {
+  auto scene        = make_cornellbox_scene();
+  auto params       = trace_params{};
+  params.resolution = 16;
+  params.samples    = 512;
+  params.counterrng = true;
+  params.noparallel = true;
+  auto bvh          = make_bvh(scene, params);
+  auto lights       = make_lights(scene, params);
+  auto tscene       = make_trace_scene(scene);
+
+  // reference means, from the samples of each pass summed in double
+  auto scratch   = make_state(scene, params);
+  auto reference = vector<double>(scratch.image.size() * 3, 0);
+  for (auto sample = 0; sample < params.samples; sample++) {
+    scratch.samples = sample;
+    std::fill(scratch.image.begin(), scratch.image.end(), vec4f{0, 0, 0, 0});
+    trace_samples(scratch, scene, tscene, bvh, lights, params);
+    for (auto idx = (size_t)0; idx < scratch.image.size(); idx++) {
+      for (auto c = 0; c < 3; c++) {
+        reference[idx * 3 + c] += scratch.image[idx][c] / params.samples;
+      }
+    }
+  }
+
+  // largest, mean and rms errors relative to the reference, for pixels that
+  // are not dark
+  struct accumulation_error {
+    double max = 0, mean = 0, rms = 0;
+  };
+  auto errors = vector<accumulation_error>{};
+  for (auto type = 0; type < (int)trace_accumulation_names.size(); type++) {
+    auto aparams         = params;
+    aparams.accumulation = (trace_accumulation_type)type;
+    auto astate          = make_state(scene, aparams);
+    for (auto sample = 0; sample < params.samples; sample++)
+      trace_samples(astate, scene, tscene, bvh, lights, aparams);
+    auto render = get_render(astate);
+    auto error  = accumulation_error{};
+    auto count  = 0;
+    for (auto idx = (size_t)0; idx < render.pixels.size(); idx++) {
+      for (auto c = 0; c < 3; c++) {
+        auto value = reference[idx * 3 + c];
+        if (value < 1e-3) continue;
+        auto relative = (render.pixels[idx][c] - value) / value;
+        error.max     = max(error.max, std::abs(relative));
+        error.mean += relative;
+        error.rms += relative * relative;
+        count += 1;
+      }
+    }
+    error.mean /= count;
+    error.rms = std::sqrt(error.rms / count);
+    errors.push_back(error);
+  }
+  auto& single      = errors[(int)trace_accumulation_type::single];
+  auto& compensated = errors[(int)trace_accumulation_type::compensated];
+  auto& half        = errors[(int)trace_accumulation_type::half];
+  check(state, single.max < 1e-5,
+      "float accumulation is accurate, error " + std::to_string(single.max));
+  check(state, compensated.max <= single.max && compensated.max < 1e-6,
+      "compensated accumulation is at least as accurate as float, error " +
+          std::to_string(compensated.max));
+  // stochastic rounding errors of half means add up as a random walk of
+  // half ulps, but do not bias the result
+  check(state, std::abs(half.mean) < 1e-3,
+      "half accumulation is unbiased, bias " + std::to_string(half.mean));
+  check(state, half.rms < 0x1p-11 * std::sqrt((double)params.samples),
+      "half accumulation is within half precision, rms error " +
+          std::to_string(half.rms));
+
+  // buffers allocated for each option
+  auto buffers = [&](const trace_params& params) {
+    auto bstate = make_state(scene, params);
+    trace_samples(bstate, scene, tscene, bvh, lights, params);
+    return bstate;
+  };
+  auto sparams       = trace_params{};
+  sparams.resolution = 16;
+  auto plain         = buffers(sparams);
+  check(state,
+      !plain.image.empty() && !plain.rngs.empty() && plain.residuals.empty() &&
+          plain.imageh.empty() && plain.albedo.empty() &&
+          plain.normal.empty() && plain.moments.empty() &&
+          plain.counts.empty(),
+      "disabled buffers are not allocated");
+  auto hparams         = sparams;
+  hparams.accumulation = trace_accumulation_type::half;
+  hparams.counterrng   = true;
+  auto halfs           = buffers(hparams);
+  check(state,
+      halfs.image.empty() && !halfs.imageh.empty() && halfs.rngs.empty() &&
+          get_memory(halfs) == halfs.imageh.size() * sizeof(vec4h) +
+                                   halfs.stats.size() * sizeof(trace_stats),
+      "half accumulation with counter rngs allocates only the half image");
+  auto dparams         = sparams;
+  dparams.accumulation = trace_accumulation_type::compensated;
+  dparams.denoise      = true;
+  auto denoised        = buffers(dparams);
+  check(state,
+      !denoised.residuals.empty() && !denoised.albedo.empty() &&
+          !denoised.normal.empty(),
+      "enabled buffers are allocated");
+}
+
+// Interactive sessions render to completion in the background, can be
+// cancelled in the middle of a pass, and restart from a clean state
+static void test_trace_session(test_state& state) {
+  auto scene        = make_cornellbox_scene();
+  auto params       = trace_params{};
+  params.resolution = 32;
+  params.samples    = 8;
+  params.pratio     = 4;
+  auto wait         = [](trace_session& session) {
+    if (session.worker.valid()) session.worker.wait();
+  };
+
+  // straight render used as reference
+  auto bvh       = make_bvh(scene, params);
+  auto lights    = make_lights(scene, params);
+  auto reference = make_state(scene, params);
+  for (auto sample = 0; sample < params.samples; sample++)
+    trace_samples(reference, scene, bvh, lights, params);
+
+  // render to completion
+  auto session = trace_session{};
+  init_session(session, scene, params);
+  start_session(session, scene, params);
+  wait(session);
+  auto render = color_image{};
+  check(state,
+      session.samples == params.samples && update_render(render, session) &&
+          render == get_render(session.state) &&
+          !update_render(render, session),
+      "sessions publish the final render once");
+  check(state, same_state(session.state, reference),
+      "sessions render as trace_samples");
+
+  // cancel in the middle of a long render, after the first pass
+  auto lparams    = params;
+  lparams.samples = 1 << 20;
+  start_session(session, scene, lparams);
+  auto timer = simple_timer{};
+  while (session.samples < 1 && elapsed_seconds(timer) < 30) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto stop_timer = simple_timer{};
+  stop_session(session);
+  check(state,
+      session.samples >= 1 && elapsed_seconds(stop_timer) < 1 &&
+          session.state.samples < lparams.samples &&
+          !session.worker.valid(),
+      "sessions stop in the middle of a render");
+  check(state, update_render(render, session) && render.width == 32,
+      "cancelled sessions keep their last image");
+
+  // restart while running, then render to completion
+  start_session(session, scene, lparams);
+  start_session(session, scene, params);
+  wait(session);
+  check(state,
+      session.samples == params.samples &&
+          same_state(session.state, reference),
+      "restarted sessions render from a clean state");
+  stop_session(session);
+  stop_session(session);
+  check(state, !session.worker.valid(), "sessions can be stopped twice");
+}
+
+// Updating lights after emission, material, shape and environment edits
+// gives the same lights as building them again
+static void test_update_lights(test_state& state) {
+  auto scene  = make_cornellbox_scene();
+  auto params = trace_params{};
+  auto lights = make_lights(scene, params);
+  auto same_lights = [&scene, &params](const trace_lights& lights) {
+    auto expected = make_lights(scene, params);
+    if (lights.lights.size() != expected.lights.size()) return false;
+    for (auto idx = 0; idx < (int)lights.lights.size(); idx++) {
+      auto& a = lights.lights[idx];
+      auto& b = expected.lights[idx];
+      if (a.instance != b.instance || a.environment != b.environment ||
+          !same_bytes(a.elements_cdf, b.elements_cdf))
+        return false;
+    }
+    return true;
+  };
+  auto light    = lights.lights.front().instance;
+  auto material = scene.instances[light].material;
+  auto emission = scene.materials[material].emission;
+
+  // emission turned off and on, with no updated handles
+  scene.materials[material].emission = {0, 0, 0};
+  update_lights(lights, scene, params, {}, {}, {});
+  check(state, lights.lights.empty() && same_lights(lights),
+      "lights are removed when emission is turned off");
+  scene.materials[material].emission = emission;
+  update_lights(lights, scene, params, {}, {}, {});
+  check(state, same_lights(lights), "lights are added back");
+
+  // other materials made emissive, and instances assigned emissive materials
+  auto floor = light == 0 ? 1 : 0;
+  scene.materials[scene.instances[floor].material].emission = {1, 1, 1};
+  update_lights(lights, scene, params, {}, {}, {});
+  check(state, lights.lights.size() == 2 && same_lights(lights),
+      "lights follow material emission edits");
+  auto wall = 0;
+  while (scene.materials[scene.instances[wall].material].emission != zero3f)
+    wall++;
+  scene.instances[wall].material = material;
+  update_lights(lights, scene, params, {wall}, {}, {});
+  check(state, lights.lights.size() == 3 && same_lights(lights),
+      "lights follow material assignments");
+
+  // shapes moved and scaled
+  auto shape = scene.instances[light].shape;
+  for (auto& position : scene.shapes[shape].positions) {
+    position = position * vec3f{2, 1, 1.5f} + vec3f{0, 0.1f, 0};
+  }
+  update_lights(lights, scene, params, {}, {shape}, {});
+  check(state, same_lights(lights), "lights follow shape edits");
+
+  // environments added and edited
+  auto texture = make_image(32, 16, true);
+  for (auto idx = 0; idx < (int)texture.pixels.size(); idx++) {
+    texture.pixels[idx] = {(float)(idx % 7), 1, 1, 1};
+  }
+  scene.textures.push_back(image_to_texture(texture));
+  auto& environment        = scene.environments.emplace_back();
+  environment.emission     = {1, 1, 1};
+  environment.emission_tex = (int)scene.textures.size() - 1;
+  auto handle              = (int)scene.environments.size() - 1;
+  update_lights(lights, scene, params, {}, {}, {handle});
+  check(state, same_lights(lights), "lights include added environments");
+  for (auto& pixel : scene.textures.back().pixelsf) pixel.x += 3;
+  update_lights(lights, scene, params, {}, {}, {handle});
+  check(state, same_lights(lights), "lights follow environment edits");
+}
+
+// Spatial split bvhs are valid trees whose leaves cover every primitive,
+// do not depend on threading, and give the same hits as bvhs built without
+// spatial splits, on hair and lines shapes
+static void test_bvh_spatial(test_state& state) {
+  // clumped hair and long lines with random directions, whose bounds overlap
+  auto lines = scene_shape{};
+  auto rng   = make_rng(19);
+  for (auto idx = 0; idx < 2048; idx++) {
+    lines.lines.push_back({idx * 2 + 0, idx * 2 + 1});
+    lines.positions.push_back(rand3f(rng));
+    lines.positions.push_back(rand3f(rng));
+    lines.radius.push_back(0.002f);
+    lines.radius.push_back(0.002f);
+  }
+  auto shapes = vector<pair<string, scene_shape>>{
+      {"hair", make_hair(make_sphere(8), {4, 2048}, {0.5f, 0.5f},
+                   {0.001f, 0.001f}, {0.5f, 8})},
+      {"lines", lines},
+  };
+  for (auto& [name, shape] : shapes) {
+    for (auto highquality : {false, true}) {
+      auto label    = name + (highquality ? " (highquality)" : "");
+      auto bvh      = make_bvh(shape, highquality, false, 1.0f);
+      auto serial   = make_bvh(shape, highquality, false, 1.0f, true);
+      auto baseline = make_bvh(shape, highquality);
+      auto& nodes = bvh.bvh.nodes;
+      auto& prims = bvh.bvh.primitives;
+      check(state,
+          same_bytes(nodes, serial.bvh.nodes) &&
+              same_bytes(prims, serial.bvh.primitives),
+          label + ": parallel and serial builds match");
+      check(state, prims.size() > shape.lines.size(),
+          label + ": spatial splits duplicate references");
+
+      // node bounds contain their children, and leaves cover every point of
+      // the primitives they reference
+      auto valid   = true;
+      auto leaves  = vector<vector<int>>(shape.lines.size());
+      auto visited = vector<bool>(nodes.size(), false);
+      auto stack   = vector<int>{0};
+      while (!stack.empty()) {
+        auto nodeid = stack.back();
+        stack.pop_back();
+        if (nodeid < 0 || nodeid >= (int)nodes.size() || visited[nodeid]) {
+          valid = false;
+          break;
+        }
+        visited[nodeid] = true;
+        auto& node      = nodes[nodeid];
+        if (node.internal) {
+          for (auto child = node.start; child < node.start + 2; child++) {
+            if (child >= (int)nodes.size()) continue;
+            auto& cbbox = nodes[child].bbox;
+            valid = valid && cbbox.min.x >= node.bbox.min.x &&
+                    cbbox.min.y >= node.bbox.min.y &&
+                    cbbox.min.z >= node.bbox.min.z &&
+                    cbbox.max.x <= node.bbox.max.x &&
+                    cbbox.max.y <= node.bbox.max.y &&
+                    cbbox.max.z <= node.bbox.max.z;
+            stack.push_back(child);
+          }
+        } else if (node.start < 0 ||
+                   node.start + node.num > (int)prims.size()) {
+          valid = false;
+        } else {
+          for (auto idx = node.start; idx < node.start + node.num; idx++) {
+            leaves[prims[idx]].push_back(nodeid);
+          }
+        }
+      }
+      check(state, valid, label + ": node bounds contain their children");
+      auto uncovered = 0;
+      for (auto element = 0; element < (int)shape.lines.size(); element++) {
+        auto& line = shape.lines[element];
+        for (auto step = 0; step <= 8; step++) {
+          auto point = lerp(shape.positions[line.x], shape.positions[line.y],
+              step / 8.0f);
+          auto covered = false;
+          for (auto nodeid : leaves[element]) {
+            auto& bbox = nodes[nodeid].bbox;
+            covered    = covered || (point.x >= bbox.min.x - 1e-6f &&
+                                     point.y >= bbox.min.y - 1e-6f &&
+                                     point.z >= bbox.min.z - 1e-6f &&
+                                     point.x <= bbox.max.x + 1e-6f &&
+                                     point.y <= bbox.max.y + 1e-6f &&
+                                     point.z <= bbox.max.z + 1e-6f);
+          }
+          if (!covered) uncovered += 1;
+        }
+      }
+      check(state, uncovered == 0,
+          label + ": leaves cover all primitives, " +
+              std::to_string(uncovered) + " points are not covered");
+
+      // rays from random points in random directions
+      auto root     = baseline.bvh.nodes[0].bbox;
+      auto mismatch = 0, hits = 0;
+      for (auto sample = 0; sample < 4096; sample++) {
+        auto origin = root.min + rand3f(rng) * (root.max - root.min);
+        auto ray    = ray3f{origin, sample_sphere(rand2f(rng))};
+        auto a      = intersect_bvh(bvh, shape, ray);
+        auto b      = intersect_bvh(baseline, shape, ray);
+        if (a.hit) hits += 1;
+        if (a.hit != b.hit || (a.hit && a.distance != b.distance))
+          mismatch += 1;
+      }
+      check(state, hits > 0 && mismatch == 0,
+          label + ": hits match, " + std::to_string(mismatch) +
+              " rays differ");
+    }
+  }
+}
+
+// Check that two intersections match in all fields
+static bool same_intersection(
+    const bvh_intersection& a, const bvh_intersection& b) {
+  return a.hit == b.hit && a.instance == b.instance && a.element == b.element &&
+         a.uv == b.uv && a.distance == b.distance;
+}
+
+// Batched closest point queries, that are reordered along a Morton curve,
+// return the same results as single point queries, in input order
+static void test_overlap_queries(test_state& state) {
+  // random points around the shape, some out of range, and duplicates
+  auto make_positions = [](const bbox3f& bbox, int num) {
+    auto rng       = make_rng(11);
+    auto size      = bbox.max - bbox.min;
+    auto positions = vector<vec3f>{};
+    for (auto idx = 0; idx < num; idx++) {
+      positions.push_back(bbox.min - size * 0.25f + rand3f(rng) * size * 1.5f);
+    }
+    for (auto idx = 0; idx < num / 8; idx++) {
+      positions.push_back(positions[idx * 3]);
+    }
+    return positions;
+  };
+
+  // shape queries
+  auto shape     = make_sphere(16);
+  auto sbvh      = make_bvh(shape);
+  auto positions = make_positions(sbvh.bvh.nodes[0].bbox, 4096);
+  for (auto noparallel : {false, true}) {
+    auto batch   = overlap_bvh(sbvh, shape, positions, 0.1f, noparallel);
+    auto matches = batch.size() == positions.size();
+    auto hits    = 0;
+    for (auto idx = 0; matches && idx < (int)positions.size(); idx++) {
+      auto single = overlap_bvh(sbvh, shape, positions[idx], 0.1f);
+      matches     = matches && same_intersection(batch[idx], single);
+      if (single.hit) hits += 1;
+    }
+    check(state, matches && hits > 0 && hits < (int)positions.size(),
+        string("shape batch queries match single queries") +
+            (noparallel ? " (serial)" : ""));
+  }
+  check(state, overlap_bvh(sbvh, shape, vector<vec3f>{}, 0.1f).empty(),
+      "empty batches return no results");
+
+  // scene queries
+  auto scene      = make_cornellbox_scene();
+  auto bvh        = make_bvh(scene);
+  auto spositions = make_positions(bvh.bvh.nodes[0].bbox, 4096);
+  for (auto noparallel : {false, true}) {
+    auto batch   = overlap_bvh(bvh, scene, spositions, 0.05f, true, noparallel);
+    auto matches = batch.size() == spositions.size();
+    auto hits    = 0;
+    for (auto idx = 0; matches && idx < (int)spositions.size(); idx++) {
+      auto single = overlap_bvh(bvh, scene, spositions[idx], 0.05f);
+      matches     = matches && same_intersection(batch[idx], single);
+      if (single.hit) hits += 1;
+    }
+    check(state, matches && hits > 0 && hits < (int)spositions.size(),
+        string("scene batch queries match single queries") +
+            (noparallel ? " (serial)" : ""));
+  }
+}
+
+// The first 2^k Sobol points fill each elementary interval of area 2^-k
+// once, in 1D and 2D, and sequences with different seeds are uncorrelated
+static void test_sobol(test_state& state) {
+  for (auto seed : {0ull, 1ull, 123456789ull}) {
+    auto stratified = true;
+    for (auto k = 1; k <= 10; k++) {
+      auto num = 1u << k;
+      // 1D intervals of size 2^-k
+      auto counts = vector<int>(num, 0);
+      for (auto index = 0u; index < num; index++) {
+        counts[(int)(sobol1f(index, seed) * num)] += 1;
+      }
+      for (auto count : counts) stratified = stratified && count == 1;
+      // 2D intervals of size 2^-a by 2^-(k-a)
+      for (auto a = 0; a <= k; a++) {
+        auto nx = 1 << a, ny = 1 << (k - a);
+        auto cells = vector<int>(num, 0);
+        for (auto index = 0u; index < num; index++) {
+          auto p = sobol2f(index, seed);
+          cells[(int)(p.y * ny) * nx + (int)(p.x * nx)] += 1;
+        }
+        for (auto count : cells) stratified = stratified && count == 1;
+      }
+    }
+    check(state, stratified,
+        "sobol points fill elementary intervals, seed " +
+            std::to_string(seed));
+  }
+
+  // correlation of the same dimension across seeds, and of the two
+  // dimensions of a 2D sequence, that for independent sequences is within
+  // a few times 1/sqrt(num)
+  auto correlation = [](const vector<float>& a, const vector<float>& b) {
+    auto num = (double)a.size();
+    auto ma = 0.0, mb = 0.0;
+    for (auto idx = (size_t)0; idx < a.size(); idx++) {
+      ma += a[idx] / num;
+      mb += b[idx] / num;
+    }
+    auto cab = 0.0, caa = 0.0, cbb = 0.0;
+    for (auto idx = (size_t)0; idx < a.size(); idx++) {
+      cab += (a[idx] - ma) * (b[idx] - mb);
+      caa += (a[idx] - ma) * (a[idx] - ma);
+      cbb += (b[idx] - mb) * (b[idx] - mb);
+    }
+    return cab / std::sqrt(caa * cbb);
+  };
+  auto num        = 1u << 16;
+  auto max_corr   = 0.0;
+  auto sequence1f = [num](uint64_t seed) {
+    auto values = vector<float>(num);
+    for (auto index = 0u; index < num; index++) {
+      values[index] = sobol1f(index, seed);
+    }
+    return values;
+  };
+  auto sequence2f = [num](uint64_t seed, int dim) {
+    auto values = vector<float>(num);
+    for (auto index = 0u; index < num; index++) {
+      values[index] = sobol2f(index, seed)[dim];
+    }
+    return values;
+  };
+  for (auto seed = 0ull; seed < 8; seed++) {
+    auto a = sequence1f(seed), b = sequence1f(seed + 1);
+    max_corr = max(max_corr, std::abs(correlation(a, b)));
+    for (auto dim = 0; dim < 2; dim++) {
+      auto c = sequence2f(seed, dim), d = sequence2f(seed + 1, dim);
+      max_corr = max(max_corr, std::abs(correlation(c, d)));
+    }
+    auto x = sequence2f(seed, 0), y = sequence2f(seed, 1);
+    max_corr = max(max_corr, std::abs(correlation(x, y)));
+    check(state, a != b && x != sequence2f(seed + 1, 0),
+        "sobol sequences differ across seeds");
+  }
+  check(state, max_corr < 5 / std::sqrt((double)num),
+      "sobol sequences are uncorrelated across seeds, correlation " +
+          std::to_string(max_corr));
+}
+
+// Denoising a noisy constant image, with constant albedo and normal, lowers
+// its variance and preserves its mean, and constant images are unchanged
+static void test_denoise_image(test_state& state) {
+  auto width = 64, height = 48;
+  auto albedo = make_image(width, height, true);
+  auto normal = make_image(width, height, true);
+  for (auto& pixel : albedo.pixels) pixel = {0.8f, 0.6f, 0.4f, 1};
+  for (auto& pixel : normal.pixels) pixel = {0, 0, 1, 1};
+  auto value    = vec4f{0.4f, 0.3f, 0.2f, 1};
+  auto constant = make_image(width, height, true);
+  auto noisy    = make_image(width, height, true);
+  auto rng      = make_rng(3);
+  for (auto idx = 0; idx < (int)noisy.pixels.size(); idx++) {
+    constant.pixels[idx] = value;
+    noisy.pixels[idx]    = value * vec4f{0.5f + rand1f(rng),
+                                    0.5f + rand1f(rng), 0.5f + rand1f(rng), 1};
+  }
+  auto statistics = [](const color_image& image) {
+    auto num = (double)image.pixels.size();
+    auto mean = vec3f{0, 0, 0}, variance = vec3f{0, 0, 0};
+    for (auto& pixel : image.pixels) mean += xyz(pixel) / (float)num;
+    for (auto& pixel : image.pixels) {
+      variance += (xyz(pixel) - mean) * (xyz(pixel) - mean) / (float)num;
+    }
+    return pair{mean, variance};
+  };
+
+  auto [noisy_mean, noisy_variance] = statistics(noisy);
+  auto denoised                     = denoise_image(noisy, albedo, normal);
+  auto [mean, variance]             = statistics(denoised);
+  check(state, max(variance / noisy_variance) < 0.01f,
+      "denoising lowers the variance, ratio " +
+          std::to_string(max(variance / noisy_variance)));
+  check(state, max(abs(mean - noisy_mean) / noisy_mean) < 0.01f,
+      "denoising preserves the mean, relative error " +
+          std::to_string(max(abs(mean - noisy_mean) / noisy_mean)));
+
+  auto unchanged = denoise_image(constant, albedo, normal);
+  auto error     = 0.0f;
+  for (auto& pixel : unchanged.pixels) {
+    error = max(error, max(abs(xyz(pixel) - xyz(value))));
+  }
+  check(state, error < 1e-6f, "denoising keeps constant images");
+}
+
+// Resizing keeps constant images, averages blocks when box downsampling by
+// two, and keeps smooth images at the new pixel centers with smooth filters.
+// Zero sizes keep the aspect ratio, and ldr and byte images are filtered in
+// linear color space.
+static void test_resize_image(test_state& state) {
+  auto filters = vector<resize_filter_type>{resize_filter_type::automatic,
+      resize_filter_type::box, resize_filter_type::mitchell,
+      resize_filter_type::catmullrom, resize_filter_type::lanczos};
+  auto width = 64, height = 48;
+  auto sizes = vector<vec2i>{{32, 24}, {160, 120}, {41, 97}};
+
+  // constant images, with alpha
+  auto constant = make_image(width, height, true);
+  for (auto& pixel : constant.pixels) pixel = {0.4f, 0.3f, 0.2f, 0.5f};
+  auto constant_error = 0.0f;
+  for (auto filter : filters) {
+    for (auto size : sizes) {
+      auto resized = resize_image(constant, size.x, size.y, filter);
+      for (auto& pixel : resized.pixels) {
+        constant_error = max(
+            constant_error, max(abs(pixel - constant.pixels.front())));
+      }
+    }
+  }
+  check(state, constant_error < 1e-5f,
+      "resizing keeps constant images, error " +
+          std::to_string(constant_error));
+
+  // box downsampling by two averages 2x2 blocks
+  auto noisy = make_image(width, height, true);
+  auto rng   = make_rng(7);
+  for (auto& pixel : noisy.pixels) {
+    pixel = {rand1f(rng), rand1f(rng), rand1f(rng), 1};
+  }
+  auto box       = resize_image(noisy, width / 2, height / 2,
+      resize_filter_type::box);
+  auto box_error = 0.0f;
+  for (auto j = 0; j < box.height; j++) {
+    for (auto i = 0; i < box.width; i++) {
+      auto average = (noisy[{2 * i, 2 * j}] + noisy[{2 * i + 1, 2 * j}] +
+                         noisy[{2 * i, 2 * j + 1}] +
+                         noisy[{2 * i + 1, 2 * j + 1}]) /
+                     4;
+      box_error = max(box_error, max(abs(box[{i, j}] - average)));
+    }
+  }
+  check(state, box_error < 1e-5f,
+      "box downsampling averages blocks, error " + std::to_string(box_error));
+
+  // smooth images sampled at the new pixel centers, away from the borders,
+  // with all filters but box, that is piecewise constant when upsampling
+  auto smooth = [](float u, float v) {
+    return vec4f{0.5f + 0.25f * std::sin(2 * pif * u),
+        0.5f + 0.25f * std::cos(2 * pif * v), 0.2f + 0.3f * u * v, 1};
+  };
+  auto image = make_image(width, height, true);
+  for (auto j = 0; j < height; j++) {
+    for (auto i = 0; i < width; i++) {
+      image[{i, j}] = smooth((i + 0.5f) / width, (j + 0.5f) / height);
+    }
+  }
+  auto smooth_error = 0.0f;
+  for (auto filter : filters) {
+    if (filter == resize_filter_type::box) continue;
+    for (auto size : sizes) {
+      auto resized = resize_image(image, size.x, size.y, filter);
+      auto border  = vec2i{max(3 * size.x / width, 1) * 3,
+          max(3 * size.y / height, 1) * 3};
+      for (auto j = border.y; j < size.y - border.y; j++) {
+        for (auto i = border.x; i < size.x - border.x; i++) {
+          auto expected = smooth((i + 0.5f) / size.x, (j + 0.5f) / size.y);
+          smooth_error  = max(
+              smooth_error, max(abs(resized[{i, j}] - expected)));
+        }
+      }
+    }
+  }
+  check(state, smooth_error < 2e-3f,
+      "resizing keeps smooth images, error " + std::to_string(smooth_error));
+
+  // zero sizes keep the aspect ratio, and both zero is an error
+  auto same_size = [](const color_image& image, int width, int height) {
+    return image.width == width && image.height == height &&
+           image.pixels.size() == (size_t)width * height;
+  };
+  check(state,
+      same_size(resize_image(image, 32, 0), 32, 24) &&
+          same_size(resize_image(image, 0, 12), 16, 12) &&
+          same_size(resize_image(image, 0, 11), 15, 11) &&
+          same_size(resize_image(image, 100, 0), 100, 75),
+      "zero sizes keep the aspect ratio");
+  auto pixels = vector<vec4f>{};
+  resize_image(pixels, image.pixels, width, height, 0, 20);
+  check(state, pixels.size() == (size_t)27 * 20,
+      "zero sizes keep the aspect ratio for pixel arrays");
+  auto thrown = false;
+  try {
+    resize_image(image, 0, 0);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  check(state, thrown, "resizing to zero sizes throws");
+
+  // black and white checkers average to linear gray, not to srgb gray
+  auto checker = make_image(width, height, false);
+  auto bytes   = vector<vec4b>((size_t)width * height);
+  for (auto j = 0; j < height; j++) {
+    for (auto i = 0; i < width; i++) {
+      auto white = (i + j) % 2 == 1;
+      checker[{i, j}]      = white ? vec4f{1, 1, 1, 1} : vec4f{0, 0, 0, 1};
+      bytes[j * width + i] = white ? vec4b{255, 255, 255, 255}
+                                   : vec4b{0, 0, 0, 255};
+    }
+  }
+  auto gray      = rgb_to_srgb(0.5f);
+  auto ldr       = resize_image(checker, width / 2, height / 2,
+      resize_filter_type::box);
+  auto ldr_error = 0.0f;
+  for (auto& pixel : ldr.pixels) {
+    ldr_error = max(ldr_error, max(abs(xyz(pixel) - vec3f{gray, gray, gray})));
+  }
+  check(state, !ldr.linear && ldr_error < 1e-3f,
+      "ldr images are filtered in linear space, error " +
+          std::to_string(ldr_error));
+  auto resized = vector<vec4b>{};
+  resize_image(resized, bytes, width, height, width / 2, height / 2,
+      resize_filter_type::box);
+  auto byte_error = 0;
+  for (auto& pixel : resized) {
+    byte_error = max(
+        byte_error, std::abs((int)pixel.x - (int)float_to_byte(gray)));
+  }
+  check(state, resized.size() == ldr.pixels.size() && byte_error <= 1,
+      "byte images are filtered in linear space, error " +
+          std::to_string(byte_error));
+
+  // byte images match ldr images within a code
+  for (auto idx = 0; idx < (int)bytes.size(); idx++) {
+    bytes[idx]          = float_to_byte(noisy.pixels[idx]);
+    checker.pixels[idx] = byte_to_float(bytes[idx]);
+  }
+  auto match_error = 0;
+  for (auto size : sizes) {
+    auto expected = resize_image(checker, size.x, size.y);
+    resize_image(resized, bytes, width, height, size.x, size.y);
+    for (auto idx = 0; idx < (int)resized.size(); idx++) {
+      auto pixel = float_to_byte(expected.pixels[idx]);
+      for (auto c = 0; c < 4; c++) {
+        match_error = max(
+            match_error, std::abs((int)resized[idx][c] - (int)pixel[c]));
+      }
+    }
+  }
+  check(state, match_error <= 1,
+      "byte images match ldr images, error " + std::to_string(match_error));
+}
+
+// Batch color kernels match the scalar color functions within the bounds
+// documented in yocto_image.cpp, for sizes that are not multiples of the
+// batch, and keep alpha
+static void test_color_kernels(test_state& state) {
+  // channels sweep [0,1], then values up to the half range, and negatives
+  auto count  = 4099;
+  auto values = vector<float>((size_t)count * 3);
+  auto half   = (int)values.size() / 2;
+  for (auto idx : range((int)values.size())) {
+    values[idx] = idx < half ? idx / (float)(half - 1)
+                             : std::exp2((idx - half) * 15.99f / half);
+  }
+  values[1] = -0.5f;
+  values[2] = -0.01f;
+  auto hdr  = vector<vec4f>(count);
+  for (auto idx : range(count)) {
+    hdr[idx] = {values[idx * 3 + 0], values[idx * 3 + 1],
+        values[idx * 3 + 2], idx / (float)count};
+  }
+
+  // errors are absolute for values in [0,1], relative elsewhere
+  auto within = [](float value, float exact, float abs_bound,
+                    float rel_bound) {
+    if (exact >= 0 && exact <= 1) return std::abs(value - exact) <= abs_bound;
+    return std::abs(value - exact) <= rel_bound * std::abs(exact);
+  };
+  auto check_kernel = [&](const string& name, const vector<vec4f>& batch,
+                          auto&& scalar, float abs_bound, float rel_bound) {
+    auto ok = batch.size() == hdr.size();
+    for (auto idx = 0; ok && idx < count; idx++) {
+      auto exact = scalar(hdr[idx]);
+      for (auto c : range(3))
+        ok = ok && within(batch[idx][c], exact[c], abs_bound, rel_bound);
+      ok = ok && batch[idx].w == hdr[idx].w;
+    }
+    check(state, ok, name + " batch kernel matches the scalar one");
+  };
+
+  auto srgb = vector<vec4f>{}, rgb = vector<vec4f>{};
+  rgb_to_srgb(srgb, hdr);
+  check_kernel(
+      "rgb_to_srgb", srgb,
+      [](const vec4f& a) { return rgb_to_srgb(a); }, 2e-7f, 1e-6f);
+  srgb_to_rgb(rgb, hdr);
+  check_kernel(
+      "srgb_to_rgb", rgb,
+      [](const vec4f& a) { return srgb_to_rgb(a); }, 2e-7f, 2.5e-6f);
+  for (auto filmic : {false, true}) {
+    for (auto to_srgb : {false, true}) {
+      auto ldr = vector<vec4f>{};
+      tonemap_image(ldr, hdr, 0.5f, filmic, to_srgb);
+      check_kernel(
+          "tonemap", ldr,
+          [&](const vec4f& a) { return tonemap(a, 0.5f, filmic, to_srgb); },
+          1e-6f, 1e-6f);
+      auto ldr_mt = vector<vec4f>(count);
+      tonemap_image_mt(ldr_mt, hdr, 0.5f, filmic, to_srgb);
+      check(state, same_bytes(ldr, ldr_mt),
+          "multithreaded tonemap matches the serial one");
+    }
+  }
+
+  // bytes may differ only where the float result rounds differently
+  auto bytes = vector<vec4b>{};
+  tonemap_image(bytes, hdr, 0.5f, true, true);
+  auto byte_diff = 0;
+  for (auto idx : range(count)) {
+    auto exact = float_to_byte(tonemap(hdr[idx], 0.5f, true, true));
+    for (auto c : range(4))
+      byte_diff = max(byte_diff, std::abs((int)bytes[idx][c] - exact[c]));
+  }
+  check(state, byte_diff <= 1, "byte tonemap matches the scalar one");
+}
+
+// Color grading with a baked lookup table matches direct grading
+static void test_colorgrade_lut(test_state& state) {
+  auto params       = colorgrade_params{};
+  params.exposure   = 0.5f;
+  params.filmic     = true;
+  params.contrast   = 0.6f;
+  params.saturation = 0.6f;
+  params.midtones   = 0.45f;
+  for (auto linear : {true, false}) {
+    // color ramps, with a few colors outside the range of the table
+    auto image = make_image(64, 64, linear);
+    for (auto j = 0; j < image.height; j++) {
+      for (auto i = 0; i < image.width; i++) {
+        auto scale = linear ? 2.0f : 1.0f;
+        image.pixels[j * image.width + i] = {scale * i / (image.width - 1),
+            scale * j / (image.height - 1), (i * j % 7) / 6.0f, 1};
+      }
+    }
+    if (linear) image.pixels[0] = {8, 0.5f, 0.5f, 1};
+    auto direct = make_image(image.width, image.height, false);
+    auto graded = make_image(image.width, image.height, false);
+    colorgrade_image_mt(direct, image, params);
+    colorgrade_image_mt(graded, image, make_colorgrade_lut(params, linear));
+    auto error = 0.0f;
+    for (auto idx : range(image.pixels.size())) {
+      error = max(error, max(abs(direct.pixels[idx] - graded.pixels[idx])));
+    }
+    check(state, error < 1.0f / 255,
+        string{"lut grading matches direct grading for "} +
+            (linear ? "linear" : "srgb") + " images, error " +
+            std::to_string(error * 255) + " codes");
+  }
+}
+
+// Wide operations match the scalar ones in each lane. Built once with the
+// default storage and once with YOCTO_WIDE_SCALAR.
+static void test_wide_vectors(test_state& state) {
+  auto av = vector<float>{}, bv = vector<float>{};
+  for (auto lane = 0; lane < wide_lanes; lane++) {
+    av.push_back(lane - 3.5f);
+    bv.push_back(2 + lane * 0.25f);
+  }
+  auto a = load_float8(av.data()), b = load_float8(bv.data());
+  auto check_lanes = [&state](const float8& wide, auto&& func,
+                         const string& name) {
+    auto ok = true;
+    for (auto lane = 0; lane < wide_lanes; lane++) {
+      if (wide[lane] != func(lane)) ok = false;
+    }
+    check(state, ok, name + " matches the scalar lanes");
+  };
+  check_lanes(a + b, [&](int i) { return av[i] + bv[i]; }, "add");
+  check_lanes(a - b, [&](int i) { return av[i] - bv[i]; }, "sub");
+  check_lanes(a * b, [&](int i) { return av[i] * bv[i]; }, "mul");
+  check_lanes(a / b, [&](int i) { return av[i] / bv[i]; }, "div");
+  check_lanes(2 - a * 3, [&](int i) { return 2 - av[i] * 3; }, "scalar ops");
+  check_lanes(-a, [&](int i) { return -av[i]; }, "neg");
+  auto c = a;
+  c += b;
+  c *= 2;
+  check_lanes(c, [&](int i) { return (av[i] + bv[i]) * 2; }, "assignments");
+  check_lanes(abs(a), [&](int i) { return std::abs(av[i]); }, "abs");
+  check_lanes(min(a, b), [&](int i) { return min(av[i], bv[i]); }, "min");
+  check_lanes(max(a, 0.5f), [&](int i) { return max(av[i], 0.5f); }, "max");
+  check_lanes(clamp(a, -1.0f, 1.0f),
+      [&](int i) { return clamp(av[i], -1.0f, 1.0f); }, "clamp");
+  check_lanes(sqrt(b), [&](int i) { return std::sqrt(bv[i]); }, "sqrt");
+  check_lanes(floor(a), [&](int i) { return std::floor(av[i]); }, "floor");
+
+  // masks and selection
+  auto mask = a < 0.0f;
+  auto ok   = true;
+  for (auto lane = 0; lane < wide_lanes; lane++) {
+    if (mask[lane] != (av[lane] < 0)) ok = false;
+    if ((mask && b > 2.5f)[lane] != (av[lane] < 0 && bv[lane] > 2.5f))
+      ok = false;
+    if ((!mask || a == 0.5f)[lane] != (av[lane] >= 0 || av[lane] == 0.5f))
+      ok = false;
+  }
+  check(state, ok, "masks match the scalar comparisons");
+  check_lanes(select(mask, a, b),
+      [&](int i) { return av[i] < 0 ? av[i] : bv[i]; }, "select");
+  check(state, any(mask) && !all(mask), "any and all on mixed masks");
+  check(state, all(b > 0.0f) && !any(b < 0.0f), "any and all on uniform masks");
+
+  // partial loads and stores
+  auto partial = load_float8(av.data(), 3);
+  auto stored  = vector<float>(wide_lanes, -1);
+  store_float8(stored.data(), b, 5);
+  check_lanes(partial, [&](int i) { return i < 3 ? av[i] : 0.0f; },
+      "partial load");
+  check(state, stored[4] == bv[4] && stored[5] == -1,
+      "partial store writes only the given lanes");
+
+  // vectors, compared to scalar results up to rounding
+  auto points = vector<vec3f>{};
+  for (auto idx = 0; idx < 13; idx++) {
+    points.push_back({idx * 0.5f - 2, 1 - idx * 0.25f, idx * 0.125f + 0.5f});
+  }
+  auto frame = frame3f{{0, 0, 1}, {1, 0, 0}, {0, 1, 0}, {1, 2, 3}};
+  auto wide  = to_wide(points);
+  for (auto& p : wide) p = normalize(transform_point(frame, p) + cross(p, p));
+  auto result = from_wide(wide, points.size());
+  auto error  = 0.0f;
+  for (auto idx : range(points.size())) {
+    auto expected = normalize(transform_point(frame, points[idx]));
+    error         = max(error, max(abs(result[idx] - expected)));
+  }
+  check(state, result.size() == points.size() && error < 1e-6f,
+      "vector operations match the scalar ones");
+}
+
+// Parallel partitions are stable, evaluate the predicate once per value, and
+// run serially when nested in parallel loops
+static void test_parallel_partition(test_state& state) {
+  auto num       = 1 << 17;
+  auto selected  = [num](int value) { return (value * 7919) % num % 3 == 0; };
+  auto partition = [&](atomic<int>& calls, bool& stable) {
+    auto values = vector<int>(num);
+    for (auto idx : range(num)) values[idx] = idx;
+    auto mid = parallel_partition(values, 0, values.size(), [&](int value) {
+      calls += 1;
+      return selected(value);
+    });
+    stable = mid == (size_t)(num + 2) / 3;
+    for (auto idx : range(num)) {
+      if (selected(values[idx]) != ((size_t)idx < mid)) stable = false;
+      if ((size_t)idx + 1 != mid && idx + 1 < num &&
+          values[idx] >= values[idx + 1])
+        stable = false;
+    }
+  };
+  auto calls  = atomic<int>{0};
+  auto stable = false;
+  partition(calls, stable);
+  check(state, stable, "parallel partition is stable");
+  check(state, calls == num, "parallel partition evaluates once per value");
+  auto nested_calls  = atomic<int>{0};
+  auto nested_flags = vector<int>(4, 0);
+  parallel_for(4, [&](int idx) {
+    auto region = parallel_region;
+    auto result = false;
+    partition(nested_calls, result);
+    nested_flags[idx] = region && result ? 1 : 0;
+  });
+  check(state, nested_flags == vector<int>(4, 1),
+      "nested parallel partitions are stable and serial");
+  check(state, nested_calls == num * 4,
+      "nested parallel partitions evaluate once per value");
+  check(state, !parallel_region, "parallel region ends with the loop");
+}
+
+// Parallel algorithms match serial ones for sizes around block boundaries,
+// with and without threads
+static void test_parallel_algorithms(test_state& state) {
+  auto nums = vector<size_t>{0, 1, 4095, 4096, 4097, 65536, 200003};
+  for (auto num : nums) {
+    auto values = vector<uint32_t>(num);
+    for (auto idx : range(num)) values[idx] = (uint32_t)(idx * 2654435761u);
+    auto suffix = " for " + std::to_string(num) + " values";
+
+    auto sum = (uint64_t)0;
+    for (auto value : values) sum += value >> 8;
+    for (auto noparallel : {false, true}) {
+      auto reduced = parallel_reduce(
+          num, (uint64_t)0, [&](size_t idx) { return values[idx] >> 8; },
+          [](uint64_t a, uint64_t b) { return a + b; }, noparallel);
+      check(state, reduced == sum, "parallel reduce" + suffix);
+    }
+
+    auto scanned = vector<uint64_t>(values.begin(), values.end());
+    auto partial = scanned;
+    std::partial_sum(partial.begin(), partial.end(), partial.begin());
+    parallel_inclusive_scan(
+        scanned, [](uint64_t a, uint64_t b) { return a + b; });
+    check(state, scanned == partial, "parallel inclusive scan" + suffix);
+
+    // keys with few bits test stability and skipped digits
+    auto key    = [](uint32_t value) { return (value >> 4) & 0xff00u; };
+    auto sorted = values;
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+    for (auto noparallel : {false, true}) {
+      auto radix = values;
+      parallel_sort(radix, key, noparallel);
+      check(state, radix == sorted, "parallel sort" + suffix);
+    }
+  }
+
+  // nested loops run on the worker, visiting all indices once
+  auto visits = vector<atomic<int>>(4 * 1000);
+  auto serial = atomic<bool>{true};
+  parallel_for(4, [&](int outer) {
+    auto thread = std::this_thread::get_id();
+    parallel_for(1000, [&](int inner) {
+      if (std::this_thread::get_id() != thread) serial = false;
+      visits[outer * 1000 + inner] += 1;
+    });
+  });
+  auto once = std::all_of(visits.begin(), visits.end(),
+      [](const atomic<int>& count) { return count == 1; });
+  check(state, once, "nested parallel for visits all indices once");
+  check(state, serial, "nested parallel for runs on the calling worker");
+}
+
+// Batch noise matches the scalar noise in every lane, for point counts that
+// are not multiples of the lanes, negative coordinates and wrapping
+static void test_perlin_lanes(test_state& state) {
+  auto points = vector<vec3f>(1003);
+  auto rng    = make_rng(7);
+  for (auto& point : points) point = (rand3f(rng) * 2 - 1) * 300;
+  for (auto wrap : {vec3i{0, 0, 0}, vec3i{16, 32, 8}}) {
+    auto suffix     = wrap == zero3i ? "" : " with wrap";
+    auto check_noise = [&](const string& name, const vector<float>& batch,
+                         auto&& scalar) {
+      auto error = 0.0f;
+      for (auto idx : range(points.size()))
+        error = max(error, std::abs(batch[idx] - scalar(points[idx])));
+      check(state, batch.size() == points.size() && error <= 1e-6f,
+          name + suffix + " lanes match the scalar noise");
+    };
+    auto noise = vector<float>{};
+    perlin_noise(noise, points, wrap);
+    check_noise("perlin_noise", noise,
+        [&](const vec3f& p) { return perlin_noise(p, wrap); });
+    perlin_ridge(noise, points, 2, 0.5f, 6, 1, wrap);
+    check_noise("perlin_ridge", noise,
+        [&](const vec3f& p) { return perlin_ridge(p, 2, 0.5f, 6, 1, wrap); });
+    perlin_fbm(noise, points, 2, 0.5f, 6, wrap);
+    check_noise("perlin_fbm", noise,
+        [&](const vec3f& p) { return perlin_fbm(p, 2, 0.5f, 6, wrap); });
+    perlin_turbulence(noise, points, 2, 0.5f, 6, wrap);
+    check_noise("perlin_turbulence", noise, [&](const vec3f& p) {
+      return perlin_turbulence(p, 2, 0.5f, 6, wrap);
+    });
+  }
+}
+
+// Arguments in [0,1)^2 for math functions, from a low-discrepancy sequence
+static vector<vec2f> make_math_args(int count) {
+  auto args = vector<vec2f>(count);
+  for (auto idx : range(count)) {
+    args[idx] = {(float)std::fmod(idx * 0.6180339887498949 + 0.5, 1.0),
+        (float)std::fmod(idx * 0.4142135623730950 + 0.5, 1.0)};
+  }
+  return args;
+}
+
+// Fast approximate math stays within the error bounds documented in
+// yocto_math.h, measured against double precision, and matches the standard
+// library for special values
+static void test_approx_math(test_state& state) {
+  auto args       = make_math_args(1 << 18);
+  auto check_math = [&](const string& name, float bound, auto&& approx_func,
+                        auto&& exact_func, auto&& scale_func) {
+    auto error = 0.0;
+    for (auto& uv : args) {
+      auto exact = exact_func(uv);
+      auto scale = scale_func(uv, exact);
+      error      = std::max(error, std::abs(approx_func(uv) - exact) / scale);
+    }
+    check(state, error <= bound,
+        name + " error " + std::to_string(error * 1e9) + " ppb within bound");
+  };
+  auto absolute = [](const vec2f&, double) { return 1.0; };
+  auto relative = [](const vec2f&, double exact) { return std::abs(exact); };
+  check_math(
+      "sincos", 1.6e-7f,
+      [](const vec2f& uv) {
+        auto [s, c] = approx_sincos((uv.x * 2 - 1) * 8 * pif);
+        return s + c;
+      },
+      [](const vec2f& uv) {
+        auto a = (double)((uv.x * 2 - 1) * 8 * pif);
+        return std::sin(a) + std::cos(a);
+      },
+      absolute);
+  check_math(
+      "atan", 1.5e-7f,
+      [](const vec2f& uv) { return approx_atan((uv.x * 2 - 1) * 16); },
+      [](const vec2f& uv) { return std::atan((double)((uv.x * 2 - 1) * 16)); },
+      absolute);
+  check_math(
+      "atan2", 3e-7f,
+      [](const vec2f& uv) { return approx_atan2(uv.y * 2 - 1, uv.x * 2 - 1); },
+      [](const vec2f& uv) {
+        return std::atan2((double)(uv.y * 2 - 1), (double)(uv.x * 2 - 1));
+      },
+      absolute);
+  check_math(
+      "acos", 5e-7f, [](const vec2f& uv) { return approx_acos(uv.x * 2 - 1); },
+      [](const vec2f& uv) { return std::acos((double)(uv.x * 2 - 1)); },
+      absolute);
+  check_math(
+      "exp", 1e-7f, [](const vec2f& uv) { return approx_exp(-uv.x * 16); },
+      [](const vec2f& uv) { return std::exp((double)(-uv.x * 16)); },
+      relative);
+  check_math(
+      "log", 1e-7f, [](const vec2f& uv) { return approx_log(uv.x * 16); },
+      [](const vec2f& uv) { return std::log((double)(uv.x * 16)); },
+      [](const vec2f&, double exact) {
+        return std::max(1.0, std::abs(exact));
+      });
+  check_math(
+      "pow", 1.2e-7f,
+      [](const vec2f& uv) { return approx_pow(uv.x + 0.0625f, uv.y * 8); },
+      [](const vec2f& uv) {
+        return std::pow((double)(uv.x + 0.0625f), (double)(uv.y * 8));
+      },
+      [](const vec2f& uv, double exact) {
+        return std::abs(exact) *
+               (1 + std::abs(uv.y * 8 * std::log((double)(uv.x + 0.0625f))));
+      });
+
+  // special values, compared with their signs and up to the error bounds
+  auto same = [](float a, float b) {
+    if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b);
+    if (std::signbit(a) != std::signbit(b)) return false;
+    return a == b || std::abs(a - b) <= 1e-6f;
+  };
+  auto inf      = std::numeric_limits<float>::infinity();
+  auto nan      = std::numeric_limits<float>::quiet_NaN();
+  auto specials = vector<float>{0.0f, -0.0f, 1, -1, 2, -2, inf, -inf, nan};
+  auto ok       = true;
+  for (auto a : specials) {
+    if (!same(approx_sin(a), std::sin(a))) ok = false;
+    if (!same(approx_cos(a), std::cos(a))) ok = false;
+    if (!same(approx_atan(a), std::atan(a))) ok = false;
+    if (!same(approx_acos(a), std::acos(a))) ok = false;
+    if (!same(approx_exp(a), std::exp(a))) ok = false;
+    if (!same(approx_log(a), std::log(a))) ok = false;
+    for (auto b : specials) {
+      if (!same(approx_atan2(a, b), std::atan2(a, b))) ok = false;
+      if (!same(approx_pow(a, b), std::pow(a, b))) ok = false;
+    }
+  }
+  check(state, ok, "special values match the standard library");
+  check(state, approx_atan2(inf, inf) == std::atan2(inf, inf),
+      "atan2 of infinities");
+  check(state, approx_atan2(-0.0f, -1) == -pif, "atan2 of negative zero");
+}
+
+// app params
+struct app_params {
+  string name = "";
+};
+
+// run tests
+int run_tests(const app_params& params) {
+  auto tests = vector<pair<string, void (*)(test_state&)>>{
+      {"overlap_triangles", test_overlap_triangles},
+      {"bvh_spatial", test_bvh_spatial},
+      {"overlap_queries", test_overlap_queries},
+      {"sobol", test_sobol},
+      {"trace_timebudget", test_trace_timebudget},
+      {"trace_adaptive", test_trace_adaptive},
+      {"trace_merge", test_trace_merge},
+      {"trace_checkpoint", test_trace_checkpoint},
+      {"trace_counterrng", test_trace_counterrng},
+      {"trace_accumulation", test_trace_accumulation},
+      {"trace_session", test_trace_session},
+      {"update_lights", test_update_lights},
+      {"colorgrade_lut", test_colorgrade_lut},
+      {"denoise_image", test_denoise_image},
+      {"resize_image", test_resize_image},
+      {"color_kernels", test_color_kernels},
+      {"parallel_partition", test_parallel_partition},
+      {"parallel_algorithms", test_parallel_algorithms},
+      {"approx_math", test_approx_math},
+      {"perlin_lanes", test_perlin_lanes},
+      {"wide_vectors", test_wide_vectors},
+  };
+  auto state = test_state{};
+  auto found = false;
+  for (auto& [name, test] : tests) {
+    if (!params.name.empty() && params.name != name) continue;
+    found         = true;
+    auto failures = state.failures;
+    test(state);
+    print_info(name + ": " + (state.failures == failures ? "ok" : "failed"));
+  }
+  if (!found) return print_fatal("unknown test " + params.name);
+  print_info(std::to_string(state.checks) + " checks, " +
+             std::to_string(state.failures) + " failures");
+  if (state.failures != 0) return print_fatal("tests failed");
+  return 0;
+}
+
+// Cli
+void parse_cli(app_params& params, int argc, const char** argv) {
+  auto cli = make_cli("ytest", "Test Yocto/GL.");
+  add_option(cli, "name", params.name, "Run only the named test.");
+  parse_cli(cli, argc, argv);
+}
+
+int main(int argc, const char* argv[]) {
+  // command line parameters
+  auto params = app_params{};
+  parse_cli(params, argc, argv);
+
+  // run tests
+  return run_tests(params);
+}
@@ -298,6 +298,27 @@ static bool intersect_embree_bvh(const bvh_scene& bvh, const scene_model& scene,
 // -----------------------------------------------------------------------------
 namespace yocto {
 
+// Computes the bounds of the primitive centers in [start, end).
+static bbox3f compute_centers_bbox(const vector<int>& primitives,
+    const vector<vec3f>& centers, int start, int end) {
+  return parallel_reduce(
+      end - start, invalidb3f,
+      [&](int idx) {
+        auto& center = centers[primitives[start + idx]];
+        return bbox3f{center, center};
+      },
+      [](const bbox3f& a, const bbox3f& b) { return merge(a, b); });
+}
+
+// Computes the bounds of the primitives in [start, end).
+static bbox3f compute_primitives_bbox(const vector<int>& primitives,
+    const vector<bbox3f>& bboxes, int start, int end) {
+  return parallel_reduce(
+      end - start, invalidb3f,
+      [&](int idx) { return bboxes[primitives[start + idx]]; },
+      [](const bbox3f& a, const bbox3f& b) { return merge(a, b); });
+}
+
 // Splits a BVH node using the SAH heuristic. Returns split position and axis.
 static pair<int, int> split_sah(vector<int>& primitives,
     const vector<bbox3f>& bboxes, const vector<vec3f>& centers, int start,
@@ -307,9 +328,7 @@ static pair<int, int> split_sah(vector<int>& primitives,
   auto mid        = (start + end) / 2;
 
   // compute primintive bounds and size
-  auto cbbox = invalidb3f;
-  for (auto i = start; i < end; i++)
-    cbbox = merge(cbbox, centers[primitives[i]]);
+  auto cbbox = compute_centers_bbox(primitives, centers, start, end);
   auto csize = cbbox.max - cbbox.min;
   if (csize == zero3f) return {mid, split_axis};
 
@@ -346,10 +365,10 @@ static pair<int, int> split_sah(vector<int>& primitives,
     }
   }
   // split
-  mid = (int)(std::partition(primitives.data() + start, primitives.data() + end,
-                  [split_axis, middle, &centers](
-                      auto a) { return centers[a][split_axis] < middle; }) -
-              primitives.data());
+  mid = (int)parallel_partition(
+      primitives, start, end, [split_axis, middle, &centers](int a) {
+        return centers[a][split_axis] < middle;
+      });
 
   // if we were not able to split, just break the primitives in half
   if (mid == start || mid == end) {
@@ -371,9 +390,7 @@ static pair<int, int> split_sah(vector<int>& primitives,
   auto mid  = (start + end) / 2;
 
   // compute primintive bounds and size
-  auto cbbox = invalidb3f;
-  for (auto i = start; i < end; i++)
-    cbbox = merge(cbbox, centers[primitives[i]]);
+  auto cbbox = compute_centers_bbox(primitives, centers, start, end);
   auto csize = cbbox.max - cbbox.min;
   if (csize == zero3f) return {mid, axis};
 
@@ -410,9 +427,7 @@ static pair<int, int> split_middle(vector<int>& primitives,
   auto mid  = (start + end) / 2;
 
   // compute primintive bounds and size
-  auto cbbox = invalidb3f;
-  for (auto i = start; i < end; i++)
-    cbbox = merge(cbbox, centers[primitives[i]]);
+  auto cbbox = compute_centers_bbox(primitives, centers, start, end);
   auto csize = cbbox.max - cbbox.min;
   if (csize == zero3f) return {mid, axis};
 
@@ -424,10 +439,8 @@ static pair<int, int> split_middle(vector<int>& primitives,
   // split the space in the middle along the largest axis
   auto cmiddle = (cbbox.max + cbbox.min) / 2;
   auto middle  = cmiddle[axis];
-  mid = (int)(std::partition(primitives.data() + start, primitives.data() + end,
-                  [axis, middle, &centers](
-                      auto a) { return centers[a][axis] < middle; }) -
-              primitives.data());
+  mid = (int)parallel_partition(primitives, start, end,
+      [axis, middle, &centers](int a) { return centers[a][axis] < middle; });
 
   // if we were not able to split, just break the primitives in half
   if (mid == start || mid == end) {
@@ -477,9 +490,7 @@ static void build_bvh_serial(
     auto& node = nodes[nodeid];
 
     // compute bounds
-    node.bbox = invalidb3f;
-    for (auto i = start; i < end; i++)
-      node.bbox = merge(node.bbox, bboxes[primitives[i]]);
+    node.bbox = compute_primitives_bbox(primitives, bboxes, start, end);
 
     // split into two children
     if (end - start > bvh_max_prims) {
@@ -509,6 +520,402 @@ static void build_bvh_serial(
   nodes.shrink_to_fit();
 }
 
+// Primitive reference used by the spatial split builder. References store
+// the bounds of the part of the primitive that lies within a node, so that
+// the same primitive can be referenced by more than one leaf.
+struct bvh_reference {
+  int    primitive = -1;
+  bbox3f bbox      = invalidb3f;
+};
+
+// Surface area of a bounding box. Empty boxes have zero area.
+static float bvh_area(const bbox3f& bbox) {
+  auto size = bbox.max - bbox.min;
+  if (size.x < 0 || size.y < 0 || size.z < 0) return 0;
+  return 2 * size.x * size.y + 2 * size.x * size.z + 2 * size.y * size.z;
+}
+
+// Intersection of two bounding boxes.
+static bbox3f bvh_intersect(const bbox3f& a, const bbox3f& b) {
+  return {max(a.min, b.min), min(a.max, b.max)};
+}
+
+// Check whether a bounding box is empty.
+static bool bvh_empty(const bbox3f& bbox) {
+  return bbox.min.x > bbox.max.x || bbox.min.y > bbox.max.y ||
+         bbox.min.z > bbox.max.z;
+}
+
+// Splits a bounding box with an axis aligned plane. Used for primitives whose
+// geometry cannot be clipped more tightly than their bounds.
+static pair<bbox3f, bbox3f> split_bbox(
+    const bbox3f& bbox, int axis, float split) {
+  auto left = bbox, right = bbox;
+  left.max[axis]  = min(left.max[axis], split);
+  right.min[axis] = max(right.min[axis], split);
+  return {left, right};
+}
+
+// Splits a polygon with an axis aligned plane, returning the bounds of the
+// two parts clipped against the reference bounds.
+static pair<bbox3f, bbox3f> split_polygon(const bbox3f& bbox,
+    const vec3f* vertices, int num, int axis, float split) {
+  auto left = invalidb3f, right = invalidb3f;
+  for (auto idx = 0; idx < num; idx++) {
+    auto& v0 = vertices[idx];
+    auto& v1 = vertices[(idx + 1) % num];
+    if (v0[axis] <= split) left = merge(left, v0);
+    if (v0[axis] >= split) right = merge(right, v0);
+    if ((v0[axis] < split && v1[axis] > split) ||
+        (v0[axis] > split && v1[axis] < split)) {
+      auto t  = clamp((split - v0[axis]) / (v1[axis] - v0[axis]), 0.0f, 1.0f);
+      auto p     = lerp(v0, v1, t);
+      p[axis]    = split;
+      left       = merge(left, p);
+      right      = merge(right, p);
+    }
+  }
+  return {bvh_intersect(left, bbox), bvh_intersect(right, bbox)};
+}
+
+// Splits a line of radius up to `radius` with an axis aligned plane,
+// returning the bounds of the two parts clipped against the reference bounds.
+// The segment is clipped against planes offset by the radius, since the
+// geometry on one side of the plane may come from segment points on the other.
+static pair<bbox3f, bbox3f> split_line(const bbox3f& bbox, const vec3f& p0,
+    const vec3f& p1, float radius, int axis, float split) {
+  auto clip_line = [&](float plane, bool below) {
+    auto d0 = p0[axis] - plane, d1 = p1[axis] - plane;
+    if (below) d0 = -d0, d1 = -d1;
+    if (d0 < 0 && d1 < 0) return invalidb3f;
+    auto a = p0, b = p1;
+    if (d0 < 0) a = lerp(p0, p1, d0 / (d0 - d1));
+    if (d1 < 0) b = lerp(p0, p1, d0 / (d0 - d1));
+    return line_bounds(a, b, radius, radius);
+  };
+  auto left = clip_line(split + radius, true);
+  if (!bvh_empty(left)) left.max[axis] = min(left.max[axis], split);
+  auto right = clip_line(split - radius, false);
+  if (!bvh_empty(right)) right.min[axis] = max(right.min[axis], split);
+  return {bvh_intersect(left, bbox), bvh_intersect(right, bbox)};
+}
+
+// Number of bins used for binned SAH and spatial splits, and their number
+// for high quality builds.
+const int bvh_nbins             = 16;
+const int bvh_nbins_highquality = 32;
+
+// Minimum overlap, relative to the root area, of the object split children
+// before a spatial split is attempted.
+const float bvh_spatial_overlap = 1e-5f;
+
+// Maximum depth for spatial splits to bound the traversal stack.
+const int bvh_spatial_depth = 48;
+
+// Depth at which spatial split subtrees are built in parallel.
+const int bvh_spatial_parallel_depth = 6;
+
+// Node to build with spatial splits, as node index, depth and references.
+struct bvh_spatial_item {
+  int                   nodeid     = 0;
+  int                   depth      = 0;
+  vector<bvh_reference> references = {};
+};
+
+// Build BVH nodes from `root` using both object and spatial splits, adding
+// at most `budget` duplicated references. Nodes at `defer_depth` are not
+// built, but appended to `deferred`. Returns the number of duplicated
+// references.
+template <typename Split>
+static size_t build_bvh_spatial_nodes(bvh_tree& bvh, bvh_spatial_item&& root,
+    size_t budget, float root_area, int nbins, int defer_depth,
+    vector<bvh_spatial_item>& deferred, Split&& split_reference) {
+  // get values
+  auto& nodes      = bvh.nodes;
+  auto& primitives = bvh.primitives;
+
+  // duplicated references
+  auto duplicated = (size_t)0;
+
+  // bins used for split evaluation
+  struct bin_data {
+    bbox3f bbox    = invalidb3f;
+    int    entries = 0;
+    int    exits   = 0;
+  };
+  auto bins         = array<bin_data, bvh_nbins_highquality>{};
+  auto right_bboxes = array<bbox3f, bvh_nbins_highquality>{};
+
+  // node to work on
+  auto stack = vector<bvh_spatial_item>{};
+  stack.push_back(std::move(root));
+
+  // create nodes until the stack is empty
+  while (!stack.empty()) {
+    // grab node to work on
+    auto item = std::move(stack.back());
+    stack.pop_back();
+    auto& refs = item.references;
+
+    // defer node
+    if (item.depth == defer_depth) {
+      deferred.push_back(std::move(item));
+      continue;
+    }
+
+    // compute bounds
+    auto bbox = invalidb3f, cbbox = invalidb3f;
+    for (auto& ref : refs) {
+      bbox  = merge(bbox, ref.bbox);
+      cbbox = merge(cbbox, center(ref.bbox));
+    }
+    nodes[item.nodeid].bbox = bbox;
+
+    // make a leaf node
+    if (refs.size() <= bvh_max_prims) {
+      auto& node    = nodes[item.nodeid];
+      node.internal = false;
+      node.num      = (int16_t)refs.size();
+      node.start    = (int)primitives.size();
+      for (auto& ref : refs) primitives.push_back(ref.primitive);
+      continue;
+    }
+
+    // object split: binned SAH over reference centers
+    auto object_cost = flt_max, object_split = 0.0f;
+    auto object_axis = -1;
+    auto left_bbox = invalidb3f, right_bbox = invalidb3f;
+    auto csize = cbbox.max - cbbox.min;
+    for (auto axis = 0; axis < 3; axis++) {
+      if (csize[axis] <= 0) continue;
+      bins.fill({});
+      for (auto& ref : refs) {
+        auto b = clamp(
+            (int)(nbins * (center(ref.bbox)[axis] - cbbox.min[axis]) /
+                  csize[axis]),
+            0, nbins - 1);
+        bins[b].bbox = merge(bins[b].bbox, ref.bbox);
+        bins[b].entries += 1;
+      }
+      auto right = invalidb3f;
+      for (auto b = nbins - 1; b > 0; b--) {
+        right           = merge(right, bins[b].bbox);
+        right_bboxes[b] = right;
+      }
+      auto left = invalidb3f;
+      auto nleft = 0, nright = (int)refs.size();
+      for (auto b = 1; b < nbins; b++) {
+        left = merge(left, bins[b - 1].bbox);
+        nleft += bins[b - 1].entries;
+        nright -= bins[b - 1].entries;
+        if (nleft == 0 || nright == 0) continue;
+        auto cost = nleft * bvh_area(left) + nright * bvh_area(right_bboxes[b]);
+        if (cost < object_cost) {
+          object_cost  = cost;
+          object_axis  = axis;
+          object_split = cbbox.min[axis] + b * csize[axis] / nbins;
+          left_bbox    = left;
+          right_bbox   = right_bboxes[b];
+        }
+      }
+    }
+
+    // spatial split: binned SAH over clipped references, attempted only if
+    // the object split children overlap significantly
+    auto spatial_cost = flt_max, spatial_split = 0.0f;
+    auto spatial_axis = -1;
+    auto overlap      = bvh_area(bvh_intersect(left_bbox, right_bbox));
+    if (duplicated < budget && item.depth < bvh_spatial_depth &&
+        (object_axis < 0 || overlap / root_area > bvh_spatial_overlap)) {
+      auto size = bbox.max - bbox.min;
+      for (auto axis = 0; axis < 3; axis++) {
+        if (size[axis] <= 0) continue;
+        bins.fill({});
+        auto bin_width = size[axis] / nbins;
+        auto bin_index = [&](float value) {
+          return clamp(
+              (int)((value - bbox.min[axis]) / bin_width), 0, nbins - 1);
+        };
+        for (auto& ref : refs) {
+          auto first = bin_index(ref.bbox.min[axis]);
+          auto last  = bin_index(ref.bbox.max[axis]);
+          auto rest  = ref;
+          for (auto b = first; b < last; b++) {
+            auto plane = bbox.min[axis] + (b + 1) * bin_width;
+            auto [left, right] = split_reference(rest, axis, plane);
+            bins[b].bbox = merge(bins[b].bbox, left);
+            rest.bbox    = right;
+          }
+          bins[last].bbox = merge(bins[last].bbox, rest.bbox);
+          bins[first].entries += 1;
+          bins[last].exits += 1;
+        }
+        auto right = invalidb3f;
+        for (auto b = nbins - 1; b > 0; b--) {
+          right           = merge(right, bins[b].bbox);
+          right_bboxes[b] = right;
+        }
+        auto left  = invalidb3f;
+        auto nleft = 0, nright = (int)refs.size();
+        for (auto b = 1; b < nbins; b++) {
+          left = merge(left, bins[b - 1].bbox);
+          nleft += bins[b - 1].entries;
+          nright -= bins[b - 1].exits;
+          if (nleft == 0 || nright == 0) continue;
+          auto cost = nleft * bvh_area(left) +
+                      nright * bvh_area(right_bboxes[b]);
+          if (cost < spatial_cost) {
+            spatial_cost  = cost;
+            spatial_axis  = axis;
+            spatial_split = bbox.min[axis] + b * bin_width;
+          }
+        }
+      }
+    }
+
+    // partition references
+    auto left_refs  = vector<bvh_reference>{};
+    auto right_refs = vector<bvh_reference>{};
+    auto axis       = 0;
+    if (spatial_axis >= 0 && spatial_cost < object_cost) {
+      axis = spatial_axis;
+      for (auto& ref : refs) {
+        if (ref.bbox.max[axis] <= spatial_split) {
+          left_refs.push_back(ref);
+        } else if (ref.bbox.min[axis] >= spatial_split) {
+          right_refs.push_back(ref);
+        } else {
+          auto [left, right] = split_reference(ref, axis, spatial_split);
+          auto left_empty = bvh_empty(left), right_empty = bvh_empty(right);
+          if (!left_empty) left_refs.push_back({ref.primitive, left});
+          if (!right_empty) right_refs.push_back({ref.primitive, right});
+          if (!left_empty && !right_empty) duplicated += 1;
+        }
+      }
+    } else if (object_axis >= 0) {
+      axis = object_axis;
+      for (auto& ref : refs) {
+        if (center(ref.bbox)[axis] < object_split) {
+          left_refs.push_back(ref);
+        } else {
+          right_refs.push_back(ref);
+        }
+      }
+    }
+
+    // if we were not able to split, break the references in half
+    if (left_refs.empty() || right_refs.empty() ||
+        left_refs.size() == refs.size() || right_refs.size() == refs.size()) {
+      // split along largest
+      axis = 0;
+      if (csize.y >= csize.x && csize.y >= csize.z) axis = 1;
+      if (csize.z >= csize.x && csize.z >= csize.y) axis = 2;
+      auto mid = refs.size() / 2;
+      std::nth_element(refs.begin(), refs.begin() + mid, refs.end(),
+          [axis](const bvh_reference& a, const bvh_reference& b) {
+            return center(a.bbox)[axis] < center(b.bbox)[axis];
+          });
+      left_refs.assign(refs.begin(), refs.begin() + mid);
+      right_refs.assign(refs.begin() + mid, refs.end());
+    }
+    refs.clear();
+    refs.shrink_to_fit();
+
+    // make an internal node
+    auto start                  = (int)nodes.size();
+    nodes[item.nodeid].internal = true;
+    nodes[item.nodeid].axis     = (int8_t)axis;
+    nodes[item.nodeid].num      = 2;
+    nodes[item.nodeid].start    = start;
+    nodes.emplace_back();
+    nodes.emplace_back();
+    stack.push_back({start + 1, item.depth + 1, std::move(right_refs)});
+    stack.push_back({start + 0, item.depth + 1, std::move(left_refs)});
+  }
+
+  return duplicated;
+}
+
+// Build BVH nodes using both object and spatial splits (SBVH). Spatial splits
+// clip primitive references against the split planes using `split_reference`,
+// so long and thin primitives can be separated even if their bounds overlap.
+// The number of duplicated references is bounded by `budget` times the
+// number of primitives. The top of the tree is built serially, and the
+// subtrees below it in parallel, each with a share of the remaining budget
+// proportional to its references, so the tree does not depend on threading.
+template <typename Split>
+static void build_bvh_spatial(bvh_tree& bvh, const vector<bbox3f>& bboxes,
+    bool highquality, float budget, bool noparallel, Split&& split_reference) {
+  // get values
+  auto& nodes      = bvh.nodes;
+  auto& primitives = bvh.primitives;
+
+  // prepare to build nodes
+  nodes.clear();
+  nodes.reserve(bboxes.size() * 2);
+  primitives.clear();
+  primitives.reserve(bboxes.size());
+
+  // prepare references
+  auto references = vector<bvh_reference>(bboxes.size());
+  auto root_bbox  = invalidb3f;
+  for (auto idx = 0; idx < (int)bboxes.size(); idx++) {
+    references[idx] = {idx, bboxes[idx]};
+    root_bbox       = merge(root_bbox, bboxes[idx]);
+  }
+  auto root_area  = max(bvh_area(root_bbox), 1e-12f);
+  auto max_budget = (size_t)(bboxes.size() * max(budget, 0.0f));
+  auto nbins      = highquality ? bvh_nbins_highquality : bvh_nbins;
+
+  // build the top of the tree
+  auto subtrees = vector<bvh_spatial_item>{};
+  nodes.emplace_back();
+  auto duplicated = build_bvh_spatial_nodes(bvh, {0, 0, std::move(references)},
+      max_budget, root_area, nbins, bvh_spatial_parallel_depth, subtrees,
+      split_reference);
+
+  // build subtrees
+  auto remaining   = max_budget - min(duplicated, max_budget);
+  auto subtree_refs = (size_t)0;
+  for (auto& subtree : subtrees) subtree_refs += subtree.references.size();
+  auto trees        = vector<bvh_tree>(subtrees.size());
+  auto build_subtree = [&](size_t idx) {
+    auto& subtree = subtrees[idx];
+    auto  share   = (size_t)((double)remaining * subtree.references.size() /
+                          max(subtree_refs, (size_t)1));
+    auto  unused  = vector<bvh_spatial_item>{};
+    trees[idx].nodes.emplace_back();
+    build_bvh_spatial_nodes(trees[idx],
+        {0, subtree.depth, std::move(subtree.references)}, share, root_area,
+        nbins, -1, unused, split_reference);
+  };
+  if (noparallel) {
+    for (auto idx = (size_t)0; idx < subtrees.size(); idx++)
+      build_subtree(idx);
+  } else {
+    parallel_for(subtrees.size(), build_subtree);
+  }
+
+  // merge subtrees, with their roots in place of the deferred nodes
+  for (auto idx = (size_t)0; idx < subtrees.size(); idx++) {
+    auto& tree        = trees[idx];
+    auto  node_offset = (int)nodes.size() - 1;
+    auto  prim_offset = (int)primitives.size();
+    for (auto& node : tree.nodes) {
+      node.start += node.internal ? node_offset : prim_offset;
+    }
+    nodes[subtrees[idx].nodeid] = tree.nodes[0];
+    nodes.insert(nodes.end(), tree.nodes.begin() + 1, tree.nodes.end());
+    primitives.insert(
+        primitives.end(), tree.primitives.begin(), tree.primitives.end());
+    tree = {};
+  }
+
+  // cleanup
+  nodes.shrink_to_fit();
+  primitives.shrink_to_fit();
+}
+
 #if 0
 
 // Build BVH nodes
@@ -539,7 +946,7 @@ static void build_bvh_parallel(
   atomic<int>          num_processed_prims(0);
   std::mutex           queue_mutex;
   vector<future<void>> futures;
-  auto                 nthreads = std::thread::hardware_concurrency();
+  auto                 nthreads = get_parallel_threads();
 
   // create nodes until the queue is empty
   for (auto thread_id = 0; thread_id < nthreads; thread_id++) {
@@ -629,8 +1036,8 @@ static void refit_bvh(bvh_tree& bvh, const vector<bbox3f>& bboxes) {
   }
 }
 
-static void build_bvh(
-    bvh_shape& bvh, const scene_shape& shape, bool highquality, bool embree) {
+static void build_bvh(bvh_shape& bvh, const scene_shape& shape,
+    bool highquality, bool embree, float spatial_budget, bool noparallel) {
 #ifdef YOCTO_EMBREE
   if (embree) {
     return build_embree_bvh(bvh, shape, highquality);
@@ -668,6 +1075,45 @@ static void build_bvh(
     }
   }
 
+  // build nodes with spatial splits
+  if (spatial_budget > 0) {
+    if (!shape.lines.empty()) {
+      return build_bvh_spatial(bvh.bvh, bboxes, highquality, spatial_budget,
+          noparallel,
+          [&shape](const bvh_reference& ref, int axis, float split) {
+            auto& l = shape.lines[ref.primitive];
+            return split_line(ref.bbox, shape.positions[l.x],
+                shape.positions[l.y], max(shape.radius[l.x], shape.radius[l.y]),
+                axis, split);
+          });
+    } else if (!shape.triangles.empty()) {
+      return build_bvh_spatial(bvh.bvh, bboxes, highquality, spatial_budget,
+          noparallel,
+          [&shape](const bvh_reference& ref, int axis, float split) {
+            auto& t        = shape.triangles[ref.primitive];
+            auto  vertices = array<vec3f, 3>{shape.positions[t.x],
+                shape.positions[t.y], shape.positions[t.z]};
+            return split_polygon(ref.bbox, vertices.data(), 3, axis, split);
+          });
+    } else if (!shape.quads.empty()) {
+      return build_bvh_spatial(bvh.bvh, bboxes, highquality, spatial_budget,
+          noparallel,
+          [&shape](const bvh_reference& ref, int axis, float split) {
+            auto& q        = shape.quads[ref.primitive];
+            auto  vertices = array<vec3f, 4>{shape.positions[q.x],
+                shape.positions[q.y], shape.positions[q.z],
+                shape.positions[q.w]};
+            return split_polygon(ref.bbox, vertices.data(), 4, axis, split);
+          });
+    } else {
+      return build_bvh_spatial(bvh.bvh, bboxes, highquality, spatial_budget,
+          noparallel,
+          [](const bvh_reference& ref, int axis, float split) {
+            return split_bbox(ref.bbox, axis, split);
+          });
+    }
+  }
+
   // build nodes
   build_bvh_serial(bvh.bvh, bboxes, highquality);
 }
@@ -695,32 +1141,36 @@ static void build_bvh(bvh_scene& bvh, const scene_model& scene,
   build_bvh_serial(bvh.bvh, bboxes, highquality);
 }
 
-bvh_shape make_bvh(const scene_shape& shape, bool highquality, bool embree) {
+bvh_shape make_bvh(const scene_shape& shape, bool highquality, bool embree,
+    float spatial_budget, bool noparallel) {
   // bvh
   auto bvh = bvh_shape{};
 
   // build scene bvh
-  build_bvh(bvh, shape, highquality, embree);
+  build_bvh(bvh, shape, highquality, embree, spatial_budget, noparallel);
 
   // handle progress
   return bvh;
 }
 
-bvh_scene make_bvh(
-    const scene_model& scene, bool highquality, bool embree, bool noparallel) {
+bvh_scene make_bvh(const scene_model& scene, bool highquality, bool embree,
+    bool noparallel, float spatial_budget) {
   // bvh
   auto bvh = bvh_scene{};
 
   // build shape bvh
   bvh.shapes.resize(scene.shapes.size());
-  if (noparallel) {
+  if (noparallel || spatial_budget > 0) {
+    // spatial split bvhs are built in parallel one shape at a time
     for (auto idx = (size_t)0; idx < scene.shapes.size(); idx++) {
-      build_bvh(bvh.shapes[idx], scene.shapes[idx], highquality, embree);
+      build_bvh(bvh.shapes[idx], scene.shapes[idx], highquality, embree,
+          spatial_budget, noparallel);
     }
   } else {
     // mutex
     parallel_for(scene.shapes.size(), [&](size_t idx) {
-      build_bvh(bvh.shapes[idx], scene.shapes[idx], highquality, embree);
+      build_bvh(bvh.shapes[idx], scene.shapes[idx], highquality, embree,
+          spatial_budget, noparallel);
     });
   }
 
@@ -816,10 +1266,12 @@ void update_bvh(bvh_scene& bvh, const scene_model& scene,
 // -----------------------------------------------------------------------------
 namespace yocto {
 
-// Intersect ray with a bvh.
+// Intersect ray with a bvh. Traversal statistics are counted in `stats`
+// only if `count_stats` is true, so the common case has no overhead.
+template <bool count_stats = false>
 static bool intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
-    const ray3f& ray_, int& element, vec2f& uv, float& distance,
-    bool find_any) {
+    const ray3f& ray_, int& element, vec2f& uv, float& distance, bool find_any,
+    bvh_stats* stats = nullptr) {
 #ifdef YOCTO_EMBREE
   // call Embree if needed
   if (bvh.embree_bvh) {
@@ -851,6 +1303,7 @@ static bool intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
   while (node_cur != 0) {
     // grab node
     auto& node = bvh.bvh.nodes[node_stack[--node_cur]];
+    if constexpr (count_stats) stats->nodes += 1;
 
     // intersect bbox
     // if (!intersect_bbox(ray, ray_dinv, ray_dsign, node.bbox)) continue;
@@ -869,6 +1322,7 @@ static bool intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
         node_stack[node_cur++] = node.start + 0;
       }
     } else if (!shape.points.empty()) {
+      if constexpr (count_stats) stats->primitives += node.num;
       for (auto idx = node.start; idx < node.start + node.num; idx++) {
         auto& p = shape.points[bvh.bvh.primitives[idx]];
         if (intersect_point(
@@ -879,6 +1333,7 @@ static bool intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
         }
       }
     } else if (!shape.lines.empty()) {
+      if constexpr (count_stats) stats->primitives += node.num;
       for (auto idx = node.start; idx < node.start + node.num; idx++) {
         auto& l = shape.lines[bvh.bvh.primitives[idx]];
         if (intersect_line(ray, shape.positions[l.x], shape.positions[l.y],
@@ -889,6 +1344,7 @@ static bool intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
         }
       }
     } else if (!shape.triangles.empty()) {
+      if constexpr (count_stats) stats->primitives += node.num;
       for (auto idx = node.start; idx < node.start + node.num; idx++) {
         auto& t = shape.triangles[bvh.bvh.primitives[idx]];
         if (intersect_triangle(ray, shape.positions[t.x], shape.positions[t.y],
@@ -899,6 +1355,7 @@ static bool intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
         }
       }
     } else if (!shape.quads.empty()) {
+      if constexpr (count_stats) stats->primitives += node.num;
       for (auto idx = node.start; idx < node.start + node.num; idx++) {
         auto& q = shape.quads[bvh.bvh.primitives[idx]];
         if (intersect_quad(ray, shape.positions[q.x], shape.positions[q.y],
@@ -917,10 +1374,12 @@ static bool intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
   return hit;
 }
 
-// Intersect ray with a bvh.
+// Intersect ray with a bvh. Traversal statistics are counted in `stats`
+// only if `count_stats` is true, so the common case has no overhead.
+template <bool count_stats = false>
 static bool intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
     const ray3f& ray_, int& instance, int& element, vec2f& uv, float& distance,
-    bool find_any, bool non_rigid_frames) {
+    bool find_any, bool non_rigid_frames, bvh_stats* stats = nullptr) {
 #ifdef YOCTO_EMBREE
   // call Embree if needed
   if (bvh.embree_bvh) {
@@ -952,6 +1411,7 @@ static bool intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
   while (node_cur != 0) {
     // grab node
     auto& node = bvh.bvh.nodes[node_stack[--node_cur]];
+    if constexpr (count_stats) stats->nodes += 1;
 
     // intersect bbox
     // if (!intersect_bbox(ray, ray_dinv, ray_dsign, node.bbox)) continue;
@@ -974,9 +1434,10 @@ static bool intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
         auto& instance_ = scene.instances[bvh.bvh.primitives[idx]];
         auto  inv_ray   = transform_ray(
             inverse(instance_.frame, non_rigid_frames), ray);
-        if (intersect_bvh(bvh.shapes[instance_.shape],
+        if constexpr (count_stats) stats->instances += 1;
+        if (intersect_bvh<count_stats>(bvh.shapes[instance_.shape],
                 scene.shapes[instance_.shape], inv_ray, element, uv, distance,
-                find_any)) {
+                find_any, stats)) {
           hit      = true;
           instance = bvh.bvh.primitives[idx];
           ray.tmax = distance;
@@ -992,13 +1453,16 @@ static bool intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
 }
 
 // Intersect ray with a bvh.
+template <bool count_stats = false>
 static bool intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
     int instance_, const ray3f& ray, int& element, vec2f& uv, float& distance,
-    bool find_any, bool non_rigid_frames) {
+    bool find_any, bool non_rigid_frames, bvh_stats* stats = nullptr) {
   auto& instance = scene.instances[instance_];
   auto  inv_ray = transform_ray(inverse(instance.frame, non_rigid_frames), ray);
-  return intersect_bvh(bvh.shapes[instance.shape], scene.shapes[instance.shape],
-      inv_ray, element, uv, distance, find_any);
+  if constexpr (count_stats) stats->instances += 1;
+  return intersect_bvh<count_stats>(bvh.shapes[instance.shape],
+      scene.shapes[instance.shape], inv_ray, element, uv, distance, find_any,
+      stats);
 }
 
 }  // namespace yocto
@@ -1008,6 +1472,30 @@ static bool intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
 // -----------------------------------------------------------------------------
 namespace yocto {
 
+// Squared distance between a point and a bounding box.
+static float distance_squared(const vec3f& pos, const bbox3f& bbox) {
+  auto delta = max(max(bbox.min - pos, pos - bbox.max), 0.0f);
+  return dot(delta, delta);
+}
+
+// Push the children of an internal node on the stack so that the closest
+// child is visited first, skipping children farther than `max_distance`.
+template <size_t N>
+static void push_closest_children(const bvh_tree& bvh, const bvh_node& node,
+    const vec3f& pos, float max_distance, array<int, N>& node_stack,
+    int& node_cur) {
+  auto max_distance2 = max_distance * max_distance;
+  auto distance0     = distance_squared(pos, bvh.nodes[node.start + 0].bbox);
+  auto distance1     = distance_squared(pos, bvh.nodes[node.start + 1].bbox);
+  if (distance0 <= distance1) {
+    if (distance1 < max_distance2) node_stack[node_cur++] = node.start + 1;
+    if (distance0 < max_distance2) node_stack[node_cur++] = node.start + 0;
+  } else {
+    if (distance0 < max_distance2) node_stack[node_cur++] = node.start + 0;
+    if (distance1 < max_distance2) node_stack[node_cur++] = node.start + 1;
+  }
+}
+
 // Intersect ray with a bvh.
 static bool overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
     const vec3f& pos, float max_distance, int& element, vec2f& uv,
@@ -1034,9 +1522,9 @@ static bool overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
     // intersect node, switching based on node type
     // for each type, iterate over the the primitive list
     if (node.internal) {
-      // internal node
-      node_stack[node_cur++] = node.start + 0;
-      node_stack[node_cur++] = node.start + 1;
+      // internal node, visiting the closest child first
+      push_closest_children(
+          bvh.bvh, node, pos, max_distance, node_stack, node_cur);
     } else if (!shape.points.empty()) {
       for (auto idx = 0; idx < node.num; idx++) {
         auto  primitive = bvh.bvh.primitives[node.start + idx];
@@ -1065,8 +1553,8 @@ static bool overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
         auto  primitive = bvh.bvh.primitives[node.start + idx];
         auto& t         = shape.triangles[primitive];
         if (overlap_triangle(pos, max_distance, shape.positions[t.x],
-                shape.positions[t.y], shape.positions[t.z], shape.radius[t.x],
-                shape.radius[t.y], shape.radius[t.z], uv, distance)) {
+                shape.positions[t.y], shape.positions[t.z], 0, 0, 0, uv,
+                distance)) {
           hit          = true;
           element      = primitive;
           max_distance = distance;
@@ -1078,8 +1566,7 @@ static bool overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
         auto& q         = shape.quads[primitive];
         if (overlap_quad(pos, max_distance, shape.positions[q.x],
                 shape.positions[q.y], shape.positions[q.z],
-                shape.positions[q.w], shape.radius[q.x], shape.radius[q.y],
-                shape.radius[q.z], shape.radius[q.w], uv, distance)) {
+                shape.positions[q.w], 0, 0, 0, 0, uv, distance)) {
           hit          = true;
           element      = primitive;
           max_distance = distance;
@@ -1120,9 +1607,9 @@ static bool overlap_bvh(const bvh_scene& bvh, const scene_model& scene,
     // intersect node, switching based on node type
     // for each type, iterate over the the primitive list
     if (node.internal) {
-      // internal node
-      node_stack[node_cur++] = node.start + 0;
-      node_stack[node_cur++] = node.start + 1;
+      // internal node, visiting the closest child first
+      push_closest_children(
+          bvh.bvh, node, pos, max_distance, node_stack, node_cur);
     } else {
       for (auto idx = 0; idx < node.num; idx++) {
         auto  primitive = bvh.bvh.primitives[node.start + idx];
@@ -1147,67 +1634,275 @@ static bool overlap_bvh(const bvh_scene& bvh, const scene_model& scene,
   return hit;
 }
 
-#if 0
-// Finds the overlap between BVH leaf nodes.
-template <typename OverlapElem>
-void overlap_bvh_elems(const bvh_data& bvh1, const bvh_data& bvh2,
-                bool skip_duplicates, bool skip_self, vector<vec2i>& overlaps,
-                const OverlapElem& overlap_elems) {
-    // node stack
-    vec2i node_stack[128];
-    auto node_cur = 0;
-    node_stack[node_cur++] = {0, 0};
-
-    // walking stack
-    while (node_cur) {
-        // grab node
-        auto node_idx = node_stack[--node_cur];
-        const auto node1 = bvh1->nodes[node_idx.x];
-        const auto node2 = bvh2->nodes[node_idx.y];
-
-        // intersect bbox
-        if (!overlap_bbox(node1.bbox, node2.bbox)) continue;
-
-        // check for leaves
-        if (node1.isleaf && node2.isleaf) {
-            // collide primitives
-            for (auto i1 = node1.start; i1 < node1.start + node1.count; i1++) {
-                for (auto i2 = node2.start; i2 < node2.start + node2.count;
-                      i2++) {
-                    auto idx1 = bvh1->sorted_prim[i1];
-                    auto idx2 = bvh2->sorted_prim[i2];
-                    if (skip_duplicates && idx1 > idx2) continue;
-                    if (skip_self && idx1 == idx2) continue;
-                    if (overlap_elems(idx1, idx2))
-                        overlaps.push_back({idx1, idx2});
-                }
-            }
-        } else {
-            // descend
-            if (node1.isleaf) {
-                for (auto idx2 = node2.start; idx2 < node2.start + node2.count;
-                      idx2++) {
-                    node_stack[node_cur++] = {node_idx.x, (int)idx2};
-                }
-            } else if (node2.isleaf) {
-                for (auto idx1 = node1.start; idx1 < node1.start + node1.count;
-                      idx1++) {
-                    node_stack[node_cur++] = {(int)idx1, node_idx.y};
-                }
-            } else {
-                for (auto idx2 = node2.start; idx2 < node2.start + node2.count;
-                      idx2++) {
-                    for (auto idx1 = node1.start;
-                          idx1 < node1.start + node1.count; idx1++) {
-                        node_stack[node_cur++] = {(int)idx1, (int)idx2};
-                    }
-                }
-            }
+// Minimum number of node pairs in the traversal front before the overlap
+// traversal is distributed across threads.
+const int bvh_overlap_front = 1024;
+
+// Finds the overlaps between the elements of two BVHs, or the elements of a
+// BVH with itself if `self` is true, by traversing the two trees at once.
+// Node bounds are tested with `overlap_bboxes` and elements with
+// `overlap_elements`. The traversal front is expanded breadth-first and
+// then distributed across threads. Returns sorted unique element pairs.
+template <typename OverlapBboxes, typename OverlapElements>
+static vector<vec2i> overlap_bvh_elements(const bvh_tree& bvh1,
+    const bvh_tree& bvh2, bool self, OverlapBboxes&& overlap_bboxes,
+    OverlapElements&& overlap_elements, bool noparallel) {
+  // check empty
+  if (bvh1.nodes.empty() || bvh2.nodes.empty()) return {};
+
+  // process a node pair, adding children pairs to the stack and
+  // element pairs to the overlaps
+  auto process_pair = [&](const vec2i& pair, vector<vec2i>& stack,
+                          vector<vec2i>& overlaps) {
+    auto& node1 = bvh1.nodes[pair.x];
+    auto& node2 = bvh2.nodes[pair.y];
+    if (!overlap_bboxes(node1.bbox, node2.bbox)) return;
+    if (self && pair.x == pair.y) {
+      if (node1.internal) {
+        stack.push_back({node1.start + 0, node1.start + 0});
+        stack.push_back({node1.start + 1, node1.start + 1});
+        stack.push_back({node1.start + 0, node1.start + 1});
+      } else {
+        for (auto idx1 = node1.start; idx1 < node1.start + node1.num; idx1++) {
+          for (auto idx2 = idx1 + 1; idx2 < node1.start + node1.num; idx2++) {
+            auto element1 = bvh1.primitives[idx1];
+            auto element2 = bvh1.primitives[idx2];
+            if (element1 == element2) continue;
+            if (element1 > element2) std::swap(element1, element2);
+            if (overlap_elements(element1, element2))
+              overlaps.push_back({element1, element2});
+          }
+        }
+      }
+    } else if (!node1.internal && !node2.internal) {
+      for (auto idx1 = node1.start; idx1 < node1.start + node1.num; idx1++) {
+        for (auto idx2 = node2.start; idx2 < node2.start + node2.num; idx2++) {
+          auto element1 = bvh1.primitives[idx1];
+          auto element2 = bvh2.primitives[idx2];
+          if (self && element1 == element2) continue;
+          if (self && element1 > element2) std::swap(element1, element2);
+          if (overlap_elements(element1, element2))
+            overlaps.push_back({element1, element2});
         }
+      }
+    } else if (!node2.internal ||
+               (node1.internal &&
+                   bvh_area(node1.bbox) >= bvh_area(node2.bbox))) {
+      stack.push_back({node1.start + 0, pair.y});
+      stack.push_back({node1.start + 1, pair.y});
+    } else {
+      stack.push_back({pair.x, node2.start + 0});
+      stack.push_back({pair.x, node2.start + 1});
+    }
+  };
+
+  // expand the traversal front breadth-first
+  auto overlaps = vector<vec2i>{};
+  auto front    = vector<vec2i>{{0, 0}};
+  if (!noparallel) {
+    auto next = vector<vec2i>{};
+    while (!front.empty() && front.size() < bvh_overlap_front) {
+      next.clear();
+      for (auto& pair : front) process_pair(pair, next, overlaps);
+      std::swap(front, next);
+    }
+  }
+
+  // process the front
+  if (noparallel) {
+    auto stack = std::move(front);
+    while (!stack.empty()) {
+      auto pair = stack.back();
+      stack.pop_back();
+      process_pair(pair, stack, overlaps);
     }
+  } else {
+    auto front_overlaps = vector<vector<vec2i>>(front.size());
+    parallel_for(front.size(), [&](size_t idx) {
+      auto stack = vector<vec2i>{front[idx]};
+      while (!stack.empty()) {
+        auto pair = stack.back();
+        stack.pop_back();
+        process_pair(pair, stack, front_overlaps[idx]);
+      }
+    });
+    for (auto& elements : front_overlaps)
+      overlaps.insert(overlaps.end(), elements.begin(), elements.end());
+  }
+
+  // sort and remove duplicates from spatial splits
+  std::sort(overlaps.begin(), overlaps.end(), [](auto& a, auto& b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+  });
+  overlaps.erase(std::unique(overlaps.begin(), overlaps.end()), overlaps.end());
+  return overlaps;
+}
+
+// Get the vertices of a shape element.
+static int get_element_vertices(
+    const scene_shape& shape, int element, array<int, 4>& vertices) {
+  if (!shape.points.empty()) {
+    vertices = {shape.points[element], -1, -1, -1};
+    return 1;
+  } else if (!shape.lines.empty()) {
+    auto& l  = shape.lines[element];
+    vertices = {l.x, l.y, -1, -1};
+    return 2;
+  } else if (!shape.triangles.empty()) {
+    auto& t  = shape.triangles[element];
+    vertices = {t.x, t.y, t.z, -1};
+    return 3;
+  } else if (!shape.quads.empty()) {
+    auto& q  = shape.quads[element];
+    vertices = {q.x, q.y, q.z, q.w};
+    return q.z == q.w ? 3 : 4;
+  } else {
+    return 0;
+  }
+}
+
+// Get the bounds of a shape element.
+static bbox3f get_element_bounds(
+    const scene_shape& shape, int element, const frame3f& frame) {
+  auto vertices = array<int, 4>{};
+  auto num      = get_element_vertices(shape, element, vertices);
+  auto bbox     = invalidb3f;
+  for (auto idx = 0; idx < num; idx++) {
+    auto radius = shape.radius.empty() ? 0.0f : shape.radius[vertices[idx]];
+    bbox        = merge(bbox,
+        point_bounds(
+            transform_point(frame, shape.positions[vertices[idx]]), radius));
+  }
+  return bbox;
 }
-#endif
 
+// Check if two shape elements overlap. Triangles and quads are tested exactly,
+// while points and lines are tested using their bounds. Elements that share
+// vertices, by index or by position to handle seams, are skipped if
+// `skip_adjacent` is true.
+static bool overlap_elements(const scene_shape& shape1, int element1,
+    const frame3f& frame1, const scene_shape& shape2, int element2,
+    const frame3f& frame2, bool skip_adjacent) {
+  auto vertices1 = array<int, 4>{}, vertices2 = array<int, 4>{};
+  auto num1 = get_element_vertices(shape1, element1, vertices1);
+  auto num2 = get_element_vertices(shape2, element2, vertices2);
+  if (skip_adjacent) {
+    for (auto idx1 = 0; idx1 < num1; idx1++) {
+      for (auto idx2 = 0; idx2 < num2; idx2++) {
+        if (vertices1[idx1] == vertices2[idx2] ||
+            shape1.positions[vertices1[idx1]] ==
+                shape2.positions[vertices2[idx2]])
+          return false;
+      }
+    }
+  }
+  if (num1 < 3 || num2 < 3) {
+    return overlap_bbox(get_element_bounds(shape1, element1, frame1),
+        get_element_bounds(shape2, element2, frame2));
+  }
+  auto positions1 = array<vec3f, 4>{}, positions2 = array<vec3f, 4>{};
+  for (auto idx = 0; idx < num1; idx++)
+    positions1[idx] = transform_point(frame1, shape1.positions[vertices1[idx]]);
+  for (auto idx = 0; idx < num2; idx++)
+    positions2[idx] = transform_point(frame2, shape2.positions[vertices2[idx]]);
+  for (auto triangle1 = 0; triangle1 < num1 - 2; triangle1++) {
+    for (auto triangle2 = 0; triangle2 < num2 - 2; triangle2++) {
+      // quads are split into triangles (0, 1, 3) and (2, 3, 1)
+      auto& p0 = triangle1 == 0 ? positions1[0] : positions1[2];
+      auto& p1 = positions1[1];
+      auto& p2 = num1 == 3 ? positions1[2] : positions1[3];
+      auto& q0 = triangle2 == 0 ? positions2[0] : positions2[2];
+      auto& q1 = positions2[1];
+      auto& q2 = num2 == 3 ? positions2[2] : positions2[3];
+      if (overlap_triangles(p0, p1, p2, q0, q1, q2)) return true;
+    }
+  }
+  return false;
+}
+
+// Find the overlapping elements between two shapes.
+vector<vec2i> overlap_bvh(const bvh_shape& bvh1, const scene_shape& shape1,
+    const bvh_shape& bvh2, const scene_shape& shape2, bool noparallel) {
+  auto identity = identity3x4f;
+  return overlap_bvh_elements(
+      bvh1.bvh, bvh2.bvh, false,
+      [](const bbox3f& bbox1, const bbox3f& bbox2) {
+        return overlap_bbox(bbox1, bbox2);
+      },
+      [&](int element1, int element2) {
+        return overlap_elements(
+            shape1, element1, identity, shape2, element2, identity, false);
+      },
+      noparallel);
+}
+
+// Find the overlapping elements within a shape.
+vector<vec2i> overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
+    bool skip_adjacent, bool noparallel) {
+  auto identity = identity3x4f;
+  return overlap_bvh_elements(
+      bvh.bvh, bvh.bvh, true,
+      [](const bbox3f& bbox1, const bbox3f& bbox2) {
+        return overlap_bbox(bbox1, bbox2);
+      },
+      [&](int element1, int element2) {
+        return overlap_elements(shape, element1, identity, shape, element2,
+            identity, skip_adjacent);
+      },
+      noparallel);
+}
+
+// Find the overlapping elements between the instances of a scene.
+vector<vec4i> overlap_bvh(const bvh_scene& bvh, const scene_model& scene,
+    bool self_overlap, bool skip_adjacent, bool noparallel) {
+  // find overlapping instances
+  auto instances = overlap_bvh_elements(
+      bvh.bvh, bvh.bvh, true,
+      [](const bbox3f& bbox1, const bbox3f& bbox2) {
+        return overlap_bbox(bbox1, bbox2);
+      },
+      [](int, int) { return true; }, true);
+  if (self_overlap) {
+    for (auto instance = 0; instance < (int)scene.instances.size(); instance++)
+      instances.push_back({instance, instance});
+  }
+
+  // find overlapping elements
+  auto overlaps = vector<vec4i>{};
+  for (auto& [instance1, instance2] : instances) {
+    auto& instance1_ = scene.instances[instance1];
+    auto& instance2_ = scene.instances[instance2];
+    auto& shape1     = scene.shapes[instance1_.shape];
+    auto& shape2     = scene.shapes[instance2_.shape];
+    auto& sbvh1      = bvh.shapes[instance1_.shape].bvh;
+    auto& sbvh2      = bvh.shapes[instance2_.shape].bvh;
+    auto  frame12 = inverse(instance1_.frame, true) * instance2_.frame;
+    auto  self    = instance1 == instance2;
+    auto  elements = overlap_bvh_elements(
+        sbvh1, sbvh2, self,
+        [&](const bbox3f& bbox1, const bbox3f& bbox2) {
+          return overlap_bbox(
+              bbox1, self ? bbox2 : transform_bbox(frame12, bbox2));
+        },
+        [&](int element1, int element2) {
+          return overlap_elements(shape1, element1, instance1_.frame, shape2,
+              element2, instance2_.frame, self && skip_adjacent);
+        },
+        noparallel || sbvh1.nodes.size() + sbvh2.nodes.size() <
+                          bvh_overlap_front);
+    for (auto& [element1, element2] : elements)
+      overlaps.push_back({instance1, element1, instance2, element2});
+  }
+  return overlaps;
+}
+
+bvh_intersection intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
+    const ray3f& ray, bool find_any) {
+  auto intersection = bvh_intersection{};
+  intersection.hit  = intersect_bvh(bvh, shape, ray, intersection.element,
+      intersection.uv, intersection.distance, find_any);
+  return intersection;
+}
 bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
     const ray3f& ray, bool find_any, bool non_rigid_frames) {
   auto intersection = bvh_intersection{};
@@ -1226,6 +1921,33 @@ bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
   return intersection;
 }
 
+bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
+    const ray3f& ray, bvh_stats& stats, bool find_any,
+    bool non_rigid_frames) {
+  auto intersection = bvh_intersection{};
+  intersection.hit  = intersect_bvh<true>(bvh, scene, ray,
+      intersection.instance, intersection.element, intersection.uv,
+      intersection.distance, find_any, non_rigid_frames, &stats);
+  return intersection;
+}
+bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
+    int instance, const ray3f& ray, bvh_stats& stats, bool find_any,
+    bool non_rigid_frames) {
+  auto intersection     = bvh_intersection{};
+  intersection.hit      = intersect_bvh<true>(bvh, scene, instance, ray,
+      intersection.element, intersection.uv, intersection.distance, find_any,
+      non_rigid_frames, &stats);
+  intersection.instance = instance;
+  return intersection;
+}
+
+bvh_intersection overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
+    const vec3f& pos, float max_distance, bool find_any) {
+  auto intersection = bvh_intersection{};
+  intersection.hit  = overlap_bvh(bvh, shape, pos, max_distance,
+      intersection.element, intersection.uv, intersection.distance, find_any);
+  return intersection;
+}
 bvh_intersection overlap_bvh(const bvh_scene& bvh, const scene_model& scene,
     const vec3f& pos, float max_distance, bool find_any,
     bool non_rigid_frames) {
@@ -1236,4 +1958,72 @@ bvh_intersection overlap_bvh(const bvh_scene& bvh, const scene_model& scene,
   return intersection;
 }
 
+// Number of queries processed together by each thread in batched queries.
+const size_t bvh_query_batch = 256;
+
+// Interleave the lower 10 bits of a number with two zero bits.
+static uint32_t morton_expand(uint32_t value) {
+  value = (value * 0x00010001u) & 0xFF0000FFu;
+  value = (value * 0x00000101u) & 0x0F00F00Fu;
+  value = (value * 0x00000011u) & 0xC30C30C3u;
+  value = (value * 0x00000005u) & 0x49249249u;
+  return value;
+}
+
+// Sort query points along a Morton curve so that consecutive queries visit
+// similar BVH nodes. Returns the query order.
+static vector<int> sort_queries(const vector<vec3f>& positions) {
+  auto bbox = parallel_reduce(
+      positions.size(), invalidb3f,
+      [&](size_t idx) { return bbox3f{positions[idx], positions[idx]}; },
+      [](const bbox3f& a, const bbox3f& b) { return merge(a, b); });
+  auto size  = max(bbox.max - bbox.min, 1e-12f);
+  auto order = vector<int>(positions.size());
+  for (auto idx = 0; idx < (int)order.size(); idx++) order[idx] = idx;
+  parallel_sort(order, [&](int idx) {
+    auto cell = (positions[idx] - bbox.min) / size * 1023.0f;
+    return (morton_expand((uint32_t)cell.x) << 2) |
+           (morton_expand((uint32_t)cell.y) << 1) |
+           morton_expand((uint32_t)cell.z);
+  });
+  return order;
+}
+
+vector<bvh_intersection> overlap_bvh(const bvh_shape& bvh,
+    const scene_shape& shape, const vector<vec3f>& positions,
+    float max_distance, bool noparallel) {
+  auto intersections = vector<bvh_intersection>(positions.size());
+  auto order         = sort_queries(positions);
+  auto query         = [&](size_t idx) {
+    auto& intersection = intersections[order[idx]];
+    intersection.hit   = overlap_bvh(bvh, shape, positions[order[idx]],
+        max_distance, intersection.element, intersection.uv,
+        intersection.distance, false);
+  };
+  if (noparallel) {
+    for (auto idx = (size_t)0; idx < positions.size(); idx++) query(idx);
+  } else {
+    parallel_for_batch(positions.size(), bvh_query_batch, query);
+  }
+  return intersections;
+}
+vector<bvh_intersection> overlap_bvh(const bvh_scene& bvh,
+    const scene_model& scene, const vector<vec3f>& positions,
+    float max_distance, bool non_rigid_frames, bool noparallel) {
+  auto intersections = vector<bvh_intersection>(positions.size());
+  auto order         = sort_queries(positions);
+  auto query         = [&](size_t idx) {
+    auto& intersection = intersections[order[idx]];
+    intersection.hit   = overlap_bvh(bvh, scene, positions[order[idx]],
+        max_distance, intersection.instance, intersection.element,
+        intersection.uv, intersection.distance, false, non_rigid_frames);
+  };
+  if (noparallel) {
+    for (auto idx = (size_t)0; idx < positions.size(); idx++) query(idx);
+  } else {
+    parallel_for_batch(positions.size(), bvh_query_batch, query);
+  }
+  return intersections;
+}
+
 }  // namespace yocto
@@ -100,11 +100,16 @@ struct bvh_scene {
   unique_ptr<void, void (*)(void*)> embree_bvh = {nullptr, nullptr};  // embree
 };
 
-// Build the bvh acceleration structure.
-bvh_shape make_bvh(
-    const scene_shape& shape, bool highquality = false, bool embree = false);
+// Build the bvh acceleration structure. If `spatial_budget` is positive,
+// shape bvhs are built with spatial splits (SBVH) that clip primitives against
+// the split planes, which helps with long and thin primitives like hair.
+// The budget bounds the number of duplicated primitive references as a
+// fraction of the number of primitives. Spatial split bvhs are built in
+// parallel unless `noparallel` is set, with the same result.
+bvh_shape make_bvh(const scene_shape& shape, bool highquality = false,
+    bool embree = false, float spatial_budget = 0, bool noparallel = false);
 bvh_scene make_bvh(const scene_model& scene, bool highquality = false,
-    bool embree = false, bool noparallel = false);
+    bool embree = false, bool noparallel = false, float spatial_budget = 0);
 
 // Refit bvh data
 void update_bvh(bvh_shape& bvh, const scene_shape& shape);
@@ -128,23 +133,70 @@ struct bvh_intersection {
 // depending on `find_any`. Returns the ray distance , the instance id,
 // the shape element index and the element barycentric coordinates.
 bvh_intersection intersect_bvh(const bvh_shape& bvh, const scene_shape& shape,
-    const ray3f& ray, bool find_any = false, bool non_rigid_frames = true);
+    const ray3f& ray, bool find_any = false);
 bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
     const ray3f& ray, bool find_any = false, bool non_rigid_frames = true);
 bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
     int instance, const ray3f& ray, bool find_any = false,
     bool non_rigid_frames = true);
 
+// Ray traversal statistics, counting visited nodes, primitive intersection
+// tests and instance transforms.
+struct bvh_stats {
+  uint64_t nodes      = 0;
+  uint64_t primitives = 0;
+  uint64_t instances  = 0;
+};
+
+// Intersect ray with a bvh as above, accumulating traversal statistics.
+// Embree bvhs do not report statistics.
+bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
+    const ray3f& ray, bvh_stats& stats, bool find_any = false,
+    bool non_rigid_frames = true);
+bvh_intersection intersect_bvh(const bvh_scene& bvh, const scene_model& scene,
+    int instance, const ray3f& ray, bvh_stats& stats, bool find_any = false,
+    bool non_rigid_frames = true);
+
 // Find a shape element that overlaps a point within a given distance
 // max distance, returning either the closest or any overlap depending on
 // `find_any`. Returns the point distance, the instance id, the shape element
-// index and the element barycentric coordinates.
+// index and the element barycentric coordinates. Nodes are visited closest
+// first and the search radius shrinks as closer elements are found.
 bvh_intersection overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
     const vec3f& pos, float max_distance, bool find_any = false);
 bvh_intersection overlap_bvh(const bvh_scene& bvh, const scene_model& scene,
     const vec3f& pos, float max_distance, bool find_any = false,
     bool non_rigid_frames = true);
 
+// Find the closest shape elements to a batch of points within a given
+// max distance. Returns one result per point, in the same order.
+// Queries are sorted spatially for coherence and run in parallel unless
+// `noparallel` is set.
+vector<bvh_intersection> overlap_bvh(const bvh_shape& bvh,
+    const scene_shape& shape, const vector<vec3f>& positions,
+    float max_distance, bool noparallel = false);
+vector<bvh_intersection> overlap_bvh(const bvh_scene& bvh,
+    const scene_model& scene, const vector<vec3f>& positions,
+    float max_distance, bool non_rigid_frames = true, bool noparallel = false);
+
+// Find all pairs of overlapping elements between two shapes, or within a
+// single shape. Returns the element indices of each pair, sorted.
+// Triangles and quads are tested exactly, while points and lines are tested
+// using their bounds. For a single shape, each pair is reported once and
+// elements that share a vertex are skipped if `skip_adjacent` is true.
+// The traversal is distributed across threads unless `noparallel` is set.
+vector<vec2i> overlap_bvh(const bvh_shape& bvh1, const scene_shape& shape1,
+    const bvh_shape& bvh2, const scene_shape& shape2, bool noparallel = false);
+vector<vec2i> overlap_bvh(const bvh_shape& bvh, const scene_shape& shape,
+    bool skip_adjacent = true, bool noparallel = false);
+
+// Find all pairs of overlapping elements between the instances of a scene,
+// returned as {instance1, element1, instance2, element2}. Overlaps within
+// an instance are included if `self_overlap` is true.
+vector<vec4i> overlap_bvh(const bvh_scene& bvh, const scene_model& scene,
+    bool self_overlap = true, bool skip_adjacent = true,
+    bool noparallel = false);
+
 }  // namespace yocto
 
 #endif
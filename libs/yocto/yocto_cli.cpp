@@ -309,8 +309,10 @@ static void cli_to_schema(cli_json& js, const T& value,
       js["type"]     = "array";
       js["minItems"] = value.size();
       js["maxItems"] = value.size();
+      cli_to_schema(js["items"], typename T::value_type{}, {}, name, usage);
     } else if constexpr (cli_is_vector_v<T>) {
       js["type"] = "array";
+      cli_to_schema(js["items"], typename T::value_type{}, {}, name, usage);
     }
   }
 }
@@ -361,7 +363,7 @@ static void add_option_impl(const cli_command& cli, const string& name,
   if (req) schema["required"].push_back(name);
   cli.state->variables.push_back(
       cli_variable{cli.path.empty() ? name : (cli.path + "/" + name), &value,
-          cli_from_json_<T>, choices});
+          cli_from_json_<array<T, N>>, choices});
 }
 template <typename T>
 static void add_argument_impl(const cli_command& cli, const string& name,
@@ -407,11 +409,11 @@ static void add_argumentv_impl(const cli_command& cli, const string& name,
   cli_to_schema(schema["properties"][name], value, choices, name, usage);
   if (req) schema["required"].push_back(name);
   if (!schema.contains("cli_positionals"))
-    schema["positionals"] = cli_json::array();
-  schema["positionals"].push_back(name);
+    schema["cli_positionals"] = cli_json::array();
+  schema["cli_positionals"].push_back(name);
   cli.state->variables.push_back(
       cli_variable{cli.path.empty() ? name : (cli.path + "/" + name), &value,
-          cli_from_json_<T>, choices});
+          cli_from_json_<vector<T>>, choices});
 }
 
 // Add an optional argument. Supports strings, numbers, and boolean flags.
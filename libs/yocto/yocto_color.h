@@ -51,6 +51,8 @@
 // INCLUDES
 // -----------------------------------------------------------------------------
 
+#include <array>
+#include <cstring>
 #include <stdexcept>
 #include <utility>
 
@@ -67,6 +69,20 @@ inline vec4f byte_to_float(const vec4b& a);
 inline byte  float_to_byte(float a);
 inline float byte_to_float(byte a);
 
+// Half-precision colors, stored as 16-bit floats
+struct vec4h {
+  uint16_t x = 0;
+  uint16_t y = 0;
+  uint16_t z = 0;
+  uint16_t w = 0;
+};
+
+// Conversion between floats and half-precision floats
+inline vec4h    float_to_half(const vec4f& a);
+inline vec4f    half_to_float(const vec4h& a);
+inline uint16_t float_to_half(float a);
+inline float    half_to_float(uint16_t a);
+
 // Luminance
 inline float luminance(const vec3f& a);
 
@@ -78,6 +94,9 @@ inline vec4f srgb_to_rgb(const vec4f& srgb);
 inline vec3f rgb_to_srgb(const vec3f& rgb);
 inline vec4f rgb_to_srgb(const vec4f& rgb);
 
+// sRGB non-linear curve for bytes, decoded with a lookup table
+inline vec4f srgb_to_rgb(const vec4b& srgb);
+
 // Conversion between number of channels.
 inline vec4f rgb_to_rgba(const vec3f& rgb);
 inline vec3f rgba_to_rgb(const vec4f& rgba);
@@ -215,6 +234,62 @@ inline vec4f byte_to_float(const vec4b& a) {
 inline byte float_to_byte(float a) { return (byte)clamp(int(a * 256), 0, 255); }
 inline float byte_to_float(byte a) { return a / 255.0f; }
 
+// Conversion between floats and half-precision floats, with rounding to
+// nearest even, following https://gist.github.com/rygorous/2156668
+inline vec4h float_to_half(const vec4f& a) {
+  return {float_to_half(a.x), float_to_half(a.y), float_to_half(a.z),
+      float_to_half(a.w)};
+}
+inline vec4f half_to_float(const vec4h& a) {
+  return {half_to_float(a.x), half_to_float(a.y), half_to_float(a.z),
+      half_to_float(a.w)};
+}
+inline uint16_t float_to_half(float a) {
+  auto bits = (uint32_t)0;
+  memcpy(&bits, &a, sizeof(bits));
+  auto sign = bits & 0x80000000u;
+  bits ^= sign;
+  auto half = (uint32_t)0;
+  if (bits >= (127u + 16u) << 23) {
+    half = bits > 255u << 23 ? 0x7e00u : 0x7c00u;  // nan or infinity
+  } else if (bits < 113u << 23) {
+    // denormals, rounded by the float addition
+    auto magic = ((127u - 15u) + (23u - 10u) + 1u) << 23, value = 0u;
+    auto fvalue = 0.0f, fmagic = 0.0f;
+    memcpy(&fvalue, &bits, sizeof(bits));
+    memcpy(&fmagic, &magic, sizeof(magic));
+    fvalue += fmagic;
+    memcpy(&value, &fvalue, sizeof(value));
+    half = value - magic;
+  } else {
+    auto odd = (bits >> 13) & 1u;
+    bits += ((uint32_t)(15 - 127) << 23) + 0xfffu + odd;
+    half = bits >> 13;
+  }
+  return (uint16_t)(half | (sign >> 16));
+}
+inline float half_to_float(uint16_t a) {
+  auto bits     = ((uint32_t)a & 0x7fffu) << 13;
+  auto exponent = bits & (0x7c00u << 13);
+  bits += (127u - 15u) << 23;
+  if (exponent == 0x7c00u << 13) {
+    bits += (128u - 16u) << 23;  // nan or infinity
+  } else if (exponent == 0) {
+    // denormals, renormalized by the float subtraction
+    auto magic = 113u << 23;
+    auto value = 0.0f, fmagic = 0.0f;
+    bits += 1u << 23;
+    memcpy(&value, &bits, sizeof(bits));
+    memcpy(&fmagic, &magic, sizeof(magic));
+    value -= fmagic;
+    memcpy(&bits, &value, sizeof(bits));
+  }
+  bits |= ((uint32_t)a & 0x8000u) << 16;
+  auto value = 0.0f;
+  memcpy(&value, &bits, sizeof(bits));
+  return value;
+}
+
 // Luminance
 inline float luminance(const vec3f& a) {
   return (0.2126f * a.x + 0.7152f * a.y + 0.0722f * a.z);
@@ -243,6 +318,19 @@ inline vec4f rgb_to_srgb(const vec4f& rgb) {
   return {rgb_to_srgb(rgb.x), rgb_to_srgb(rgb.y), rgb_to_srgb(rgb.z), rgb.w};
 }
 
+// sRGB non-linear curve for bytes, decoded with a lookup table
+inline const auto srgb_to_rgb_table = [] {
+  auto table = std::array<float, 256>{};
+  for (auto i = 0; i < 256; i++) {
+    table[i] = srgb_to_rgb(byte_to_float((byte)i));
+  }
+  return table;
+}();
+inline vec4f srgb_to_rgb(const vec4b& srgb) {
+  return {srgb_to_rgb_table[srgb.x], srgb_to_rgb_table[srgb.y],
+      srgb_to_rgb_table[srgb.z], byte_to_float(srgb.w)};
+}
+
 // Conversion between number of channels.
 inline vec4f rgb_to_rgba(const vec3f& rgb) { return {rgb.x, rgb.y, rgb.z, 1}; }
 inline vec3f rgba_to_rgb(const vec4f& rgba) { return xyz(rgba); }
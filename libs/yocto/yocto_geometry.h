@@ -311,6 +311,10 @@ inline bool overlap_bbox(const vec3f& pos, float dist_max, const bbox3f& bbox);
 // Check if two bboxe overlap.
 inline bool overlap_bbox(const bbox3f& bbox1, const bbox3f& bbox2);
 
+// Check if two triangles overlap. Touching triangles are considered overlapping.
+inline bool overlap_triangles(const vec3f& p0, const vec3f& p1,
+    const vec3f& p2, const vec3f& q0, const vec3f& q1, const vec3f& q2);
+
 }  // namespace yocto
 
 // -----------------------------------------------------------------------------
@@ -872,10 +876,9 @@ inline bool overlap_quad(const vec3f& pos, float dist_max, const vec3f& p0,
     hit      = true;
     dist_max = dist;
   }
-  if (!overlap_triangle(pos, dist_max, p2, p3, p1, r2, r3, r1, uv, dist)) {
+  if (overlap_triangle(pos, dist_max, p2, p3, p1, r2, r3, r1, uv, dist)) {
     hit = true;
     uv  = 1 - uv;
-    // dist_max = dist;
   }
   return hit;
 }
@@ -905,6 +908,39 @@ inline bool overlap_bbox(const bbox3f& bbox1, const bbox3f& bbox2) {
   return true;
 }
 
+// Check if two triangles overlap using the separating axis test. The axes are
+// the triangle normals and the cross products of the triangle edges. For
+// coplanar triangles, these cross products all lie along the normal, so the
+// edge normals in the common plane are used instead.
+inline bool overlap_triangles(const vec3f& p0, const vec3f& p1,
+    const vec3f& p2, const vec3f& q0, const vec3f& q1, const vec3f& q2) {
+  auto separated = [&](const vec3f& axis) {
+    if (dot(axis, axis) < 1e-20f) return false;
+    auto pa = dot(axis, p0), pb = dot(axis, p1), pc = dot(axis, p2);
+    auto qa = dot(axis, q0), qb = dot(axis, q1), qc = dot(axis, q2);
+    return max(pa, max(pb, pc)) < min(qa, min(qb, qc)) ||
+           max(qa, max(qb, qc)) < min(pa, min(pb, pc));
+  };
+  const vec3f pe[3] = {p1 - p0, p2 - p1, p0 - p2};
+  const vec3f qe[3] = {q1 - q0, q2 - q1, q0 - q2};
+  auto pn = cross(pe[0], pe[1]), qn = cross(qe[0], qe[1]);
+  if (separated(pn) || separated(qn)) return false;
+  auto pn_length = length(pn), qn_length = length(qn);
+  auto coplanar  = length(cross(pn, qn)) <= 1e-6f * pn_length * qn_length &&
+                  abs(dot(pn, q0 - p0)) <= 1e-6f * pn_length * length(q0 - p0);
+  if (coplanar) {
+    for (auto& pedge : pe)
+      if (separated(cross(pn, pedge))) return false;
+    for (auto& qedge : qe)
+      if (separated(cross(qn, qedge))) return false;
+  } else {
+    for (auto& pedge : pe)
+      for (auto& qedge : qe)
+        if (separated(cross(pedge, qedge))) return false;
+  }
+  return true;
+}
+
 }  // namespace yocto
 
 #endif
@@ -32,10 +32,12 @@
 
 #include "yocto_image.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 
-#include "ext/stb_image_resize.h"
 #include "yocto_color.h"
 #include "yocto_noise.h"
 #include "yocto_parallel.h"
@@ -50,6 +52,402 @@ using std::unique_ptr;
 
 }  // namespace yocto
 
+// -----------------------------------------------------------------------------
+// BATCH COLOR KERNELS
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Batch kernels are compiled for AVX2 and for the baseline instruction set,
+// and the version to run is picked at load time, when supported.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && \
+    defined(__linux__)
+#define YOCTO_BATCH_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define YOCTO_BATCH_CLONES
+#endif
+
+// Floats processed together. The fixed-size inner loops are vectorized by
+// the compiler, as 2x8 lanes with AVX2 and 4x4 lanes with SSE.
+constexpr auto batch_lanes = 16;
+
+// Pixels processed by each parallel task
+constexpr auto batch_pixels = (size_t)4096;
+
+// Bit casts and selects. Selects use integer masks and compares, so that
+// loops stay vectorizable without relaxing floating point semantics.
+static inline int32_t batch_bits(float a) {
+  auto bits = (int32_t)0;
+  memcpy(&bits, &a, sizeof(bits));
+  return bits;
+}
+static inline float batch_float(int32_t bits) {
+  auto a = 0.0f;
+  memcpy(&a, &bits, sizeof(bits));
+  return a;
+}
+static inline float batch_select(bool condition, float a, float b) {
+  auto mask = -(int32_t)condition;
+  return batch_float((batch_bits(a) & mask) | (batch_bits(b) & ~mask));
+}
+
+// Logarithm of |x|, from the exponent and an atanh series on the mantissa,
+// with absolute error below 5e-8.
+static inline float batch_log2(float x) {
+  auto bits     = batch_bits(x) & 0x7fffffff;
+  auto big      = (bits & 0x007fffff) > 0x003504f3;  // mantissa > sqrt(2)
+  auto exponent = (bits >> 23) - 127 + (big ? 1 : 0);
+  auto mantissa = batch_float(
+      (bits & 0x007fffff) | (big ? 0x3f000000 : 0x3f800000));
+  auto t = (mantissa - 1) / (mantissa + 1), t2 = t * t;
+  auto p = 0.412198583f;
+  p      = p * t2 + 0.577078016f;
+  p      = p * t2 + 0.961796694f;
+  p      = p * t2 + 2.88539008f;
+  return exponent + t * p;
+}
+
+// Power of two, from a rounded exponent and a Taylor polynomial on the
+// remainder, with relative error below 1e-8. Results are clamped to the
+// normal float range.
+static inline float batch_exp2(float x) {
+  auto rounded  = (x + 12582912.0f) - 12582912.0f;
+  auto f        = x - rounded;
+  auto exponent = (int32_t)rounded + 127;
+  exponent      = exponent < 1 ? 1 : (exponent > 254 ? 254 : exponent);
+  auto p        = 0.0000152527339f;
+  p             = p * f + 0.000154035304f;
+  p             = p * f + 0.00133335581f;
+  p             = p * f + 0.00961812911f;
+  p             = p * f + 0.0555041087f;
+  p             = p * f + 0.240226507f;
+  p             = p * f + 0.693147181f;
+  p             = p * f + 1;
+  return p * batch_float(exponent << 23);
+}
+
+// Square root of x >= 0, from Newton steps on the reciprocal square root,
+// with relative error below 3e-7. Unlike sqrt(), this does not set errno,
+// so it does not block vectorization.
+static inline float batch_sqrt(float x) {
+  auto y = batch_float(0x5f3759df - (batch_bits(x) >> 1));
+  y      = y * (1.5f - 0.5f * x * y * y);
+  y      = y * (1.5f - 0.5f * x * y * y);
+  y      = y * (1.5f - 0.5f * x * y * y);
+  return x * y;
+}
+
+// sRGB curves. Against srgb_to_rgb() and rgb_to_srgb(), the absolute error
+// is below 2e-7 on [0,1]. Up to 65504, the relative error elsewhere is below
+// 5e-7 for rgb_to_srgb(), and for srgb_to_rgb() below 1e-6 up to 64 and
+// 2.5e-6 beyond, since the rounding of the exponent grows with it.
+static inline float batch_rgb_to_srgb(float rgb) {
+  auto linear = 12.92f * rgb;
+  auto curve  = 1.055f * batch_exp2(batch_log2(rgb) * (1 / 2.4f)) - 0.055f;
+  return batch_select(batch_bits(rgb) <= batch_bits(0.0031308f), linear, curve);
+}
+static inline float batch_srgb_to_rgb(float srgb) {
+  auto linear = srgb / 12.92f;
+  auto curve  = batch_exp2(
+      batch_log2((srgb + 0.055f) / (1.0f + 0.055f)) * 2.4f);
+  return batch_select(batch_bits(srgb) <= batch_bits(0.04045f), linear, curve);
+}
+
+// Filmic curve, computed as in tonemap_filmic()
+static inline float batch_filmic(float hdr_) {
+  auto hdr = hdr_ * 0.6f;
+  auto ldr = (hdr * hdr * 2.51f + hdr * 0.03f) /
+             (hdr * hdr * 2.43f + hdr * 0.59f + 0.14f);
+  return batch_select(batch_bits(ldr) < 0, 0.0f, ldr);
+}
+
+// Store float or byte results
+static inline void batch_store(float& result, float value) { result = value; }
+static inline void batch_store(byte& result, float value) {
+  result = float_to_byte(value);
+}
+
+// Apply a per-channel function to the colors of `size` floats of pixel data,
+// keeping alpha. This is the loop that gets vectorized.
+template <typename T, typename Func>
+YOCTO_BATCH_CLONES static void apply_batch(
+    T* result, const float* pixels, size_t size, Func&& func) {
+  auto start = (size_t)0;
+  for (; start + batch_lanes <= size; start += batch_lanes) {
+    float values[batch_lanes], colors[batch_lanes];
+    for (auto lane = 0; lane < batch_lanes; lane++)
+      values[lane] = pixels[start + lane];
+    for (auto lane = 0; lane < batch_lanes; lane++)
+      colors[lane] = func(values[lane]);
+    for (auto lane = 0; lane < batch_lanes; lane++)
+      batch_store(result[start + lane],
+          (lane & 3) == 3 ? values[lane] : colors[lane]);
+  }
+  for (; start < size; start++) {
+    batch_store(
+        result[start], (start & 3) == 3 ? pixels[start] : func(pixels[start]));
+  }
+}
+
+// Tone map `size` floats of pixel data, as tonemap(), writing floats or
+// bytes. Also used for plain sRGB conversions.
+template <typename T>
+static void tonemap_batch(T* ldr, const float* hdr,
+    size_t size, float exposure, bool filmic, bool srgb) {
+  auto scale = exposure != 0 ? exp2(exposure) : 1.0f;
+  if (filmic && srgb) {
+    apply_batch(ldr, hdr, size, [scale](float hdr) {
+      return batch_rgb_to_srgb(batch_filmic(hdr * scale));
+    });
+  } else if (filmic) {
+    apply_batch(ldr, hdr, size,
+        [scale](float hdr) { return batch_filmic(hdr * scale); });
+  } else if (srgb) {
+    apply_batch(ldr, hdr, size,
+        [scale](float hdr) { return batch_rgb_to_srgb(hdr * scale); });
+  } else {
+    apply_batch(ldr, hdr, size, [scale](float hdr) { return hdr * scale; });
+  }
+}
+
+// Convert `size` floats of pixel data from sRGB to linear, as srgb_to_rgb().
+static void srgb_to_rgb_batch(
+    float* rgb, const float* srgb, size_t size) {
+  apply_batch(
+      rgb, srgb, size, [](float srgb) { return batch_srgb_to_rgb(srgb); });
+}
+
+// Run a batch kernel over chunks of `count` pixels in parallel. `Func` takes
+// the range of pixels to process.
+template <typename Func>
+static void parallel_batches(size_t count, Func&& func) {
+  parallel_for((count + batch_pixels - 1) / batch_pixels, [&](size_t chunk) {
+    auto start = chunk * batch_pixels, end = start + batch_pixels;
+    func(start, end < count ? end : count);
+  });
+}
+
+}  // namespace yocto
+
+// -----------------------------------------------------------------------------
+// IMAGE RESAMPLING
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Resampling filters, as in stb_image_resize, with the addition of Lanczos.
+// Distances are in pixels of the finer of the two images, and `scale` is the
+// ratio of the finer to the coarser pixel size. The box filter integrates
+// pixel coverage.
+static float resample_filter(resize_filter_type filter, float x, float scale) {
+  x = abs(x);
+  switch (filter) {
+    case resize_filter_type::box: {
+      auto outer = 0.5f + scale / 2, inner = 0.5f - scale / 2;
+      return x >= outer ? 0 : (x <= inner ? 1 : (outer - x) / scale);
+    }
+    case resize_filter_type::mitchell: {
+      if (x < 1) return (16 + x * x * (21 * x - 36)) / 18;
+      if (x < 2) return (32 + x * (-60 + x * (36 - 7 * x))) / 18;
+      return 0;
+    }
+    case resize_filter_type::catmullrom: {
+      if (x < 1) return 1 - x * x * (2.5f - 1.5f * x);
+      if (x < 2) return 2 - x * (4 + x * (0.5f * x - 2.5f));
+      return 0;
+    }
+    case resize_filter_type::lanczos: {
+      if (x < 1e-6f) return 1;
+      if (x >= 3) return 0;
+      auto px = pif * x;
+      return 3 * sin(px) * sin(px / 3) / (px * px);
+    }
+    default: return 0;
+  }
+}
+
+// Filter radius, in pixels of the finer image
+static float resample_radius(resize_filter_type filter, float scale) {
+  switch (filter) {
+    case resize_filter_type::box: return 0.5f + scale / 2;
+    case resize_filter_type::lanczos: return 3;
+    default: return 2;
+  }
+}
+
+// Precomputed filter weights to resample `size` pixels from `source` ones
+// along an axis. Each pixel blends `taps` source pixels, starting at `first`.
+// Taps outside the source are clamped to its edges.
+struct resample_weights {
+  int           size    = 0;
+  int           taps    = 0;
+  vector<int>   first   = {};
+  vector<float> weights = {};
+};
+
+// Compute resampling weights. Like stb_image_resize, pixels with the same
+// size are filtered as when downsampling.
+static resample_weights make_resample_weights(
+    int source, int size, resize_filter_type filter) {
+  auto ratio = size / (float)source;
+  if (filter == resize_filter_type::automatic) {
+    filter = ratio > 1 ? resize_filter_type::catmullrom
+                       : resize_filter_type::mitchell;
+  }
+  auto scale    = ratio > 1 ? 1 / ratio : ratio;
+  auto distance = ratio > 1 ? 1 : ratio;
+  auto radius   = resample_radius(filter, scale) / distance;
+  auto weights  = resample_weights{};
+  weights.size  = size;
+  weights.taps  = min((int)ceil(2 * radius) + 1, source);
+  weights.first.resize(size);
+  weights.weights.assign((size_t)size * weights.taps, 0);
+  for (auto idx = 0; idx < size; idx++) {
+    auto center = (idx + 0.5f) / ratio;
+    auto start  = (int)floor(center - radius + 0.5f);
+    auto end    = (int)floor(center + radius - 0.5f);
+    auto first  = min(max(start, 0), source - weights.taps);
+    auto values = weights.weights.data() + (size_t)idx * weights.taps;
+    auto total  = 0.0f;
+    for (auto i = start; i <= end; i++) {
+      auto weight = resample_filter(
+          filter, (center - (i + 0.5f)) * distance, scale);
+      values[clamp(i, 0, source - 1) - first] += weight;
+      total += weight;
+    }
+    if (total != 0) {
+      for (auto tap = 0; tap < weights.taps; tap++) values[tap] /= total;
+    }
+    weights.first[idx] = first;
+  }
+  return weights;
+}
+
+// Resample a row of pixels horizontally
+YOCTO_BATCH_CLONES static void resample_row(
+    vec4f* result, const vec4f* row, const resample_weights& weights) {
+  for (auto idx = 0; idx < weights.size; idx++) {
+    auto pixels = row + weights.first[idx];
+    auto values = weights.weights.data() + (size_t)idx * weights.taps;
+    auto sum    = vec4f{0, 0, 0, 0};
+    for (auto tap = 0; tap < weights.taps; tap++) {
+      sum += pixels[tap] * values[tap];
+    }
+    result[idx] = sum;
+  }
+}
+
+// Resample row `j` vertically from rows of `width` pixels. Accumulation is
+// done over batches of floats, so that it is vectorized.
+YOCTO_BATCH_CLONES static void resample_column(vec4f* result,
+    const vec4f* rows, int width, const resample_weights& weights, int j) {
+  auto size   = (size_t)width * 4;
+  auto source = (const float*)(rows + (size_t)weights.first[j] * width);
+  auto values = weights.weights.data() + (size_t)j * weights.taps;
+  auto output = (float*)result;
+  auto start  = (size_t)0;
+  for (; start + batch_lanes <= size; start += batch_lanes) {
+    float sum[batch_lanes] = {};
+    for (auto tap = 0; tap < weights.taps; tap++) {
+      auto row = source + tap * size + start;
+      for (auto lane = 0; lane < batch_lanes; lane++)
+        sum[lane] += row[lane] * values[tap];
+    }
+    for (auto lane = 0; lane < batch_lanes; lane++)
+      output[start + lane] = sum[lane];
+  }
+  for (; start < size; start++) {
+    auto sum = 0.0f;
+    for (auto tap = 0; tap < weights.taps; tap++)
+      sum += source[tap * size + start] * values[tap];
+    output[start] = sum;
+  }
+}
+
+// Resample an image with separable filters, first horizontally, then
+// vertically, in parallel over rows. Pixels are filtered as linear colors
+// with premultiplied alpha. `decode` fills a row of the source image with
+// them, and `encode` takes a row of the result.
+template <typename Decode, typename Encode>
+static void resample_image(int width, int height, int res_width,
+    int res_height, resize_filter_type filter, Decode&& decode,
+    Encode&& encode) {
+  auto xweights = make_resample_weights(width, res_width, filter);
+  auto yweights = make_resample_weights(height, res_height, filter);
+  auto rows     = vector<vec4f>((size_t)height * res_width);
+  parallel_for(height, [&](int j) {
+    auto row = vector<vec4f>(width);
+    decode(row.data(), j);
+    resample_row(rows.data() + (size_t)j * res_width, row.data(), xweights);
+  });
+  parallel_for(res_height, [&](int j) {
+    auto row = vector<vec4f>(res_width);
+    resample_column(row.data(), rows.data(), res_width, yweights, j);
+    encode(row.data(), j);
+  });
+}
+
+// Convert a row of pixels to linear colors with premultiplied alpha
+static void decode_row(
+    vec4f* row, const vec4f* pixels, int width, bool linear) {
+  if (!linear) {
+    srgb_to_rgb_batch((float*)row, (const float*)pixels, (size_t)width * 4);
+  } else {
+    std::copy(pixels, pixels + width, row);
+  }
+  for (auto i = 0; i < width; i++) {
+    auto& pixel = row[i];
+    pixel       = {pixel.x * pixel.w, pixel.y * pixel.w, pixel.z * pixel.w,
+        pixel.w};
+  }
+}
+static void decode_row(vec4f* row, const vec4b* pixels, int width) {
+  for (auto i = 0; i < width; i++) {
+    auto  pixel = pixels[i];
+    auto  alpha = byte_to_float(pixel.w);
+    row[i] = {srgb_to_rgb_table[pixel.x] * alpha,
+        srgb_to_rgb_table[pixel.y] * alpha, srgb_to_rgb_table[pixel.z] * alpha,
+        alpha};
+  }
+}
+
+// Convert a row of linear colors with premultiplied alpha to pixels
+static void unpremultiply_row(vec4f* row, int width) {
+  for (auto i = 0; i < width; i++) {
+    auto& pixel = row[i];
+    auto  scale = pixel.w != 0 ? 1 / pixel.w : 0;
+    pixel = {pixel.x * scale, pixel.y * scale, pixel.z * scale, pixel.w};
+  }
+}
+static void encode_row(vec4f* pixels, vec4f* row, int width, bool linear) {
+  unpremultiply_row(row, width);
+  if (!linear) {
+    tonemap_batch(
+        (float*)pixels, (const float*)row, (size_t)width * 4, 0, false, true);
+  } else {
+    std::copy(row, row + width, pixels);
+  }
+}
+static void encode_row(vec4b* pixels, vec4f* row, int width) {
+  unpremultiply_row(row, width);
+  tonemap_batch(
+      (byte*)pixels, (const float*)row, (size_t)width * 4, 0, false, true);
+}
+
+// Compute the size of a resized image, keeping the aspect ratio if one of
+// the sizes is zero.
+static vec2i resize_size(int width, int height, int res_width, int res_height) {
+  if (res_width == 0 && res_height == 0) {
+    throw std::invalid_argument{"bad image size in resize"};
+  }
+  if (res_height == 0) {
+    res_height = (int)round(res_width * (double)height / (double)width);
+  } else if (res_width == 0) {
+    res_width = (int)round(res_height * (double)width / (double)height);
+  }
+  return {res_width, res_height};
+}
+
+}  // namespace yocto
+
 // -----------------------------------------------------------------------------
 // IMPLEMENTATION OF IMAGE DATA AND UTILITIES
 // -----------------------------------------------------------------------------
@@ -150,9 +548,9 @@ color_image tonemap_image(
     const color_image& image, float exposure, bool filmic) {
   if (!image.linear) return image;
   auto result = make_image(image.width, image.height, false);
-  for (auto idx = 0; idx < image.width * image.height; idx++) {
-    result.pixels[idx] = tonemap(image.pixels[idx], exposure, filmic, true);
-  }
+  tonemap_batch((float*)result.pixels.data(),
+      (const float*)image.pixels.data(), image.pixels.size() * 4, exposure,
+      filmic, true);
   return result;
 }
 
@@ -163,9 +561,9 @@ void tonemap_image(color_image& result, const color_image& image,
     throw std::invalid_argument{"image should be the same size"};
   if (result.linear) throw std::invalid_argument{"ldr expected"};
   if (image.linear) {
-    for (auto idx = (size_t)0; idx < image.pixels.size(); idx++) {
-      result.pixels[idx] = tonemap(image.pixels[idx], exposure, filmic);
-    }
+    tonemap_batch((float*)result.pixels.data(),
+        (const float*)image.pixels.data(), image.pixels.size() * 4, exposure,
+        filmic, true);
   } else {
     auto scale = vec4f{pow(2, exposure), pow(2, exposure), pow(2, exposure), 1};
     for (auto idx = (size_t)0; idx < image.pixels.size(); idx++) {
@@ -180,10 +578,11 @@ void tonemap_image_mt(color_image& result, const color_image& image,
     throw std::invalid_argument{"image should be the same size"};
   if (result.linear) throw std::invalid_argument{"ldr expected"};
   if (image.linear) {
-    parallel_for_batch((size_t)image.width * (size_t)image.height,
-        (size_t)image.width, [&result, &image, exposure, filmic](size_t idx) {
-          result.pixels[idx] = tonemap(image.pixels[idx], exposure, filmic);
-        });
+    parallel_batches(image.pixels.size(), [&](size_t start, size_t end) {
+      tonemap_batch((float*)(result.pixels.data() + start),
+          (const float*)(image.pixels.data() + start), (end - start) * 4,
+          exposure, filmic, true);
+    });
   } else {
     auto scale = vec4f{pow(2, exposure), pow(2, exposure), pow(2, exposure), 1};
     parallel_for_batch((size_t)image.width * (size_t)image.height,
@@ -194,27 +593,56 @@ void tonemap_image_mt(color_image& result, const color_image& image,
 }
 
 // Resize an image.
-color_image resize_image(
-    const color_image& image, int res_width, int res_height) {
-  if (res_width == 0 && res_height == 0) {
-    throw std::invalid_argument{"bad image size in resize"};
-  }
-  if (res_height == 0) {
-    res_height = (int)round(
-        res_width * (double)image.height / (double)image.width);
-  } else if (res_width == 0) {
-    res_width = (int)round(
-        res_height * (double)image.width / (double)image.height);
-  }
-  auto result = make_image(res_width, res_height, image.linear);
-  stbir_resize_float_generic((float*)image.pixels.data(), (int)image.width,
-      (int)image.height, (int)(sizeof(vec4f) * image.width),
-      (float*)result.pixels.data(), (int)result.width, (int)result.height,
-      (int)(sizeof(vec4f) * result.width), 4, 3, 0, STBIR_EDGE_CLAMP,
-      STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, nullptr);
+color_image resize_image(const color_image& image, int res_width,
+    int res_height, resize_filter_type filter) {
+  auto size   = resize_size(image.width, image.height, res_width, res_height);
+  auto result = make_image(size.x, size.y, image.linear);
+  resample_image(
+      image.width, image.height, result.width, result.height, filter,
+      [&](vec4f* row, int j) {
+        decode_row(row, image.pixels.data() + (size_t)j * image.width,
+            image.width, image.linear);
+      },
+      [&](vec4f* row, int j) {
+        encode_row(result.pixels.data() + (size_t)j * result.width, row,
+            result.width, result.linear);
+      });
   return result;
 }
 
+// Make a mip chain.
+vector<color_image> make_image_mips(
+    const color_image& image, resize_filter_type filter) {
+  // levels are kept in linear premultiplied colors to filter the next ones
+  auto mips   = vector<color_image>{image};
+  auto linear = vector<vec4f>((size_t)image.width * image.height);
+  parallel_for(image.height, [&](int j) {
+    auto offset = (size_t)j * image.width;
+    decode_row(linear.data() + offset, image.pixels.data() + offset,
+        image.width, image.linear);
+  });
+  while (mips.back().width > 1 || mips.back().height > 1) {
+    auto& level = mips.back();
+    auto  mip   = make_image(
+        max(level.width / 2, 1), max(level.height / 2, 1), image.linear);
+    auto next = vector<vec4f>((size_t)mip.width * mip.height);
+    resample_image(
+        level.width, level.height, mip.width, mip.height, filter,
+        [&](vec4f* row, int j) {
+          auto pixels = linear.data() + (size_t)j * level.width;
+          std::copy(pixels, pixels + level.width, row);
+        },
+        [&](vec4f* row, int j) {
+          auto offset = (size_t)j * mip.width;
+          std::copy(row, row + mip.width, next.data() + offset);
+          encode_row(mip.pixels.data() + offset, row, mip.width, mip.linear);
+        });
+    linear = std::move(next);
+    mips.push_back(std::move(mip));
+  }
+  return mips;
+}
+
 // Compute the difference between two images.
 color_image image_difference(
     const color_image& image1, const color_image& image2, bool display) {
@@ -362,17 +790,275 @@ void colorgrade_image_mt(color_image& result, const color_image& image,
       });
 }
 
+// Bake color grading params into a lookup table.
+colorgrade_lut make_colorgrade_lut(
+    const colorgrade_params& params, bool linear, int size) {
+  if (size < 2) throw std::invalid_argument{"lut size should be at least 2"};
+  auto lut            = colorgrade_lut{};
+  lut.size            = size;
+  lut.linear          = linear;
+  lut.range           = linear ? 4.0f : 1.0f;
+  lut.scale           = params.tint;
+  lut.params          = params;
+  lut.params.tint     = {1, 1, 1};
+  lut.params.exposure = 0;
+  if (params.exposure != 0) lut.scale *= exp2(params.exposure);
+  lut.values.resize((size_t)size * size * size);
+  parallel_for(size, [&lut](int b) {
+    auto grid = [&lut](int i) {
+      auto u = i / (float)(lut.size - 1);
+      return u * u * lut.range;
+    };
+    for (auto g = 0; g < lut.size; g++) {
+      for (auto r = 0; r < lut.size; r++) {
+        lut.values[((size_t)b * lut.size + g) * lut.size + r] = colorgrade(
+            vec4f{grid(r), grid(g), grid(b), 1}, lut.linear, lut.params);
+      }
+    }
+  });
+  return lut;
+}
+
+// Lookups of colors in a baked table, stored per lane. For each color, we
+// store the first table entry of its cell, the offsets of the two inner
+// vertices of the tetrahedron that contains it, the vertex weights, and
+// whether the color is inside the table.
+template <int lanes>
+struct colorgrade_lookups {
+  int   base[lanes], corner1[lanes], corner2[lanes];
+  float weight0[lanes], weight1[lanes], weight2[lanes], weight3[lanes];
+  int   inside[lanes];
+};
+
+// Compute the lookups of `lanes` pixels. Colors are clamped to the table and
+// compares are done on the float bits, so that the loop is vectorized.
+template <int lanes>
+YOCTO_BATCH_CLONES static void colorgrade_lookup(
+    colorgrade_lookups<lanes>& lookups, const vec4f* pixels,
+    const colorgrade_lut& lut) {
+  auto range = batch_bits(lut.range), last = lut.size - 2;
+  auto cells = (float)(lut.size - 1), scale = 1 / lut.range;
+  auto dr = 1, dg = lut.size, db = lut.size * lut.size;
+  float red[lanes], green[lanes], blue[lanes];
+  for (auto lane = 0; lane < lanes; lane++) {
+    red[lane]   = pixels[lane].x * lut.scale.x;
+    green[lane] = pixels[lane].y * lut.scale.y;
+    blue[lane]  = pixels[lane].z * lut.scale.z;
+  }
+  for (auto lane = 0; lane < lanes; lane++) {
+    auto r = batch_bits(red[lane]), g = batch_bits(green[lane]),
+         b = batch_bits(blue[lane]);
+    lookups.inside[lane] = (r >= 0 && r <= range) & (g >= 0 && g <= range) &
+                           (b >= 0 && b <= range);
+    r = r < 0 ? 0 : (r > range ? range : r);
+    g = g < 0 ? 0 : (g > range ? range : g);
+    b = b < 0 ? 0 : (b > range ? range : b);
+    auto u = batch_sqrt(batch_float(r) * scale) * cells,
+         v = batch_sqrt(batch_float(g) * scale) * cells,
+         w = batch_sqrt(batch_float(b) * scale) * cells;
+    auto i = min((int)u, last), j = min((int)v, last), k = min((int)w, last);
+    auto fx = u - (float)i, fy = v - (float)j, fz = w - (float)k;
+
+    // order the fractions to pick the tetrahedron
+    auto xy = batch_bits(fx) >= batch_bits(fy),
+         yz = batch_bits(fy) >= batch_bits(fz),
+         xz = batch_bits(fx) >= batch_bits(fz);
+    auto fmax = batch_select(
+        xy, batch_select(xz, fx, fz), batch_select(yz, fy, fz));
+    auto fmin = batch_select(
+        xy, batch_select(yz, fz, fy), batch_select(xz, fz, fx));
+    auto fmid             = fx + fy + fz - fmax - fmin;
+    lookups.base[lane]    = (k * lut.size + j) * lut.size + i;
+    lookups.corner1[lane] = xy ? (xz ? dr : db) : (yz ? dg : db);
+    lookups.corner2[lane] = dr + dg + db -
+                            (xy ? (yz ? db : dg) : (xz ? db : dr));
+    lookups.weight0[lane] = 1 - fmax;
+    lookups.weight1[lane] = fmax - fmid;
+    lookups.weight2[lane] = fmid - fmin;
+    lookups.weight3[lane] = fmin;
+  }
+}
+
+// Blend the table entries of a lookup
+template <int lanes>
+static inline vec4f colorgrade_blend(const colorgrade_lookups<lanes>& lookups,
+    int lane, const vec4f& color, const vec4f* values, int diagonal) {
+  auto base   = lookups.base[lane];
+  auto graded = values[base] * lookups.weight0[lane] +
+                values[base + lookups.corner1[lane]] * lookups.weight1[lane] +
+                values[base + lookups.corner2[lane]] * lookups.weight2[lane] +
+                values[base + diagonal] * lookups.weight3[lane];
+  return {graded.x, graded.y, graded.z, color.w};
+}
+
+// Color grade a color with a baked lookup table.
+vec4f colorgrade(const vec4f& color, const colorgrade_lut& lut) {
+  auto lookups = colorgrade_lookups<1>{};
+  colorgrade_lookup(lookups, &color, lut);
+  if (!lookups.inside[0]) {
+    auto rgb = xyz(color) * lut.scale;
+    return colorgrade(
+        vec4f{rgb.x, rgb.y, rgb.z, color.w}, lut.linear, lut.params);
+  }
+  return colorgrade_blend(
+      lookups, 0, color, lut.values.data(), 1 + lut.size + lut.size * lut.size);
+}
+
+// Color grade `size` pixels with a baked lookup table. Lookups are computed
+// for a batch of pixels at once, then table entries are blended per pixel.
+// Colors outside the table are graded directly.
+static void colorgrade_batch(vec4f* result, const vec4f* pixels,
+    size_t size, const colorgrade_lut& lut) {
+  auto start    = (size_t)0;
+  auto lookups  = colorgrade_lookups<batch_lanes>{};
+  auto values   = lut.values.data();
+  auto diagonal = 1 + lut.size + lut.size * lut.size;
+  for (; start + batch_lanes <= size; start += batch_lanes) {
+    colorgrade_lookup(lookups, pixels + start, lut);
+    for (auto lane = 0; lane < batch_lanes; lane++) {
+      result[start + lane] = lookups.inside[lane]
+                                 ? colorgrade_blend(lookups, lane,
+                                       pixels[start + lane], values, diagonal)
+                                 : colorgrade(pixels[start + lane], lut);
+    }
+  }
+  for (; start < size; start++) result[start] = colorgrade(pixels[start], lut);
+}
+
+// Color grade an hdr or ldr image to an ldr image, with a baked lookup table.
+void colorgrade_image_mt(
+    color_image& result, const color_image& image, const colorgrade_lut& lut) {
+  if (image.width != result.width || image.height != result.height)
+    throw std::invalid_argument{"image should be the same size"};
+  if (result.linear) throw std::invalid_argument{"non linear expected"};
+  if (image.linear != lut.linear)
+    throw std::invalid_argument{"lut baked for a different color space"};
+  parallel_batches(image.pixels.size(), [&](size_t start, size_t end) {
+    colorgrade_batch(result.pixels.data() + start, image.pixels.data() + start,
+        end - start, lut);
+  });
+}
+
 // determine white balance colors
 vec4f compute_white_balance(const color_image& image) {
-  auto rgb = vec3f{0, 0, 0};
-  for (auto idx = (size_t)0; image.pixels.size(); idx++) {
-    rgb += xyz(image.pixels[idx]);
-  }
+  auto rgb = parallel_reduce(
+      image.pixels.size(), vec3f{0, 0, 0},
+      [&](size_t idx) { return xyz(image.pixels[idx]); },
+      [](const vec3f& a, const vec3f& b) { return a + b; });
   if (rgb == vec3f{0, 0, 0}) return {0, 0, 0, 1};
   rgb /= max(rgb);
   return {rgb.x, rgb.y, rgb.z, 1};
 }
 
+// Denoise an image with an edge-avoiding a-trous wavelet filter
+color_image denoise_image(const color_image& image, const color_image& albedo,
+    const color_image& normal, int iterations) {
+  auto result = make_image(image.width, image.height, image.linear);
+  denoise_image(result, image, albedo, normal, iterations);
+  return result;
+}
+void denoise_image(color_image& result, const color_image& image,
+    const color_image& albedo, const color_image& normal, int iterations) {
+  if (image.width != result.width || image.height != result.height ||
+      image.width != albedo.width || image.height != albedo.height ||
+      image.width != normal.width || image.height != normal.height)
+    throw std::invalid_argument{"image should be the same size"};
+  if (!image.linear || !result.linear)
+    throw std::invalid_argument{"linear expected"};
+
+  // filter parameters: color, albedo and normal tolerances
+  const auto sigma_color  = 4.0f;
+  const auto sigma_albedo = 0.2f;
+  const auto exp_normal   = 32.0f;
+  const auto min_albedo   = 0.01f;
+  const auto kernel       = std::array<float, 5>{
+      1 / 16.0f, 1 / 4.0f, 3 / 8.0f, 1 / 4.0f, 1 / 16.0f};
+
+  // split features in planar arrays, demodulating albedo from color so that
+  // texture detail is not blurred
+  auto size     = (size_t)image.width * (size_t)image.height;
+  auto colors   = vector<vec3f>(size);
+  auto filtered = vector<vec3f>(size);
+  auto albedos  = vector<vec3f>(size);
+  auto normals  = vector<vec3f>(size);
+  for (auto idx = (size_t)0; idx < size; idx++) {
+    albedos[idx] = max(xyz(albedo.pixels[idx]), min_albedo);
+    normals[idx] = xyz(normal.pixels[idx]);
+    colors[idx]  = xyz(image.pixels[idx]) / albedos[idx];
+  }
+
+  // estimate the noise level as the median of the local color variances
+  auto variances = vector<float>{};
+  for (auto j = 1; j < image.height - 1; j++) {
+    for (auto i = 1; i < image.width - 1; i++) {
+      auto mean = vec3f{0, 0, 0}, mean2 = vec3f{0, 0, 0};
+      for (auto kj = -1; kj <= 1; kj++) {
+        for (auto ki = -1; ki <= 1; ki++) {
+          auto color = colors[(size_t)(j + kj) * image.width + i + ki];
+          auto tcolor = color / (1 + color);
+          mean += tcolor;
+          mean2 += tcolor * tcolor;
+        }
+      }
+      mean /= 9;
+      mean2 /= 9;
+      variances.push_back(sum(mean2 - mean * mean) / 3);
+    }
+  }
+  auto noise = 1.0f;
+  if (!variances.empty()) {
+    auto median = variances.begin() + variances.size() / 2;
+    std::nth_element(variances.begin(), median, variances.end());
+    noise = max(*median, 1e-6f);
+  }
+
+  // filter passes with increasing step and decreasing color tolerance
+  for (auto iteration = 0; iteration < iterations; iteration++) {
+    auto step  = 1 << iteration;
+    auto scale = (float)(1 << iteration) /
+                 (sigma_color * sigma_color * noise);
+    parallel_for(image.height, [&](int j) {
+      for (auto i = 0; i < image.width; i++) {
+        auto idx     = (size_t)j * image.width + i;
+        auto color   = colors[idx];
+        auto albedo_ = albedos[idx];
+        auto normal_ = normals[idx];
+        auto tcolor  = color / (1 + color);
+        auto sum     = vec3f{0, 0, 0};
+        auto weights = 0.0f;
+        for (auto kj = 0; kj < 5; kj++) {
+          auto jj = j + (kj - 2) * step;
+          if (jj < 0 || jj >= image.height) continue;
+          for (auto ki = 0; ki < 5; ki++) {
+            auto ii = i + (ki - 2) * step;
+            if (ii < 0 || ii >= image.width) continue;
+            auto kidx   = (size_t)jj * image.width + ii;
+            auto kcolor = colors[kidx];
+            auto dcolor = kcolor / (1 + kcolor) - tcolor;
+            auto dalbedo = albedos[kidx] - albedo_;
+            auto cnormal = max(dot(normals[kidx], normal_), 0.0f);
+            auto weight  = kernel[ki] * kernel[kj] *
+                          exp(-dot(dcolor, dcolor) * scale -
+                              dot(dalbedo, dalbedo) /
+                                  (sigma_albedo * sigma_albedo)) *
+                          pow(cnormal, exp_normal);
+            sum += kcolor * weight;
+            weights += weight;
+          }
+        }
+        filtered[idx] = weights > 0 ? sum / weights : color;
+      }
+    });
+    std::swap(colors, filtered);
+  }
+
+  // remodulate albedo
+  for (auto idx = (size_t)0; idx < size; idx++) {
+    auto rgb           = colors[idx] * albedos[idx];
+    result.pixels[idx] = {rgb.x, rgb.y, rgb.z, image.pixels[idx].w};
+  }
+}
+
 }  // namespace yocto
 
 // -----------------------------------------------------------------------------
@@ -417,15 +1103,37 @@ static color_image make_proc_image(
     int width, int height, bool linear, Shader&& shader) {
   auto image = make_image(width, height, linear);
   auto scale = 1.0f / max(width, height);
-  for (auto j = 0; j < height; j++) {
+  parallel_for(height, [&](int j) {
     for (auto i = 0; i < width; i++) {
       auto uv                     = vec2f{i * scale, j * scale};
       image.pixels[j * width + i] = shader(uv);
     }
-  }
+  });
   return image;
 }
 
+// Makes a noise image, evaluating noise for a row of pixels at once. `Noise`
+// fills noise values for a vector of points.
+template <typename Noise>
+static void make_noise_image(vector<vec4f>& pixels, int width, int height,
+    float scale, const vec4f& color0, const vec4f& color1, Noise&& noise) {
+  pixels.resize((size_t)width * (size_t)height);
+  auto pixel_scale = 1.0f / max(width, height);
+  parallel_for(height, [&](int j) {
+    auto points = vector<vec3f>(width);
+    auto values = vector<float>{};
+    for (auto i = 0; i < width; i++) {
+      auto uv   = vec2f{i * pixel_scale, j * pixel_scale} * (8 * scale);
+      points[i] = {uv.x, uv.y, 0};
+    }
+    noise(values, points);
+    for (auto i = 0; i < width; i++) {
+      auto v                = clamp(values[i], 0.0f, 1.0f);
+      pixels[j * width + i] = lerp(color0, color1, v);
+    }
+  });
+}
+
 // Make an image
 color_image make_grid(int width, int height, float scale, const vec4f& color0,
     const vec4f& color1) {
@@ -558,43 +1266,42 @@ color_image make_colormapramp(int width, int height, float scale) {
 
 color_image make_noisemap(int width, int height, float scale,
     const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(width, height, true, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_noise(vec3f{uv.x, uv.y, 0});
-    v      = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  auto image = make_image(width, height, true);
+  make_noise_image(image.pixels, width, height, scale, color0, color1,
+      [](vector<float>& values, const vector<vec3f>& points) {
+        perlin_noise(values, points);
+      });
+  return image;
 }
 
 color_image make_fbmmap(int width, int height, float scale, const vec4f& noise,
     const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(width, height, true, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_fbm({uv.x, uv.y, 0}, noise.x, noise.y, (int)noise.z);
-    v      = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  auto image = make_image(width, height, true);
+  make_noise_image(image.pixels, width, height, scale, color0, color1,
+      [&noise](vector<float>& values, const vector<vec3f>& points) {
+        perlin_fbm(values, points, noise.x, noise.y, (int)noise.z);
+      });
+  return image;
 }
 
 color_image make_turbulencemap(int width, int height, float scale,
     const vec4f& noise, const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(width, height, true, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_turbulence({uv.x, uv.y, 0}, noise.x, noise.y, (int)noise.z);
-    v      = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  auto image = make_image(width, height, true);
+  make_noise_image(image.pixels, width, height, scale, color0, color1,
+      [&noise](vector<float>& values, const vector<vec3f>& points) {
+        perlin_turbulence(values, points, noise.x, noise.y, (int)noise.z);
+      });
+  return image;
 }
 
 color_image make_ridgemap(int width, int height, float scale,
     const vec4f& noise, const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(width, height, true, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_ridge(
-        {uv.x, uv.y, 0}, noise.x, noise.y, (int)noise.z, noise.w);
-    v = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  auto image = make_image(width, height, true);
+  make_noise_image(image.pixels, width, height, scale, color0, color1,
+      [&noise](vector<float>& values, const vector<vec3f>& points) {
+        perlin_ridge(values, points, noise.x, noise.y, (int)noise.z, noise.w);
+      });
+  return image;
 }
 
 // Add image border
@@ -705,9 +1412,8 @@ color_image make_sunsky(int width, int height, float theta_sun, float turbidity,
   };
 
   // Make the sun sky image
-  auto img          = make_image(width, height, true);
-  auto sky_integral = 0.0f, sun_integral = 0.0f;
-  for (auto j = 0; j < height / 2; j++) {
+  auto img = make_image(width, height, true);
+  parallel_for(height / 2, [&](int j) {
     auto theta = pif * ((j + 0.5f) / height);
     theta      = clamp(theta, 0.0f, pif / 2 - flt_eps);
     for (int i = 0; i < width; i++) {
@@ -716,22 +1422,21 @@ color_image make_sunsky(int width, int height, float theta_sun, float turbidity,
       auto gamma   = acos(clamp(dot(w, sun_direction), -1.0f, 1.0f));
       auto sky_col = sky(theta, gamma, theta_sun);
       auto sun_col = sun(theta, gamma);
-      sky_integral += mean(sky_col) * sin(theta);
-      sun_integral += mean(sun_col) * sin(theta);
-      auto col                  = sky_col + sun_col;
+      auto col     = sky_col + sun_col;
       img.pixels[j * width + i] = {col.x, col.y, col.z, 1};
     }
-  }
+  });
 
   if (ground_albedo != zero3f) {
     auto ground = zero3f;
     for (auto j = 0; j < height / 2; j++) {
-      auto theta = pif * ((j + 0.5f) / height);
+      auto theta     = pif * ((j + 0.5f) / height);
+      auto cos_theta = cos(theta);
+      auto angle     = sin(theta) * 4 * pif / (width * height);
       for (int i = 0; i < width; i++) {
-        auto pxl   = img.pixels[j * width + i];
-        auto le    = vec3f{pxl.x, pxl.y, pxl.z};
-        auto angle = sin(theta) * 4 * pif / (width * height);
-        ground += le * (ground_albedo / pif) * cos(theta) * angle;
+        auto pxl = img.pixels[j * width + i];
+        auto le  = vec3f{pxl.x, pxl.y, pxl.z};
+        ground += le * (ground_albedo / pif) * cos_theta * angle;
       }
     }
     for (auto j = height / 2; j < height; j++) {
@@ -782,14 +1487,14 @@ namespace yocto {
 // Lookup an image at coordinates `ij`
 static vec4f lookup_image(const vector<vec4f>& img, int width, int height,
     int i, int j, bool as_linear) {
-  return img[j * width * i];
+  return img[j * width + i];
 }
 static vec4f lookup_image(const vector<vec4b>& img, int width, int height,
     int i, int j, bool as_linear) {
   if (as_linear) {
-    return srgb_to_rgb(byte_to_float(img[j * width * i]));
+    return srgb_to_rgb(img[j * width + i]);
   } else {
-    return byte_to_float(img[j * width * i]);
+    return byte_to_float(img[j * width + i]);
   }
 }
 
@@ -850,52 +1555,61 @@ void byte_to_float(vector<vec4f>& fl, const vector<vec4b>& bt) {
 }
 void float_to_byte(vector<vec4b>& bt, const vector<vec4f>& fl) {
   bt.resize(fl.size());
-  for (auto i = 0ull; i < bt.size(); i++) bt[i] = float_to_byte(fl[i]);
+  parallel_batches(bt.size(), [&](size_t start, size_t end) {
+    for (auto i = start; i < end; i++) bt[i] = float_to_byte(fl[i]);
+  });
 }
 
 // Conversion between linear and gamma-encoded images.
 void srgb_to_rgb(vector<vec4f>& rgb, const vector<vec4f>& srgb) {
   rgb.resize(srgb.size());
-  for (auto i = 0ull; i < rgb.size(); i++) rgb[i] = srgb_to_rgb(srgb[i]);
+  srgb_to_rgb_batch(
+      (float*)rgb.data(), (const float*)srgb.data(), srgb.size() * 4);
 }
 void rgb_to_srgb(vector<vec4f>& srgb, const vector<vec4f>& rgb) {
   srgb.resize(rgb.size());
-  for (auto i = 0ull; i < srgb.size(); i++) srgb[i] = rgb_to_srgb(rgb[i]);
+  tonemap_batch((float*)srgb.data(), (const float*)rgb.data(), rgb.size() * 4,
+      0, false, true);
 }
 void srgb_to_rgb(vector<vec4f>& rgb, const vector<vec4b>& srgb) {
   rgb.resize(srgb.size());
   for (auto i = 0ull; i < rgb.size(); i++)
-    rgb[i] = srgb_to_rgb(byte_to_float(srgb[i]));
+    rgb[i] = srgb_to_rgb(srgb[i]);
 }
 void rgb_to_srgb(vector<vec4b>& srgb, const vector<vec4f>& rgb) {
   srgb.resize(rgb.size());
-  for (auto i = 0ull; i < srgb.size(); i++)
-    srgb[i] = float_to_byte(rgb_to_srgb(rgb[i]));
+  tonemap_batch((byte*)srgb.data(), (const float*)rgb.data(), rgb.size() * 4,
+      0, false, true);
 }
 
 // Apply exposure and filmic tone mapping
 void tonemap_image(vector<vec4f>& ldr, const vector<vec4f>& hdr, float exposure,
     bool filmic, bool srgb) {
   ldr.resize(hdr.size());
-  for (auto i = 0ull; i < hdr.size(); i++)
-    ldr[i] = tonemap(hdr[i], exposure, filmic, srgb);
+  tonemap_batch((float*)ldr.data(), (const float*)hdr.data(), hdr.size() * 4,
+      exposure, filmic, srgb);
 }
 void tonemap_image(vector<vec4b>& ldr, const vector<vec4f>& hdr, float exposure,
     bool filmic, bool srgb) {
   ldr.resize(hdr.size());
-  for (auto i = 0ull; i < hdr.size(); i++)
-    ldr[i] = float_to_byte(tonemap(hdr[i], exposure, filmic, srgb));
+  tonemap_batch((byte*)ldr.data(), (const float*)hdr.data(), hdr.size() * 4,
+      exposure, filmic, srgb);
 }
 
 void tonemap_image_mt(vector<vec4f>& ldr, const vector<vec4f>& hdr,
     float exposure, bool filmic, bool srgb) {
-  parallel_for_batch(hdr.size(), (size_t)1024,
-      [&](size_t i) { ldr[i] = tonemap(hdr[i], exposure, filmic, srgb); });
+  parallel_batches(hdr.size(), [&](size_t start, size_t end) {
+    tonemap_batch((float*)(ldr.data() + start),
+        (const float*)(hdr.data() + start), (end - start) * 4, exposure,
+        filmic, srgb);
+  });
 }
 void tonemap_image_mt(vector<vec4b>& ldr, const vector<vec4f>& hdr,
     float exposure, bool filmic, bool srgb) {
-  parallel_for_batch(hdr.size(), (size_t)1024, [&](size_t i) {
-    ldr[i] = float_to_byte(tonemap(hdr[i], exposure, filmic, srgb));
+  parallel_batches(hdr.size(), [&](size_t start, size_t end) {
+    tonemap_batch((byte*)(ldr.data() + start),
+        (const float*)(hdr.data() + start), (end - start) * 4, exposure,
+        filmic, srgb);
   });
 }
 
@@ -922,43 +1636,38 @@ void colorgrade_image_mt(vector<vec4b>& corrected, const vector<vec4f>& img,
 
 // compute white balance
 vec3f compute_white_balance(const vector<vec4f>& img) {
-  auto rgb = zero3f;
-  for (auto& p : img) rgb += xyz(p);
+  auto rgb = parallel_reduce(
+      img.size(), zero3f, [&](size_t idx) { return xyz(img[idx]); },
+      [](const vec3f& a, const vec3f& b) { return a + b; });
   if (rgb == zero3f) return zero3f;
   return rgb / max(rgb);
 }
 
 void resize_image(vector<vec4f>& res, const vector<vec4f>& img, int width,
-    int height, int res_width, int res_height) {
-  if (res_width == 0 && res_height == 0) {
-    throw std::invalid_argument{"bad image size in resize"};
-  }
-  if (res_height == 0) {
-    res_height = (int)round(res_width * (double)height / (double)width);
-  } else if (res_width == 0) {
-    res_width = (int)round(res_height * (double)width / (double)height);
-  }
-  res.resize((size_t)res_width * (size_t)res_height);
-  stbir_resize_float_generic((float*)img.data(), width, height,
-      sizeof(vec4f) * width, (float*)res.data(), res_width, res_height,
-      sizeof(vec4f) * res_width, 4, 3, 0, STBIR_EDGE_CLAMP,
-      STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, nullptr);
+    int height, int res_width, int res_height, resize_filter_type filter) {
+  auto size = resize_size(width, height, res_width, res_height);
+  res.resize((size_t)size.x * (size_t)size.y);
+  resample_image(
+      width, height, size.x, size.y, filter,
+      [&](vec4f* row, int j) {
+        decode_row(row, img.data() + (size_t)j * width, width, true);
+      },
+      [&](vec4f* row, int j) {
+        encode_row(res.data() + (size_t)j * size.x, row, size.x, true);
+      });
 }
 void resize_image(vector<vec4b>& res, const vector<vec4b>& img, int width,
-    int height, int res_width, int res_height) {
-  if (res_width == 0 && res_height == 0) {
-    throw std::invalid_argument{"bad image size in resize"};
-  }
-  if (res_height == 0) {
-    res_height = (int)round(res_width * (double)height / (double)width);
-  } else if (res_width == 0) {
-    res_width = (int)round(res_height * (double)width / (double)height);
-  }
-  res.resize((size_t)res_width * (size_t)res_height);
-  stbir_resize_uint8_generic((byte*)img.data(), width, height,
-      sizeof(vec4b) * width, (byte*)res.data(), res_width, res_height,
-      sizeof(vec4b) * res_width, 4, 3, 0, STBIR_EDGE_CLAMP,
-      STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, nullptr);
+    int height, int res_width, int res_height, resize_filter_type filter) {
+  auto size = resize_size(width, height, res_width, res_height);
+  res.resize((size_t)size.x * (size_t)size.y);
+  resample_image(
+      width, height, size.x, size.y, filter,
+      [&](vec4f* row, int j) {
+        decode_row(row, img.data() + (size_t)j * width, width);
+      },
+      [&](vec4f* row, int j) {
+        encode_row(res.data() + (size_t)j * size.x, row, size.x);
+      });
 }
 
 void image_difference(vector<vec4f>& diff, const vector<vec4f>& a,
@@ -1009,12 +1718,12 @@ static void make_proc_image(
     vector<vec4f>& pixels, int width, int height, Shader&& shader) {
   pixels.resize((size_t)width * (size_t)height);
   auto scale = 1.0f / max(width, height);
-  for (auto j = 0; j < height; j++) {
+  parallel_for(height, [&](int j) {
     for (auto i = 0; i < width; i++) {
       auto uv               = vec2f{i * scale, j * scale};
       pixels[j * width + i] = shader(uv);
     }
-  }
+  });
 }
 
 // Make an image
@@ -1151,43 +1860,34 @@ void make_colormapramp(
 
 void make_noisemap(vector<vec4f>& pixels, int width, int height, float scale,
     const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(pixels, width, height, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_noise(vec3f{uv.x, uv.y, 0});
-    v      = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  return make_noise_image(pixels, width, height, scale, color0, color1,
+      [](vector<float>& values, const vector<vec3f>& points) {
+        perlin_noise(values, points);
+      });
 }
 
 void make_fbmmap(vector<vec4f>& pixels, int width, int height, float scale,
     const vec4f& noise, const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(pixels, width, height, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_fbm({uv.x, uv.y, 0}, noise.x, noise.y, (int)noise.z);
-    v      = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  return make_noise_image(pixels, width, height, scale, color0, color1,
+      [&noise](vector<float>& values, const vector<vec3f>& points) {
+        perlin_fbm(values, points, noise.x, noise.y, (int)noise.z);
+      });
 }
 
 void make_turbulencemap(vector<vec4f>& pixels, int width, int height,
     float scale, const vec4f& noise, const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(pixels, width, height, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_turbulence({uv.x, uv.y, 0}, noise.x, noise.y, (int)noise.z);
-    v      = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  return make_noise_image(pixels, width, height, scale, color0, color1,
+      [&noise](vector<float>& values, const vector<vec3f>& points) {
+        perlin_turbulence(values, points, noise.x, noise.y, (int)noise.z);
+      });
 }
 
 void make_ridgemap(vector<vec4f>& pixels, int width, int height, float scale,
     const vec4f& noise, const vec4f& color0, const vec4f& color1) {
-  return make_proc_image(pixels, width, height, [=](vec2f uv) {
-    uv *= 8 * scale;
-    auto v = perlin_ridge(
-        {uv.x, uv.y, 0}, noise.x, noise.y, (int)noise.z, noise.w);
-    v = clamp(v, 0.0f, 1.0f);
-    return lerp(color0, color1, v);
-  });
+  return make_noise_image(pixels, width, height, scale, color0, color1,
+      [&noise](vector<float>& values, const vector<vec3f>& points) {
+        perlin_ridge(values, points, noise.x, noise.y, (int)noise.z, noise.w);
+      });
 }
 
 // Add image border
@@ -1299,8 +1999,7 @@ void make_sunsky(vector<vec4f>& pixels, int width, int height, float theta_sun,
 
   // Make the sun sky image
   pixels.resize(width * height);
-  auto sky_integral = 0.0f, sun_integral = 0.0f;
-  for (auto j = 0; j < height / 2; j++) {
+  parallel_for(height / 2, [&](int j) {
     auto theta = pif * ((j + 0.5f) / height);
     theta      = clamp(theta, 0.0f, pif / 2 - flt_eps);
     for (int i = 0; i < width; i++) {
@@ -1309,22 +2008,21 @@ void make_sunsky(vector<vec4f>& pixels, int width, int height, float theta_sun,
       auto gamma   = acos(clamp(dot(w, sun_direction), -1.0f, 1.0f));
       auto sky_col = sky(theta, gamma, theta_sun);
       auto sun_col = sun(theta, gamma);
-      sky_integral += mean(sky_col) * sin(theta);
-      sun_integral += mean(sun_col) * sin(theta);
-      auto col              = sky_col + sun_col;
+      auto col     = sky_col + sun_col;
       pixels[j * width + i] = {col.x, col.y, col.z, 1};
     }
-  }
+  });
 
   if (ground_albedo != zero3f) {
     auto ground = zero3f;
     for (auto j = 0; j < height / 2; j++) {
-      auto theta = pif * ((j + 0.5f) / height);
+      auto theta     = pif * ((j + 0.5f) / height);
+      auto cos_theta = cos(theta);
+      auto angle     = sin(theta) * 4 * pif / (width * height);
       for (int i = 0; i < width; i++) {
-        auto pxl   = pixels[j * width + i];
-        auto le    = vec3f{pxl.x, pxl.y, pxl.z};
-        auto angle = sin(theta) * 4 * pif / (width * height);
-        ground += le * (ground_albedo / pif) * cos(theta) * angle;
+        auto pxl = pixels[j * width + i];
+        auto le  = vec3f{pxl.x, pxl.y, pxl.z};
+        ground += le * (ground_albedo / pif) * cos_theta * angle;
       }
     }
     for (auto j = height / 2; j < height; j++) {
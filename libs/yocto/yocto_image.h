@@ -5,8 +5,7 @@
 // algorithms. These include a simple image data structure, color conversion
 // utilities and tone mapping, loading and saving functionality, and image
 // resizing.
-// Yocto/Image is implemented in `yocto_image.h` and `yocto_image.cpp`, and
-// depends on `stb_image_resize.h` for image resizing.
+// Yocto/Image is implemented in `yocto_image.h` and `yocto_image.cpp`.
 //
 
 //
@@ -111,8 +110,24 @@ void tonemap_image(color_image& ldr, const color_image& image, float exposure,
 void tonemap_image_mt(color_image& ldr, const color_image& image,
     float exposure, bool filmic = false);
 
-// Resize an image.
-color_image resize_image(const color_image& image, int width, int height);
+// Resampling filters used for resizing. The automatic filter uses Catmull-Rom
+// for upsampling and Mitchell for downsampling.
+enum struct resize_filter_type { automatic, box, mitchell, catmullrom, lanczos };
+
+// Resampling filter names
+inline const auto resize_filter_names = vector<string>{
+    "automatic", "box", "mitchell", "catmullrom", "lanczos"};
+
+// Resize an image. If one of the sizes is zero, the aspect ratio is kept.
+// Ldr images are filtered in linear color space. Uses multithreading for speed.
+color_image resize_image(const color_image& image, int width, int height,
+    resize_filter_type filter = resize_filter_type::automatic);
+
+// Make a mip chain, from the image down to one pixel, halving the size at
+// each level. Each level is filtered from the previous one, in linear color
+// space. Uses multithreading for speed.
+vector<color_image> make_image_mips(const color_image& image,
+    resize_filter_type filter = resize_filter_type::automatic);
 
 // set/get region
 void set_region(color_image& image, const color_image& region, int x, int y);
@@ -148,9 +163,44 @@ void colorgrade_image(color_image& result, const color_image& image,
 void colorgrade_image_mt(color_image& result, const color_image& image,
     const colorgrade_params& params);
 
+// Color grading baked into a 3D lookup table. Exposure and tint are applied
+// before the lookup, and the table is indexed by the square root of the
+// exposed colors in [0, range]. Colors outside the range are graded directly.
+struct colorgrade_lut {
+  int               size   = 0;          // entries per axis
+  bool              linear = false;      // whether inputs are linear
+  float             range  = 1;          // max exposed color in the table
+  vec3f             scale  = {1, 1, 1};  // exposure and tint
+  colorgrade_params params = {};         // params after exposure and tint
+  vector<vec4f>     values = {};         // graded colors, padded to rgba
+};
+
+// Bake color grading params into a lookup table, with `size` entries per
+// axis, for linear or srgb inputs. Uses multithreading for speed.
+colorgrade_lut make_colorgrade_lut(
+    const colorgrade_params& params, bool linear, int size = 65);
+
+// Color grade a color with a baked lookup table, using tetrahedral
+// interpolation.
+vec4f colorgrade(const vec4f& color, const colorgrade_lut& lut);
+
+// Color grade an hdr or ldr image to an ldr image, with a baked lookup table.
+// Uses multithreading for speed.
+void colorgrade_image_mt(
+    color_image& result, const color_image& image, const colorgrade_lut& lut);
+
 // determine white balance colors
 vec4f compute_white_balance(const color_image& image);
 
+// Denoise a linear rendered image with an edge-avoiding a-trous wavelet
+// filter, guided by the albedo and normal feature buffers of the render.
+// Uses multithreading for speed.
+color_image denoise_image(const color_image& image, const color_image& albedo,
+    const color_image& normal, int iterations = 5);
+void        denoise_image(color_image& result, const color_image& image,
+           const color_image& albedo, const color_image& normal,
+           int iterations = 5);
+
 }  // namespace yocto
 
 // -----------------------------------------------------------------------------
@@ -260,11 +310,13 @@ void colorgrade_image_mt(vector<vec4b>& corrected, const vector<vec4f>& img,
 // determine white balance colors
 vec3f compute_white_balance(const vector<vec4f>& img);
 
-// Resize an image.
+// Resize an image. Byte images are filtered in linear color space.
 void resize_image(vector<vec4f>& res, const vector<vec4f>& img, int width,
-    int height, int res_width, int res_height);
+    int height, int res_width, int res_height,
+    resize_filter_type filter = resize_filter_type::automatic);
 void resize_image(vector<vec4b>& res, const vector<vec4b>& img, int width,
-    int height, int res_width, int res_height);
+    int height, int res_width, int res_height,
+    resize_filter_type filter = resize_filter_type::automatic);
 
 // Compute the difference between two images
 void image_difference(vector<vec4f>& diff, const vector<vec4f>& a,
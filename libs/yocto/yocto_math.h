@@ -39,6 +39,7 @@
 
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <utility>
 
@@ -76,6 +77,7 @@ inline float max(float a, float b);
 inline float clamp(float a, float min, float max);
 inline float sign(float a);
 inline float sqrt(float a);
+inline float floor(float a);
 inline float sin(float a);
 inline float cos(float a);
 inline float tan(float a);
@@ -111,6 +113,41 @@ inline size_t max(size_t a, size_t b);
 
 }  // namespace yocto
 
+// -----------------------------------------------------------------------------
+// FAST APPROXIMATE MATH FUNCTIONS
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Polynomial approximations of transcendental functions. Maximum errors,
+// measured against double precision, are 8e-8 for sin and cos with
+// |a| <= 8192, 1.5e-7 for atan, 3e-7 for atan2 and 5e-7 for acos. Errors are
+// relative for exp, 1e-7, for log, 1e-7 relative to max(1, |log(a)|), and
+// for pow, 1.2e-7 * (1 + |b log(a)|).
+// Arguments out of the approximated ranges, and non-finite values, fall back
+// to the standard library functions.
+inline float              approx_sin(float a);
+inline float              approx_cos(float a);
+inline pair<float, float> approx_sincos(float a);  // {sin(a), cos(a)}
+inline float              approx_atan(float a);
+inline float              approx_atan2(float a, float b);
+inline float              approx_acos(float a);
+inline float              approx_exp(float a);
+inline float              approx_log(float a);
+inline float              approx_pow(float a, float b);
+
+// Trigonometric functions used in the rendering hot paths. These are the
+// approximations above when compiling with YOCTO_FASTMATH, and the standard
+// library functions otherwise. There are no fast exp, log and pow, since the
+// table-based standard library versions are faster than the approximations.
+inline float              fast_sin(float a);
+inline float              fast_cos(float a);
+inline pair<float, float> fast_sincos(float a);  // {sin(a), cos(a)}
+inline float              fast_atan(float a);
+inline float              fast_atan2(float a, float b);
+inline float              fast_acos(float a);
+
+}  // namespace yocto
+
 // -----------------------------------------------------------------------------
 // VECTORS
 // -----------------------------------------------------------------------------
@@ -1335,6 +1372,7 @@ inline float clamp(float a, float min_, float max_) {
 }
 inline float sign(float a) { return a < 0 ? -1.0f : 1.0f; }
 inline float sqrt(float a) { return std::sqrt(a); }
+inline float floor(float a) { return std::floor(a); }
 inline float sin(float a) { return std::sin(a); }
 inline float cos(float a) { return std::cos(a); }
 inline float tan(float a) { return std::tan(a); }
@@ -1379,6 +1417,160 @@ inline size_t max(size_t a, size_t b) { return (a > b) ? a : b; }
 
 }  // namespace yocto
 
+// -----------------------------------------------------------------------------
+// FAST APPROXIMATE MATH FUNCTIONS
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Sine and cosine with Cody-Waite reduction to [-pi/4,pi/4] and minimax
+// polynomials from Cephes. The quadrant is rounded by adding 1.5 * 2^23, and
+// quadrant swaps and signs are branchless. Zeros fall back to keep the sign.
+inline pair<float, float> approx_sincos(float a) {
+  if (!(abs(a) <= 8192) || a == 0) return {std::sin(a), std::cos(a)};
+  auto q = (a * 0.63661977236758134f + 12582912.0f) - 12582912.0f;
+  auto x = a - q * 1.5703125f;
+  x -= q * 4.837512969970703125e-4f;
+  x -= q * 7.54978995489188216e-8f;
+  auto x2 = x * x;
+  auto s  = -1.9515295891e-4f;
+  s       = s * x2 + 8.3321608736e-3f;
+  s       = s * x2 - 1.6666654611e-1f;
+  s       = s * x2 * x + x;
+  auto c  = 2.443315711809948e-5f;
+  c       = c * x2 - 1.388731625493765e-3f;
+  c       = c * x2 + 4.166664568298827e-2f;
+  c       = c * x2 * x2 - 0.5f * x2 + 1;
+  auto quadrant = (int)q;
+  auto swap     = (quadrant & 1) != 0;
+  auto sin_     = swap ? c : s, cos_ = swap ? s : c;
+  auto sin_bits = uint32_t{0}, cos_bits = uint32_t{0};
+  std::memcpy(&sin_bits, &sin_, sizeof(float));
+  std::memcpy(&cos_bits, &cos_, sizeof(float));
+  sin_bits ^= (uint32_t)(quadrant & 2) << 30;
+  cos_bits ^= (uint32_t)((quadrant + 1) & 2) << 30;
+  std::memcpy(&sin_, &sin_bits, sizeof(float));
+  std::memcpy(&cos_, &cos_bits, sizeof(float));
+  return {sin_, cos_};
+}
+inline float approx_sin(float a) { return approx_sincos(a).first; }
+inline float approx_cos(float a) { return approx_sincos(a).second; }
+
+// Arc tangent with reduction to [0,tan(pi/8)] and a polynomial from Cephes.
+inline float approx_atan(float a) {
+  if (!(abs(a) <= flt_max)) return std::atan(a);
+  auto x = abs(a), offset = 0.0f;
+  if (x > 2.414213562373095f) {
+    offset = pif / 2;
+    x      = -1 / x;
+  } else if (x > 0.4142135623730950f) {
+    offset = pif / 4;
+    x      = (x - 1) / (x + 1);
+  }
+  auto x2 = x * x;
+  auto y  = 8.05374449538e-2f;
+  y       = y * x2 - 1.38776856032e-1f;
+  y       = y * x2 + 1.99777106478e-1f;
+  y       = y * x2 - 3.33329491539e-1f;
+  y       = offset + (y * x2 * x + x);
+  return std::copysign(y, a);
+}
+// Zeros, whose signs select the quadrant, fall back too.
+inline float approx_atan2(float a, float b) {
+  if (!(abs(a) <= flt_max && abs(b) <= flt_max) || a == 0 || b == 0)
+    return std::atan2(a, b);
+  auto angle = approx_atan(a / b);
+  if (b < 0) angle += a < 0 ? -pif : pif;
+  return angle;
+}
+
+// Arc cosine from Abramowitz and Stegun 4.4.46.
+inline float approx_acos(float a) {
+  if (!(abs(a) <= 1)) return std::acos(a);
+  auto x = abs(a);
+  auto y = -0.0012624911f;
+  y      = y * x + 0.0066700901f;
+  y      = y * x - 0.0170881256f;
+  y      = y * x + 0.0308918810f;
+  y      = y * x - 0.0501743046f;
+  y      = y * x + 0.0889789874f;
+  y      = y * x - 0.2145988016f;
+  y      = y * x + 1.5707963050f;
+  y      = std::sqrt(1 - x) * y;
+  return a < 0 ? pif - y : y;
+}
+
+// Exponential with reduction to [-ln(2)/2,ln(2)/2] and a polynomial from
+// Cephes, scaled by a power of two built from its exponent bits.
+inline float approx_exp(float a) {
+  if (!(abs(a) < 87)) return std::exp(a);
+  auto n = (a * 1.44269504088896341f + 12582912.0f) - 12582912.0f;
+  auto x = a - n * 0.693359375f;
+  x += n * 2.12194440e-4f;
+  auto y = 1.9875691500e-4f;
+  y      = y * x + 1.3981999507e-3f;
+  y      = y * x + 8.3334519073e-3f;
+  y      = y * x + 4.1665795894e-2f;
+  y      = y * x + 1.6666665459e-1f;
+  y      = y * x + 5.0000001201e-1f;
+  y      = y * (x * x) + x + 1;
+  auto scale_bits = (uint32_t)((int)n + 127) << 23;
+  auto scale      = 0.0f;
+  std::memcpy(&scale, &scale_bits, sizeof(float));
+  return y * scale;
+}
+
+// Logarithm from the exponent bits, and a polynomial from Cephes for the
+// mantissa reduced to [sqrt(2)/2,sqrt(2)].
+inline float approx_log(float a) {
+  if (!(a >= 1.17549435e-38f && a <= flt_max)) return std::log(a);
+  auto bits = uint32_t{0};
+  std::memcpy(&bits, &a, sizeof(float));
+  auto e             = (int)(bits >> 23) - 126;
+  auto mantissa_bits = (bits & 0x007fffffu) | 0x3f000000u;
+  auto m             = 0.0f;
+  std::memcpy(&m, &mantissa_bits, sizeof(float));
+  auto small = m < 0.707106781186547524f;
+  auto x     = small ? m + m - 1 : m - 1;
+  e -= small ? 1 : 0;
+  auto x2 = x * x;
+  auto y  = 7.0376836292e-2f;
+  y       = y * x - 1.1514610310e-1f;
+  y       = y * x + 1.1676998740e-1f;
+  y       = y * x - 1.2420140846e-1f;
+  y       = y * x + 1.4249322787e-1f;
+  y       = y * x - 1.6668057665e-1f;
+  y       = y * x + 2.0000714765e-1f;
+  y       = y * x - 2.4999993993e-1f;
+  y       = y * x + 3.3333331174e-1f;
+  y       = y * x * x2 - 2.12194440e-4f * e - 0.5f * x2;
+  return (x + y) + 0.693359375f * e;
+}
+
+inline float approx_pow(float a, float b) {
+  if (!(a > 0 && a <= flt_max && abs(b) <= flt_max)) return std::pow(a, b);
+  return approx_exp(b * approx_log(a));
+}
+
+#ifdef YOCTO_FASTMATH
+inline float fast_sin(float a) { return approx_sin(a); }
+inline float fast_cos(float a) { return approx_cos(a); }
+inline pair<float, float> fast_sincos(float a) { return approx_sincos(a); }
+inline float fast_atan(float a) { return approx_atan(a); }
+inline float fast_atan2(float a, float b) { return approx_atan2(a, b); }
+inline float fast_acos(float a) { return approx_acos(a); }
+#else
+inline float fast_sin(float a) { return std::sin(a); }
+inline float fast_cos(float a) { return std::cos(a); }
+inline pair<float, float> fast_sincos(float a) {
+  return {std::sin(a), std::cos(a)};
+}
+inline float fast_atan(float a) { return std::atan(a); }
+inline float fast_atan2(float a, float b) { return std::atan2(a, b); }
+inline float fast_acos(float a) { return std::acos(a); }
+#endif
+
+}  // namespace yocto
+
 // -----------------------------------------------------------------------------
 // VECTORS
 // -----------------------------------------------------------------------------
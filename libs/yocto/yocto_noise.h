@@ -37,8 +37,10 @@
 // -----------------------------------------------------------------------------
 
 #include <array>
+#include <vector>
 
 #include "yocto_math.h"
+#include "yocto_wide.h"
 
 // -----------------------------------------------------------------------------
 // USING DIRECTIVES
@@ -47,6 +49,7 @@ namespace yocto {
 
 // Using directives
 using std::array;
+using std::vector;
 
 }  // namespace yocto
 
@@ -76,6 +79,21 @@ inline float perlin_fbm(const vec3f& p, float lacunarity = 2, float gain = 0.5,
 inline float perlin_turbulence(const vec3f& p, float lacunarity = 2,
     float gain = 0.5, int octaves = 6, const vec3i& wrap = zero3i);
 
+// Batch versions of the noise functions, that evaluate noise at many points
+// at once, with the same results as above. Points are processed in groups,
+// in loops that the compiler vectorizes, except for the table lookups.
+inline void perlin_noise(vector<float>& noise, const vector<vec3f>& points,
+    const vec3i& wrap = zero3i);
+inline void perlin_ridge(vector<float>& noise, const vector<vec3f>& points,
+    float lacunarity = 2, float gain = 0.5, int octaves = 6, float offset = 1,
+    const vec3i& wrap = zero3i);
+inline void perlin_fbm(vector<float>& noise, const vector<vec3f>& points,
+    float lacunarity = 2, float gain = 0.5, int octaves = 6,
+    const vec3i& wrap = zero3i);
+inline void perlin_turbulence(vector<float>& noise,
+    const vector<vec3f>& points, float lacunarity = 2, float gain = 0.5,
+    int octaves = 6, const vec3i& wrap = zero3i);
+
 }  // namespace yocto
 
 // -----------------------------------------------------------------------------
@@ -374,4 +392,160 @@ inline float perlin_turbulence(const vec3f& p, float lacunarity, float gain,
 
 }  // namespace yocto
 
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION FOR BATCH PERLIN NOISE
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Points processed together
+inline const auto perlin_lanes = wide_lanes;
+
+// Gradients of the revised noise for the low 4 bits of the corner hashes,
+// such that the gradient term is dot(gradient, offset) as in perlin_noise()
+inline const auto perlin_gradients = array<vec3f, 16>{{{1, 1, 0}, {-1, 1, 0},
+    {1, -1, 0}, {-1, -1, 0}, {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+    {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1}, {1, 1, 0}, {0, -1, 1},
+    {-1, 1, 0}, {0, -1, -1}}};
+
+// Evaluates noise at `count` points, at most `perlin_lanes`, scaled by
+// `frequency`, as perlin_noise(p * frequency, wrap). Lookups in the
+// permutation table are done per point, and the rest of the computation is
+// done on wide vectors.
+inline void perlin_noise_lanes(float* noise, const vec3f* points, int count,
+    float frequency, const vec3i& wrap) {
+  auto ease = [](const float8& a) {
+    return ((a * 6 - 15) * a + 10) * a * a * a;
+  };
+
+  // cell coordinates and fractions
+  auto p    = load_vec3f8(points, count) * frequency;
+  auto cell = vec3f8{floor(p.x), floor(p.y), floor(p.z)};
+  auto f    = p - cell;
+
+  // gradients of the cell corners, looked up per point into arrays that are
+  // then loaded as wide vectors; unused lanes hold zeros and are looked up
+  // for the cell at the origin
+  auto& _p = __perlin_permutation;
+  auto  m = vec3i{(wrap.x - 1) & 255, (wrap.y - 1) & 255, (wrap.z - 1) & 255};
+  float ci[perlin_lanes], cj[perlin_lanes], ck[perlin_lanes];
+  store_float8(ci, cell.x);
+  store_float8(cj, cell.y);
+  store_float8(ck, cell.z);
+  float gx[8][perlin_lanes], gy[8][perlin_lanes], gz[8][perlin_lanes];
+  for (auto lane = 0; lane < perlin_lanes; lane++) {
+    auto i = (int)ci[lane], j = (int)cj[lane], k = (int)ck[lane];
+    for (auto corner = 0; corner < 8; corner++) {
+      auto di = corner >> 2, dj = (corner >> 1) & 1, dk = corner & 1;
+      auto hi       = _p[(i + di) & m.x];
+      auto hj       = _p[(hi + j + dj) & m.y];
+      auto gradient = perlin_gradients[_p[(hj + k + dk) & m.z] & 15];
+      gx[corner][lane] = gradient.x;
+      gy[corner][lane] = gradient.y;
+      gz[corner][lane] = gradient.z;
+    }
+  }
+  auto gradient = [&](int corner) {
+    return vec3f8{load_float8(gx[corner]), load_float8(gy[corner]),
+        load_float8(gz[corner])};
+  };
+
+  // blend gradients
+  auto u = ease(f.x), v = ease(f.y), w = ease(f.z);
+  auto g = vec3f8{f.x - 1, f.y - 1, f.z - 1};
+  auto n000 = dot(gradient(0), {f.x, f.y, f.z});
+  auto n001 = dot(gradient(1), {f.x, f.y, g.z});
+  auto n010 = dot(gradient(2), {f.x, g.y, f.z});
+  auto n011 = dot(gradient(3), {f.x, g.y, g.z});
+  auto n100 = dot(gradient(4), {g.x, f.y, f.z});
+  auto n101 = dot(gradient(5), {g.x, f.y, g.z});
+  auto n110 = dot(gradient(6), {g.x, g.y, f.z});
+  auto n111 = dot(gradient(7), {g.x, g.y, g.z});
+  auto n00  = lerp(n000, n001, w);
+  auto n01  = lerp(n010, n011, w);
+  auto n10  = lerp(n100, n101, w);
+  auto n11  = lerp(n110, n111, w);
+  auto n0   = lerp(n00, n01, v);
+  auto n1   = lerp(n10, n11, v);
+  store_float8(noise, lerp(n0, n1, u) * 0.5f + 0.5f, count);
+}
+
+// noise
+inline void perlin_noise(
+    vector<float>& noise, const vector<vec3f>& points, const vec3i& wrap) {
+  noise.resize(points.size());
+  for (auto start = (size_t)0; start < points.size(); start += perlin_lanes) {
+    auto count = (int)min(points.size() - start, (size_t)perlin_lanes);
+    perlin_noise_lanes(
+        noise.data() + start, points.data() + start, count, 1, wrap);
+  }
+}
+
+// ridge
+inline void perlin_ridge(vector<float>& noise, const vector<vec3f>& points,
+    float lacunarity, float gain, int octaves, float offset,
+    const vec3i& wrap) {
+  noise.resize(points.size());
+  float values[perlin_lanes], prev[perlin_lanes];
+  for (auto start = (size_t)0; start < points.size(); start += perlin_lanes) {
+    auto count = (int)min(points.size() - start, (size_t)perlin_lanes);
+    auto sum   = noise.data() + start;
+    auto frequency = 1.0f, amplitude = 0.5f;
+    for (auto lane = 0; lane < count; lane++) sum[lane] = 0, prev[lane] = 1;
+    for (auto octave = 0; octave < octaves; octave++) {
+      perlin_noise_lanes(values, points.data() + start, count, frequency, wrap);
+      for (auto lane = 0; lane < count; lane++) {
+        auto r = offset - abs(values[lane] * 2 - 1);
+        r      = r * r;
+        sum[lane] += r * amplitude * prev[lane];
+        prev[lane] = r;
+      }
+      frequency *= lacunarity;
+      amplitude *= gain;
+    }
+  }
+}
+
+// fbm
+inline void perlin_fbm(vector<float>& noise, const vector<vec3f>& points,
+    float lacunarity, float gain, int octaves, const vec3i& wrap) {
+  noise.resize(points.size());
+  float values[perlin_lanes];
+  for (auto start = (size_t)0; start < points.size(); start += perlin_lanes) {
+    auto count = (int)min(points.size() - start, (size_t)perlin_lanes);
+    auto sum   = noise.data() + start;
+    auto frequency = 1.0f, amplitude = 1.0f;
+    for (auto lane = 0; lane < count; lane++) sum[lane] = 0;
+    for (auto octave = 0; octave < octaves; octave++) {
+      perlin_noise_lanes(values, points.data() + start, count, frequency, wrap);
+      for (auto lane = 0; lane < count; lane++)
+        sum[lane] += values[lane] * amplitude;
+      frequency *= lacunarity;
+      amplitude *= gain;
+    }
+  }
+}
+
+// turbulence
+inline void perlin_turbulence(vector<float>& noise,
+    const vector<vec3f>& points, float lacunarity, float gain, int octaves,
+    const vec3i& wrap) {
+  noise.resize(points.size());
+  float values[perlin_lanes];
+  for (auto start = (size_t)0; start < points.size(); start += perlin_lanes) {
+    auto count = (int)min(points.size() - start, (size_t)perlin_lanes);
+    auto sum   = noise.data() + start;
+    auto frequency = 1.0f, amplitude = 1.0f;
+    for (auto lane = 0; lane < count; lane++) sum[lane] = 0;
+    for (auto octave = 0; octave < octaves; octave++) {
+      perlin_noise_lanes(values, points.data() + start, count, frequency, wrap);
+      for (auto lane = 0; lane < count; lane++)
+        sum[lane] += abs(values[lane] * 2 - 1) * amplitude;
+      frequency *= lacunarity;
+      amplitude *= gain;
+    }
+  }
+}
+
+}  // namespace yocto
+
 #endif
@@ -37,11 +37,14 @@
 // INCLUDES
 // -----------------------------------------------------------------------------
 
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <deque>
 #include <future>
 #include <mutex>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -89,6 +92,17 @@ inline bool is_valid(const future<void>& result);
 inline bool is_running(const future<void>& result);
 inline bool is_ready(const future<void>& result);
 
+// Number of threads used by the parallel functions. Defaults to the number of
+// hardware threads. Set it to a positive count to pin the number of threads,
+// e.g. for benchmarks, or to zero to restore the default.
+inline int  get_parallel_threads();
+inline void set_parallel_threads(int nthreads);
+
+// Parallel fors, and the parallel algorithms below, called from within the
+// body of another parallel for run serially on the calling thread, since the
+// outer loop already keeps all threads busy. For example, shape BVHs built
+// from a parallel loop over shapes are built serially.
+
 // Simple parallel for used since our target platforms do not yet support
 // parallel algorithms. `Func` takes the integer index.
 template <typename T, typename Func>
@@ -112,6 +126,50 @@ inline void parallel_foreach(const vector<T>& values, Func&& func);
 
 }  // namespace yocto
 
+// -----------------------------------------------------------------------------
+// PARALLEL ALGORITHMS
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Parallel algorithms split their inputs in blocks of fixed size, combined in
+// order, so that results do not depend on the number of threads, and are the
+// same when `noparallel` is set. Blocks are processed in parallel only for
+// inputs large enough to pay for starting threads.
+inline const auto parallel_block_size = (size_t)4096;
+inline const auto parallel_min_size   = (size_t)65536;
+
+// Calls `func(block, start, end)` for the blocks of indices [start, end) that
+// split [0, num), in parallel only for large inputs.
+template <typename Func>
+inline void parallel_for_blocks(
+    size_t num, Func&& func, bool noparallel = false);
+
+// Parallel reduction of the values `func(idx)` for indices in [0, num),
+// combined with `reduce(a, b)` starting from `init`. `reduce` should be
+// associative; sums of floats may differ from serial ones in the last bits.
+template <typename T, typename Value, typename Func, typename Reduce>
+inline Value parallel_reduce(T num, const Value& init, Func&& func,
+    Reduce&& reduce, bool noparallel = false);
+
+// Parallel inclusive scan of `values` in place, combined with `reduce(a, b)`.
+template <typename T, typename Reduce>
+inline void parallel_inclusive_scan(
+    vector<T>& values, Reduce&& reduce, bool noparallel = false);
+
+// Parallel stable sort of `values` by the unsigned integer keys returned by
+// `key(value)`, with a least-significant-digit radix sort.
+template <typename T, typename Key>
+inline void parallel_sort(
+    vector<T>& values, Key&& key, bool noparallel = false);
+
+// Parallel stable partition of the values in [start, end), moving the ones
+// for which `pred(value)` is true first. Returns the partition point.
+template <typename T, typename Pred>
+inline size_t parallel_partition(vector<T>& values, size_t start, size_t end,
+    Pred&& pred, bool noparallel = false);
+
+}  // namespace yocto
+
 // -----------------------------------------------------------------------------
 //
 //
@@ -167,21 +225,43 @@ inline bool is_ready(const future<void>& result) {
                                std::future_status::ready;
 }
 
+// Number of threads used by the parallel functions, zero for the default
+inline atomic<int> parallel_threads = 0;
+
+// Number of threads used by the parallel functions
+inline int get_parallel_threads() {
+  auto nthreads = parallel_threads.load();
+  return nthreads > 0 ? nthreads
+                      : std::max((int)std::thread::hardware_concurrency(), 1);
+}
+inline void set_parallel_threads(int nthreads) {
+  parallel_threads = std::max(nthreads, 0);
+}
+
+// Whether the current thread is a parallel for worker
+inline thread_local bool parallel_region = false;
+
 // Simple parallel for used since our target platforms do not yet support
 // parallel algorithms. `Func` takes the integer index.
 template <typename T, typename Func>
 inline void parallel_for(T num, Func&& func) {
+  if (parallel_region) {
+    for (auto idx = (T)0; idx < num; idx++) func(idx);
+    return;
+  }
   auto      futures  = vector<future<void>>{};
-  auto      nthreads = std::thread::hardware_concurrency();
+  auto      nthreads = get_parallel_threads();
   atomic<T> next_idx(0);
   for (auto thread_id = 0; thread_id < (int)nthreads; thread_id++) {
     futures.emplace_back(
         std::async(std::launch::async, [&func, &next_idx, num]() {
+          parallel_region = true;
           while (true) {
             auto idx = next_idx.fetch_add(1);
             if (idx >= num) break;
             func(idx);
           }
+          parallel_region = false;
         }));
   }
   for (auto& f : futures) f.get();
@@ -191,17 +271,24 @@ inline void parallel_for(T num, Func&& func) {
 // parallel algorithms. `Func` takes the two integer indices.
 template <typename T, typename Func>
 inline void parallel_for(T num1, T num2, Func&& func) {
+  if (parallel_region) {
+    for (auto j = (T)0; j < num2; j++)
+      for (auto i = (T)0; i < num1; i++) func(i, j);
+    return;
+  }
   auto      futures  = vector<future<void>>{};
-  auto      nthreads = std::thread::hardware_concurrency();
+  auto      nthreads = get_parallel_threads();
   atomic<T> next_idx(0);
   for (auto thread_id = 0; thread_id < (int)nthreads; thread_id++) {
     futures.emplace_back(
         std::async(std::launch::async, [&func, &next_idx, num1, num2]() {
+          parallel_region = true;
           while (true) {
             auto j = next_idx.fetch_add(1);
             if (j >= num2) break;
             for (auto i = (T)0; i < num1; i++) func(i, j);
           }
+          parallel_region = false;
         }));
   }
   for (auto& f : futures) f.get();
@@ -211,18 +298,24 @@ inline void parallel_for(T num1, T num2, Func&& func) {
 // parallel algorithms. `Func` takes the integer index.
 template <typename T, typename Func>
 inline void parallel_for_batch(T num, T batch, Func&& func) {
+  if (parallel_region) {
+    for (auto idx = (T)0; idx < num; idx++) func(idx);
+    return;
+  }
   auto      futures  = vector<future<void>>{};
-  auto      nthreads = std::thread::hardware_concurrency();
+  auto      nthreads = get_parallel_threads();
   atomic<T> next_idx(0);
   for (auto thread_id = 0; thread_id < (int)nthreads; thread_id++) {
     futures.emplace_back(
         std::async(std::launch::async, [&func, &next_idx, num, batch]() {
+          parallel_region = true;
           while (true) {
             auto start = next_idx.fetch_add(batch);
             if (start >= num) break;
             auto end = std::min(num, start + batch);
             for (auto i = (T)start; i < end; i++) func(i);
           }
+          parallel_region = false;
         }));
   }
   for (auto& f : futures) f.get();
@@ -243,4 +336,183 @@ inline void parallel_foreach(const vector<T>& values, Func&& func) {
 
 }  // namespace yocto
 
+// -----------------------------------------------------------------------------
+// PARALLEL ALGORITHMS
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Number of blocks for parallel algorithms
+inline size_t parallel_num_blocks(size_t num) {
+  return (num + parallel_block_size - 1) / parallel_block_size;
+}
+
+// Calls `func(block, start, end)` for each block of indices in [0, num),
+// in parallel only for large inputs outside other parallel loops.
+template <typename Func>
+inline void parallel_for_blocks(size_t num, Func&& func, bool noparallel) {
+  auto nblocks    = parallel_num_blocks(num);
+  auto block_func = [&func, num](size_t block) {
+    auto start = block * parallel_block_size;
+    func(block, start, std::min(start + parallel_block_size, num));
+  };
+  if (noparallel || num < parallel_min_size || parallel_region) {
+    for (auto block = (size_t)0; block < nblocks; block++) block_func(block);
+  } else {
+    parallel_for(nblocks, block_func);
+  }
+}
+
+// Parallel reduction, reducing blocks first and then the block results.
+template <typename T, typename Value, typename Func, typename Reduce>
+inline Value parallel_reduce(T num, const Value& init, Func&& func,
+    Reduce&& reduce, bool noparallel) {
+  auto partials = vector<Value>(parallel_num_blocks((size_t)num), init);
+  parallel_for_blocks(
+      (size_t)num,
+      [&](size_t block, size_t start, size_t end) {
+        auto value = (Value)func((T)start);
+        for (auto idx = start + 1; idx < end; idx++)
+          value = reduce(value, func((T)idx));
+        partials[block] = value;
+      },
+      noparallel);
+  auto value = init;
+  for (auto& partial : partials) value = reduce(value, partial);
+  return value;
+}
+
+// Parallel inclusive scan. Blocks are scanned independently, then the last
+// value of each block is offset serially, and the other values in parallel.
+template <typename T, typename Reduce>
+inline void parallel_inclusive_scan(
+    vector<T>& values, Reduce&& reduce, bool noparallel) {
+  auto num = values.size();
+  parallel_for_blocks(
+      num,
+      [&](size_t, size_t start, size_t end) {
+        for (auto idx = start + 1; idx < end; idx++)
+          values[idx] = reduce(values[idx - 1], values[idx]);
+      },
+      noparallel);
+  auto nblocks = parallel_num_blocks(num);
+  for (auto block = (size_t)1; block < nblocks; block++) {
+    auto last    = std::min((block + 1) * parallel_block_size, num) - 1;
+    auto offset  = values[block * parallel_block_size - 1];
+    values[last] = reduce(offset, values[last]);
+  }
+  parallel_for_blocks(
+      num,
+      [&](size_t block, size_t start, size_t end) {
+        if (block == 0) return;
+        auto offset = values[start - 1];
+        for (auto idx = start; idx < end - 1; idx++)
+          values[idx] = reduce(offset, values[idx]);
+      },
+      noparallel);
+}
+
+// Parallel radix sort on 8-bit digits. For each digit, blocks count their
+// keys, counts are turned into offsets in digit and block order, and blocks
+// scatter their values. Digits equal for all keys are skipped.
+template <typename T, typename Key>
+inline void parallel_sort(vector<T>& values, Key&& key, bool noparallel) {
+  using key_type = std::decay_t<decltype(key(values.front()))>;
+  static_assert(std::is_unsigned_v<key_type>, "keys must be unsigned");
+  auto num = values.size();
+  if (num <= 1) return;
+  auto nblocks = parallel_num_blocks(num);
+  auto keys    = vector<key_type>(num);
+  parallel_for_blocks(
+      num,
+      [&](size_t, size_t start, size_t end) {
+        for (auto idx = start; idx < end; idx++) keys[idx] = key(values[idx]);
+      },
+      noparallel);
+  auto sorted_keys   = vector<key_type>(num);
+  auto sorted_values = vector<T>(num);
+  auto offsets       = vector<size_t>(nblocks * 256);
+  for (auto shift = 0; shift < (int)sizeof(key_type) * 8; shift += 8) {
+    parallel_for_blocks(
+        num,
+        [&](size_t block, size_t start, size_t end) {
+          auto counts = offsets.data() + block * 256;
+          std::fill(counts, counts + 256, (size_t)0);
+          for (auto idx = start; idx < end; idx++)
+            counts[(keys[idx] >> shift) & 255] += 1;
+        },
+        noparallel);
+    auto first_digit = (size_t)((keys[0] >> shift) & 255);
+    auto first_count = (size_t)0;
+    for (auto block = (size_t)0; block < nblocks; block++)
+      first_count += offsets[block * 256 + first_digit];
+    if (first_count == num) continue;
+    auto offset = (size_t)0;
+    for (auto digit = 0; digit < 256; digit++) {
+      for (auto block = (size_t)0; block < nblocks; block++) {
+        auto count                   = offsets[block * 256 + digit];
+        offsets[block * 256 + digit] = offset;
+        offset += count;
+      }
+    }
+    parallel_for_blocks(
+        num,
+        [&](size_t block, size_t start, size_t end) {
+          auto block_offsets = offsets.data() + block * 256;
+          for (auto idx = start; idx < end; idx++) {
+            auto pos           = block_offsets[(keys[idx] >> shift) & 255]++;
+            sorted_keys[pos]   = keys[idx];
+            sorted_values[pos] = std::move(values[idx]);
+          }
+        },
+        noparallel);
+    std::swap(keys, sorted_keys);
+    std::swap(values, sorted_values);
+  }
+}
+
+// Parallel stable partition. Blocks evaluate and count their selected values,
+// counts are turned into offsets, and blocks scatter their values to a copy.
+template <typename T, typename Pred>
+inline size_t parallel_partition(vector<T>& values, size_t start, size_t end,
+    Pred&& pred, bool noparallel) {
+  auto num = end - start;
+  if (noparallel || num < parallel_min_size || parallel_region) {
+    return std::stable_partition(values.begin() + start, values.begin() + end,
+               pred) -
+           values.begin();
+  }
+  auto selected = vector<uint8_t>(num);
+  auto offsets  = vector<size_t>(parallel_num_blocks(num));
+  parallel_for_blocks(num, [&](size_t block, size_t bstart, size_t bend) {
+    auto count = (size_t)0;
+    for (auto idx = bstart; idx < bend; idx++) {
+      selected[idx] = pred(values[start + idx]) ? 1 : 0;
+      count += selected[idx];
+    }
+    offsets[block] = count;
+  });
+  auto nselected = (size_t)0;
+  for (auto& offset : offsets) {
+    auto count = offset;
+    offset     = nselected;
+    nselected += count;
+  }
+  auto partitioned = vector<T>(num);
+  parallel_for_blocks(num, [&](size_t block, size_t bstart, size_t bend) {
+    auto first  = offsets[block];
+    auto second = nselected + bstart - offsets[block];
+    for (auto idx = bstart; idx < bend; idx++) {
+      partitioned[selected[idx] ? first++ : second++] = std::move(
+          values[start + idx]);
+    }
+  });
+  parallel_for_blocks(num, [&](size_t, size_t bstart, size_t bend) {
+    std::move(partitioned.begin() + bstart, partitioned.begin() + bend,
+        values.begin() + start + bstart);
+  });
+  return start + nselected;
+}
+
+}  // namespace yocto
+
 #endif
@@ -48,6 +48,7 @@
 
 #include <algorithm>  // std::upper_bound
 #include <array>
+#include <cstring>
 #include <utility>
 #include <vector>
 
@@ -91,6 +92,24 @@ inline vec3f rand3f(rng_state& rng);
 template <typename T>
 inline void shuffle(vector<T>& vals, rng_state& rng);
 
+// Counter-based random numbers. Values are computed by hashing a key, that
+// identifies a random stream, with a counter, that identifies a dimension in
+// the stream. Since no state is kept, values can be computed in any order.
+inline uint64_t hash_rng(uint64_t key, uint64_t counter);
+inline float    rand1f(uint64_t key, uint64_t counter);
+inline vec2f    rand2f(uint64_t key, uint64_t counter);
+
+// Init a random number generator for the stream keyed by seed, pixel and
+// sample index. The result does not depend on the order streams are created.
+inline rng_state make_rng(uint64_t seed, uint64_t pixel, uint64_t sample);
+
+// Owen-scrambled Sobol points in [0,1). Points with the same seed, and
+// consecutive indices, are stratified. Different seeds give independent
+// sequences, so higher dimensions are obtained by padding 1D and 2D
+// sequences with different seeds.
+inline float sobol1f(uint32_t index, uint64_t seed);
+inline vec2f sobol2f(uint32_t index, uint64_t seed);
+
 }  // namespace yocto
 
 // -----------------------------------------------------------------------------
@@ -238,6 +257,73 @@ inline void shuffle(vector<T>& vals, rng_state& rng) {
   }
 }
 
+// Counter-based random numbers, using the SplitMix64 finalizer as hash.
+inline uint64_t hash_rng(uint64_t key, uint64_t counter) {
+  auto hash = [](uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  };
+  return hash(hash(key) + (counter + 1) * 0x9e3779b97f4a7c15ull);
+}
+inline float rand1f(uint64_t key, uint64_t counter) {
+  auto bits  = ((uint32_t)(hash_rng(key, counter) >> 32) >> 9) | 0x3f800000u;
+  auto value = 0.0f;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value - 1.0f;
+}
+inline vec2f rand2f(uint64_t key, uint64_t counter) {
+  return {rand1f(key, counter), rand1f(key, counter + 1)};
+}
+
+// Init a random number generator for the stream keyed by seed, pixel and
+// sample index.
+inline rng_state make_rng(uint64_t seed, uint64_t pixel, uint64_t sample) {
+  auto key = hash_rng(hash_rng(seed, pixel), sample);
+  return make_rng(key, hash_rng(key, 0));
+}
+
+// Owen scrambling, from Burley, "Practical Hash-based Owen Scrambling", 2020.
+inline uint32_t _reverse_bits(uint32_t x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+inline uint32_t _owen_scramble(uint32_t x, uint32_t seed) {
+  x = _reverse_bits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return _reverse_bits(x);
+}
+inline float _sobol_float(uint32_t x) {
+  return min(x * 0x1p-32f, 1 - flt_eps / 2);
+}
+
+// Owen-scrambled Sobol points, shuffling the index and scrambling each
+// dimension with different seeds.
+inline float sobol1f(uint32_t index, uint64_t seed) {
+  auto hash   = hash_rng(seed, 0);
+  auto index_ = _owen_scramble(index, (uint32_t)hash);
+  return _sobol_float(
+      _owen_scramble(_reverse_bits(index_), (uint32_t)(hash >> 32)));
+}
+inline vec2f sobol2f(uint32_t index, uint64_t seed) {
+  auto hash   = hash_rng(seed, 1);
+  auto index_ = _owen_scramble(index, (uint32_t)hash);
+  auto x = _reverse_bits(index_), y = 0u;
+  for (auto v = 1u << 31; index_ != 0; index_ >>= 1, v ^= v >> 1) {
+    if (index_ & 1) y ^= v;
+  }
+  auto hash2 = hash_rng(seed, 2);
+  return {_sobol_float(_owen_scramble(x, (uint32_t)(hash >> 32))),
+      _sobol_float(_owen_scramble(y, (uint32_t)hash2))};
+}
+
 }  // namespace yocto
 
 // -----------------------------------------------------------------------------
@@ -247,10 +333,10 @@ namespace yocto {
 
 // Sample an hemispherical direction with uniform distribution.
 inline vec3f sample_hemisphere(const vec2f& ruv) {
-  auto z   = ruv.y;
-  auto r   = sqrt(clamp(1 - z * z, 0.0f, 1.0f));
-  auto phi = 2 * pif * ruv.x;
-  return {r * cos(phi), r * sin(phi), z};
+  auto z            = ruv.y;
+  auto r            = sqrt(clamp(1 - z * z, 0.0f, 1.0f));
+  auto [sphi, cphi] = fast_sincos(2 * pif * ruv.x);
+  return {r * cphi, r * sphi, z};
 }
 inline float sample_hemisphere_pdf(const vec3f& direction) {
   return (direction.z <= 0) ? 0 : 1 / (2 * pif);
@@ -260,8 +346,8 @@ inline float sample_hemisphere_pdf(const vec3f& direction) {
 inline vec3f sample_hemisphere(const vec3f& normal, const vec2f& ruv) {
   auto z               = ruv.y;
   auto r               = sqrt(clamp(1 - z * z, 0.0f, 1.0f));
-  auto phi             = 2 * pif * ruv.x;
-  auto local_direction = vec3f{r * cos(phi), r * sin(phi), z};
+  auto [sphi, cphi]    = fast_sincos(2 * pif * ruv.x);
+  auto local_direction = vec3f{r * cphi, r * sphi, z};
   return transform_direction(basis_fromz(normal), local_direction);
 }
 inline float sample_hemisphere_pdf(
@@ -271,19 +357,19 @@ inline float sample_hemisphere_pdf(
 
 // Sample a spherical direction with uniform distribution.
 inline vec3f sample_sphere(const vec2f& ruv) {
-  auto z   = 2 * ruv.y - 1;
-  auto r   = sqrt(clamp(1 - z * z, 0.0f, 1.0f));
-  auto phi = 2 * pif * ruv.x;
-  return {r * cos(phi), r * sin(phi), z};
+  auto z            = 2 * ruv.y - 1;
+  auto r            = sqrt(clamp(1 - z * z, 0.0f, 1.0f));
+  auto [sphi, cphi] = fast_sincos(2 * pif * ruv.x);
+  return {r * cphi, r * sphi, z};
 }
 inline float sample_sphere_pdf(const vec3f& w) { return 1 / (4 * pif); }
 
 // Sample an hemispherical direction with cosine distribution.
 inline vec3f sample_hemisphere_cos(const vec2f& ruv) {
-  auto z   = sqrt(ruv.y);
-  auto r   = sqrt(1 - z * z);
-  auto phi = 2 * pif * ruv.x;
-  return {r * cos(phi), r * sin(phi), z};
+  auto z            = sqrt(ruv.y);
+  auto r            = sqrt(1 - z * z);
+  auto [sphi, cphi] = fast_sincos(2 * pif * ruv.x);
+  return {r * cphi, r * sphi, z};
 }
 inline float sample_hemisphere_cos_pdf(const vec3f& direction) {
   return (direction.z <= 0) ? 0 : direction.z / pif;
@@ -293,8 +379,8 @@ inline float sample_hemisphere_cos_pdf(const vec3f& direction) {
 inline vec3f sample_hemisphere_cos(const vec3f& normal, const vec2f& ruv) {
   auto z               = sqrt(ruv.y);
   auto r               = sqrt(1 - z * z);
-  auto phi             = 2 * pif * ruv.x;
-  auto local_direction = vec3f{r * cos(phi), r * sin(phi), z};
+  auto [sphi, cphi]    = fast_sincos(2 * pif * ruv.x);
+  auto local_direction = vec3f{r * cphi, r * sphi, z};
   return transform_direction(basis_fromz(normal), local_direction);
 }
 inline float sample_hemisphere_cos_pdf(
@@ -305,10 +391,10 @@ inline float sample_hemisphere_cos_pdf(
 
 // Sample an hemispherical direction with cosine power distribution.
 inline vec3f sample_hemisphere_cospower(float exponent, const vec2f& ruv) {
-  auto z   = pow(ruv.y, 1 / (exponent + 1));
-  auto r   = sqrt(1 - z * z);
-  auto phi = 2 * pif * ruv.x;
-  return {r * cos(phi), r * sin(phi), z};
+  auto z            = pow(ruv.y, 1 / (exponent + 1));
+  auto r            = sqrt(1 - z * z);
+  auto [sphi, cphi] = fast_sincos(2 * pif * ruv.x);
+  return {r * cphi, r * sphi, z};
 }
 inline float sample_hemisphere_cospower_pdf(
     float exponent, const vec3f& direction) {
@@ -322,8 +408,8 @@ inline vec3f sample_hemisphere_cospower(
     float exponent, const vec3f& normal, const vec2f& ruv) {
   auto z               = pow(ruv.y, 1 / (exponent + 1));
   auto r               = sqrt(1 - z * z);
-  auto phi             = 2 * pif * ruv.x;
-  auto local_direction = vec3f{r * cos(phi), r * sin(phi), z};
+  auto [sphi, cphi]    = fast_sincos(2 * pif * ruv.x);
+  auto local_direction = vec3f{r * cphi, r * sphi, z};
   return transform_direction(basis_fromz(normal), local_direction);
 }
 inline float sample_hemisphere_cospower_pdf(
@@ -334,16 +420,16 @@ inline float sample_hemisphere_cospower_pdf(
 
 // Sample a point uniformly on a disk.
 inline vec2f sample_disk(const vec2f& ruv) {
-  auto r   = sqrt(ruv.y);
-  auto phi = 2 * pif * ruv.x;
-  return {cos(phi) * r, sin(phi) * r};
+  auto r            = sqrt(ruv.y);
+  auto [sphi, cphi] = fast_sincos(2 * pif * ruv.x);
+  return {cphi * r, sphi * r};
 }
 inline float sample_disk_pdf() { return 1 / pif; }
 
 // Sample a point uniformly on a cylinder, without caps.
 inline vec3f sample_cylinder(const vec2f& ruv) {
-  auto phi = 2 * pif * ruv.x;
-  return {sin(phi), cos(phi), ruv.y * 2 - 1};
+  auto [sphi, cphi] = fast_sincos(2 * pif * ruv.x);
+  return {sphi, cphi, ruv.y * 2 - 1};
 }
 inline float sample_cylinder_pdf(const vec3f& point) { return 1 / pif; }
 
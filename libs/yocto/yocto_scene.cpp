@@ -112,19 +112,26 @@ namespace yocto {
 // pixel access
 vec4f lookup_texture(
     const scene_texture& texture, int i, int j, bool as_linear) {
-  auto color = vec4f{0, 0, 0, 0};
   if (!texture.pixelsf.empty()) {
-    color = texture.pixelsf[j * texture.width + i];
+    auto& color = texture.pixelsf[j * texture.width + i];
+    return as_linear && !texture.linear ? srgb_to_rgb(color) : color;
   } else {
-    color = byte_to_float(texture.pixelsb[j * texture.width + i]);
-  }
-  if (as_linear && !texture.linear) {
-    return srgb_to_rgb(color);
-  } else {
-    return color;
+    auto& color = texture.pixelsb[j * texture.width + i];
+    return as_linear && !texture.linear ? srgb_to_rgb(color)
+                                        : byte_to_float(color);
   }
 }
 
+// Interpolates the 2x2 texel footprint, decoding each texel with `decode`
+template <typename T, typename Decode>
+static vec4f interpolate_texture(const vector<T>& pixels, int width, int i,
+    int j, int ii, int jj, float u, float v, Decode&& decode) {
+  return decode(pixels[j * width + i]) * (1 - u) * (1 - v) +
+         decode(pixels[jj * width + i]) * (1 - u) * v +
+         decode(pixels[j * width + ii]) * u * (1 - v) +
+         decode(pixels[jj * width + ii]) * u * v;
+}
+
 // Evaluates an image at a point `uv`.
 vec4f eval_texture(const scene_texture& texture, const vec2f& uv,
     bool as_linear, bool no_interpolation, bool clamp_to_edge) {
@@ -151,13 +158,26 @@ vec4f eval_texture(const scene_texture& texture, const vec2f& uv,
   auto u = s - i, v = t - j;
 
   // handle interpolation
-  if (no_interpolation) {
-    return lookup_texture(texture, i, j, as_linear);
+  if (no_interpolation) return lookup_texture(texture, i, j, as_linear);
+
+  // pick the texel decoding once for the whole footprint
+  auto decode_srgb = as_linear && !texture.linear;
+  if (!texture.pixelsf.empty()) {
+    if (decode_srgb) {
+      return interpolate_texture(texture.pixelsf, size.x, i, j, ii, jj, u, v,
+          [](const vec4f& texel) { return srgb_to_rgb(texel); });
+    } else {
+      return interpolate_texture(texture.pixelsf, size.x, i, j, ii, jj, u, v,
+          [](const vec4f& texel) { return texel; });
+    }
   } else {
-    return lookup_texture(texture, i, j, as_linear) * (1 - u) * (1 - v) +
-           lookup_texture(texture, i, jj, as_linear) * (1 - u) * v +
-           lookup_texture(texture, ii, j, as_linear) * u * (1 - v) +
-           lookup_texture(texture, ii, jj, as_linear) * u * v;
+    if (decode_srgb) {
+      return interpolate_texture(texture.pixelsb, size.x, i, j, ii, jj, u, v,
+          [](const vec4b& texel) { return srgb_to_rgb(texel); });
+    } else {
+      return interpolate_texture(texture.pixelsb, size.x, i, j, ii, jj, u, v,
+          [](const vec4b& texel) { return byte_to_float(texel); });
+    }
   }
 }
 
@@ -1150,8 +1170,12 @@ bbox3f compute_bounds(const scene_model& scene) {
   auto shape_bbox = vector<bbox3f>{};
   auto bbox       = invalidb3f;
   for (auto& shape : scene.shapes) {
-    auto& sbvh = shape_bbox.emplace_back();
-    for (auto p : shape.positions) sbvh = merge(sbvh, p);
+    shape_bbox.push_back(parallel_reduce(
+        shape.positions.size(), invalidb3f,
+        [&](size_t idx) {
+          return bbox3f{shape.positions[idx], shape.positions[idx]};
+        },
+        [](const bbox3f& a, const bbox3f& b) { return merge(a, b); }));
   }
   for (auto& instance : scene.instances) {
     auto& sbvh = shape_bbox[instance.shape];
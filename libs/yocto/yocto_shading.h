@@ -438,16 +438,16 @@ inline float microfacet_shadowing(float roughness, const vec3f& normal,
 // Sample a microfacet ditribution.
 inline vec3f sample_microfacet(
     float roughness, const vec3f& normal, const vec2f& rn, bool ggx) {
-  auto phi   = 2 * pif * rn.x;
-  auto theta = 0.0f;
+  auto [sphi, cphi] = fast_sincos(2 * pif * rn.x);
+  auto theta        = 0.0f;
   if (ggx) {
-    theta = atan(roughness * sqrt(rn.y / (1 - rn.y)));
+    theta = fast_atan(roughness * sqrt(rn.y / (1 - rn.y)));
   } else {
     auto roughness2 = roughness * roughness;
-    theta           = atan(sqrt(-roughness2 * log(1 - rn.y)));
+    theta           = fast_atan(sqrt(-roughness2 * log(1 - rn.y)));
   }
-  auto local_half_vector = vec3f{
-      cos(phi) * sin(theta), sin(phi) * sin(theta), cos(theta)};
+  auto [stheta, ctheta]  = fast_sincos(theta);
+  auto local_half_vector = vec3f{cphi * stheta, sphi * stheta, ctheta};
   return transform_direction(basis_fromz(normal), local_half_vector);
 }
 
@@ -478,12 +478,12 @@ inline vec3f sample_microfacet(float roughness, const vec3f& normal,
                            : vec3f{1, 0, 0};
     auto T2    = cross(Vh, T1);
     // Section 4.2: parameterization of the projected area
-    auto r   = sqrt(rn.y);
-    auto phi = 2 * pif * rn.x;
-    auto t1  = r * cos(phi);
-    auto t2  = r * sin(phi);
-    auto s   = 0.5f * (1 + Vh.z);
-    t2       = (1 - s) * sqrt(1 - t1 * t1) + s * t2;
+    auto r            = sqrt(rn.y);
+    auto [sphi, cphi] = fast_sincos(2 * pif * rn.x);
+    auto t1           = r * cphi;
+    auto t2           = r * sphi;
+    auto s            = 0.5f * (1 + Vh.z);
+    t2                = (1 - s) * sqrt(1 - t1 * t1) + s * t2;
     // Section 4.3: reprojection onto hemisphere
     auto Nh = t1 * T1 + t2 * T2 + sqrt(max(0.0f, 1 - t1 * t1 - t2 * t2)) * Vh;
     // Section 3.4: transforming the normal back to the ellipsoid configuration
@@ -1062,9 +1062,8 @@ inline vec3f sample_phasefunction(
   }
 
   auto sin_theta      = sqrt(max(0.0f, 1 - cos_theta * cos_theta));
-  auto phi            = 2 * pif * rn.x;
-  auto local_incoming = vec3f{
-      sin_theta * cos(phi), sin_theta * sin(phi), cos_theta};
+  auto [sphi, cphi]   = fast_sincos(2 * pif * rn.x);
+  auto local_incoming = vec3f{sin_theta * cphi, sin_theta * sphi, cos_theta};
   return basis_fromz(-outgoing) * local_incoming;
 }
 
@@ -41,6 +41,7 @@
 #include "yocto_geometry.h"
 #include "yocto_modelio.h"
 #include "yocto_noise.h"
+#include "yocto_parallel.h"
 #include "yocto_sampling.h"
 
 // -----------------------------------------------------------------------------
@@ -1243,23 +1244,144 @@ void split_facevarying(vector<vec4i>& split_quads,
   }
 }
 
-// Weld vertices within a threshold.
+// Weld vertices within a threshold. Vertices are welded to the first earlier
+// welded vertex found in the neighboring cells, as with an incremental grid.
+// Vertices are sorted by cell in parallel, and vertices without earlier
+// vertices nearby, that are never welded, are found in parallel.
 pair<vector<vec3f>, vector<int>> weld_vertices(
     const vector<vec3f>& positions, float threshold) {
-  auto indices   = vector<int>(positions.size());
-  auto welded    = vector<vec3f>{};
-  auto grid      = make_hash_grid(threshold);
-  auto neighbors = vector<int>{};
-  for (auto vertex = 0; vertex < positions.size(); vertex++) {
-    auto& position = positions[vertex];
-    find_neighbors(grid, neighbors, position, threshold);
-    if (neighbors.empty()) {
+  auto indices = vector<int>(positions.size());
+  auto welded  = vector<vec3f>{};
+  if (positions.empty()) return {welded, indices};
+  auto grid  = make_hash_grid(threshold);
+  auto cells = vector<vec3i>(positions.size());
+  parallel_for_blocks(
+      positions.size(), [&](size_t, size_t start, size_t end) {
+        for (auto vertex = start; vertex < end; vertex++)
+          cells[vertex] = get_cell_index(grid, positions[vertex]);
+      });
+  auto [cmin, cmax] = parallel_reduce(
+      positions.size(), pair{cells.front(), cells.front()},
+      [&](size_t vertex) { return pair{cells[vertex], cells[vertex]}; },
+      [](const pair<vec3i, vec3i>& a, const pair<vec3i, vec3i>& b) {
+        return pair{min(a.first, b.first), max(a.second, b.second)};
+      });
+
+  // fall back to an incremental grid if cells do not fit 21 bits per axis
+  auto fits = [](int min, int max) { return (int64_t)max - min < (1 << 21); };
+  if (!fits(cmin.x, cmax.x) || !fits(cmin.y, cmax.y) ||
+      !fits(cmin.z, cmax.z)) {
+    auto neighbors = vector<int>{};
+    for (auto vertex = 0; vertex < (int)positions.size(); vertex++) {
+      auto& position = positions[vertex];
+      find_neighbors(grid, neighbors, position, threshold);
+      if (neighbors.empty()) {
+        welded.push_back(position);
+        indices[vertex] = (int)welded.size() - 1;
+        insert_vertex(grid, position);
+      } else {
+        indices[vertex] = neighbors.front();
+      }
+    }
+    return {welded, indices};
+  }
+
+  // sort vertices by cell, keeping vertices in order within cells
+  auto cell_key = [&](const vec3i& cell) {
+    return (uint64_t)(cell.x - cmin.x) | ((uint64_t)(cell.y - cmin.y) << 21) |
+           ((uint64_t)(cell.z - cmin.z) << 42);
+  };
+  auto sorted = vector<int>(positions.size());
+  for (auto vertex = 0; vertex < (int)sorted.size(); vertex++)
+    sorted[vertex] = vertex;
+  parallel_sort(sorted, [&](int vertex) { return cell_key(cells[vertex]); });
+  auto cell_ids     = unordered_map<uint64_t, int>{};
+  auto cell_ranges  = vector<vec2i>{};
+  auto vertex_cells = vector<int>(positions.size());
+  for (auto start = 0; start < (int)sorted.size();) {
+    auto key = cell_key(cells[sorted[start]]);
+    auto end = start + 1;
+    while (end < (int)sorted.size() && cell_key(cells[sorted[end]]) == key)
+      end++;
+    for (auto idx = start; idx < end; idx++)
+      vertex_cells[sorted[idx]] = (int)cell_ranges.size();
+    cell_ids[key] = (int)cell_ranges.size();
+    cell_ranges.push_back({start, end});
+    start = end;
+  }
+
+  // non-empty neighboring cells of each cell, in the same order as
+  // find_neighbors
+  auto cell_radius    = (int)(threshold * grid.cell_inv_size) + 1;
+  auto cell_neighbors = vector<vector<int>>(cell_ranges.size());
+  parallel_for_blocks(
+      cell_ranges.size(), [&](size_t, size_t start, size_t end) {
+        for (auto cell_id = start; cell_id < end; cell_id++) {
+          auto cell = cells[sorted[cell_ranges[cell_id].x]];
+          for (auto k = -cell_radius; k <= cell_radius; k++) {
+            for (auto j = -cell_radius; j <= cell_radius; j++) {
+              for (auto i = -cell_radius; i <= cell_radius; i++) {
+                auto ncell = cell + vec3i{i, j, k};
+                if (ncell.x < cmin.x || ncell.y < cmin.y ||
+                    ncell.z < cmin.z || ncell.x > cmax.x ||
+                    ncell.y > cmax.y || ncell.z > cmax.z)
+                  continue;
+                auto it = cell_ids.find(cell_key(ncell));
+                if (it == cell_ids.end()) continue;
+                cell_neighbors[cell_id].push_back(it->second);
+              }
+            }
+          }
+        }
+      });
+
+  // vertices with no earlier vertices nearby start a new welded vertex
+  auto threshold2     = threshold * threshold;
+  auto shared         = vector<uint8_t>(positions.size());
+  auto is_shared_cell = [&](int vertex, int cell_id) {
+    auto [start, end] = cell_ranges[cell_id];
+    for (auto idx = start; idx < end && sorted[idx] < vertex; idx++) {
+      if (distance_squared(positions[sorted[idx]], positions[vertex]) <=
+          threshold2)
+        return true;
+    }
+    return false;
+  };
+  parallel_for_blocks(
+      positions.size(), [&](size_t, size_t start, size_t end) {
+        for (auto vertex = (int)start; vertex < (int)end; vertex++) {
+          if (is_shared_cell(vertex, vertex_cells[vertex])) {
+            shared[vertex] = true;
+            continue;
+          }
+          auto& neighbors = cell_neighbors[vertex_cells[vertex]];
+          shared[vertex]  = std::any_of(
+              neighbors.begin(), neighbors.end(),
+              [&](int cell_id) { return is_shared_cell(vertex, cell_id); });
+        }
+      });
+
+  // weld the other vertices in order, looking only at welded vertices
+  auto cell_welded = vector<vector<int>>(cell_ranges.size());
+  for (auto vertex = 0; vertex < (int)positions.size(); vertex++) {
+    auto& position  = positions[vertex];
+    auto  welded_id = -1;
+    if (shared[vertex]) {
+      for (auto cell_id : cell_neighbors[vertex_cells[vertex]]) {
+        if (welded_id >= 0) break;
+        for (auto other : cell_welded[cell_id]) {
+          if (distance_squared(welded[other], position) > threshold2) continue;
+          welded_id = other;
+          break;
+        }
+      }
+    }
+    if (welded_id < 0) {
+      welded_id = (int)welded.size();
       welded.push_back(position);
-      indices[vertex] = (int)welded.size() - 1;
-      insert_vertex(grid, position);
-    } else {
-      indices[vertex] = neighbors.front();
+      cell_welded[vertex_cells[vertex]].push_back(welded_id);
     }
+    indices[vertex] = welded_id;
   }
   return {welded, indices};
 }
@@ -1800,6 +1922,16 @@ void sample_points_cdf(vector<float>& cdf, int npoints) {
   for (auto i = 0; i < cdf.size(); i++) cdf[i] = 1 + (i != 0 ? cdf[i - 1] : 0);
 }
 
+// Fill a cdf with the weights returned by `weight(idx)` and sum them with
+// a parallel scan.
+template <typename Func>
+static void make_element_cdf(vector<float>& cdf, Func&& weight) {
+  parallel_for_blocks(cdf.size(), [&](size_t, size_t start, size_t end) {
+    for (auto idx = start; idx < end; idx++) cdf[idx] = weight(idx);
+  });
+  parallel_inclusive_scan(cdf, [](float a, float b) { return a + b; });
+}
+
 // Pick a point on lines uniformly.
 pair<int, float> sample_lines(const vector<float>& cdf, float re, float ru) {
   return {sample_discrete(cdf, re), ru};
@@ -1807,20 +1939,15 @@ pair<int, float> sample_lines(const vector<float>& cdf, float re, float ru) {
 vector<float> sample_lines_cdf(
     const vector<vec2i>& lines, const vector<vec3f>& positions) {
   auto cdf = vector<float>(lines.size());
-  for (auto i = 0; i < cdf.size(); i++) {
-    auto& l = lines[i];
-    auto  w = line_length(positions[l.x], positions[l.y]);
-    cdf[i]  = w + (i != 0 ? cdf[i - 1] : 0);
-  }
+  sample_lines_cdf(cdf, lines, positions);
   return cdf;
 }
 void sample_lines_cdf(vector<float>& cdf, const vector<vec2i>& lines,
     const vector<vec3f>& positions) {
-  for (auto i = 0; i < cdf.size(); i++) {
-    auto& l = lines[i];
-    auto  w = line_length(positions[l.x], positions[l.y]);
-    cdf[i]  = w + (i != 0 ? cdf[i - 1] : 0);
-  }
+  make_element_cdf(cdf, [&](size_t idx) {
+    auto& l = lines[idx];
+    return line_length(positions[l.x], positions[l.y]);
+  });
 }
 
 // Pick a point on a triangle mesh uniformly.
@@ -1831,20 +1958,15 @@ pair<int, vec2f> sample_triangles(
 vector<float> sample_triangles_cdf(
     const vector<vec3i>& triangles, const vector<vec3f>& positions) {
   auto cdf = vector<float>(triangles.size());
-  for (auto i = 0; i < cdf.size(); i++) {
-    auto& t = triangles[i];
-    auto  w = triangle_area(positions[t.x], positions[t.y], positions[t.z]);
-    cdf[i]  = w + (i != 0 ? cdf[i - 1] : 0);
-  }
+  sample_triangles_cdf(cdf, triangles, positions);
   return cdf;
 }
 void sample_triangles_cdf(vector<float>& cdf, const vector<vec3i>& triangles,
     const vector<vec3f>& positions) {
-  for (auto i = 0; i < cdf.size(); i++) {
-    auto& t = triangles[i];
-    auto  w = triangle_area(positions[t.x], positions[t.y], positions[t.z]);
-    cdf[i]  = w + (i != 0 ? cdf[i - 1] : 0);
-  }
+  make_element_cdf(cdf, [&](size_t idx) {
+    auto& t = triangles[idx];
+    return triangle_area(positions[t.x], positions[t.y], positions[t.z]);
+  });
 }
 
 // Pick a point on a quad mesh uniformly.
@@ -1864,22 +1986,16 @@ pair<int, vec2f> sample_quads(const vector<vec4i>& quads,
 vector<float> sample_quads_cdf(
     const vector<vec4i>& quads, const vector<vec3f>& positions) {
   auto cdf = vector<float>(quads.size());
-  for (auto i = 0; i < cdf.size(); i++) {
-    auto& q = quads[i];
-    auto  w = quad_area(
-        positions[q.x], positions[q.y], positions[q.z], positions[q.w]);
-    cdf[i] = w + (i ? cdf[i - 1] : 0);
-  }
+  sample_quads_cdf(cdf, quads, positions);
   return cdf;
 }
 void sample_quads_cdf(vector<float>& cdf, const vector<vec4i>& quads,
     const vector<vec3f>& positions) {
-  for (auto i = 0; i < cdf.size(); i++) {
-    auto& q = quads[i];
-    auto  w = quad_area(
+  make_element_cdf(cdf, [&](size_t idx) {
+    auto& q = quads[idx];
+    return quad_area(
         positions[q.x], positions[q.y], positions[q.z], positions[q.w]);
-    cdf[i] = w + (i ? cdf[i - 1] : 0);
-  }
+  });
 }
 
 // Samples a set of points over a triangle mesh uniformly. The rng function
@@ -29,7 +29,10 @@
 #include "yocto_trace.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <memory>
 #include <stdexcept>
 #include <utility>
@@ -45,6 +48,13 @@
 #include <OpenImageDenoise/oidn.hpp>
 #endif
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 // -----------------------------------------------------------------------------
 // IMPLEMENTATION OF RAY-SCENE INTERSECTION
 // -----------------------------------------------------------------------------
@@ -52,8 +62,71 @@ namespace yocto {
 
 // Build the bvh acceleration structure.
 bvh_scene make_bvh(const scene_model& scene, const trace_params& params) {
-  return make_bvh(
-      scene, params.highqualitybvh, params.embreebvh, params.noparallel);
+  return make_bvh(scene, params.highqualitybvh, params.embreebvh,
+      params.noparallel, params.spatialbvh);
+}
+
+// Whether rendering statistics are collected.
+#ifdef YOCTO_TRACE_STATS
+const auto trace_stats_enabled = true;
+#else
+const auto trace_stats_enabled = false;
+#endif
+
+// Per-thread rendering statistics, moved to the trace state by trace_sample.
+static trace_stats& get_thread_stats() {
+  static thread_local auto stats = trace_stats{};
+  return stats;
+}
+
+// Accumulate rendering statistics.
+static void merge_stats(trace_stats& stats, const trace_stats& other) {
+  stats.camera_rays += other.camera_rays;
+  stats.bounce_rays += other.bounce_rays;
+  stats.shadow_rays += other.shadow_rays;
+  stats.light_rays += other.light_rays;
+  stats.bounces += other.bounces;
+  stats.nodes += other.nodes;
+  stats.primitives += other.primitives;
+  stats.instances += other.instances;
+}
+
+// Intersect a ray with the scene, counting it as the ray type `counter`
+// if statistics are enabled.
+static bvh_intersection intersect_scene(const bvh_scene& bvh,
+    const scene_model& scene, const ray3f& ray,
+    uint64_t trace_stats::*counter) {
+  if constexpr (trace_stats_enabled) {
+    auto& stats        = get_thread_stats();
+    auto  bstats       = bvh_stats{};
+    auto  intersection = intersect_bvh(bvh, scene, ray, bstats);
+    stats.*counter += 1;
+    stats.nodes += bstats.nodes;
+    stats.primitives += bstats.primitives;
+    stats.instances += bstats.instances;
+    if (intersection.hit && (counter == &trace_stats::camera_rays ||
+                                counter == &trace_stats::bounce_rays))
+      stats.bounces += 1;
+    return intersection;
+  } else {
+    return intersect_bvh(bvh, scene, ray);
+  }
+}
+static bvh_intersection intersect_scene(const bvh_scene& bvh,
+    const scene_model& scene, int instance, const ray3f& ray,
+    uint64_t trace_stats::*counter) {
+  if constexpr (trace_stats_enabled) {
+    auto& stats        = get_thread_stats();
+    auto  bstats       = bvh_stats{};
+    auto  intersection = intersect_bvh(bvh, scene, instance, ray, bstats);
+    stats.*counter += 1;
+    stats.nodes += bstats.nodes;
+    stats.primitives += bstats.primitives;
+    stats.instances += bstats.instances;
+    return intersection;
+  } else {
+    return intersect_bvh(bvh, scene, instance, ray);
+  }
 }
 
 }  // namespace yocto
@@ -70,28 +143,31 @@ static vec3f eval_emission(const material_point& material, const vec3f& normal,
 }
 
 // Evaluates/sample the BRDF scaled by the cosine of the incoming direction.
+// Kernels are instantiated per material type, so that each one contains
+// only the lobe math of that type.
+template <scene_material_type type>
 static vec3f eval_bsdfcos(const material_point& material, const vec3f& normal,
     const vec3f& outgoing, const vec3f& incoming) {
   if (material.roughness == 0) return zero3f;
 
-  if (material.type == scene_material_type::matte) {
+  if constexpr (type == scene_material_type::matte) {
     return eval_matte(material.color, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::glossy) {
+  } else if constexpr (type == scene_material_type::glossy) {
     return eval_glossy(material.color, material.ior, material.roughness, normal,
         outgoing, incoming);
-  } else if (material.type == scene_material_type::metallic) {
+  } else if constexpr (type == scene_material_type::metallic) {
     return eval_metallic(
         material.color, material.roughness, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::transparent) {
+  } else if constexpr (type == scene_material_type::transparent) {
     return eval_transparent(material.color, material.ior, material.roughness,
         normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::refractive) {
+  } else if constexpr (type == scene_material_type::refractive) {
     return eval_refractive(material.color, material.ior, material.roughness,
         normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::subsurface) {
+  } else if constexpr (type == scene_material_type::subsurface) {
     return eval_refractive(material.color, material.ior, material.roughness,
         normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::gltfpbr) {
+  } else if constexpr (type == scene_material_type::gltfpbr) {
     return eval_gltfpbr(material.color, material.ior, material.roughness,
         material.metallic, normal, outgoing, incoming);
   } else {
@@ -99,19 +175,20 @@ static vec3f eval_bsdfcos(const material_point& material, const vec3f& normal,
   }
 }
 
+template <scene_material_type type>
 static vec3f eval_delta(const material_point& material, const vec3f& normal,
     const vec3f& outgoing, const vec3f& incoming) {
   if (material.roughness != 0) return zero3f;
 
-  if (material.type == scene_material_type::metallic) {
+  if constexpr (type == scene_material_type::metallic) {
     return eval_metallic(material.color, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::transparent) {
+  } else if constexpr (type == scene_material_type::transparent) {
     return eval_transparent(
         material.color, material.ior, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::refractive) {
+  } else if constexpr (type == scene_material_type::refractive) {
     return eval_refractive(
         material.color, material.ior, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::volume) {
+  } else if constexpr (type == scene_material_type::volume) {
     return eval_passthrough(material.color, normal, outgoing, incoming);
   } else {
     return {0, 0, 0};
@@ -119,28 +196,29 @@ static vec3f eval_delta(const material_point& material, const vec3f& normal,
 }
 
 // Picks a direction based on the BRDF
+template <scene_material_type type>
 static vec3f sample_bsdfcos(const material_point& material, const vec3f& normal,
     const vec3f& outgoing, float rnl, const vec2f& rn) {
   if (material.roughness == 0) return zero3f;
 
-  if (material.type == scene_material_type::matte) {
+  if constexpr (type == scene_material_type::matte) {
     return sample_matte(material.color, normal, outgoing, rn);
-  } else if (material.type == scene_material_type::glossy) {
+  } else if constexpr (type == scene_material_type::glossy) {
     return sample_specular(material.color, material.ior, material.roughness,
         normal, outgoing, rnl, rn);
-  } else if (material.type == scene_material_type::metallic) {
+  } else if constexpr (type == scene_material_type::metallic) {
     return sample_metallic(
         material.color, material.roughness, normal, outgoing, rn);
-  } else if (material.type == scene_material_type::transparent) {
+  } else if constexpr (type == scene_material_type::transparent) {
     return sample_transparent(material.color, material.ior, material.roughness,
         normal, outgoing, rnl, rn);
-  } else if (material.type == scene_material_type::refractive) {
+  } else if constexpr (type == scene_material_type::refractive) {
     return sample_refractive(material.color, material.ior, material.roughness,
         normal, outgoing, rnl, rn);
-  } else if (material.type == scene_material_type::subsurface) {
+  } else if constexpr (type == scene_material_type::subsurface) {
     return sample_refractive(material.color, material.ior, material.roughness,
         normal, outgoing, rnl, rn);
-  } else if (material.type == scene_material_type::gltfpbr) {
+  } else if constexpr (type == scene_material_type::gltfpbr) {
     return sample_gltfpbr(material.color, material.ior, material.roughness,
         material.metallic, normal, outgoing, rnl, rn);
   } else {
@@ -148,19 +226,20 @@ static vec3f sample_bsdfcos(const material_point& material, const vec3f& normal,
   }
 }
 
+template <scene_material_type type>
 static vec3f sample_delta(const material_point& material, const vec3f& normal,
     const vec3f& outgoing, float rnl) {
   if (material.roughness != 0) return zero3f;
 
-  if (material.type == scene_material_type::metallic) {
+  if constexpr (type == scene_material_type::metallic) {
     return sample_metallic(material.color, normal, outgoing);
-  } else if (material.type == scene_material_type::transparent) {
+  } else if constexpr (type == scene_material_type::transparent) {
     return sample_transparent(
         material.color, material.ior, normal, outgoing, rnl);
-  } else if (material.type == scene_material_type::refractive) {
+  } else if constexpr (type == scene_material_type::refractive) {
     return sample_refractive(
         material.color, material.ior, normal, outgoing, rnl);
-  } else if (material.type == scene_material_type::volume) {
+  } else if constexpr (type == scene_material_type::volume) {
     return sample_passthrough(material.color, normal, outgoing);
   } else {
     return {0, 0, 0};
@@ -168,28 +247,29 @@ static vec3f sample_delta(const material_point& material, const vec3f& normal,
 }
 
 // Compute the weight for sampling the BRDF
+template <scene_material_type type>
 static float sample_bsdfcos_pdf(const material_point& material,
     const vec3f& normal, const vec3f& outgoing, const vec3f& incoming) {
   if (material.roughness == 0) return 0;
 
-  if (material.type == scene_material_type::matte) {
+  if constexpr (type == scene_material_type::matte) {
     return sample_matte_pdf(material.color, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::glossy) {
+  } else if constexpr (type == scene_material_type::glossy) {
     return sample_glossy_pdf(material.color, material.ior, material.roughness,
         normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::metallic) {
+  } else if constexpr (type == scene_material_type::metallic) {
     return sample_metallic_pdf(
         material.color, material.roughness, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::transparent) {
+  } else if constexpr (type == scene_material_type::transparent) {
     return sample_tranparent_pdf(material.color, material.ior,
         material.roughness, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::refractive) {
+  } else if constexpr (type == scene_material_type::refractive) {
     return sample_refractive_pdf(material.color, material.ior,
         material.roughness, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::subsurface) {
+  } else if constexpr (type == scene_material_type::subsurface) {
     return sample_refractive_pdf(material.color, material.ior,
         material.roughness, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::gltfpbr) {
+  } else if constexpr (type == scene_material_type::gltfpbr) {
     return sample_gltfpbr_pdf(material.color, material.ior, material.roughness,
         material.metallic, normal, outgoing, incoming);
   } else {
@@ -197,25 +277,68 @@ static float sample_bsdfcos_pdf(const material_point& material,
   }
 }
 
+template <scene_material_type type>
 static float sample_delta_pdf(const material_point& material,
     const vec3f& normal, const vec3f& outgoing, const vec3f& incoming) {
   if (material.roughness != 0) return 0;
 
-  if (material.type == scene_material_type::metallic) {
+  if constexpr (type == scene_material_type::metallic) {
     return sample_metallic_pdf(material.color, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::transparent) {
+  } else if constexpr (type == scene_material_type::transparent) {
     return sample_tranparent_pdf(
         material.color, material.ior, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::refractive) {
+  } else if constexpr (type == scene_material_type::refractive) {
     return sample_refractive_pdf(
         material.color, material.ior, normal, outgoing, incoming);
-  } else if (material.type == scene_material_type::volume) {
+  } else if constexpr (type == scene_material_type::volume) {
     return sample_passthrough_pdf(material.color, normal, outgoing, incoming);
   } else {
     return 0;
   }
 }
 
+// Material kernels for a material type, dispatched once per hit
+struct trace_bsdf {
+  vec3f (*eval_bsdfcos)(const material_point& material, const vec3f& normal,
+      const vec3f& outgoing, const vec3f& incoming) = nullptr;
+  vec3f (*eval_delta)(const material_point& material, const vec3f& normal,
+      const vec3f& outgoing, const vec3f& incoming) = nullptr;
+  vec3f (*sample_bsdfcos)(const material_point& material, const vec3f& normal,
+      const vec3f& outgoing, float rnl, const vec2f& rn) = nullptr;
+  vec3f (*sample_delta)(const material_point& material, const vec3f& normal,
+      const vec3f& outgoing, float rnl) = nullptr;
+  float (*sample_bsdfcos_pdf)(const material_point& material,
+      const vec3f& normal, const vec3f& outgoing,
+      const vec3f& incoming) = nullptr;
+  float (*sample_delta_pdf)(const material_point& material,
+      const vec3f& normal, const vec3f& outgoing,
+      const vec3f& incoming) = nullptr;
+};
+
+// Instantiate the kernels of a material type
+template <scene_material_type type>
+static trace_bsdf make_bsdf() {
+  return {eval_bsdfcos<type>, eval_delta<type>, sample_bsdfcos<type>,
+      sample_delta<type>, sample_bsdfcos_pdf<type>, sample_delta_pdf<type>};
+}
+
+// Kernels indexed by material type
+static const trace_bsdf trace_bsdfs[] = {
+    make_bsdf<scene_material_type::matte>(),
+    make_bsdf<scene_material_type::glossy>(),
+    make_bsdf<scene_material_type::metallic>(),
+    make_bsdf<scene_material_type::transparent>(),
+    make_bsdf<scene_material_type::refractive>(),
+    make_bsdf<scene_material_type::subsurface>(),
+    make_bsdf<scene_material_type::volume>(),
+    make_bsdf<scene_material_type::gltfpbr>(),
+};
+
+// Get the kernels of a material point
+static const trace_bsdf& get_bsdf(const material_point& material) {
+  return trace_bsdfs[(int)material.type];
+}
+
 static vec3f eval_scattering(const material_point& material,
     const vec3f& outgoing, const vec3f& incoming) {
   if (material.density == zero3f) return zero3f;
@@ -258,6 +381,140 @@ static ray3f sample_camera(const scene_camera& camera, const vec2i& ij,
   }
 }
 
+// Textures present in a material
+const auto trace_emission_tex   = 1;
+const auto trace_color_tex      = 2;
+const auto trace_roughness_tex  = 4;
+const auto trace_scattering_tex = 8;
+
+// Minimum roughness, below which materials are delta
+static const auto trace_min_roughness = 0.03f * 0.03f;
+
+// Make a material point from material values already multiplied by
+// textures and shape colors
+static material_point make_material_point(const scene_material& material,
+    const vec3f& emission, const vec4f& color, float roughness, float metallic,
+    const vec3f& scattering) {
+  auto point         = material_point{};
+  point.type         = material.type;
+  point.emission     = emission;
+  point.color        = xyz(color);
+  point.opacity      = color.w;
+  point.metallic     = metallic;
+  point.roughness    = roughness * roughness;
+  point.ior          = material.ior;
+  point.scattering   = scattering;
+  point.scanisotropy = material.scanisotropy;
+  point.trdepth      = material.trdepth;
+
+  // volume density
+  if (material.type == scene_material_type::refractive ||
+      material.type == scene_material_type::volume ||
+      material.type == scene_material_type::subsurface) {
+    point.density = -log(clamp(point.color, 0.0001f, 1.0f)) / point.trdepth;
+  } else {
+    point.density = {0, 0, 0};
+  }
+
+  // fix roughness
+  if (point.type == scene_material_type::matte ||
+      point.type == scene_material_type::gltfpbr ||
+      point.type == scene_material_type::glossy) {
+    point.roughness = clamp(point.roughness, trace_min_roughness, 1.0f);
+  } else if (material.type == scene_material_type::volume) {
+    point.roughness = 0;
+  } else {
+    if (point.roughness < trace_min_roughness) point.roughness = 0;
+  }
+
+  return point;
+}
+
+// Evaluate material textures and shape colors. Instantiated per set of
+// present textures, so that each version looks up only those textures.
+template <int textures>
+static material_point eval_material(const scene_model& scene,
+    const scene_instance& instance, int element, const vec2f& uv) {
+  auto& material   = scene.materials[instance.material];
+  auto& shape      = scene.shapes[instance.shape];
+  auto  texcoord   = textures != 0
+                         ? eval_texcoord(scene, instance, element, uv)
+                         : vec2f{0, 0};
+  auto  emission   = material.emission;
+  auto  color      = vec4f{material.color.x, material.color.y,
+      material.color.z, material.opacity};
+  auto  roughness  = material.roughness;
+  auto  metallic   = material.metallic;
+  auto  scattering = material.scattering;
+  if constexpr ((textures & trace_emission_tex) != 0) {
+    emission *= xyz(eval_texture(scene, material.emission_tex, texcoord, true));
+  }
+  if constexpr ((textures & trace_color_tex) != 0) {
+    color *= eval_texture(scene, material.color_tex, texcoord, true);
+  }
+  if (!shape.colors.empty()) {
+    color *= eval_color(scene, instance, element, uv);
+  }
+  if constexpr ((textures & trace_roughness_tex) != 0) {
+    auto roughness_tex = eval_texture(
+        scene, material.roughness_tex, texcoord, false);
+    metallic *= roughness_tex.z;
+    roughness *= roughness_tex.y;
+  }
+  if constexpr ((textures & trace_scattering_tex) != 0) {
+    scattering *= xyz(
+        eval_texture(scene, material.scattering_tex, texcoord, true));
+  }
+  return make_material_point(
+      material, emission, color, roughness, metallic, scattering);
+}
+
+// Material evaluation indexed by the bitmask of present textures
+using material_func = material_point (*)(const scene_model& scene,
+    const scene_instance& instance, int element, const vec2f& uv);
+static const material_func trace_material_funcs[] = {eval_material<0>,
+    eval_material<1>, eval_material<2>, eval_material<3>, eval_material<4>,
+    eval_material<5>, eval_material<6>, eval_material<7>, eval_material<8>,
+    eval_material<9>, eval_material<10>, eval_material<11>,
+    eval_material<12>, eval_material<13>, eval_material<14>,
+    eval_material<15>};
+
+// Evaluate material, returning the precomputed point for constant materials
+static material_point eval_material(const scene_model& scene,
+    const trace_scene& tscene, const scene_instance& instance, int element,
+    const vec2f& uv) {
+  auto& tmaterial = tscene.materials[instance.material];
+  if (tmaterial.textures == 0 && scene.shapes[instance.shape].colors.empty())
+    return tmaterial.point;
+  return trace_material_funcs[tmaterial.textures](
+      scene, instance, element, uv);
+}
+
+// Check if an instance is volumetric
+static bool is_volumetric(
+    const trace_scene& tscene, const scene_instance& instance) {
+  return tscene.materials[instance.material].volumetric;
+}
+
+// Evaluate the emission of all environments
+static vec3f eval_environment(const scene_model& scene,
+    const trace_scene& tscene, const vec3f& direction) {
+  auto emission = zero3f;
+  for (auto& environment : tscene.environments) {
+    if (environment.emission_tex == invalidid) {
+      emission += environment.emission;
+      continue;
+    }
+    auto wl       = transform_direction(environment.inv_frame, direction);
+    auto texcoord = vec2f{fast_atan2(wl.z, wl.x) / (2 * pif),
+        fast_acos(clamp(wl.y, -1.0f, 1.0f)) / pif};
+    if (texcoord.x < 0) texcoord.x += 1;
+    emission += environment.emission *
+                xyz(eval_texture(scene, environment.emission_tex, texcoord));
+  }
+  return emission;
+}
+
 // Sample lights wrt solid angle
 static vec3f sample_lights(const scene_model& scene, const trace_lights& lights,
     const vec3f& position, float rl, float rel, const vec2f& ruv) {
@@ -277,9 +534,10 @@ static vec3f sample_lights(const scene_model& scene, const trace_lights& lights,
       auto  idx          = sample_discrete(light.elements_cdf, rel);
       auto  uv = vec2f{((idx % emission_tex.width) + 0.5f) / emission_tex.width,
           ((idx / emission_tex.width) + 0.5f) / emission_tex.height};
-      return transform_direction(environment.frame,
-          {cos(uv.x * 2 * pif) * sin(uv.y * pif), cos(uv.y * pif),
-              sin(uv.x * 2 * pif) * sin(uv.y * pif)});
+      auto [sphi, cphi]     = fast_sincos(uv.x * 2 * pif);
+      auto [stheta, ctheta] = fast_sincos(uv.y * pif);
+      return transform_direction(
+          environment.frame, vec3f{cphi * stheta, ctheta, sphi * stheta});
     } else {
       return sample_sphere(ruv);
     }
@@ -289,8 +547,9 @@ static vec3f sample_lights(const scene_model& scene, const trace_lights& lights,
 }
 
 // Sample lights pdf
-static float sample_lights_pdf(const scene_model& scene, const bvh_scene& bvh,
-    const trace_lights& lights, const vec3f& position, const vec3f& direction) {
+static float sample_lights_pdf(const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const vec3f& position, const vec3f& direction) {
   auto pdf = 0.0f;
   for (auto& light : lights.lights) {
     if (light.instance != invalidid) {
@@ -299,8 +558,8 @@ static float sample_lights_pdf(const scene_model& scene, const bvh_scene& bvh,
       auto lpdf          = 0.0f;
       auto next_position = position;
       for (auto bounce = 0; bounce < 100; bounce++) {
-        auto intersection = intersect_bvh(
-            bvh, scene, light.instance, {next_position, direction});
+        auto intersection = intersect_scene(bvh, scene, light.instance,
+            {next_position, direction}, &trace_stats::light_rays);
         if (!intersection.hit) break;
         // accumulate pdf
         auto lposition = eval_position(
@@ -319,9 +578,10 @@ static float sample_lights_pdf(const scene_model& scene, const bvh_scene& bvh,
       auto& environment = scene.environments[light.environment];
       if (environment.emission_tex != invalidid) {
         auto& emission_tex = scene.textures[environment.emission_tex];
-        auto  wl = transform_direction(inverse(environment.frame), direction);
-        auto  texcoord = vec2f{atan2(wl.z, wl.x) / (2 * pif),
-            acos(clamp(wl.y, -1.0f, 1.0f)) / pif};
+        auto  wl = transform_direction(
+            tscene.environments[light.environment].inv_frame, direction);
+        auto  texcoord = vec2f{fast_atan2(wl.z, wl.x) / (2 * pif),
+            fast_acos(clamp(wl.y, -1.0f, 1.0f)) / pif};
         if (texcoord.x < 0) texcoord.x += 1;
         auto i = clamp(
             (int)(texcoord.x * emission_tex.width), 0, emission_tex.width - 1);
@@ -343,6 +603,69 @@ static float sample_lights_pdf(const scene_model& scene, const bvh_scene& bvh,
   return pdf;
 }
 
+// Random numbers for a path sample. With low-discrepancy sequences, each
+// path bounce uses a fixed range of dimensions, so that the same choices,
+// e.g. the BSDF direction at the first bounce, are stratified across the
+// samples of a pixel. Numbers past the dimensions of a bounce are random.
+struct trace_rng {
+  rng_state&          rng;
+  trace_sequence_type sequence  = trace_sequence_type::random;
+  uint64_t            key       = 0;
+  uint32_t            sample    = 0;
+  vec2i               pixel     = {0, 0};
+  int                 dimension = 0;
+  int                 end       = 0;
+};
+
+// Dimensions used for camera and each bounce
+const auto trace_camera_dimensions = 4;
+const auto trace_bounce_dimensions = 16;
+
+// Start a new bounce
+static void start_bounce(trace_rng& rng, int bounce) {
+  rng.dimension = trace_camera_dimensions + bounce * trace_bounce_dimensions;
+  rng.end       = rng.dimension + trace_bounce_dimensions;
+}
+
+// Blue-noise dithering offset, from Jimenez's interleaved gradient noise,
+// shifted for each dimension.
+static float bluenoise_offset(const vec2i& pixel, int dimension) {
+  auto fract = [](float x) { return x - floor(x); };
+  auto x = pixel.x + 5.588238f * dimension, y = pixel.y + 5.588238f * dimension;
+  return fract(52.9829189f * fract(0.06711056f * x + 0.00583715f * y));
+}
+
+// Toroidal shift of a number in [0,1)
+static float shift_number(float value, float offset) {
+  value += offset;
+  return value < 1 ? value : value - 1;
+}
+
+// Next random numbers
+static float rand1f(trace_rng& rng) {
+  if (rng.sequence == trace_sequence_type::random || rng.dimension >= rng.end)
+    return rand1f(rng.rng);
+  auto dimension = rng.dimension++;
+  auto value     = sobol1f(rng.sample, hash_rng(rng.key, dimension));
+  if (rng.sequence == trace_sequence_type::bluenoise) {
+    value = shift_number(value, bluenoise_offset(rng.pixel, dimension));
+  }
+  return value;
+}
+static vec2f rand2f(trace_rng& rng) {
+  if (rng.sequence == trace_sequence_type::random ||
+      rng.dimension + 1 >= rng.end)
+    return rand2f(rng.rng);
+  auto dimension = rng.dimension;
+  auto value     = sobol2f(rng.sample, hash_rng(rng.key, dimension));
+  rng.dimension += 2;
+  if (rng.sequence == trace_sequence_type::bluenoise) {
+    value = {shift_number(value.x, bluenoise_offset(rng.pixel, dimension)),
+        shift_number(value.y, bluenoise_offset(rng.pixel, dimension + 1))};
+  }
+  return value;
+}
+
 struct trace_result {
   vec3f radiance = {0, 0, 0};
   bool  hit      = false;
@@ -351,9 +674,9 @@ struct trace_result {
 };
 
 // Recursive path tracing.
-static trace_result trace_path(const scene_model& scene, const bvh_scene& bvh,
-    const trace_lights& lights, const ray3f& ray_, rng_state& rng,
-    const trace_params& params) {
+static trace_result trace_path(const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray_, trace_rng& rng, const trace_params& params) {
   // initialize
   auto radiance      = zero3f;
   auto weight        = vec3f{1, 1, 1};
@@ -367,11 +690,14 @@ static trace_result trace_path(const scene_model& scene, const bvh_scene& bvh,
 
   // trace  path
   for (auto bounce = 0; bounce < params.bounces; bounce++) {
+    start_bounce(rng, bounce);
+
     // intersect next point
-    auto intersection = intersect_bvh(bvh, scene, ray);
+    auto intersection = intersect_scene(bvh, scene, ray,
+        bounce == 0 ? &trace_stats::camera_rays : &trace_stats::bounce_rays);
     if (!intersection.hit) {
       if (bounce > 0 || !params.envhidden)
-        radiance += weight * eval_environment(scene, ray.d);
+        radiance += weight * eval_environment(scene, tscene, ray.d);
       break;
     }
 
@@ -397,7 +723,8 @@ static trace_result trace_path(const scene_model& scene, const bvh_scene& bvh,
       auto  uv       = intersection.uv;
       auto  position = eval_position(scene, instance, element, uv);
       auto normal = eval_shading_normal(scene, instance, element, uv, outgoing);
-      auto material = eval_material(scene, instance, element, uv);
+      auto  material = eval_material(scene, tscene, instance, element, uv);
+      auto& bsdf     = get_bsdf(material);
 
       // correct roughness
       if (params.nocaustics) {
@@ -427,28 +754,29 @@ static trace_result trace_path(const scene_model& scene, const bvh_scene& bvh,
       auto incoming = zero3f;
       if (!is_delta(material)) {
         if (rand1f(rng) < 0.5f) {
-          incoming = sample_bsdfcos(
+          incoming = bsdf.sample_bsdfcos(
               material, normal, outgoing, rand1f(rng), rand2f(rng));
         } else {
           incoming = sample_lights(
               scene, lights, position, rand1f(rng), rand1f(rng), rand2f(rng));
         }
         weight *=
-            eval_bsdfcos(material, normal, outgoing, incoming) /
-            (0.5f * sample_bsdfcos_pdf(material, normal, outgoing, incoming) +
-                0.5f *
-                    sample_lights_pdf(scene, bvh, lights, position, incoming));
+            bsdf.eval_bsdfcos(material, normal, outgoing, incoming) /
+            (0.5f * bsdf.sample_bsdfcos_pdf(
+                        material, normal, outgoing, incoming) +
+                0.5f * sample_lights_pdf(scene, tscene, bvh, lights, position,
+                           incoming));
       } else {
-        incoming = sample_delta(material, normal, outgoing, rand1f(rng));
-        weight *= eval_delta(material, normal, outgoing, incoming) /
-                  sample_delta_pdf(material, normal, outgoing, incoming);
+        incoming = bsdf.sample_delta(material, normal, outgoing, rand1f(rng));
+        weight *= bsdf.eval_delta(material, normal, outgoing, incoming) /
+                  bsdf.sample_delta_pdf(material, normal, outgoing, incoming);
       }
 
       // update volume stack
-      if (is_volumetric(scene, instance) &&
+      if (is_volumetric(tscene, instance) &&
           dot(normal, outgoing) * dot(normal, incoming) < 0) {
         if (volume_stack.empty()) {
-          auto material = eval_material(scene, instance, element, uv);
+          auto material = eval_material(scene, tscene, instance, element, uv);
           volume_stack.push_back(material);
         } else {
           volume_stack.pop_back();
@@ -477,7 +805,8 @@ static trace_result trace_path(const scene_model& scene, const bvh_scene& bvh,
       weight *=
           eval_scattering(vsdf, outgoing, incoming) /
           (0.5f * sample_scattering_pdf(vsdf, outgoing, incoming) +
-              0.5f * sample_lights_pdf(scene, bvh, lights, position, incoming));
+              0.5f * sample_lights_pdf(
+                         scene, tscene, bvh, lights, position, incoming));
 
       // setup next iteration
       ray = {position, incoming};
@@ -499,8 +828,8 @@ static trace_result trace_path(const scene_model& scene, const bvh_scene& bvh,
 
 // Recursive path tracing.
 static trace_result trace_pathdirect(const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights, const ray3f& ray_,
-    rng_state& rng, const trace_params& params) {
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray_, trace_rng& rng, const trace_params& params) {
   // initialize
   auto radiance      = zero3f;
   auto weight        = vec3f{1, 1, 1};
@@ -515,11 +844,14 @@ static trace_result trace_pathdirect(const scene_model& scene,
 
   // trace  path
   for (auto bounce = 0; bounce < params.bounces; bounce++) {
+    start_bounce(rng, bounce);
+
     // intersect next point
-    auto intersection = intersect_bvh(bvh, scene, ray);
+    auto intersection = intersect_scene(bvh, scene, ray,
+        bounce == 0 ? &trace_stats::camera_rays : &trace_stats::bounce_rays);
     if (!intersection.hit) {
       if ((bounce > 0 || !params.envhidden) && next_emission)
-        radiance += weight * eval_environment(scene, ray.d);
+        radiance += weight * eval_environment(scene, tscene, ray.d);
       break;
     }
 
@@ -545,7 +877,8 @@ static trace_result trace_pathdirect(const scene_model& scene,
       auto  uv       = intersection.uv;
       auto  position = eval_position(scene, instance, element, uv);
       auto normal = eval_shading_normal(scene, instance, element, uv, outgoing);
-      auto material = eval_material(scene, instance, element, uv);
+      auto  material = eval_material(scene, tscene, instance, element, uv);
+      auto& bsdf     = get_bsdf(material);
 
       // correct roughness
       if (params.nocaustics) {
@@ -576,14 +909,17 @@ static trace_result trace_pathdirect(const scene_model& scene,
       if (!is_delta(material)) {
         auto incoming = sample_lights(
             scene, lights, position, rand1f(rng), rand1f(rng), rand2f(rng));
-        auto pdf = sample_lights_pdf(scene, bvh, lights, position, incoming);
-        auto bsdfcos = eval_bsdfcos(material, normal, outgoing, incoming);
+        auto pdf = sample_lights_pdf(
+            scene, tscene, bvh, lights, position, incoming);
+        auto bsdfcos = bsdf.eval_bsdfcos(
+            material, normal, outgoing, incoming);
         if (bsdfcos != zero3f && pdf > 0) {
-          auto intersection = intersect_bvh(bvh, scene, {position, incoming});
+          auto intersection = intersect_scene(
+              bvh, scene, {position, incoming}, &trace_stats::shadow_rays);
           auto emission =
               !intersection.hit
-                  ? eval_environment(scene, incoming)
-                  : eval_emission(eval_material(scene,
+                  ? eval_environment(scene, tscene, incoming)
+                  : eval_emission(eval_material(scene, tscene,
                                       scene.instances[intersection.instance],
                                       intersection.element, intersection.uv),
                         eval_shading_normal(scene,
@@ -601,28 +937,29 @@ static trace_result trace_pathdirect(const scene_model& scene,
       auto incoming = zero3f;
       if (!is_delta(material)) {
         if (rand1f(rng) < 0.5f) {
-          incoming = sample_bsdfcos(
+          incoming = bsdf.sample_bsdfcos(
               material, normal, outgoing, rand1f(rng), rand2f(rng));
         } else {
           incoming = sample_lights(
               scene, lights, position, rand1f(rng), rand1f(rng), rand2f(rng));
         }
         weight *=
-            eval_bsdfcos(material, normal, outgoing, incoming) /
-            (0.5f * sample_bsdfcos_pdf(material, normal, outgoing, incoming) +
-                0.5f *
-                    sample_lights_pdf(scene, bvh, lights, position, incoming));
+            bsdf.eval_bsdfcos(material, normal, outgoing, incoming) /
+            (0.5f * bsdf.sample_bsdfcos_pdf(
+                        material, normal, outgoing, incoming) +
+                0.5f * sample_lights_pdf(scene, tscene, bvh, lights, position,
+                           incoming));
       } else {
-        incoming = sample_delta(material, normal, outgoing, rand1f(rng));
-        weight *= eval_delta(material, normal, outgoing, incoming) /
-                  sample_delta_pdf(material, normal, outgoing, incoming);
+        incoming = bsdf.sample_delta(material, normal, outgoing, rand1f(rng));
+        weight *= bsdf.eval_delta(material, normal, outgoing, incoming) /
+                  bsdf.sample_delta_pdf(material, normal, outgoing, incoming);
       }
 
       // update volume stack
-      if (is_volumetric(scene, instance) &&
+      if (is_volumetric(tscene, instance) &&
           dot(normal, outgoing) * dot(normal, incoming) < 0) {
         if (volume_stack.empty()) {
-          auto material = eval_material(scene, instance, element, uv);
+          auto material = eval_material(scene, tscene, instance, element, uv);
           volume_stack.push_back(material);
         } else {
           volume_stack.pop_back();
@@ -648,7 +985,8 @@ static trace_result trace_pathdirect(const scene_model& scene,
       weight *=
           eval_scattering(vsdf, outgoing, incoming) /
           (0.5f * sample_scattering_pdf(vsdf, outgoing, incoming) +
-              0.5f * sample_lights_pdf(scene, bvh, lights, position, incoming));
+              0.5f * sample_lights_pdf(
+                         scene, tscene, bvh, lights, position, incoming));
 
       // setup next iteration
       ray = {position, incoming};
@@ -670,8 +1008,8 @@ static trace_result trace_pathdirect(const scene_model& scene,
 
 // Recursive path tracing with MIS.
 static trace_result trace_pathmis(const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights, const ray3f& ray_,
-    rng_state& rng, const trace_params& params) {
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray_, trace_rng& rng, const trace_params& params) {
   // initialize
   auto radiance      = zero3f;
   auto weight        = vec3f{1, 1, 1};
@@ -693,12 +1031,17 @@ static trace_result trace_pathmis(const scene_model& scene,
 
   // trace  path
   for (auto bounce = 0; bounce < params.bounces; bounce++) {
+    start_bounce(rng, bounce);
+
     // intersect next point
-    auto intersection = next_emission ? intersect_bvh(bvh, scene, ray)
-                                      : next_intersection;
+    auto intersection = next_emission
+                            ? intersect_scene(bvh, scene, ray,
+                                  bounce == 0 ? &trace_stats::camera_rays
+                                              : &trace_stats::bounce_rays)
+                            : next_intersection;
     if (!intersection.hit) {
       if ((bounce > 0 || !params.envhidden) && next_emission)
-        radiance += weight * eval_environment(scene, ray.d);
+        radiance += weight * eval_environment(scene, tscene, ray.d);
       break;
     }
 
@@ -724,7 +1067,8 @@ static trace_result trace_pathmis(const scene_model& scene,
       auto  uv       = intersection.uv;
       auto  position = eval_position(scene, instance, element, uv);
       auto normal = eval_shading_normal(scene, instance, element, uv, outgoing);
-      auto material = eval_material(scene, instance, element, uv);
+      auto  material = eval_material(scene, tscene, instance, element, uv);
+      auto& bsdf     = get_bsdf(material);
 
       // correct roughness
       if (params.nocaustics) {
@@ -757,26 +1101,31 @@ static trace_result trace_pathmis(const scene_model& scene,
       if (!is_delta(material)) {
         // direct with MIS --- light
         for (auto sample_light : {true, false}) {
-          incoming       = sample_light ? sample_lights(scene, lights, position,
-                                        rand1f(rng), rand1f(rng), rand2f(rng))
-                                        : sample_bsdfcos(material, normal, outgoing,
-                                        rand1f(rng), rand2f(rng));
-          auto bsdfcos   = eval_bsdfcos(material, normal, outgoing, incoming);
+          incoming = sample_light
+                         ? sample_lights(scene, lights, position, rand1f(rng),
+                               rand1f(rng), rand2f(rng))
+                         : bsdf.sample_bsdfcos(material, normal, outgoing,
+                               rand1f(rng), rand2f(rng));
+          auto bsdfcos = bsdf.eval_bsdfcos(
+              material, normal, outgoing, incoming);
           auto light_pdf = sample_lights_pdf(
-              scene, bvh, lights, position, incoming);
-          auto bsdf_pdf = sample_bsdfcos_pdf(
+              scene, tscene, bvh, lights, position, incoming);
+          auto bsdf_pdf = bsdf.sample_bsdfcos_pdf(
               material, normal, outgoing, incoming);
           auto mis_weight = sample_light
                                 ? mis_heuristic(light_pdf, bsdf_pdf) / light_pdf
                                 : mis_heuristic(bsdf_pdf, light_pdf) / bsdf_pdf;
           if (bsdfcos != zero3f && mis_weight != 0) {
-            auto intersection = intersect_bvh(bvh, scene, {position, incoming});
+            auto intersection = intersect_scene(bvh, scene,
+                {position, incoming},
+                sample_light ? &trace_stats::shadow_rays
+                             : &trace_stats::bounce_rays);
             if (!sample_light) next_intersection = intersection;
             auto emission = zero3f;
             if (!intersection.hit) {
-              emission = eval_environment(scene, incoming);
+              emission = eval_environment(scene, tscene, incoming);
             } else {
-              auto material = eval_material(scene,
+              auto material = eval_material(scene, tscene,
                   scene.instances[intersection.instance], intersection.element,
                   intersection.uv);
               emission      = eval_emission(material,
@@ -790,21 +1139,21 @@ static trace_result trace_pathmis(const scene_model& scene,
         }
 
         // indirect
-        weight *= eval_bsdfcos(material, normal, outgoing, incoming) /
-                  sample_bsdfcos_pdf(material, normal, outgoing, incoming);
+        weight *= bsdf.eval_bsdfcos(material, normal, outgoing, incoming) /
+                  bsdf.sample_bsdfcos_pdf(material, normal, outgoing, incoming);
         next_emission = false;
       } else {
-        incoming = sample_delta(material, normal, outgoing, rand1f(rng));
-        weight *= eval_delta(material, normal, outgoing, incoming) /
-                  sample_delta_pdf(material, normal, outgoing, incoming);
+        incoming = bsdf.sample_delta(material, normal, outgoing, rand1f(rng));
+        weight *= bsdf.eval_delta(material, normal, outgoing, incoming) /
+                  bsdf.sample_delta_pdf(material, normal, outgoing, incoming);
         next_emission = true;
       }
 
       // update volume stack
-      if (is_volumetric(scene, instance) &&
+      if (is_volumetric(tscene, instance) &&
           dot(normal, outgoing) * dot(normal, incoming) < 0) {
         if (volume_stack.empty()) {
-          auto material = eval_material(scene, instance, element, uv);
+          auto material = eval_material(scene, tscene, instance, element, uv);
           volume_stack.push_back(material);
         } else {
           volume_stack.pop_back();
@@ -832,7 +1181,8 @@ static trace_result trace_pathmis(const scene_model& scene,
       weight *=
           eval_scattering(vsdf, outgoing, incoming) /
           (0.5f * sample_scattering_pdf(vsdf, outgoing, incoming) +
-              0.5f * sample_lights_pdf(scene, bvh, lights, position, incoming));
+              0.5f * sample_lights_pdf(
+                         scene, tscene, bvh, lights, position, incoming));
 
       // setup next iteration
       ray = {position, incoming};
@@ -853,9 +1203,9 @@ static trace_result trace_pathmis(const scene_model& scene,
 }
 
 // Recursive path tracing.
-static trace_result trace_naive(const scene_model& scene, const bvh_scene& bvh,
-    const trace_lights& lights, const ray3f& ray_, rng_state& rng,
-    const trace_params& params) {
+static trace_result trace_naive(const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray_, trace_rng& rng, const trace_params& params) {
   // initialize
   auto radiance   = zero3f;
   auto weight     = vec3f{1, 1, 1};
@@ -867,11 +1217,14 @@ static trace_result trace_naive(const scene_model& scene, const bvh_scene& bvh,
 
   // trace  path
   for (auto bounce = 0; bounce < params.bounces; bounce++) {
+    start_bounce(rng, bounce);
+
     // intersect next point
-    auto intersection = intersect_bvh(bvh, scene, ray);
+    auto intersection = intersect_scene(bvh, scene, ray,
+        bounce == 0 ? &trace_stats::camera_rays : &trace_stats::bounce_rays);
     if (!intersection.hit) {
       if (bounce > 0 || !params.envhidden)
-        radiance += weight * eval_environment(scene, ray.d);
+        radiance += weight * eval_environment(scene, tscene, ray.d);
       break;
     }
 
@@ -882,7 +1235,8 @@ static trace_result trace_naive(const scene_model& scene, const bvh_scene& bvh,
     auto uv       = intersection.uv;
     auto position = eval_position(scene, instance, element, uv);
     auto normal   = eval_shading_normal(scene, instance, element, uv, outgoing);
-    auto material = eval_material(scene, instance, element, uv);
+    auto  material = eval_material(scene, tscene, instance, element, uv);
+    auto& bsdf     = get_bsdf(material);
 
     // handle opacity
     if (material.opacity < 1 && rand1f(rng) >= material.opacity) {
@@ -905,14 +1259,14 @@ static trace_result trace_naive(const scene_model& scene, const bvh_scene& bvh,
     // next direction
     auto incoming = zero3f;
     if (material.roughness != 0) {
-      incoming = sample_bsdfcos(
+      incoming = bsdf.sample_bsdfcos(
           material, normal, outgoing, rand1f(rng), rand2f(rng));
-      weight *= eval_bsdfcos(material, normal, outgoing, incoming) /
-                sample_bsdfcos_pdf(material, normal, outgoing, incoming);
+      weight *= bsdf.eval_bsdfcos(material, normal, outgoing, incoming) /
+                bsdf.sample_bsdfcos_pdf(material, normal, outgoing, incoming);
     } else {
-      incoming = sample_delta(material, normal, outgoing, rand1f(rng));
-      weight *= eval_delta(material, normal, outgoing, incoming) /
-                sample_delta_pdf(material, normal, outgoing, incoming);
+      incoming = bsdf.sample_delta(material, normal, outgoing, rand1f(rng));
+      weight *= bsdf.eval_delta(material, normal, outgoing, incoming) /
+                bsdf.sample_delta_pdf(material, normal, outgoing, incoming);
     }
 
     // check weight
@@ -934,8 +1288,8 @@ static trace_result trace_naive(const scene_model& scene, const bvh_scene& bvh,
 
 // Eyelight for quick previewing.
 static trace_result trace_eyelight(const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights, const ray3f& ray_,
-    rng_state& rng, const trace_params& params) {
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray_, trace_rng& rng, const trace_params& params) {
   // initialize
   auto radiance   = zero3f;
   auto weight     = vec3f{1, 1, 1};
@@ -947,11 +1301,14 @@ static trace_result trace_eyelight(const scene_model& scene,
 
   // trace  path
   for (auto bounce = 0; bounce < max(params.bounces, 4); bounce++) {
+    start_bounce(rng, bounce);
+
     // intersect next point
-    auto intersection = intersect_bvh(bvh, scene, ray);
+    auto intersection = intersect_scene(bvh, scene, ray,
+        bounce == 0 ? &trace_stats::camera_rays : &trace_stats::bounce_rays);
     if (!intersection.hit) {
       if (bounce > 0 || !params.envhidden)
-        radiance += weight * eval_environment(scene, ray.d);
+        radiance += weight * eval_environment(scene, tscene, ray.d);
       break;
     }
 
@@ -962,7 +1319,8 @@ static trace_result trace_eyelight(const scene_model& scene,
     auto uv       = intersection.uv;
     auto position = eval_position(scene, instance, element, uv);
     auto normal   = eval_shading_normal(scene, instance, element, uv, outgoing);
-    auto material = eval_material(scene, instance, element, uv);
+    auto  material = eval_material(scene, tscene, instance, element, uv);
+    auto& bsdf     = get_bsdf(material);
 
     // handle opacity
     if (material.opacity < 1 && rand1f(rng) >= material.opacity) {
@@ -985,13 +1343,13 @@ static trace_result trace_eyelight(const scene_model& scene,
 
     // brdf * light
     radiance += weight * pif *
-                eval_bsdfcos(material, normal, outgoing, incoming);
+                bsdf.eval_bsdfcos(material, normal, outgoing, incoming);
 
     // continue path
     if (!is_delta(material)) break;
-    incoming = sample_delta(material, normal, outgoing, rand1f(rng));
-    weight *= eval_delta(material, normal, outgoing, incoming) /
-              sample_delta_pdf(material, normal, outgoing, incoming);
+    incoming = bsdf.sample_delta(material, normal, outgoing, rand1f(rng));
+    weight *= bsdf.eval_delta(material, normal, outgoing, incoming) /
+              bsdf.sample_delta_pdf(material, normal, outgoing, incoming);
     if (weight == zero3f || !isfinite(weight)) break;
 
     // setup next iteration
@@ -1003,8 +1361,8 @@ static trace_result trace_eyelight(const scene_model& scene,
 
 // Eyelight with ambient occlusion for quick previewing.
 static trace_result trace_eyelightao(const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights, const ray3f& ray_,
-    rng_state& rng, const trace_params& params) {
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray_, trace_rng& rng, const trace_params& params) {
   // initialize
   auto radiance   = zero3f;
   auto weight     = vec3f{1, 1, 1};
@@ -1016,11 +1374,14 @@ static trace_result trace_eyelightao(const scene_model& scene,
 
   // trace  path
   for (auto bounce = 0; bounce < max(params.bounces, 4); bounce++) {
+    start_bounce(rng, bounce);
+
     // intersect next point
-    auto intersection = intersect_bvh(bvh, scene, ray);
+    auto intersection = intersect_scene(bvh, scene, ray,
+        bounce == 0 ? &trace_stats::camera_rays : &trace_stats::bounce_rays);
     if (!intersection.hit) {
       if (bounce > 0 || !params.envhidden)
-        radiance += weight * eval_environment(scene, ray.d);
+        radiance += weight * eval_environment(scene, tscene, ray.d);
       break;
     }
 
@@ -1031,7 +1392,8 @@ static trace_result trace_eyelightao(const scene_model& scene,
     auto uv       = intersection.uv;
     auto position = eval_position(scene, instance, element, uv);
     auto normal   = eval_shading_normal(scene, instance, element, uv, outgoing);
-    auto material = eval_material(scene, instance, element, uv);
+    auto  material = eval_material(scene, tscene, instance, element, uv);
+    auto& bsdf     = get_bsdf(material);
 
     // handle opacity
     if (material.opacity < 1 && rand1f(rng) >= material.opacity) {
@@ -1054,17 +1416,20 @@ static trace_result trace_eyelightao(const scene_model& scene,
 
     // occlusion
     auto occluding = sample_hemisphere_cos(normal, rand2f(rng));
-    if (intersect_bvh(bvh, scene, {position, occluding}).hit) break;
+    if (intersect_scene(
+            bvh, scene, {position, occluding}, &trace_stats::shadow_rays)
+            .hit)
+      break;
 
     // brdf * light
     radiance += weight * pif *
-                eval_bsdfcos(material, normal, outgoing, incoming);
+                bsdf.eval_bsdfcos(material, normal, outgoing, incoming);
 
     // continue path
     if (!is_delta(material)) break;
-    incoming = sample_delta(material, normal, outgoing, rand1f(rng));
-    weight *= eval_delta(material, normal, outgoing, incoming) /
-              sample_delta_pdf(material, normal, outgoing, incoming);
+    incoming = bsdf.sample_delta(material, normal, outgoing, rand1f(rng));
+    weight *= bsdf.eval_delta(material, normal, outgoing, incoming) /
+              bsdf.sample_delta_pdf(material, normal, outgoing, incoming);
     if (weight == zero3f || !isfinite(weight)) break;
 
     // setup next iteration
@@ -1076,10 +1441,48 @@ static trace_result trace_eyelightao(const scene_model& scene,
 
 // False color rendering
 static trace_result trace_falsecolor(const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights, const ray3f& ray,
-    rng_state& rng, const trace_params& params) {
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray, trace_rng& rng, const trace_params& params) {
+  // traversal cost heatmap of a path sampled from the bsdfs, on a log scale
+  // up to 4096 nodes and tests
+  if (params.falsecolor == trace_falsecolor_type::cost) {
+    auto stats    = bvh_stats{};
+    auto path_ray = ray;
+    auto opbounce = 0;
+    for (auto bounce = 0; bounce < params.bounces; bounce++) {
+      auto intersection = intersect_bvh(bvh, scene, path_ray, stats);
+      if (!intersection.hit) break;
+      auto  outgoing = -path_ray.d;
+      auto& instance = scene.instances[intersection.instance];
+      auto  element  = intersection.element;
+      auto  uv       = intersection.uv;
+      auto  position = eval_position(scene, instance, element, uv);
+      auto normal = eval_shading_normal(scene, instance, element, uv, outgoing);
+      auto  material = eval_material(scene, tscene, instance, element, uv);
+      auto& bsdf     = get_bsdf(material);
+      if (material.opacity < 1 && rand1f(rng) >= material.opacity) {
+        if (opbounce++ > 128) break;
+        path_ray = {position + path_ray.d * 1e-2f, path_ray.d};
+        bounce -= 1;
+        continue;
+      }
+      auto incoming =
+          is_delta(material)
+              ? bsdf.sample_delta(material, normal, outgoing, rand1f(rng))
+              : bsdf.sample_bsdfcos(
+                    material, normal, outgoing, rand1f(rng), rand2f(rng));
+      if (incoming == zero3f) break;
+      path_ray = {position, incoming};
+    }
+    auto cost = (float)(stats.nodes + stats.primitives);
+    auto heat = colormap(
+        clamp(log2(1 + cost) / 12, 0.0f, 1.0f), colormap_type::inferno);
+    return {srgb_to_rgb(heat), true, {0, 0, 0}, {0, 0, 0}};
+  }
+
   // intersect next point
-  auto intersection = intersect_bvh(bvh, scene, ray);
+  auto intersection = intersect_scene(
+      bvh, scene, ray, &trace_stats::camera_rays);
   if (!intersection.hit) return {};
 
   // prepare shading point
@@ -1091,7 +1494,7 @@ static trace_result trace_falsecolor(const scene_model& scene,
   auto normal   = eval_shading_normal(scene, instance, element, uv, outgoing);
   auto gnormal  = eval_element_normal(scene, instance, element);
   auto texcoord = eval_texcoord(scene, instance, element, uv);
-  auto material = eval_material(scene, instance, element, uv);
+  auto material = eval_material(scene, tscene, instance, element, uv);
   auto delta    = is_delta(material) ? 1.0f : 0.0f;
 
   // hash color
@@ -1159,8 +1562,8 @@ static trace_result trace_falsecolor(const scene_model& scene,
 
 // Trace a single ray from the camera using the given algorithm.
 using sampler_func = trace_result (*)(const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights, const ray3f& ray,
-    rng_state& rng, const trace_params& params);
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    const ray3f& ray, trace_rng& rng, const trace_params& params);
 static sampler_func get_trace_sampler_func(const trace_params& params) {
   switch (params.sampler) {
     case trace_sampler_type::path: return trace_path;
@@ -1193,32 +1596,106 @@ bool is_sampler_lit(const trace_params& params) {
   }
 }
 
+// Convert a float to half precision with stochastic rounding, by adding the
+// low 13 bits of `dither` to the truncated mantissa bits. Values outside of
+// the normal half range are rounded to nearest.
+static uint16_t float_to_half_dithered(float value, uint32_t dither) {
+  auto bits = (uint32_t)0;
+  memcpy(&bits, &value, sizeof(bits));
+  auto sign = bits & 0x80000000u;
+  auto abs  = bits ^ sign;
+  if (abs < 113u << 23 || abs >= (127u + 16u) << 23)
+    return float_to_half(value);
+  auto half = (abs + ((uint32_t)(15 - 127) << 23) + (dither & 0x1fffu)) >> 13;
+  if (half > 0x7bffu) half = 0x7bffu;
+  return (uint16_t)(half | (sign >> 16));
+}
+
+// Accumulate a sample in the state image, given the number of previous
+// samples of the pixel
+static void accumulate_sample(
+    trace_state& state, int idx, int sample, const vec4f& color) {
+  if (!state.imageh.empty()) {
+    // running mean with stochastic rounding, so that small updates are
+    // not lost to the half precision
+    auto mean  = half_to_float(state.imageh[idx]);
+    mean       = mean + (color - mean) / (float)(sample + 1);
+    auto value = hash_rng((uint64_t)idx, (uint64_t)sample);
+    state.imageh[idx] = {float_to_half_dithered(mean.x, (uint32_t)value),
+        float_to_half_dithered(mean.y, (uint32_t)(value >> 13)),
+        float_to_half_dithered(mean.z, (uint32_t)(value >> 26)),
+        float_to_half_dithered(mean.w, (uint32_t)(value >> 39))};
+  } else if (!state.residuals.empty()) {
+    // Kahan summation
+    auto& sum      = state.image[idx];
+    auto& residual = state.residuals[idx];
+    auto  value    = color - residual;
+    auto  total    = sum + value;
+    residual       = (total - sum) - value;
+    sum            = total;
+  } else {
+    state.image[idx] += color;
+  }
+}
+
 // Trace a block of samples
 void trace_sample(trace_state& state, const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights, int i, int j,
-    const trace_params& params) {
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    int i, int j, const trace_params& params) {
   auto& camera  = scene.cameras[params.camera];
   auto  sampler = get_trace_sampler_func(params);
   auto  idx     = state.width * j + i;
-  auto  ray     = sample_camera(camera, {i, j}, {state.width, state.height},
-      rand2f(state.rngs[idx]), rand2f(state.rngs[idx]), params.tentfilter);
+  auto  rng_    = rng_state{};
+  if (state.rngs.empty()) {
+    auto sample = state.counts.empty() ? state.samples : state.counts[idx];
+    rng_        = make_rng(params.seed, idx, sample);
+  }
+  auto  sample = state.counts.empty() ? state.samples : state.counts[idx];
+  auto  rng    = trace_rng{state.rngs.empty() ? rng_ : state.rngs[idx]};
+  rng.sequence = params.sequence;
+  rng.key      = params.sequence == trace_sequence_type::bluenoise
+                     ? params.seed
+                     : hash_rng(params.seed, idx);
+  rng.sample   = (uint32_t)sample;
+  rng.pixel    = {i, j};
+  rng.end      = trace_camera_dimensions;
+  auto ray = sample_camera(camera, {i, j}, {state.width, state.height},
+      rand2f(rng), rand2f(rng), params.tentfilter);
   auto [radiance, hit, albedo, normal] = sampler(
-      scene, bvh, lights, ray, state.rngs[idx], params);
+      scene, tscene, bvh, lights, ray, rng, params);
   if (!isfinite(radiance)) radiance = {0, 0, 0};
   if (max(radiance) > params.clamp)
     radiance = radiance * (params.clamp / max(radiance));
-  if (hit) {
-    state.image[idx] += {radiance.x, radiance.y, radiance.z, 1};
+  auto color = vec4f{radiance.x, radiance.y, radiance.z, 1};
+  if (!hit && !params.envhidden && !scene.environments.empty()) {
+    albedo = {1, 1, 1};
+    normal = -ray.d;
+  } else if (!hit) {
+    radiance = {0, 0, 0};
+    color    = {0, 0, 0, 0};
+    albedo   = {0, 0, 0};
+    normal   = {0, 0, 0};
+  }
+  accumulate_sample(state, idx, sample, color);
+  if (!state.albedo.empty()) {
     state.albedo[idx] += albedo;
     state.normal[idx] += normal;
-    state.hits[idx] += 1;
-  } else if (!params.envhidden && !scene.environments.empty()) {
-    state.image[idx] += {radiance.x, radiance.y, radiance.z, 1};
-    state.albedo[idx] += {1, 1, 1};
-    state.normal[idx] += -ray.d;
-    state.hits[idx] += 1;
+  }
+  if (!state.counts.empty()) {
+    state.moments[idx] += luminance(radiance) * luminance(radiance);
+    state.counts[idx] += 1;
+  }
+  if constexpr (trace_stats_enabled) {
+    merge_stats(state.stats[j], get_thread_stats());
+    get_thread_stats() = {};
   }
 }
+void trace_sample(trace_state& state, const scene_model& scene,
+    const bvh_scene& bvh, const trace_lights& lights, int i, int j,
+    const trace_params& params) {
+  trace_sample(
+      state, scene, make_trace_scene(scene), bvh, lights, i, j, params);
+}
 
 // Init a sequence of random number generators.
 trace_state make_state(const scene_model& scene, const trace_params& params) {
@@ -1232,106 +1709,418 @@ trace_state make_state(const scene_model& scene, const trace_params& params) {
     state.width  = (int)round(params.resolution * camera.aspect);
   }
   state.samples = 0;
-  state.image.assign(state.width * state.height, {0, 0, 0, 0});
-  state.albedo.assign(state.width * state.height, {0, 0, 0});
-  state.normal.assign(state.width * state.height, {0, 0, 0});
-  state.hits.assign(state.width * state.height, 0);
-  state.rngs.assign(state.width * state.height, {});
-  auto rng_ = make_rng(1301081);
-  for (auto& rng : state.rngs) {
-    rng = make_rng(params.seed, rand1i(rng_, 1 << 31) / 2 + 1);
+  if (params.accumulation == trace_accumulation_type::half) {
+    state.imageh.assign(state.width * state.height, {0, 0, 0, 0});
+  } else {
+    state.image.assign(state.width * state.height, {0, 0, 0, 0});
+  }
+  if (params.accumulation == trace_accumulation_type::compensated) {
+    state.residuals.assign(state.width * state.height, {0, 0, 0, 0});
+  }
+  if (params.denoise) {
+    state.albedo.assign(state.width * state.height, {0, 0, 0});
+    state.normal.assign(state.width * state.height, {0, 0, 0});
+  }
+  if (!params.counterrng) {
+    state.rngs.assign(state.width * state.height, {});
+    auto rng_ = make_rng(1301081);
+    for (auto& rng : state.rngs) {
+      rng = make_rng(params.seed, rand1i(rng_, 1 << 31) / 2 + 1);
+    }
+  }
+  if constexpr (trace_stats_enabled) state.stats.assign(state.height, {});
+  if (params.adaptive > 0) {
+    state.moments.assign(state.width * state.height, 0);
+    state.counts.assign(state.width * state.height, 0);
   }
   return state;
 }
 
+// Compile the scene snapshot used by the samplers
+trace_scene make_trace_scene(const scene_model& scene) {
+  auto tscene = trace_scene{};
+  tscene.materials.reserve(scene.materials.size());
+  for (auto& material : scene.materials) {
+    auto& tmaterial = tscene.materials.emplace_back();
+    tmaterial.point = make_material_point(material, material.emission,
+        {material.color.x, material.color.y, material.color.z,
+            material.opacity},
+        material.roughness, material.metallic, material.scattering);
+    tmaterial.textures =
+        (material.emission_tex != invalidid ? trace_emission_tex : 0) |
+        (material.color_tex != invalidid ? trace_color_tex : 0) |
+        (material.roughness_tex != invalidid ? trace_roughness_tex : 0) |
+        (material.scattering_tex != invalidid ? trace_scattering_tex : 0);
+    tmaterial.volumetric = is_volumetric(material);
+  }
+  tscene.environments.reserve(scene.environments.size());
+  for (auto& environment : scene.environments) {
+    auto& tenvironment        = tscene.environments.emplace_back();
+    tenvironment.inv_frame    = inverse(environment.frame);
+    tenvironment.emission     = environment.emission;
+    tenvironment.emission_tex = environment.emission_tex;
+  }
+  return tscene;
+}
+
+// Memory used by the state buffers
+size_t get_memory(const trace_state& state) {
+  return state.image.size() * sizeof(vec4f) +
+         state.residuals.size() * sizeof(vec4f) +
+         state.imageh.size() * sizeof(vec4h) +
+         state.albedo.size() * sizeof(vec3f) +
+         state.normal.size() * sizeof(vec3f) +
+         state.rngs.size() * sizeof(rng_state) +
+         state.stats.size() * sizeof(trace_stats) +
+         state.moments.size() * sizeof(float) +
+         state.counts.size() * sizeof(int);
+}
+
 // Forward declaration
 static trace_light& add_light(trace_lights& lights) {
   return lights.lights.emplace_back();
 }
 
+// Build a cdf from the weights returned by `weight(idx)`. Weights are computed
+// in parallel, and summed with a parallel scan.
+template <typename Func>
+static void make_cdf(
+    vector<float>& cdf, int size, bool noparallel, Func&& weight) {
+  cdf.resize(size);
+  parallel_for_blocks(
+      cdf.size(),
+      [&](size_t, size_t start, size_t end) {
+        for (auto idx = start; idx < end; idx++) cdf[idx] = weight((int)idx);
+      },
+      noparallel);
+  parallel_inclusive_scan(
+      cdf, [](float a, float b) { return a + b; }, noparallel);
+}
+
+// Build the cdf of a light
+static void make_light_cdf(trace_light& light, const scene_model& scene,
+    const trace_params& params) {
+  light.elements_cdf.clear();
+  if (light.instance != invalidid) {
+    auto& shape = scene.shapes[scene.instances[light.instance].shape];
+    if (!shape.triangles.empty()) {
+      make_cdf(light.elements_cdf, (int)shape.triangles.size(),
+          params.noparallel, [&shape](int idx) {
+            auto& t = shape.triangles[idx];
+            return triangle_area(shape.positions[t.x], shape.positions[t.y],
+                shape.positions[t.z]);
+          });
+    }
+    if (!shape.quads.empty()) {
+      make_cdf(light.elements_cdf, (int)shape.quads.size(), params.noparallel,
+          [&shape](int idx) {
+            auto& q = shape.quads[idx];
+            return quad_area(shape.positions[q.x], shape.positions[q.y],
+                shape.positions[q.z], shape.positions[q.w]);
+          });
+    }
+  }
+  if (light.environment != invalidid) {
+    auto& environment = scene.environments[light.environment];
+    if (environment.emission_tex != invalidid) {
+      auto& texture = scene.textures[environment.emission_tex];
+      make_cdf(light.elements_cdf, texture.width * texture.height,
+          params.noparallel, [&texture](int idx) {
+            auto ij    = vec2i{idx % texture.width, idx / texture.width};
+            auto th    = (ij.y + 0.5f) * pif / texture.height;
+            auto value = lookup_texture(texture, ij.x, ij.y);
+            return max(value) * sin(th);
+          });
+    }
+  }
+}
+
+// Check whether an instance or environment is a light
+static bool is_light_instance(const scene_model& scene, int handle) {
+  auto& instance = scene.instances[handle];
+  if (scene.materials[instance.material].emission == zero3f) return false;
+  auto& shape = scene.shapes[instance.shape];
+  return !shape.triangles.empty() || !shape.quads.empty();
+}
+static bool is_light_environment(const scene_model& scene, int handle) {
+  return scene.environments[handle].emission != zero3f;
+}
+
 // Init trace lights
 trace_lights make_lights(const scene_model& scene, const trace_params& params) {
   auto lights = trace_lights{};
-
-  for (auto handle = 0; handle < scene.instances.size(); handle++) {
-    auto& instance = scene.instances[handle];
-    auto& material = scene.materials[instance.material];
-    if (material.emission == zero3f) continue;
-    auto& shape = scene.shapes[instance.shape];
-    if (shape.triangles.empty() && shape.quads.empty()) continue;
+  for (auto handle = 0; handle < (int)scene.instances.size(); handle++) {
+    if (!is_light_instance(scene, handle)) continue;
     auto& light       = add_light(lights);
     light.instance    = handle;
     light.environment = invalidid;
-    if (!shape.triangles.empty()) {
-      light.elements_cdf = vector<float>(shape.triangles.size());
-      for (auto idx = 0; idx < light.elements_cdf.size(); idx++) {
-        auto& t                 = shape.triangles[idx];
-        light.elements_cdf[idx] = triangle_area(
-            shape.positions[t.x], shape.positions[t.y], shape.positions[t.z]);
-        if (idx != 0) light.elements_cdf[idx] += light.elements_cdf[idx - 1];
-      }
-    }
-    if (!shape.quads.empty()) {
-      light.elements_cdf = vector<float>(shape.quads.size());
-      for (auto idx = 0; idx < light.elements_cdf.size(); idx++) {
-        auto& t                 = shape.quads[idx];
-        light.elements_cdf[idx] = quad_area(shape.positions[t.x],
-            shape.positions[t.y], shape.positions[t.z], shape.positions[t.w]);
-        if (idx != 0) light.elements_cdf[idx] += light.elements_cdf[idx - 1];
-      }
-    }
+    make_light_cdf(light, scene, params);
   }
-  for (auto handle = 0; handle < scene.environments.size(); handle++) {
-    auto& environment = scene.environments[handle];
-    if (environment.emission == zero3f) continue;
+  for (auto handle = 0; handle < (int)scene.environments.size(); handle++) {
+    if (!is_light_environment(scene, handle)) continue;
     auto& light       = add_light(lights);
     light.instance    = invalidid;
     light.environment = handle;
-    if (environment.emission_tex != invalidid) {
-      auto& texture      = scene.textures[environment.emission_tex];
-      light.elements_cdf = vector<float>(texture.width * texture.height);
-      for (auto idx = 0; idx < light.elements_cdf.size(); idx++) {
-        auto ij    = vec2i{idx % texture.width, idx / texture.width};
-        auto th    = (ij.y + 0.5f) * pif / texture.height;
-        auto value = lookup_texture(texture, ij.x, ij.y);
-        light.elements_cdf[idx] = max(value) * sin(th);
-        if (idx != 0) light.elements_cdf[idx] += light.elements_cdf[idx - 1];
-      }
-    }
+    make_light_cdf(light, scene, params);
   }
-
-  // handle progress
   return lights;
 }
 
+// Update trace lights
+void update_lights(trace_lights& lights, const scene_model& scene,
+    const trace_params& params, const vector<int>& updated_instances,
+    const vector<int>& updated_shapes,
+    const vector<int>& updated_environments) {
+  // mark updated lights
+  auto instance_updated    = vector<bool>(scene.instances.size(), false);
+  auto environment_updated = vector<bool>(scene.environments.size(), false);
+  auto shape_updated       = vector<bool>(scene.shapes.size(), false);
+  for (auto handle : updated_instances) instance_updated[handle] = true;
+  for (auto handle : updated_environments) environment_updated[handle] = true;
+  for (auto handle : updated_shapes) shape_updated[handle] = true;
+  for (auto handle = 0; handle < (int)scene.instances.size(); handle++) {
+    if (shape_updated[scene.instances[handle].shape])
+      instance_updated[handle] = true;
+  }
+
+  // reuse lights that are still valid, moving their cdfs
+  auto instance_lights    = vector<int>(scene.instances.size(), invalidid);
+  auto environment_lights = vector<int>(scene.environments.size(), invalidid);
+  for (auto idx = 0; idx < (int)lights.lights.size(); idx++) {
+    auto& light = lights.lights[idx];
+    if (light.instance != invalidid &&
+        light.instance < (int)scene.instances.size())
+      instance_lights[light.instance] = idx;
+    if (light.environment != invalidid &&
+        light.environment < (int)scene.environments.size())
+      environment_lights[light.environment] = idx;
+  }
+  auto old_lights = std::move(lights.lights);
+  lights.lights.clear();
+  for (auto handle = 0; handle < (int)scene.instances.size(); handle++) {
+    if (!is_light_instance(scene, handle)) continue;
+    auto& light = add_light(lights);
+    if (instance_lights[handle] != invalidid && !instance_updated[handle]) {
+      light = std::move(old_lights[instance_lights[handle]]);
+    } else {
+      light.instance    = handle;
+      light.environment = invalidid;
+      make_light_cdf(light, scene, params);
+    }
+  }
+  for (auto handle = 0; handle < (int)scene.environments.size(); handle++) {
+    if (!is_light_environment(scene, handle)) continue;
+    auto& light = add_light(lights);
+    if (environment_lights[handle] != invalidid &&
+        !environment_updated[handle]) {
+      light = std::move(old_lights[environment_lights[handle]]);
+    } else {
+      light.instance    = invalidid;
+      light.environment = handle;
+      make_light_cdf(light, scene, params);
+    }
+  }
+}
+
 // Progressively computes an image.
 color_image trace_image(const scene_model& scene, const trace_params& params) {
   auto bvh    = make_bvh(scene, params);
   auto lights = make_lights(scene, params);
+  auto tscene = make_trace_scene(scene);
   auto state  = make_state(scene, params);
-  for (auto sample = 0; sample < params.samples; sample++) {
-    trace_samples(state, scene, bvh, lights, params);
+  auto start  = std::chrono::steady_clock::now();
+  while (!is_converged(state, params)) {
+    trace_samples(state, scene, tscene, bvh, lights, params);
+    auto elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start);
+    if (is_out_of_budget(params, state.samples, elapsed.count())) break;
   }
   return get_render(state);
 }
 
-// Progressively compute an image by calling trace_samples multiple times.
-void trace_samples(trace_state& state, const scene_model& scene,
-    const bvh_scene& bvh, const trace_lights& lights,
-    const trace_params& params) {
-  if (state.samples >= params.samples) return;
+// Adaptive sampling parameters: tile size, maximum samples per pixel in
+// one pass, and offset to the relative error denominator for dark pixels.
+const auto trace_adaptive_tile    = 16;
+const auto trace_adaptive_maxpass = 16;
+const auto trace_adaptive_dark    = 0.01f;
+
+// Maximum number of samples per pixel. With a time budget, sampling goes on
+// until the budget runs out.
+static int get_max_samples(const trace_params& params) {
+  return params.timebudget > 0 ? int_max : params.samples;
+}
+
+// Normalization of accumulated pixel values
+static float get_scale(const trace_state& state, int idx) {
+  if (state.counts.empty()) return 1.0f / (float)max(state.samples, 1);
+  return 1.0f / (float)max(state.counts[idx], 1);
+}
+
+// Get the mean color of a pixel
+static vec4f get_pixel(const trace_state& state, int idx) {
+  if (!state.imageh.empty()) return half_to_float(state.imageh[idx]);
+  if (!state.residuals.empty())
+    return (state.image[idx] - state.residuals[idx]) * get_scale(state, idx);
+  return state.image[idx] * get_scale(state, idx);
+}
+
+// Relative error of the mean luminance of a pixel
+static float adaptive_error(const trace_state& state, int idx) {
+  auto count = state.counts[idx];
+  if (count < 2) return flt_max;
+  auto mean     = luminance(xyz(get_pixel(state, idx)));
+  auto variance = max(state.moments[idx] / count - mean * mean, 0.0f);
+  return sqrt(variance / count) / (mean + trace_adaptive_dark);
+}
+
+// Computes the number of samples for each image tile in the next pass.
+// Tiles below the target error get no samples, while the remaining ones
+// share a budget of one sample per image pixel in proportion to their
+// error. Returns the number of tiles that need more samples.
+static int adaptive_samples(vector<int>& tile_samples, vec2i& tiles,
+    const trace_state& state, const trace_params& params) {
+  tiles = {(state.width + trace_adaptive_tile - 1) / trace_adaptive_tile,
+      (state.height + trace_adaptive_tile - 1) / trace_adaptive_tile};
+  tile_samples.assign(tiles.x * tiles.y, 0);
+
+  // compute tile errors, skipping pixels that reached the sample count
+  auto errors = vector<float>(tile_samples.size(), 0);
+  auto pixels = vector<int>(tile_samples.size(), 0);
+  for (auto tile = 0; tile < (int)errors.size(); tile++) {
+    auto start = vec2i{tile % tiles.x, tile / tiles.x} * trace_adaptive_tile;
+    auto end   = min(start + trace_adaptive_tile, {state.width, state.height});
+    for (auto j = start.y; j < end.y; j++) {
+      for (auto i = start.x; i < end.x; i++) {
+        auto idx = j * state.width + i;
+        if (state.counts[idx] >= get_max_samples(params)) continue;
+        errors[tile] += min(adaptive_error(state, idx), 1e6f);
+        pixels[tile] += 1;
+      }
+    }
+    if (pixels[tile] != 0) errors[tile] /= pixels[tile];
+  }
+
+  // uniform sampling until the error estimates are reliable
+  if (state.samples < params.adaptivemin) {
+    auto active = 0;
+    for (auto tile = 0; tile < (int)errors.size(); tile++) {
+      tile_samples[tile] = pixels[tile] != 0 ? 1 : 0;
+      active += tile_samples[tile];
+    }
+    return active;
+  }
+
+  // distribute samples to unconverged tiles
+  auto active_pixels = 0, active = 0;
+  auto active_error  = 0.0;
+  for (auto tile = 0; tile < (int)errors.size(); tile++) {
+    if (pixels[tile] == 0 || errors[tile] <= params.adaptive) continue;
+    active_pixels += pixels[tile];
+    active_error += (double)errors[tile] * pixels[tile];
+    active += 1;
+  }
+  if (active == 0) return 0;
+  auto budget = (double)state.width * state.height / active_error;
+  for (auto tile = 0; tile < (int)errors.size(); tile++) {
+    if (pixels[tile] == 0 || errors[tile] <= params.adaptive) continue;
+    tile_samples[tile] = clamp((int)round(budget * errors[tile]), 1,
+        trace_adaptive_maxpass);
+  }
+  return active;
+}
+
+// Check whether all pixels have converged or reached the sample count
+bool is_converged(const trace_state& state, const trace_params& params) {
+  if (state.samples >= get_max_samples(params)) return true;
+  if (params.adaptive <= 0 || state.counts.empty()) return false;
+  auto tile_samples = vector<int>{};
+  auto tiles        = zero2i;
+  return adaptive_samples(tile_samples, tiles, state, params) == 0;
+}
+
+// Check whether another call to trace_samples would exceed the time budget
+bool is_out_of_budget(const trace_params& params, int passes, double elapsed) {
+  if (params.timebudget <= 0 || passes <= 0) return false;
+  return elapsed + elapsed / passes > params.timebudget;
+}
+
+// Progressively compute an image, stopping early if `stop` is set
+static bool trace_samples(trace_state& state, const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh,
+    const trace_lights& lights, const trace_params& params,
+    const atomic<bool>* stop) {
+  if (state.samples >= get_max_samples(params)) return true;
+  auto stopped = [stop]() { return stop != nullptr && (bool)*stop; };
+  if (params.adaptive > 0 && !state.counts.empty()) {
+    auto tile_samples = vector<int>{};
+    auto tiles        = zero2i;
+    if (adaptive_samples(tile_samples, tiles, state, params) == 0) {
+      state.samples = max(state.samples, params.samples);
+      return true;
+    }
+    auto trace_pixel = [&](int i, int j) {
+      auto idx      = j * state.width + i;
+      auto tile     = (j / trace_adaptive_tile) * tiles.x +
+                  i / trace_adaptive_tile;
+      auto nsamples = min(
+          tile_samples[tile], get_max_samples(params) - state.counts[idx]);
+      for (auto sample = 0; sample < nsamples; sample++) {
+        if (stopped()) return;
+        trace_sample(state, scene, tscene, bvh, lights, i, j, params);
+      }
+    };
+    if (params.noparallel) {
+      for (auto j = 0; j < state.height; j++) {
+        for (auto i = 0; i < state.width; i++) trace_pixel(i, j);
+      }
+    } else {
+      parallel_for(state.width, state.height, trace_pixel);
+    }
+    if (stopped()) return false;
+    state.samples += 1;
+    return true;
+  }
   if (params.noparallel) {
     for (auto j = 0; j < state.height; j++) {
       for (auto i = 0; i < state.width; i++) {
-        trace_sample(state, scene, bvh, lights, i, j, params);
+        if (stopped()) return false;
+        trace_sample(state, scene, tscene, bvh, lights, i, j, params);
       }
     }
   } else {
     parallel_for(state.width, state.height, [&](int i, int j) {
-      trace_sample(state, scene, bvh, lights, i, j, params);
+      if (stopped()) return;
+      trace_sample(state, scene, tscene, bvh, lights, i, j, params);
     });
   }
+  if (stopped()) return false;
   state.samples += 1;
+  return true;
+}
+
+// Progressively compute an image by calling trace_samples multiple times.
+void trace_samples(trace_state& state, const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh,
+    const trace_lights& lights, const trace_params& params) {
+  trace_samples(state, scene, tscene, bvh, lights, params, nullptr);
+}
+bool trace_samples(trace_state& state, const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh,
+    const trace_lights& lights, const trace_params& params,
+    const atomic<bool>& stop) {
+  return trace_samples(state, scene, tscene, bvh, lights, params, &stop);
+}
+void trace_samples(trace_state& state, const scene_model& scene,
+    const bvh_scene& bvh, const trace_lights& lights,
+    const trace_params& params) {
+  trace_samples(
+      state, scene, make_trace_scene(scene), bvh, lights, params, nullptr);
+}
+bool trace_samples(trace_state& state, const scene_model& scene,
+    const bvh_scene& bvh, const trace_lights& lights,
+    const trace_params& params, const atomic<bool>& stop) {
+  return trace_samples(
+      state, scene, make_trace_scene(scene), bvh, lights, params, &stop);
 }
 
 // Check image type
@@ -1344,6 +2133,100 @@ static void check_image(
         linear ? "expected linear image" : "expected srgb image"};
 }
 
+// Check that denoising buffers are allocated
+static void check_buffers(const trace_state& state) {
+  if (state.albedo.empty() || state.normal.empty())
+    throw std::invalid_argument{"denoising buffers not allocated"};
+}
+
+// Buffers allocated in a state, saved as a mask in the state file header
+// and compared when merging states
+const auto trace_buffer_image     = 1u << 0;
+const auto trace_buffer_residuals = 1u << 1;
+const auto trace_buffer_imageh    = 1u << 2;
+const auto trace_buffer_albedo    = 1u << 3;
+const auto trace_buffer_normal    = 1u << 4;
+const auto trace_buffer_rngs      = 1u << 5;
+const auto trace_buffer_moments   = 1u << 6;
+const auto trace_buffer_counts    = 1u << 7;
+
+// Get the mask of the buffers allocated in a state
+static uint32_t get_state_buffers(const trace_state& state) {
+  auto buffers = 0u;
+  if (!state.image.empty()) buffers |= trace_buffer_image;
+  if (!state.residuals.empty()) buffers |= trace_buffer_residuals;
+  if (!state.imageh.empty()) buffers |= trace_buffer_imageh;
+  if (!state.albedo.empty()) buffers |= trace_buffer_albedo;
+  if (!state.normal.empty()) buffers |= trace_buffer_normal;
+  if (!state.rngs.empty()) buffers |= trace_buffer_rngs;
+  if (!state.moments.empty()) buffers |= trace_buffer_moments;
+  if (!state.counts.empty()) buffers |= trace_buffer_counts;
+  return buffers;
+}
+
+// Names of the state buffers, in the order of their mask bits
+static const auto trace_buffer_names = vector<string>{"image", "residuals",
+    "half image", "albedo", "normal", "rngs", "moments", "counts"};
+
+// Check that two states have the same size and buffers
+bool check_state(
+    const trace_state& state, const trace_state& other, string& error) {
+  if (state.width != other.width || state.height != other.height) {
+    error = "image size does not match";
+    return false;
+  }
+  auto mismatch = get_state_buffers(state) ^ get_state_buffers(other);
+  for (auto idx = 0; idx < (int)trace_buffer_names.size(); idx++) {
+    if ((mismatch & (1u << idx)) == 0) continue;
+    error = trace_buffer_names[idx] + " does not match";
+    return false;
+  }
+  return true;
+}
+
+// Merge a rendering state into another
+void merge_state(trace_state& merged, const trace_state& state) {
+  auto error = string{};
+  if (!check_state(merged, state, error))
+    throw std::invalid_argument{"states should match, " + error};
+  for (auto idx = 0; idx < (int)state.image.size(); idx++) {
+    merged.image[idx] += state.image[idx];
+  }
+  for (auto idx = 0; idx < (int)state.residuals.size(); idx++) {
+    merged.residuals[idx] += state.residuals[idx];
+  }
+  for (auto idx = 0; idx < (int)state.imageh.size(); idx++) {
+    // weight means by their sample counts
+    auto count1 = merged.counts.empty() ? merged.samples : merged.counts[idx];
+    auto count2 = state.counts.empty() ? state.samples : state.counts[idx];
+    if (count1 + count2 == 0) continue;
+    merged.imageh[idx] = float_to_half(
+        (half_to_float(merged.imageh[idx]) * (float)count1 +
+            half_to_float(state.imageh[idx]) * (float)count2) /
+        (float)(count1 + count2));
+  }
+  for (auto idx = 0; idx < (int)state.albedo.size(); idx++) {
+    merged.albedo[idx] += state.albedo[idx];
+    merged.normal[idx] += state.normal[idx];
+  }
+  for (auto idx = 0; idx < (int)state.counts.size(); idx++) {
+    merged.moments[idx] += state.moments[idx];
+    merged.counts[idx] += state.counts[idx];
+  }
+  for (auto idx = 0; idx < (int)state.stats.size(); idx++) {
+    if (idx < (int)merged.stats.size())
+      merge_stats(merged.stats[idx], state.stats[idx]);
+  }
+  merged.samples += state.samples;
+}
+
+// Get rendering statistics
+trace_stats get_stats(const trace_state& state) {
+  auto stats = trace_stats{};
+  for (auto& row_stats : state.stats) merge_stats(stats, row_stats);
+  return stats;
+}
+
 // Get resulting render
 color_image get_render(const trace_state& state) {
   auto image = make_image(state.width, state.height, true);
@@ -1352,9 +2235,8 @@ color_image get_render(const trace_state& state) {
 }
 void get_render(color_image& image, const trace_state& state) {
   check_image(image, state.width, state.height, true);
-  auto scale = 1.0f / (float)state.samples;
   for (auto idx = 0; idx < state.width * state.height; idx++) {
-    image.pixels[idx] = state.image[idx] * scale;
+    image.pixels[idx] = get_pixel(state, idx);
   }
 }
 
@@ -1365,6 +2247,7 @@ color_image get_denoised(const trace_state& state) {
   return image;
 }
 void get_denoised(color_image& image, const trace_state& state) {
+  check_buffers(state);
 #if YOCTO_DENOISE
   // Create an Intel Open Image Denoise device
   oidn::DeviceRef device = oidn::newDevice();
@@ -1376,10 +2259,9 @@ void get_denoised(color_image& image, const trace_state& state) {
   // get albedo and normal
   auto albedo = vector<vec3f>(image.pixels.size()),
        normal = vector<vec3f>(image.pixels.size());
-  auto scale  = 1.0f / (float)state.samples;
   for (auto idx = 0; idx < state.width * state.height; idx++) {
-    albedo[idx] = state.albedo[idx] * scale;
-    normal[idx] = state.normal[idx] * scale;
+    albedo[idx] = state.albedo[idx] * get_scale(state, idx);
+    normal[idx] = state.normal[idx] * get_scale(state, idx);
   }
 
   // Create a denoising filter
@@ -1399,7 +2281,8 @@ void get_denoised(color_image& image, const trace_state& state) {
   // Filter the image
   filter.execute();
 #else
-  get_render(image, state);
+  auto render = get_render(state);
+  denoise_image(image, render, get_albedo(state), get_normal(state));
 #endif
 }
 
@@ -1411,8 +2294,9 @@ color_image get_albedo(const trace_state& state) {
 }
 void get_albedo(color_image& albedo, const trace_state& state) {
   check_image(albedo, state.width, state.height, true);
-  auto scale = 1.0f / (float)state.samples;
+  check_buffers(state);
   for (auto idx = 0; idx < state.width * state.height; idx++) {
+    auto scale = get_scale(state, idx);
     albedo.pixels[idx] = {state.albedo[idx].x * scale,
         state.albedo[idx].y * scale, state.albedo[idx].z * scale, 1.0f};
   }
@@ -1424,8 +2308,9 @@ color_image get_normal(const trace_state& state) {
 }
 void get_normal(color_image& normal, const trace_state& state) {
   check_image(normal, state.width, state.height, true);
-  auto scale = 1.0f / (float)state.samples;
+  check_buffers(state);
   for (auto idx = 0; idx < state.width * state.height; idx++) {
+    auto scale = get_scale(state, idx);
     normal.pixels[idx] = {state.normal[idx].x * scale,
         state.normal[idx].y * scale, state.normal[idx].z * scale, 1.0f};
   }
@@ -1472,8 +2357,304 @@ void denoise_render(color_image& denoised, const color_image& render,
   // Filter the image
   filter.execute();
 #else
-  denoised = render;
+  denoise_image(denoised, render, albedo, normal);
 #endif
 }
 
 }  // namespace yocto
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION FOR STATE IO
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Magic number and version of state files
+static const char trace_state_magic[8] = {
+    'Y', 'T', 'S', 'T', 'A', 'T', 'E', '3'};
+
+// Open a file with utf8 names
+static FILE* fopen_state(const string& filename, const char* mode) {
+#ifdef _WIN32
+  auto path8    = std::filesystem::u8path(filename);
+  auto str_mode = string{mode};
+  auto wmode    = std::wstring(str_mode.begin(), str_mode.end());
+  return _wfopen(path8.c_str(), wmode.c_str());
+#else
+  return fopen(filename.c_str(), mode);
+#endif
+}
+
+// Flush file contents to disk, so that they survive a crash after renaming
+static bool sync_state(FILE* fs) {
+#ifdef _WIN32
+  return _commit(_fileno(fs)) == 0;
+#else
+  return fsync(fileno(fs)) == 0;
+#endif
+}
+
+// Flush the directory entry of a renamed file to disk. Windows has no
+// directory handles, and renames there are flushed with the file.
+static bool sync_state_dir(const string& filename) {
+#ifdef _WIN32
+  return true;
+#else
+  auto dirname = std::filesystem::u8path(filename).parent_path();
+  if (dirname.empty()) dirname = ".";
+  auto fd = open(dirname.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  auto ok = fsync(fd) == 0;
+  return close(fd) == 0 && ok;
+#endif
+}
+
+// Read and write values and arrays
+template <typename T>
+static bool write_state_value(FILE* fs, const T& value) {
+  return fwrite(&value, sizeof(T), 1, fs) == 1;
+}
+template <typename T>
+static bool write_state_values(FILE* fs, const vector<T>& values) {
+  auto size = (uint64_t)values.size();
+  if (!write_state_value(fs, size)) return false;
+  if (size == 0) return true;
+  return fwrite(values.data(), sizeof(T), size, fs) == size;
+}
+template <typename T>
+static bool read_state_value(FILE* fs, T& value) {
+  return fread(&value, sizeof(T), 1, fs) == 1;
+}
+template <typename T>
+static bool read_state_values(FILE* fs, vector<T>& values, size_t max_size) {
+  auto size = (uint64_t)0;
+  if (!read_state_value(fs, size)) return false;
+  if (size > max_size) return false;
+  values.resize(size);
+  if (size == 0) return true;
+  return fread(values.data(), sizeof(T), size, fs) == size;
+}
+
+// Save a trace state. The state is written to a temporary file that is
+// flushed to disk and renamed on success, so that a crash leaves either the
+// previous or the new file intact.
+bool save_state(
+    const string& filename, const trace_state& state, string& error) {
+  auto write_error = [&filename, &error]() {
+    error = filename + ": write error";
+    return false;
+  };
+
+  auto tmpname = filename + ".tmp";
+  auto fs      = fopen_state(tmpname, "wb");
+  if (!fs) {
+    error = filename + ": file not found";
+    return false;
+  }
+  auto ok = fwrite(trace_state_magic, 1, 8, fs) == 8 &&
+            write_state_value(fs, state.width) &&
+            write_state_value(fs, state.height) &&
+            write_state_value(fs, state.samples) &&
+            write_state_value(fs, get_state_buffers(state)) &&
+            write_state_values(fs, state.image) &&
+            write_state_values(fs, state.residuals) &&
+            write_state_values(fs, state.imageh) &&
+            write_state_values(fs, state.albedo) &&
+            write_state_values(fs, state.normal) &&
+            write_state_values(fs, state.rngs) &&
+            write_state_values(fs, state.moments) &&
+            write_state_values(fs, state.counts);
+  ok = fflush(fs) == 0 && ok;
+  ok = ok && sync_state(fs);
+  ok = fclose(fs) == 0 && ok;
+  if (!ok) return write_error();
+
+  auto rename_error = std::error_code{};
+  std::filesystem::rename(std::filesystem::u8path(tmpname),
+      std::filesystem::u8path(filename), rename_error);
+  if (rename_error) return write_error();
+  if (!sync_state_dir(filename)) return write_error();
+  return true;
+}
+
+// Load a trace state
+bool load_state(const string& filename, trace_state& state, string& error) {
+  auto read_error = [&filename, &error]() {
+    error = filename + ": read error";
+    return false;
+  };
+
+  auto fs = fopen_state(filename, "rb");
+  if (!fs) {
+    error = filename + ": file not found";
+    return false;
+  }
+  char magic[8];
+  state        = {};
+  auto buffers = 0u;
+  auto ok      = fread(magic, 1, 8, fs) == 8 &&
+            memcmp(magic, trace_state_magic, 8) == 0 &&
+            read_state_value(fs, state.width) &&
+            read_state_value(fs, state.height) &&
+            read_state_value(fs, state.samples) &&
+            read_state_value(fs, buffers) && state.width >= 0 &&
+            state.height >= 0;
+  auto size = (size_t)state.width * (size_t)state.height;
+  ok        = ok && read_state_values(fs, state.image, size) &&
+       read_state_values(fs, state.residuals, size) &&
+       read_state_values(fs, state.imageh, size) &&
+       read_state_values(fs, state.albedo, size) &&
+       read_state_values(fs, state.normal, size) &&
+       read_state_values(fs, state.rngs, size) &&
+       read_state_values(fs, state.moments, size) &&
+       read_state_values(fs, state.counts, size);
+  fclose(fs);
+  if (!ok) return read_error();
+  // optional buffers are either empty or full size, as listed in the header
+  auto check_size = [size](size_t buffer_size) {
+    return buffer_size == 0 || buffer_size == size;
+  };
+  if (get_state_buffers(state) != buffers ||
+      state.image.size() + state.imageh.size() != size ||
+      (!state.residuals.empty() && state.image.empty()) ||
+      !check_size(state.residuals.size()) ||
+      !check_size(state.albedo.size()) ||
+      state.normal.size() != state.albedo.size() ||
+      !check_size(state.rngs.size()) ||
+      state.moments.size() != state.counts.size())
+    return read_error();
+  if constexpr (trace_stats_enabled) state.stats.assign(state.height, {});
+  return true;
+}
+
+}  // namespace yocto
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION FOR INTERACTIVE RENDERING
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Cleanup
+trace_session::~trace_session() { stop_session(*this); }
+
+// Publish the back buffer as the last image
+static void publish_render(trace_session& session, int samples) {
+  auto lock = std::lock_guard{session.mutex};
+  std::swap(session.render, session.image);
+  session.samples = samples;
+  session.updated = true;
+}
+
+// Make sure the back buffer matches the state size
+static void check_render(trace_session& session) {
+  auto& state  = session.state;
+  auto& render = session.render;
+  if (render.width != state.width || render.height != state.height) {
+    render = make_image(state.width, state.height, true);
+  }
+}
+
+// Render a low resolution preview, followed by progressive passes
+static void run_session(trace_session& session, const scene_model& scene) {
+  auto& params = session.params;
+  auto& state  = session.state;
+
+  // preview
+  if (params.pratio > 1) {
+    auto pparams       = params;
+    pparams.resolution = max(params.resolution / params.pratio, 1);
+    pparams.samples    = 1;
+    pparams.adaptive   = 0;
+    auto pstate        = make_state(scene, pparams);
+    if (!trace_samples(pstate, scene, session.tscene, session.bvh,
+            session.lights, pparams, session.stop))
+      return;
+    auto preview = get_render(pstate);
+    check_render(session);
+    auto& render = session.render;
+    for (auto j = 0; j < render.height; j++) {
+      for (auto i = 0; i < render.width; i++) {
+        auto pi = clamp(i * preview.width / render.width, 0, preview.width - 1);
+        auto pj = clamp(
+            j * preview.height / render.height, 0, preview.height - 1);
+        render.pixels[j * render.width + i] =
+            preview.pixels[pj * preview.width + pi];
+      }
+    }
+    publish_render(session, 0);
+  }
+
+  // progressive rendering
+  auto start = std::chrono::steady_clock::now();
+  while (!is_converged(state, params)) {
+    for (auto batch = 0; batch < max(params.batch, 1); batch++) {
+      if (!trace_samples(state, scene, session.tscene, session.bvh,
+              session.lights, params, session.stop))
+        return;
+    }
+    check_render(session);
+    if (params.denoise) {
+      get_denoised(session.render, state);
+    } else {
+      get_render(session.render, state);
+    }
+    publish_render(session, min(state.samples, get_max_samples(params)));
+    auto elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start);
+    if (is_out_of_budget(params, state.samples, elapsed.count())) break;
+  }
+}
+
+// Build the bvh and lights of a session
+void init_session(trace_session& session, const scene_model& scene,
+    const trace_params& params) {
+  stop_session(session);
+  session.params = params;
+  session.bvh    = make_bvh(scene, params);
+  session.lights = make_lights(scene, params);
+}
+
+// Restart rendering
+void start_session(trace_session& session, const scene_model& scene,
+    const trace_params& params) {
+  stop_session(session);
+  session.params  = params;
+  session.tscene  = make_trace_scene(scene);
+  session.state   = make_state(scene, params);
+  session.samples = 0;
+  session.stop    = false;
+  {
+    auto lock       = std::lock_guard{session.mutex};
+    session.updated = false;
+  }
+  session.worker = run_async([&session, &scene]() {
+    run_session(session, scene);
+  });
+}
+
+// Stop rendering
+void stop_session(trace_session& session) {
+  session.stop = true;
+  if (session.worker.valid()) session.worker.get();
+  session.worker = {};
+}
+
+// Update the bvh and lights after edits
+void update_session(trace_session& session, const scene_model& scene,
+    const vector<int>& updated_instances, const vector<int>& updated_shapes,
+    const vector<int>& updated_environments) {
+  stop_session(session);
+  update_bvh(session.bvh, scene, updated_instances, updated_shapes);
+  update_lights(session.lights, scene, session.params, updated_instances,
+      updated_shapes, updated_environments);
+}
+
+// Swap the last rendered image
+bool update_render(color_image& render, trace_session& session) {
+  auto lock = std::lock_guard{session.mutex};
+  if (!session.updated) return false;
+  std::swap(render, session.image);
+  session.updated = false;
+  return true;
+}
+
+}  // namespace yocto
@@ -40,11 +40,13 @@
 #include <atomic>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "yocto_bvh.h"
+#include "yocto_color.h"
 #include "yocto_image.h"
 #include "yocto_math.h"
 #include "yocto_sampling.h"
@@ -85,48 +87,76 @@ enum struct trace_falsecolor_type {
   // clang-format off
   position, normal, frontfacing, gnormal, gfrontfacing, texcoord, mtype, color,
   emission, roughness, opacity, metallic, delta, instance, shape, material, 
-  element, highlight
+  element, highlight, cost
   // clang-format on
 };
 
+// Type of random sequences used for sampling
+enum struct trace_sequence_type {
+  random,     // independent random numbers
+  sobol,      // Owen-scrambled Sobol sequence
+  bluenoise,  // Sobol sequence dithered across pixels
+};
+
+// Type of accumulation of samples in the rendering state
+enum struct trace_accumulation_type {
+  single,       // single precision sums
+  compensated,  // single precision sums with Kahan compensation
+  half,         // half precision running means
+};
+
 // Default trace seed
 const auto trace_default_seed = 961748941ull;
 
 // Options for trace functions
 struct trace_params {
-  int                   camera         = 0;
-  int                   resolution     = 1280;
-  trace_sampler_type    sampler        = trace_sampler_type::path;
-  trace_falsecolor_type falsecolor     = trace_falsecolor_type::color;
-  int                   samples        = 512;
-  int                   bounces        = 8;
-  float                 clamp          = 10;
-  bool                  nocaustics     = false;
-  bool                  envhidden      = false;
-  bool                  tentfilter     = false;
-  uint64_t              seed           = trace_default_seed;
-  bool                  embreebvh      = false;
-  bool                  highqualitybvh = false;
-  bool                  noparallel     = false;
-  int                   pratio         = 8;
-  float                 exposure       = 0;
-  bool                  filmic         = false;
-  bool                  denoise        = false;
-  int                   batch          = 1;
+  int                     camera         = 0;
+  int                     resolution     = 1280;
+  trace_sampler_type      sampler        = trace_sampler_type::path;
+  trace_falsecolor_type   falsecolor     = trace_falsecolor_type::color;
+  int                     samples        = 512;
+  int                     bounces        = 8;
+  float                   clamp          = 10;
+  bool                    nocaustics     = false;
+  bool                    envhidden      = false;
+  bool                    tentfilter     = false;
+  uint64_t                seed           = trace_default_seed;
+  bool                    embreebvh      = false;
+  bool                    highqualitybvh = false;
+  float                   spatialbvh     = 0;
+  bool                    noparallel     = false;
+  int                     pratio         = 8;
+  float                   exposure       = 0;
+  bool                    filmic         = false;
+  bool                    denoise        = false;
+  int                     batch          = 1;
+  float                   adaptive       = 0;   // target error, 0 disables
+  int                     adaptivemin    = 16;  // uniform samples before
+  float                   timebudget     = 0;   // seconds, 0 disables
+  bool                    counterrng     = false;
+  trace_sequence_type     sequence       = trace_sequence_type::random;
+  trace_accumulation_type accumulation   = trace_accumulation_type::single;
 };
 
 inline const auto trace_sampler_names = std::vector<std::string>{"path",
     "pathdirect", "pathmis", "naive", "eyelight", "eyelightao", "falsecolor"};
 
+inline const auto trace_sequence_names = vector<string>{
+    "random", "sobol", "bluenoise"};
+
+inline const auto trace_accumulation_names = vector<string>{
+    "single", "compensated", "half"};
+
 inline const auto trace_falsecolor_names = vector<string>{"position", "normal",
     "frontfacing", "gnormal", "gfrontfacing", "texcoord", "mtype", "color",
     "emission", "roughness", "opacity", "metallic", "delta", "instance",
-    "shape", "material", "element", "highlight"};
+    "shape", "material", "element", "highlight", "cost"};
 
 // Progress report callback
 using image_callback = function<void(int current, int total)>;
 
-// Progressively computes an image.
+// Progressively computes an image, stopping early if adaptive sampling
+// converges or the time budget runs out.
 color_image trace_image(const scene_model& scene, const trace_params& params);
 
 }  // namespace yocto
@@ -148,52 +178,175 @@ struct trace_lights {
   vector<trace_light> lights = {};
 };
 
+// Material values precomputed for rendering. Materials without textures
+// are fully evaluated, while for the others only the present textures are
+// looked up at each hit.
+struct trace_material {
+  material_point point      = {};     // values without textures
+  int            textures   = 0;      // bitmask of present textures
+  bool           volumetric = false;  // whether the material has a volume
+};
+
+// Environment values precomputed for rendering
+struct trace_environment {
+  frame3f inv_frame    = identity3x4f;  // inverse of the environment frame
+  vec3f   emission     = {0, 0, 0};
+  int     emission_tex = invalidid;
+};
+
+// Read-only snapshot of the scene compiled for rendering, with one entry per
+// scene material and environment. Shapes and textures are read from the
+// scene. The snapshot is built once per render and passed to trace_samples(),
+// and should be rebuilt after material or environment edits.
+struct trace_scene {
+  vector<trace_material>    materials    = {};
+  vector<trace_environment> environments = {};
+};
+
+// Compile the scene snapshot used by the samplers.
+trace_scene make_trace_scene(const scene_model& scene);
+
 // Check is a sampler requires lights
 bool is_sampler_lit(const trace_params& params);
 
-// Trace state
+// Rendering statistics, counting rays cast by type, traversal work and
+// path bounces. Statistics are collected only if the library is compiled
+// with `YOCTO_TRACE_STATS`, so that the rendering code has no overhead
+// otherwise.
+struct trace_stats {
+  uint64_t camera_rays = 0;  // rays from the camera
+  uint64_t bounce_rays = 0;  // rays continuing paths
+  uint64_t shadow_rays = 0;  // rays for direct lighting and occlusion
+  uint64_t light_rays  = 0;  // rays for light pdfs
+  uint64_t bounces     = 0;  // path vertices
+  uint64_t nodes       = 0;  // bvh nodes visited
+  uint64_t primitives  = 0;  // primitive intersection tests
+  uint64_t instances   = 0;  // instance transforms
+};
+
+// Trace state. Only the buffers required by the params are allocated. The
+// image is accumulated either as sums in `image`, with Kahan compensation
+// terms in `residuals` if compensated, or as half precision means in
+// `imageh`. Denoising buffers are allocated only if denoising.
 struct trace_state {
-  int               width   = 0;
-  int               height  = 0;
-  int               samples = 0;
-  vector<vec4f>     image   = {};
-  vector<vec3f>     albedo  = {};
-  vector<vec3f>     normal  = {};
-  vector<int>       hits    = {};
-  vector<rng_state> rngs    = {};
+  int                 width     = 0;
+  int                 height    = 0;
+  int                 samples   = 0;
+  vector<vec4f>       image     = {};  // sums, if not half precision
+  vector<vec4f>       residuals = {};  // sum compensation, if compensated
+  vector<vec4h>       imageh    = {};  // means, if half precision
+  vector<vec3f>       albedo    = {};  // sums, if denoising
+  vector<vec3f>       normal    = {};  // sums, if denoising
+  vector<rng_state>   rngs      = {};  // if not using counter-based rngs
+  vector<trace_stats> stats     = {};  // per image row, if enabled
+  vector<float>       moments   = {};  // luminance squares, if adaptive
+  vector<int>         counts    = {};  // per pixel samples, if adaptive
 };
 
 // Initialize state.
 trace_state make_state(const scene_model& scene, const trace_params& params);
 
+// Memory used by the state buffers in bytes
+size_t get_memory(const trace_state& state);
+
 // Initialize lights.
 trace_lights make_lights(const scene_model& scene, const trace_params& params);
 
+// Update lights after scene edits, rebuilding only the sampling
+// distributions of updated instances, shapes and environments, including
+// environments whose emission texture changed. Lights are added or removed
+// if material or environment emission changed.
+void update_lights(trace_lights& lights, const scene_model& scene,
+    const trace_params& params, const vector<int>& updated_instances,
+    const vector<int>& updated_shapes, const vector<int>& updated_environments);
+
 // Build the bvh acceleration structure.
 bvh_scene make_bvh(const scene_model& scene, const trace_params& params);
 
-// Progressively computes an image.
+// Progressively computes an image. With adaptive sampling, enabled by
+// setting `params.adaptive` to the target relative error, the first
+// `params.adaptivemin` calls sample all pixels uniformly, while later calls
+// skip image tiles whose error is below the target and spend the saved
+// samples on the noisiest tiles, up to `params.samples` per pixel. In this
+// mode, `state.samples` counts passes, while `state.counts` holds the samples
+// of each pixel. A call made once all tiles converge sets `state.samples` to
+// at least `params.samples`, so that loops on the sample count stop.
+void trace_samples(trace_state& state, const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh,
+    const trace_lights& lights, const trace_params& params);
+// Same as above, but returns early when `stop` is set, checking it before
+// each pixel sample. Returns false if the pass was cancelled, in which case
+// the state is partially updated and should be reset before reuse.
+bool trace_samples(trace_state& state, const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh,
+    const trace_lights& lights, const trace_params& params,
+    const atomic<bool>& stop);
+// Same as above, compiling the scene snapshot at each call.
 void trace_samples(trace_state& state, const scene_model& scene,
     const bvh_scene& bvh, const trace_lights& lights,
     const trace_params& params);
+bool trace_samples(trace_state& state, const scene_model& scene,
+    const bvh_scene& bvh, const trace_lights& lights,
+    const trace_params& params, const atomic<bool>& stop);
+// Trace a sample for pixel `i`, `j`.
+void trace_sample(trace_state& state, const scene_model& scene,
+    const trace_scene& tscene, const bvh_scene& bvh, const trace_lights& lights,
+    int i, int j, const trace_params& params);
+// Same as above, compiling the scene snapshot at each call.
 void trace_sample(trace_state& state, const scene_model& scene,
     const bvh_scene& bvh, const trace_lights& lights, int i, int j,
     const trace_params& params);
 
+// Get rendering statistics accumulated in the state. Statistics are
+// collected per image row, so concurrent calls to trace_sample should work
+// on different rows. Returns zero counts if statistics are not enabled.
+trace_stats get_stats(const trace_state& state);
+
+// Check whether all pixels have converged or reached the sample count.
+// With a time budget, the sample count is unbounded and rendering stops
+// only when the budget runs out, as checked by is_out_of_budget().
+bool is_converged(const trace_state& state, const trace_params& params);
+
+// Check whether another call to trace_samples would exceed the time budget,
+// given the number of calls and the seconds elapsed since rendering started.
+// The cost of the next call is predicted from the average of the previous
+// ones.
+bool is_out_of_budget(const trace_params& params, int passes, double elapsed);
+
 // Get resulting render
 color_image get_render(const trace_state& state);
 void        get_render(color_image& render, const trace_state& state);
 
-// Get denoised result
+// Get denoised result. Requires denoising buffers.
 color_image get_denoised(const trace_state& state);
 void        get_denoised(color_image& render, const trace_state& state);
 
-// Get denoising buffers
+// Get denoising buffers, allocated only if `params.denoise` is set
 color_image get_albedo(const trace_state& state);
 void        get_albedo(color_image& albedo, const trace_state& state);
 color_image get_normal(const trace_state& state);
 void        get_normal(color_image& normal, const trace_state& state);
 
+// Merge a rendering state into another, accumulating its samples. States
+// rendered with different seeds, e.g. in different processes, are merged into
+// the same result of a single render with the total number of samples.
+// States should have the same size and buffers, i.e. use the same adaptive
+// sampling, accumulation and denoising params. Rng streams of the merged
+// state are left unchanged.
+void merge_state(trace_state& merged, const trace_state& state);
+
+// Check that two states have the same size and buffers, so that they can be
+// merged, or one can resume the other. Otherwise returns false and sets
+// `error` to the first mismatch.
+bool check_state(
+    const trace_state& state, const trace_state& other, string& error);
+
+// Save and load the rendering state to checkpoint and resume renders.
+// Saving is atomic, so that interrupted saves leave previous files intact.
+bool save_state(
+    const string& filename, const trace_state& state, string& error);
+bool load_state(const string& filename, trace_state& state, string& error);
+
 // Denoise image
 color_image denoise_render(const color_image& render, const color_image& albedo,
     const color_image& normal);
@@ -202,4 +355,67 @@ void        denoise_render(color_image& denoised, const color_image& render,
 
 }  // namespace yocto
 
+// -----------------------------------------------------------------------------
+// INTERACTIVE RENDERING API
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// Interactive rendering session. The session owns the bvh, lights and state,
+// and renders progressively in a background thread, starting with a low
+// resolution preview scaled by `params.pratio`. Rendered images are double
+// buffered, so that readers only swap buffers under the lock. The scene
+// should not be modified while the session is rendering.
+struct trace_session {
+  trace_params params = {};
+  bvh_scene    bvh    = {};
+  trace_lights lights = {};
+  trace_scene  tscene = {};
+  trace_state  state  = {};
+
+  // rendering thread
+  future<void> worker  = {};
+  atomic<bool> stop    = false;
+  atomic<int>  samples = 0;  // samples of the last image
+
+  // double buffered images
+  std::mutex  mutex   = {};
+  color_image render  = {};     // written by the rendering thread
+  color_image image   = {};     // last image, swapped out by readers
+  bool        updated = false;  // whether the last image was not read
+
+  // disable copy construction
+  trace_session()                     = default;
+  trace_session(const trace_session&) = delete;
+  trace_session& operator=(const trace_session&) = delete;
+
+  // cleanup
+  ~trace_session();
+};
+
+// Build the bvh and lights of a session, stopping rendering if needed.
+void init_session(trace_session& session, const scene_model& scene,
+    const trace_params& params);
+
+// Restart rendering from scratch with new params, reusing the bvh and
+// lights, so that camera and material edits restart quickly.
+void start_session(trace_session& session, const scene_model& scene,
+    const trace_params& params);
+
+// Stop rendering. Cancellation is checked before each pixel sample, so this
+// returns after at most one sample per thread.
+void stop_session(trace_session& session);
+
+// Update the bvh and lights after edits to instances, shapes, environments
+// or emission, stopping rendering if needed. Restart rendering with
+// `start_session()`.
+void update_session(trace_session& session, const scene_model& scene,
+    const vector<int>& updated_instances, const vector<int>& updated_shapes,
+    const vector<int>& updated_environments);
+
+// Swap the last rendered image into `render` if a new one is available.
+// Returns whether the image was updated.
+bool update_render(color_image& render, trace_session& session);
+
+}  // namespace yocto
+
 #endif
@@ -0,0 +1,735 @@
+//
+// # Yocto/Wide: Wide vectors
+//
+// Yocto/Wide defines wide types that hold one value for each of 8 lanes,
+// used to write batch kernels with SIMD instructions. Yocto/Wide is
+// implemented in `yocto_wide.h` and is used by the batch noise functions.
+//
+
+//
+// LICENSE:
+//
+// Copyright (c) 2016 -- 2021 Fabio Pellacini
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef _YOCTO_WIDE_H_
+#define _YOCTO_WIDE_H_
+
+// -----------------------------------------------------------------------------
+// INCLUDES
+// -----------------------------------------------------------------------------
+
+#include <cstring>
+#include <vector>
+
+#include "yocto_math.h"
+
+// Wide vectors use compiler vector extensions, if available, and intrinsics.
+#if !defined(YOCTO_WIDE_SCALAR) && !defined(__GNUC__) && !defined(__clang__)
+#define YOCTO_WIDE_SCALAR
+#endif
+#if !defined(YOCTO_WIDE_SCALAR) && defined(__AVX__)
+#include <immintrin.h>
+#elif !defined(YOCTO_WIDE_SCALAR) && defined(__SSE__)
+#include <xmmintrin.h>
+#elif !defined(YOCTO_WIDE_SCALAR) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Wide types are declared in an inline namespace that depends on their
+// storage, so that code compiled with different storage can be linked
+// together, as when libraries are built with different flags.
+#if defined(YOCTO_WIDE_SCALAR)
+#define YOCTO_WIDE_STORAGE wide_scalar
+#elif defined(__AVX__)
+#define YOCTO_WIDE_STORAGE wide_avx
+#else
+#define YOCTO_WIDE_STORAGE wide_halves
+#endif
+
+// -----------------------------------------------------------------------------
+// USING DIRECTIVES
+// -----------------------------------------------------------------------------
+namespace yocto {
+
+// using directives
+using std::vector;
+
+}  // namespace yocto
+
+// -----------------------------------------------------------------------------
+// WIDE VECTORS
+// -----------------------------------------------------------------------------
+namespace yocto {
+inline namespace YOCTO_WIDE_STORAGE {
+
+// Wide types hold one value for each of 8 lanes, and are used to write batch
+// kernels that process 8 elements at once with SIMD instructions. Storage is
+// chosen at compile time: a 256-bit vector with AVX, two 128-bit vectors
+// otherwise, i.e. with SSE or NEON, or plain arrays for compilers without
+// vector extensions. Define YOCTO_WIDE_SCALAR to force the latter.
+inline const auto wide_lanes = 8;
+
+#if defined(YOCTO_WIDE_SCALAR)
+template <typename T>
+struct wide_storage {
+  T lanes[wide_lanes];
+};
+using wide_floats = wide_storage<float>;
+using wide_ints   = wide_storage<int>;
+#elif defined(__AVX__)
+using wide_floats = float __attribute__((vector_size(32)));
+using wide_ints   = int __attribute__((vector_size(32)));
+#else
+using wide_float4 = float __attribute__((vector_size(16)));
+using wide_int4   = int __attribute__((vector_size(16)));
+template <typename T>
+struct wide_storage {
+  T lo;
+  T hi;
+};
+using wide_floats = wide_storage<wide_float4>;
+using wide_ints   = wide_storage<wide_int4>;
+#endif
+
+// Wide floats. Construction from a scalar broadcasts it to all lanes.
+struct float8 {
+  wide_floats lanes = {};
+
+  float8() = default;
+  explicit float8(float value);
+  explicit float8(const wide_floats& lanes);
+
+  float&       operator[](int i);
+  const float& operator[](int i) const;
+};
+
+// Wide booleans, stored with all bits either set or cleared, as returned by
+// wide comparisons.
+struct mask8 {
+  wide_ints lanes = {};
+
+  mask8() = default;
+  explicit mask8(bool value);
+  explicit mask8(const wide_ints& lanes);
+
+  bool operator[](int i) const;
+};
+
+// Wide 3D vectors, stored as a structure of arrays.
+struct vec3f8 {
+  float8 x = {};
+  float8 y = {};
+  float8 z = {};
+};
+
+// Loads and stores `count` values, with missing lanes set to zero.
+inline float8 load_float8(const float* values, int count = wide_lanes);
+inline vec3f8 load_vec3f8(const vec3f* values, int count = wide_lanes);
+inline void store_float8(
+    float* values, const float8& a, int count = wide_lanes);
+inline void store_vec3f8(
+    vec3f* values, const vec3f8& a, int count = wide_lanes);
+
+// Lane access
+inline vec3f get_lane(const vec3f8& a, int lane);
+inline void  set_lane(vec3f8& a, int lane, const vec3f& value);
+
+// Wide operations.
+inline float8 operator+(const float8& a);
+inline float8 operator-(const float8& a);
+inline float8 operator+(const float8& a, const float8& b);
+inline float8 operator-(const float8& a, const float8& b);
+inline float8 operator*(const float8& a, const float8& b);
+inline float8 operator/(const float8& a, const float8& b);
+inline float8 operator+(const float8& a, float b);
+inline float8 operator+(float a, const float8& b);
+inline float8 operator-(const float8& a, float b);
+inline float8 operator-(float a, const float8& b);
+inline float8 operator*(const float8& a, float b);
+inline float8 operator*(float a, const float8& b);
+inline float8 operator/(const float8& a, float b);
+inline float8 operator/(float a, const float8& b);
+
+// Wide assignments.
+inline float8& operator+=(float8& a, const float8& b);
+inline float8& operator+=(float8& a, float b);
+inline float8& operator-=(float8& a, const float8& b);
+inline float8& operator-=(float8& a, float b);
+inline float8& operator*=(float8& a, const float8& b);
+inline float8& operator*=(float8& a, float b);
+inline float8& operator/=(float8& a, const float8& b);
+inline float8& operator/=(float8& a, float b);
+
+// Wide comparisons.
+inline mask8 operator==(const float8& a, const float8& b);
+inline mask8 operator!=(const float8& a, const float8& b);
+inline mask8 operator<(const float8& a, const float8& b);
+inline mask8 operator<=(const float8& a, const float8& b);
+inline mask8 operator>(const float8& a, const float8& b);
+inline mask8 operator>=(const float8& a, const float8& b);
+inline mask8 operator==(const float8& a, float b);
+inline mask8 operator!=(const float8& a, float b);
+inline mask8 operator<(const float8& a, float b);
+inline mask8 operator<=(const float8& a, float b);
+inline mask8 operator>(const float8& a, float b);
+inline mask8 operator>=(const float8& a, float b);
+
+// Mask operations. Unlike their scalar counterpart, all operands are evaluated.
+inline mask8 operator!(const mask8& a);
+inline mask8 operator&&(const mask8& a, const mask8& b);
+inline mask8 operator||(const mask8& a, const mask8& b);
+inline bool  any(const mask8& a);
+inline bool  all(const mask8& a);
+
+// Per-lane selection of a or b, as in mask ? a : b.
+inline float8 select(const mask8& mask, const float8& a, const float8& b);
+inline vec3f8 select(const mask8& mask, const vec3f8& a, const vec3f8& b);
+
+// Functions applied to wide elements.
+inline float8 abs(const float8& a);
+inline float8 max(const float8& a, float b);
+inline float8 min(const float8& a, float b);
+inline float8 max(const float8& a, const float8& b);
+inline float8 min(const float8& a, const float8& b);
+inline float8 clamp(const float8& a, float min, float max);
+inline float8 clamp(const float8& a, const float8& min, const float8& max);
+inline float8 sqrt(const float8& a);
+inline float8 floor(const float8& a);
+inline float8 lerp(const float8& a, const float8& b, const float8& u);
+
+// Wide vector operations.
+inline vec3f8 operator+(const vec3f8& a);
+inline vec3f8 operator-(const vec3f8& a);
+inline vec3f8 operator+(const vec3f8& a, const vec3f8& b);
+inline vec3f8 operator-(const vec3f8& a, const vec3f8& b);
+inline vec3f8 operator*(const vec3f8& a, const vec3f8& b);
+inline vec3f8 operator*(const vec3f8& a, const float8& b);
+inline vec3f8 operator*(const float8& a, const vec3f8& b);
+inline vec3f8 operator/(const vec3f8& a, const vec3f8& b);
+inline vec3f8 operator/(const vec3f8& a, const float8& b);
+inline vec3f8 operator*(const vec3f8& a, float b);
+inline vec3f8 operator*(float a, const vec3f8& b);
+inline vec3f8 operator/(const vec3f8& a, float b);
+
+// Wide vector assignments.
+inline vec3f8& operator+=(vec3f8& a, const vec3f8& b);
+inline vec3f8& operator-=(vec3f8& a, const vec3f8& b);
+inline vec3f8& operator*=(vec3f8& a, const vec3f8& b);
+inline vec3f8& operator*=(vec3f8& a, const float8& b);
+inline vec3f8& operator*=(vec3f8& a, float b);
+inline vec3f8& operator/=(vec3f8& a, const vec3f8& b);
+inline vec3f8& operator/=(vec3f8& a, const float8& b);
+inline vec3f8& operator/=(vec3f8& a, float b);
+
+// Wide vector products and lengths.
+inline float8 dot(const vec3f8& a, const vec3f8& b);
+inline vec3f8 cross(const vec3f8& a, const vec3f8& b);
+inline float8 length(const vec3f8& a);
+inline float8 length_squared(const vec3f8& a);
+inline vec3f8 normalize(const vec3f8& a);
+inline float8 distance(const vec3f8& a, const vec3f8& b);
+inline vec3f8 lerp(const vec3f8& a, const vec3f8& b, const float8& u);
+
+// Transforms wide points, vectors and directions by a frame.
+inline vec3f8 transform_point(const frame3f& a, const vec3f8& b);
+inline vec3f8 transform_vector(const frame3f& a, const vec3f8& b);
+inline vec3f8 transform_direction(const frame3f& a, const vec3f8& b);
+
+// Conversion between arrays of values and arrays of wide values, that store
+// values in groups of 8. Missing lanes are set to zero.
+inline vector<float8> to_wide(const vector<float>& values);
+inline vector<vec3f8> to_wide(const vector<vec3f>& values);
+inline vector<float>  from_wide(const vector<float8>& values, size_t size);
+inline vector<vec3f>  from_wide(const vector<vec3f8>& values, size_t size);
+
+}  // namespace YOCTO_WIDE_STORAGE
+}  // namespace yocto
+
+// -----------------------------------------------------------------------------
+//
+//
+// IMPLEMENTATION
+//
+//
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// WIDE VECTORS
+// -----------------------------------------------------------------------------
+namespace yocto {
+inline namespace YOCTO_WIDE_STORAGE {
+
+// Storage operations for backends that are not vector extensions. Arrays
+// apply operations per lane, while pairs apply them to each half.
+#if defined(YOCTO_WIDE_SCALAR)
+template <typename T, typename Func>
+inline auto apply_wide(const wide_storage<T>& a, Func&& func) {
+  auto c = wide_storage<decltype(func(a.lanes[0]))>{};
+  for (auto i = 0; i < wide_lanes; i++) c.lanes[i] = func(a.lanes[i]);
+  return c;
+}
+template <typename T, typename Func>
+inline auto apply_wide(
+    const wide_storage<T>& a, const wide_storage<T>& b, Func&& func) {
+  auto c = wide_storage<decltype(func(a.lanes[0], b.lanes[0]))>{};
+  for (auto i = 0; i < wide_lanes; i++)
+    c.lanes[i] = func(a.lanes[i], b.lanes[i]);
+  return c;
+}
+#elif !defined(__AVX__)
+template <typename T, typename Func>
+inline auto apply_wide(const wide_storage<T>& a, Func&& func) {
+  return wide_storage<decltype(func(a.lo))>{func(a.lo), func(a.hi)};
+}
+template <typename T, typename Func>
+inline auto apply_wide(
+    const wide_storage<T>& a, const wide_storage<T>& b, Func&& func) {
+  return wide_storage<decltype(func(a.lo, b.lo))>{
+      func(a.lo, b.lo), func(a.hi, b.hi)};
+}
+#endif
+#if defined(YOCTO_WIDE_SCALAR) || !defined(__AVX__)
+template <typename T>
+inline wide_storage<T> operator-(const wide_storage<T>& a) {
+  return apply_wide(a, [](auto a) { return -a; });
+}
+template <typename T>
+inline wide_storage<T> operator~(const wide_storage<T>& a) {
+  return apply_wide(a, [](auto a) { return ~a; });
+}
+template <typename T>
+inline wide_storage<T> operator+(
+    const wide_storage<T>& a, const wide_storage<T>& b) {
+  return apply_wide(a, b, [](auto a, auto b) { return a + b; });
+}
+template <typename T>
+inline wide_storage<T> operator-(
+    const wide_storage<T>& a, const wide_storage<T>& b) {
+  return apply_wide(a, b, [](auto a, auto b) { return a - b; });
+}
+template <typename T>
+inline wide_storage<T> operator*(
+    const wide_storage<T>& a, const wide_storage<T>& b) {
+  return apply_wide(a, b, [](auto a, auto b) { return a * b; });
+}
+template <typename T>
+inline wide_storage<T> operator/(
+    const wide_storage<T>& a, const wide_storage<T>& b) {
+  return apply_wide(a, b, [](auto a, auto b) { return a / b; });
+}
+template <typename T>
+inline wide_storage<T> operator&(
+    const wide_storage<T>& a, const wide_storage<T>& b) {
+  return apply_wide(a, b, [](auto a, auto b) { return a & b; });
+}
+template <typename T>
+inline wide_storage<T> operator|(
+    const wide_storage<T>& a, const wide_storage<T>& b) {
+  return apply_wide(a, b, [](auto a, auto b) { return a | b; });
+}
+template <typename T>
+inline wide_storage<T> operator^(
+    const wide_storage<T>& a, const wide_storage<T>& b) {
+  return apply_wide(a, b, [](auto a, auto b) { return a ^ b; });
+}
+#endif
+// Comparisons return all bits set for true lanes, as vector extensions do.
+#if defined(YOCTO_WIDE_SCALAR)
+template <typename Func>
+inline wide_ints compare_wide(
+    const wide_floats& a, const wide_floats& b, Func&& func) {
+  return apply_wide(
+      a, b, [&func](float a, float b) { return func(a, b) ? -1 : 0; });
+}
+#elif defined(__AVX__)
+template <typename Func>
+inline wide_ints compare_wide(
+    const wide_floats& a, const wide_floats& b, Func&& func) {
+  return func(a, b);
+}
+#else
+template <typename Func>
+inline wide_ints compare_wide(
+    const wide_floats& a, const wide_floats& b, Func&& func) {
+  return apply_wide(a, b, func);
+}
+#endif
+
+// Reinterprets the bits of wide values.
+template <typename T, typename U>
+inline T bitcast_wide(const U& a) {
+  static_assert(sizeof(T) == sizeof(U), "same size expected");
+  auto c = T{};
+  std::memcpy(&c, &a, sizeof(T));
+  return c;
+}
+
+// Wide floats
+inline float8::float8(float value) {
+#if defined(YOCTO_WIDE_SCALAR)
+  for (auto i = 0; i < wide_lanes; i++) lanes.lanes[i] = value;
+#elif defined(__AVX__)
+  lanes = wide_floats{value, value, value, value, value, value, value, value};
+#else
+  auto half = wide_float4{value, value, value, value};
+  lanes     = {half, half};
+#endif
+}
+inline float8::float8(const wide_floats& lanes_) : lanes{lanes_} {}
+inline float& float8::operator[](int i) {
+  return reinterpret_cast<float*>(&lanes)[i];
+}
+inline const float& float8::operator[](int i) const {
+  return reinterpret_cast<const float*>(&lanes)[i];
+}
+
+// Wide booleans
+inline mask8::mask8(bool value) {
+  auto bits = value ? -1 : 0;
+#if defined(YOCTO_WIDE_SCALAR)
+  for (auto i = 0; i < wide_lanes; i++) lanes.lanes[i] = bits;
+#elif defined(__AVX__)
+  lanes = wide_ints{bits, bits, bits, bits, bits, bits, bits, bits};
+#else
+  auto half = wide_int4{bits, bits, bits, bits};
+  lanes     = {half, half};
+#endif
+}
+inline mask8::mask8(const wide_ints& lanes_) : lanes{lanes_} {}
+inline bool mask8::operator[](int i) const {
+  return reinterpret_cast<const int*>(&lanes)[i] != 0;
+}
+
+// Loads and stores
+inline float8 load_float8(const float* values, int count) {
+  auto c = float8{};
+  if (count == wide_lanes) {
+    std::memcpy(&c.lanes, values, sizeof(c.lanes));
+  } else {
+    for (auto i = 0; i < count; i++) c[i] = values[i];
+  }
+  return c;
+}
+inline void store_float8(float* values, const float8& a, int count) {
+  if (count == wide_lanes) {
+    std::memcpy(values, &a.lanes, sizeof(a.lanes));
+  } else {
+    for (auto i = 0; i < count; i++) values[i] = a[i];
+  }
+}
+inline vec3f8 load_vec3f8(const vec3f* values, int count) {
+  // deinterleave in memory since lane inserts are slow
+  float x[wide_lanes] = {}, y[wide_lanes] = {}, z[wide_lanes] = {};
+  for (auto i = 0; i < count; i++) {
+    x[i] = values[i].x;
+    y[i] = values[i].y;
+    z[i] = values[i].z;
+  }
+  return {load_float8(x), load_float8(y), load_float8(z)};
+}
+inline void store_vec3f8(vec3f* values, const vec3f8& a, int count) {
+  for (auto i = 0; i < count; i++) values[i] = get_lane(a, i);
+}
+
+// Lane access
+inline vec3f get_lane(const vec3f8& a, int lane) {
+  return {a.x[lane], a.y[lane], a.z[lane]};
+}
+inline void set_lane(vec3f8& a, int lane, const vec3f& value) {
+  a.x[lane] = value.x;
+  a.y[lane] = value.y;
+  a.z[lane] = value.z;
+}
+
+// Wide operations.
+inline float8 operator+(const float8& a) { return a; }
+inline float8 operator-(const float8& a) { return float8{-a.lanes}; }
+inline float8 operator+(const float8& a, const float8& b) {
+  return float8{a.lanes + b.lanes};
+}
+inline float8 operator-(const float8& a, const float8& b) {
+  return float8{a.lanes - b.lanes};
+}
+inline float8 operator*(const float8& a, const float8& b) {
+  return float8{a.lanes * b.lanes};
+}
+inline float8 operator/(const float8& a, const float8& b) {
+  return float8{a.lanes / b.lanes};
+}
+inline float8 operator+(const float8& a, float b) { return a + float8{b}; }
+inline float8 operator+(float a, const float8& b) { return float8{a} + b; }
+inline float8 operator-(const float8& a, float b) { return a - float8{b}; }
+inline float8 operator-(float a, const float8& b) { return float8{a} - b; }
+inline float8 operator*(const float8& a, float b) { return a * float8{b}; }
+inline float8 operator*(float a, const float8& b) { return float8{a} * b; }
+inline float8 operator/(const float8& a, float b) { return a / float8{b}; }
+inline float8 operator/(float a, const float8& b) { return float8{a} / b; }
+
+// Wide assignments.
+inline float8& operator+=(float8& a, const float8& b) { return a = a + b; }
+inline float8& operator+=(float8& a, float b) { return a = a + b; }
+inline float8& operator-=(float8& a, const float8& b) { return a = a - b; }
+inline float8& operator-=(float8& a, float b) { return a = a - b; }
+inline float8& operator*=(float8& a, const float8& b) { return a = a * b; }
+inline float8& operator*=(float8& a, float b) { return a = a * b; }
+inline float8& operator/=(float8& a, const float8& b) { return a = a / b; }
+inline float8& operator/=(float8& a, float b) { return a = a / b; }
+
+// Wide comparisons.
+inline mask8 operator==(const float8& a, const float8& b) {
+  return mask8{compare_wide(
+      a.lanes, b.lanes, [](auto a, auto b) { return a == b; })};
+}
+inline mask8 operator!=(const float8& a, const float8& b) {
+  return mask8{compare_wide(
+      a.lanes, b.lanes, [](auto a, auto b) { return a != b; })};
+}
+inline mask8 operator<(const float8& a, const float8& b) {
+  return mask8{
+      compare_wide(a.lanes, b.lanes, [](auto a, auto b) { return a < b; })};
+}
+inline mask8 operator<=(const float8& a, const float8& b) {
+  return mask8{compare_wide(
+      a.lanes, b.lanes, [](auto a, auto b) { return a <= b; })};
+}
+inline mask8 operator>(const float8& a, const float8& b) {
+  return mask8{
+      compare_wide(a.lanes, b.lanes, [](auto a, auto b) { return a > b; })};
+}
+inline mask8 operator>=(const float8& a, const float8& b) {
+  return mask8{compare_wide(
+      a.lanes, b.lanes, [](auto a, auto b) { return a >= b; })};
+}
+inline mask8 operator==(const float8& a, float b) { return a == float8{b}; }
+inline mask8 operator!=(const float8& a, float b) { return a != float8{b}; }
+inline mask8 operator<(const float8& a, float b) { return a < float8{b}; }
+inline mask8 operator<=(const float8& a, float b) { return a <= float8{b}; }
+inline mask8 operator>(const float8& a, float b) { return a > float8{b}; }
+inline mask8 operator>=(const float8& a, float b) { return a >= float8{b}; }
+
+// Mask operations.
+inline mask8 operator!(const mask8& a) { return mask8{~a.lanes}; }
+inline mask8 operator&&(const mask8& a, const mask8& b) {
+  return mask8{a.lanes & b.lanes};
+}
+inline mask8 operator||(const mask8& a, const mask8& b) {
+  return mask8{a.lanes | b.lanes};
+}
+inline bool any(const mask8& a) {
+#if !defined(YOCTO_WIDE_SCALAR) && defined(__AVX__)
+  return _mm256_movemask_ps((__m256)a.lanes) != 0;
+#elif !defined(YOCTO_WIDE_SCALAR) && defined(__SSE__)
+  return _mm_movemask_ps((__m128)(a.lanes.lo | a.lanes.hi)) != 0;
+#else
+  auto bits = 0;
+  for (auto i = 0; i < wide_lanes; i++) bits |= a[i] ? 1 : 0;
+  return bits != 0;
+#endif
+}
+inline bool all(const mask8& a) { return !any(!a); }
+
+// Per-lane selection.
+inline float8 select(const mask8& mask, const float8& a, const float8& b) {
+  auto a_ = bitcast_wide<wide_ints>(a.lanes);
+  auto b_ = bitcast_wide<wide_ints>(b.lanes);
+  return float8{bitcast_wide<wide_floats>(
+      (a_ & mask.lanes) | (b_ & ~mask.lanes))};
+}
+inline vec3f8 select(const mask8& mask, const vec3f8& a, const vec3f8& b) {
+  return {select(mask, a.x, b.x), select(mask, a.y, b.y),
+      select(mask, a.z, b.z)};
+}
+
+// Functions applied to wide elements.
+inline float8 abs(const float8& a) {
+  auto bits = bitcast_wide<wide_ints>(a.lanes);
+  auto mask = bitcast_wide<wide_ints>(float8{-0.0f}.lanes);
+  return float8{bitcast_wide<wide_floats>(bits & ~mask)};
+}
+inline float8 max(const float8& a, float b) { return max(a, float8{b}); }
+inline float8 min(const float8& a, float b) { return min(a, float8{b}); }
+inline float8 max(const float8& a, const float8& b) {
+  return select(a > b, a, b);
+}
+inline float8 min(const float8& a, const float8& b) {
+  return select(a < b, a, b);
+}
+inline float8 clamp(const float8& a, float min_, float max_) {
+  return min(max(a, min_), max_);
+}
+inline float8 clamp(const float8& a, const float8& min_, const float8& max_) {
+  return min(max(a, min_), max_);
+}
+inline float8 sqrt(const float8& a) {
+#if !defined(YOCTO_WIDE_SCALAR) && defined(__AVX__)
+  return float8{(wide_floats)_mm256_sqrt_ps((__m256)a.lanes)};
+#elif !defined(YOCTO_WIDE_SCALAR) && defined(__SSE__)
+  return float8{apply_wide(a.lanes,
+      [](wide_float4 a) { return (wide_float4)_mm_sqrt_ps((__m128)a); })};
+#elif !defined(YOCTO_WIDE_SCALAR) && defined(__ARM_NEON) && \
+    defined(__aarch64__)
+  return float8{apply_wide(a.lanes,
+      [](wide_float4 a) { return (wide_float4)vsqrtq_f32((float32x4_t)a); })};
+#else
+  auto c = float8{};
+  for (auto i = 0; i < wide_lanes; i++) c[i] = std::sqrt(a[i]);
+  return c;
+#endif
+}
+inline float8 floor(const float8& a) {
+#if !defined(YOCTO_WIDE_SCALAR) && defined(__AVX__)
+  return float8{(wide_floats)_mm256_floor_ps((__m256)a.lanes)};
+#elif !defined(YOCTO_WIDE_SCALAR) && defined(__ARM_NEON) && \
+    defined(__aarch64__)
+  return float8{apply_wide(a.lanes,
+      [](wide_float4 a) { return (wide_float4)vrndmq_f32((float32x4_t)a); })};
+#else
+  // round magnitudes by adding and subtracting 2^23, then correct the
+  // rounding; values beyond 2^23, zeros and nans are returned as is
+  auto big     = float8{8388608.0f};
+  auto rounded = abs(a) + big - big;
+  rounded      = select(a < 0, -rounded, rounded);
+  rounded      = select(rounded > a, rounded - 1, rounded);
+  return select(abs(a) < big && a != 0, rounded, a);
+#endif
+}
+inline float8 lerp(const float8& a, const float8& b, const float8& u) {
+  return a * (1 - u) + b * u;
+}
+
+// Wide vector operations.
+inline vec3f8 operator+(const vec3f8& a) { return a; }
+inline vec3f8 operator-(const vec3f8& a) { return {-a.x, -a.y, -a.z}; }
+inline vec3f8 operator+(const vec3f8& a, const vec3f8& b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+inline vec3f8 operator-(const vec3f8& a, const vec3f8& b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+inline vec3f8 operator*(const vec3f8& a, const vec3f8& b) {
+  return {a.x * b.x, a.y * b.y, a.z * b.z};
+}
+inline vec3f8 operator*(const vec3f8& a, const float8& b) {
+  return {a.x * b, a.y * b, a.z * b};
+}
+inline vec3f8 operator*(const float8& a, const vec3f8& b) {
+  return {a * b.x, a * b.y, a * b.z};
+}
+inline vec3f8 operator/(const vec3f8& a, const vec3f8& b) {
+  return {a.x / b.x, a.y / b.y, a.z / b.z};
+}
+inline vec3f8 operator/(const vec3f8& a, const float8& b) {
+  return {a.x / b, a.y / b, a.z / b};
+}
+inline vec3f8 operator*(const vec3f8& a, float b) { return a * float8{b}; }
+inline vec3f8 operator*(float a, const vec3f8& b) { return float8{a} * b; }
+inline vec3f8 operator/(const vec3f8& a, float b) { return a / float8{b}; }
+
+// Wide vector assignments.
+inline vec3f8& operator+=(vec3f8& a, const vec3f8& b) { return a = a + b; }
+inline vec3f8& operator-=(vec3f8& a, const vec3f8& b) { return a = a - b; }
+inline vec3f8& operator*=(vec3f8& a, const vec3f8& b) { return a = a * b; }
+inline vec3f8& operator*=(vec3f8& a, const float8& b) { return a = a * b; }
+inline vec3f8& operator*=(vec3f8& a, float b) { return a = a * b; }
+inline vec3f8& operator/=(vec3f8& a, const vec3f8& b) { return a = a / b; }
+inline vec3f8& operator/=(vec3f8& a, const float8& b) { return a = a / b; }
+inline vec3f8& operator/=(vec3f8& a, float b) { return a = a / b; }
+
+// Wide vector products and lengths.
+inline float8 dot(const vec3f8& a, const vec3f8& b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline vec3f8 cross(const vec3f8& a, const vec3f8& b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline float8 length(const vec3f8& a) { return sqrt(dot(a, a)); }
+inline float8 length_squared(const vec3f8& a) { return dot(a, a); }
+inline vec3f8 normalize(const vec3f8& a) {
+  auto l = length(a);
+  return select(l != 0, a / l, a);
+}
+inline float8 distance(const vec3f8& a, const vec3f8& b) {
+  return length(a - b);
+}
+inline vec3f8 lerp(const vec3f8& a, const vec3f8& b, const float8& u) {
+  return a * (1 - u) + b * u;
+}
+
+// Transforms wide points, vectors and directions by a frame.
+inline vec3f8 transform_point(const frame3f& a, const vec3f8& b) {
+  return {a.x.x * b.x + a.y.x * b.y + a.z.x * b.z + a.o.x,
+      a.x.y * b.x + a.y.y * b.y + a.z.y * b.z + a.o.y,
+      a.x.z * b.x + a.y.z * b.y + a.z.z * b.z + a.o.z};
+}
+inline vec3f8 transform_vector(const frame3f& a, const vec3f8& b) {
+  return {a.x.x * b.x + a.y.x * b.y + a.z.x * b.z,
+      a.x.y * b.x + a.y.y * b.y + a.z.y * b.z,
+      a.x.z * b.x + a.y.z * b.y + a.z.z * b.z};
+}
+inline vec3f8 transform_direction(const frame3f& a, const vec3f8& b) {
+  return normalize(transform_vector(a, b));
+}
+
+// Conversion between arrays of values and arrays of wide values.
+inline vector<float8> to_wide(const vector<float>& values) {
+  auto wide = vector<float8>((values.size() + wide_lanes - 1) / wide_lanes);
+  for (auto idx = (size_t)0; idx < wide.size(); idx++) {
+    auto start = idx * wide_lanes;
+    wide[idx]  = load_float8(values.data() + start,
+        (int)std::min(values.size() - start, (size_t)wide_lanes));
+  }
+  return wide;
+}
+inline vector<vec3f8> to_wide(const vector<vec3f>& values) {
+  auto wide = vector<vec3f8>((values.size() + wide_lanes - 1) / wide_lanes);
+  for (auto idx = (size_t)0; idx < wide.size(); idx++) {
+    auto start = idx * wide_lanes;
+    wide[idx]  = load_vec3f8(values.data() + start,
+        (int)std::min(values.size() - start, (size_t)wide_lanes));
+  }
+  return wide;
+}
+inline vector<float> from_wide(const vector<float8>& wide, size_t size) {
+  auto values = vector<float>(size);
+  for (auto idx = (size_t)0; idx < wide.size(); idx++) {
+    auto start = idx * wide_lanes;
+    if (start >= size) break;
+    store_float8(values.data() + start, wide[idx],
+        (int)std::min(size - start, (size_t)wide_lanes));
+  }
+  return values;
+}
+inline vector<vec3f> from_wide(const vector<vec3f8>& wide, size_t size) {
+  auto values = vector<vec3f>(size);
+  for (auto idx = (size_t)0; idx < wide.size(); idx++) {
+    auto start = idx * wide_lanes;
+    if (start >= size) break;
+    store_vec3f8(values.data() + start, wide[idx],
+        (int)std::min(size - start, (size_t)wide_lanes));
+  }
+  return values;
+}
+
+}  // namespace YOCTO_WIDE_STORAGE
+}  // namespace yocto
+
+#endif
@@ -438,28 +438,24 @@ void view_scene(const string& title, const string& name, scene_model& scene,
   // copy params and camera
   auto params = params_;
 
-  // build bvh
-  if (print) print_progress_begin("build bvh");
-  auto bvh = make_bvh(scene, params);
-  if (print) print_progress_end();
-
-  // init renderer
-  if (print) print_progress_begin("init lights");
-  auto lights = make_lights(scene, params);
+  // build bvh and lights
+  if (print) print_progress_begin("init session");
+  auto session = trace_session{};
+  init_session(session, scene, params);
   if (print) print_progress_end();
 
   // fix renderer type if no lights
-  if (lights.lights.empty() && is_sampler_lit(params)) {
+  if (session.lights.lights.empty() && is_sampler_lit(params)) {
     if (print) print_info("no lights presents --- switching to eyelight");
     params.sampler = trace_sampler_type::eyelight;
   }
 
-  // init state
+  // start rendering
   if (print) print_progress_begin("init state");
-  auto state   = make_state(scene, params);
-  auto image   = make_image(state.width, state.height, true);
-  auto display = make_image(state.width, state.height, false);
-  auto render  = make_image(state.width, state.height, true);
+  start_session(session, scene, params);
+  auto image   = make_image(session.state.width, session.state.height, true);
+  auto display = make_image(
+      session.state.width, session.state.height, false);
   if (print) print_progress_end();
 
   // opengl image
@@ -478,90 +474,27 @@ void view_scene(const string& title, const string& name, scene_model& scene,
     }
   }
 
-  // renderer update
-  auto render_update  = std::atomic<bool>{};
-  auto render_current = std::atomic<int>{};
-  auto render_mutex   = std::mutex{};
-  auto render_worker  = future<void>{};
-  auto render_stop    = atomic<bool>{};
-  auto reset_display  = [&]() {
-    // stop render
-    render_stop = true;
-    if (render_worker.valid()) render_worker.get();
-
-    state   = make_state(scene, params);
-    image   = make_image(state.width, state.height, true);
-    display = make_image(state.width, state.height, false);
-    render  = make_image(state.width, state.height, true);
-
-    render_worker = {};
-    render_stop   = false;
-
-    // preview
-    auto pparams = params;
-    pparams.resolution /= params.pratio;
-    pparams.samples = 1;
-    auto pstate     = make_state(scene, pparams);
-    trace_samples(pstate, scene, bvh, lights, pparams);
-    auto preview = get_render(pstate);
-    for (auto idx = 0; idx < state.width * state.height; idx++) {
-      auto i = idx % render.width, j = idx / render.width;
-      auto pi            = clamp(i / params.pratio, 0, preview.width - 1),
-           pj            = clamp(j / params.pratio, 0, preview.height - 1);
-      render.pixels[idx] = preview.pixels[pj * preview.width + pi];
-    }
-    // if (current > 0) return;
-    {
-      auto lock      = std::lock_guard{render_mutex};
-      render_current = 0;
-      image          = render;
-      tonemap_image_mt(display, image, params.exposure, params.filmic);
-      render_update = true;
-    }
-
-    // start renderer
-    render_worker = std::async(std::launch::async, [&]() {
-      for (auto sample = 0; sample < params.samples; sample += params.batch) {
-        if (render_stop) return;
-        parallel_for(state.width, state.height, [&](int i, int j) {
-          for (auto s = 0; s < params.batch; s++) {
-            if (render_stop) return;
-            trace_sample(state, scene, bvh, lights, i, j, params);
-          }
-        });
-        state.samples += params.batch;
-        if (!render_stop) {
-          auto lock      = std::lock_guard{render_mutex};
-          render_current = state.samples;
-          if (!params.denoise || render_stop) {
-            get_render(render, state);
-          } else {
-            get_denoised(render, state);
-          }
-          image = render;
-          tonemap_image_mt(display, image, params.exposure, params.filmic);
-          render_update = true;
-        }
-      }
-    });
-  };
+  // restart rendering
+  auto reset_display = [&]() { start_session(session, scene, params); };
 
   // stop render
-  auto stop_render = [&]() {
-    render_stop = true;
-    if (render_worker.valid()) render_worker.get();
+  auto stop_render = [&]() { stop_session(session); };
+
+  // update the displayed image if a new render is available
+  auto update_display = [&]() {
+    if (!update_render(image, session)) return false;
+    if (display.width != image.width || display.height != image.height)
+      display = make_image(image.width, image.height, false);
+    tonemap_image_mt(display, image, params.exposure, params.filmic);
+    return true;
   };
 
-  // start rendering
-  reset_display();
-
   // prepare selection
   auto selection = scene_selection{};
 
   // callbacks
   auto callbacks    = glwindow_callbacks{};
   callbacks.init_cb = [&](const glinput_state& input) {
-    auto lock = std::lock_guard{render_mutex};
     init_image(glimage);
     set_image(glimage, display);
   };
@@ -570,18 +503,14 @@ void view_scene(const string& title, const string& name, scene_model& scene,
   };
   callbacks.draw_cb = [&](const glinput_state& input) {
     // update image
-    if (render_update) {
-      auto lock = std::lock_guard{render_mutex};
-      set_image(glimage, display);
-      render_update = false;
-    }
+    if (update_display()) set_image(glimage, display);
     update_image_params(input, image, glparams);
     draw_image(glimage, glparams);
   };
   callbacks.widgets_cb = [&](const glinput_state& input) {
     auto edited = 0;
     draw_glcombobox("name", selected, names);
-    auto current = (int)render_current;
+    auto current = (int)session.samples;
     draw_glprogressbar("sample", current, params.samples);
     if (begin_glheader("render")) {
       auto edited  = 0;
@@ -609,11 +538,14 @@ void view_scene(const string& title, const string& name, scene_model& scene,
       }
     }
     if (begin_glheader("tonemap")) {
+      auto denoise = params.denoise;
       edited += draw_glslider("exposure", params.exposure, -5, 5);
       edited += draw_glcheckbox("filmic", params.filmic);
       edited += draw_glcheckbox("denoise", params.denoise);
       end_glheader();
-      if (edited) {
+      if (denoise != params.denoise) {
+        reset_display();
+      } else if (edited) {
         tonemap_image_mt(display, image, params.exposure, params.filmic);
         set_image(glimage, display);
       }
@@ -621,6 +553,14 @@ void view_scene(const string& title, const string& name, scene_model& scene,
     draw_image_inspector(input, image, display, glparams);
     if (edit) {
       if (draw_scene_editor(scene, selection, [&]() { stop_render(); })) {
+        auto updated_instances    = vector<int>{};
+        auto updated_environments = vector<int>{};
+        if (!scene.instances.empty())
+          updated_instances.push_back(selection.instance);
+        if (!scene.environments.empty())
+          updated_environments.push_back(selection.environment);
+        update_session(
+            session, scene, updated_instances, {}, updated_environments);
         reset_display();
       }
     }